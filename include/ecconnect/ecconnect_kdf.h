@@ -117,6 +117,140 @@ ecconnect_status_t ecconnect_kdf(const void* key,
                          void* output,
                          size_t output_length);
 
+/**
+ * Precomputed ecconnect KDF state for a fixed key.
+ *
+ * @see ecconnect_kdf_ctx_create
+ */
+typedef struct ecconnect_kdf_ctx_type ecconnect_kdf_ctx_t;
+
+/**
+ * Prepares ecconnect KDF for repeated derivations from the same key.
+ *
+ * @param [in]  key             base secret key
+ * @param [in]  key_length      length of `key` in bytes
+ *
+ * HMAC key pads are processed once here, so that every following call
+ * to ecconnect_kdf_ctx_derive() hashes only the label and the context.
+ * The resulting keys are exactly the same as produced by ecconnect_kdf()
+ * with the same key.
+ *
+ * Contexts are not modified by derivation and may be used concurrently
+ * from multiple threads. Destroy the context with ecconnect_kdf_ctx_destroy()
+ * after use, this wipes the key material.
+ *
+ * Unlike ecconnect_kdf(), implicit keys are not supported so `key` is required.
+ *
+ * @returns new KDF context or NULL if `key` is NULL, `key_length` is zero,
+ * or the context could not be allocated.
+ */
+ECCONNECT_API
+ecconnect_kdf_ctx_t* ecconnect_kdf_ctx_create(const void* key, size_t key_length);
+
+/**
+ * Derives a key using precomputed ecconnect KDF context.
+ *
+ * @param [in]  ctx             KDF context
+ * @param [in]  label           purpose of the key, may be empty
+ * @param [in]  context         an array of context data, may be NULL
+ * @param [in]  context_count   number of elements in `context` array
+ * @param [out] output          output key buffer
+ * @param [in]  output_length   length of `output` in bytes (1..32)
+ *
+ * Parameters have the same meaning as for ecconnect_kdf().
+ *
+ * @returns ECCONNECT_SUCCESS on successful key derivation.
+ *
+ * @exception ECCONNECT_FAIL on critical backend failure.
+ *
+ * @exception ECCONNECT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `label` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `context` is NULL, but `context_count` is not 0.
+ * @exception ECCONNECT_INVALID_PARAMETER if `output` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `output_length` is not in [1, 32] range.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_kdf_ctx_derive(const ecconnect_kdf_ctx_t* ctx,
+                                            const char* label,
+                                            const ecconnect_kdf_context_buf_t* context,
+                                            size_t context_count,
+                                            void* output,
+                                            size_t output_length);
+
+/**
+ * Reusable working state of ecconnect KDF.
+ *
+ * @see ecconnect_kdf_state_create
+ */
+typedef struct ecconnect_kdf_state_type ecconnect_kdf_state_t;
+
+/**
+ * Allocates working state for repeated key derivations.
+ *
+ * ecconnect_kdf_ctx_derive() sets up hash state for every derivation.
+ * Callers deriving many keys may allocate working state once and pass it
+ * to ecconnect_kdf_ctx_derive_with_state() instead. The state may be used
+ * with any KDF context, but only by one thread at a time.
+ *
+ * Destroy the state with ecconnect_kdf_state_destroy() after use.
+ *
+ * @returns new working state or NULL if it could not be allocated.
+ */
+ECCONNECT_API
+ecconnect_kdf_state_t* ecconnect_kdf_state_create(void);
+
+/**
+ * Derives a key using precomputed ecconnect KDF context and working state.
+ *
+ * @param [in]  ctx             KDF context
+ * @param [in]  state           working state, overwritten by derivation
+ * @param [in]  label           purpose of the key, may be empty
+ * @param [in]  context         an array of context data, may be NULL
+ * @param [in]  context_count   number of elements in `context` array
+ * @param [out] output          output key buffer
+ * @param [in]  output_length   length of `output` in bytes (1..32)
+ *
+ * Same as ecconnect_kdf_ctx_derive(), but does not allocate memory.
+ *
+ * @returns ECCONNECT_SUCCESS on successful key derivation.
+ *
+ * @exception ECCONNECT_FAIL on critical backend failure.
+ *
+ * @exception ECCONNECT_INVALID_PARAMETER if `ctx` or `state` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `label` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `context` is NULL, but `context_count` is not 0.
+ * @exception ECCONNECT_INVALID_PARAMETER if `output` is NULL.
+ * @exception ECCONNECT_INVALID_PARAMETER if `output_length` is not in [1, 32] range.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_kdf_ctx_derive_with_state(const ecconnect_kdf_ctx_t* ctx,
+                                                       ecconnect_kdf_state_t* state,
+                                                       const char* label,
+                                                       const ecconnect_kdf_context_buf_t* context,
+                                                       size_t context_count,
+                                                       void* output,
+                                                       size_t output_length);
+
+/**
+ * Destroys KDF working state and wipes it.
+ *
+ * @param [in]  state           working state, may be NULL
+ *
+ * @returns ECCONNECT_SUCCESS.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_kdf_state_destroy(ecconnect_kdf_state_t* state);
+
+/**
+ * Destroys KDF context and wipes precomputed key material.
+ *
+ * @param [in]  ctx             KDF context, may be NULL
+ *
+ * @returns ECCONNECT_SUCCESS.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_kdf_ctx_destroy(ecconnect_kdf_ctx_t* ctx);
+
 /**
  * Computes PKCS#5 PBKDF2 HMAC-SHA-256 for a passphrase.
  *
@@ -160,6 +294,53 @@ ecconnect_status_t ecconnect_pbkdf2_sha256(const uint8_t* passphrase,
                                    uint8_t* key,
                                    size_t key_length);
 
+/**
+ * Parameters and output of one PBKDF2 derivation.
+ *
+ * @see ecconnect_pbkdf2_sha256_batch
+ */
+struct ecconnect_pbkdf2_sha256_job_type {
+    const uint8_t* passphrase;
+    size_t passphrase_length;
+    const uint8_t* salt;
+    size_t salt_length;
+    size_t iterations;
+    uint8_t* key;
+    size_t key_length;
+};
+typedef struct ecconnect_pbkdf2_sha256_job_type ecconnect_pbkdf2_sha256_job_t;
+
+/**
+ * Derives many keys from passphrases with PBKDF2 HMAC-SHA-256.
+ *
+ * @param [in]  jobs        array of derivation parameters
+ * @param [in]  job_count   number of elements in `jobs`
+ *
+ * Each job produces exactly the same key as ecconnect_pbkdf2_sha256()
+ * with the same parameters, written into `key` of the job.
+ *
+ * Iterations of a single derivation depend on each other and cannot be
+ * parallelized. However, independent derivations are computed together in
+ * SIMD lanes (8 with AVX2, 4 with SSE2) which is considerably faster than
+ * doing them one by one. The instruction set is selected at runtime. If no
+ * SIMD support is available, jobs are processed with ecconnect_pbkdf2_sha256().
+ *
+ * Jobs with the same iteration count are grouped together, so derivations
+ * with mixed iteration counts benefit less.
+ *
+ * @returns ECCONNECT_SUCCESS if all keys have been derived.
+ *
+ * @exception ECCONNECT_FAIL on critical backend failure.
+ * @exception ECCONNECT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECCONNECT_INVALID_PARAMETER if `jobs` is NULL or `job_count` is zero.
+ * @exception ECCONNECT_INVALID_PARAMETER if any job has invalid parameters,
+ * as described for ecconnect_pbkdf2_sha256(). No keys are derived then.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_pbkdf2_sha256_batch(const ecconnect_pbkdf2_sha256_job_t* jobs,
+                                                 size_t job_count);
+
 /** @} */
 /** @} */
 
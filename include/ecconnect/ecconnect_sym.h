@@ -54,6 +54,8 @@
 #define ECCONNECT_SYM_AES_XTS 0x30000000
 /** AES in GCM mode (with authenticated encryption) */
 #define ECCONNECT_SYM_AES_GCM 0x40010000
+/** ChaCha20 with Poly1305 (with authenticated encryption), 256-bit keys only */
+#define ECCONNECT_SYM_CHACHA20_POLY1305 0x50010000
 
 /** @} */
 
@@ -175,6 +177,20 @@ ecconnect_status_t ecconnect_sym_encrypt_update(ecconnect_sym_ctx_t* ctx,
 ECCONNECT_API
 ecconnect_status_t ecconnect_sym_encrypt_final(ecconnect_sym_ctx_t* ctx, void* cipher_data, size_t* cipher_data_length);
 
+/**
+ * @brief reset symmetric encryption context with a new iv
+ * @param [in] ctx pointer to symmetric encryption context previously created by
+ * ecconnect_sym_encrypt_create
+ * @param [in] iv pointer to iv buffer
+ * @param [in] iv_length length of iv
+ * @return result of operation, @ref ECCONNECT_SUCCESS on success and @ref ECCONNECT_FAIL on failure.
+ * @note Algorithm and key of the context are preserved, so key schedule is not recomputed. This
+ * allows to process many independent messages under the same key, e.g., disk sectors with XTS,
+ * without creating a new context for each of them. Context must not be used concurrently.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_encrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, size_t iv_length);
+
 /**
  * @brief destroy symmetric encryption context
  * @param [in] ctx pointer to symmetric encryption context previously created by
@@ -247,6 +263,20 @@ ecconnect_status_t ecconnect_sym_decrypt_update(ecconnect_sym_ctx_t* ctx,
 ECCONNECT_API
 ecconnect_status_t ecconnect_sym_decrypt_final(ecconnect_sym_ctx_t* ctx, void* plain_data, size_t* plain_data_length);
 
+/**
+ * @brief reset symmetric decryption context with a new iv
+ * @param [in] ctx pointer to symmetric decryption context previously created by
+ * ecconnect_sym_decrypt_create
+ * @param [in] iv pointer to iv buffer
+ * @param [in] iv_length length of iv
+ * @return result of operation, @ref ECCONNECT_SUCCESS on success and @ref ECCONNECT_FAIL on failure.
+ * @note Algorithm and key of the context are preserved, so key schedule is not recomputed. This
+ * allows to process many independent messages under the same key, e.g., disk sectors with XTS,
+ * without creating a new context for each of them. Context must not be used concurrently.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_decrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, size_t iv_length);
+
 /**
  * @brief destroy symmetric decryption context
  * @param [in] ctx pointer to symmetric decryption context previously created by
@@ -290,6 +320,25 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_encrypt_create(uint32_t alg,
                                                const void* iv,
                                                size_t iv_length);
 
+/**
+ * @brief reset symmetric encryption context with a new key and iv
+ * @param [in] ctx pointer to symmetric encryption context previously created by
+ * ecconnect_sym_aead_encrypt_create
+ * @param [in] key pointer to key buffer
+ * @param [in] key_length length of key
+ * @param [in] iv pointer to iv buffer
+ * @param [in] iv_length length of iv
+ * @return result of operation, @ref ECCONNECT_SUCCESS on success and @ref ECCONNECT_FAIL on failure.
+ * @note Algorithm of the context is preserved. This allows to reuse one context for many messages
+ * without allocating a new one for each of them. Context must not be used concurrently.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_aead_encrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            size_t key_length,
+                                            const void* iv,
+                                            size_t iv_length);
+
 /**
  * @brief Add AAD data to symmetric encryption context
  * @param [in] ctx pointer to symmetric encryption context previously created by
@@ -376,6 +425,25 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_decrypt_create(uint32_t alg,
                                                const void* iv,
                                                size_t iv_length);
 
+/**
+ * @brief reset symmetric decryption context with a new key and iv
+ * @param [in] ctx pointer to symmetric decryption context previously created by
+ * ecconnect_sym_aead_decrypt_create
+ * @param [in] key pointer to key buffer
+ * @param [in] key_length length of key
+ * @param [in] iv pointer to iv buffer
+ * @param [in] iv_length length of iv
+ * @return result of operation, @ref ECCONNECT_SUCCESS on success and @ref ECCONNECT_FAIL on failure.
+ * @note Algorithm of the context is preserved. This allows to reuse one context for many messages
+ * without allocating a new one for each of them. Context must not be used concurrently.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_aead_decrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            size_t key_length,
+                                            const void* iv,
+                                            size_t iv_length);
+
 /**
  * @brief Add AAD data to symmetric decryption context
  * @param [in] ctx pointer to symmetric decryption context previously created by
@@ -421,6 +489,25 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_final(ecconnect_sym_ctx_t* ctx,
                                             const void* auth_tag,
                                             size_t auth_tag_length);
 
+/** minimal length of truncated auth tag accepted by ecconnect_sym_aead_decrypt_final_truncated */
+#define ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH 8
+
+/**
+ * @brief final symmetric decryption context with truncated auth tag
+ * @param [in] ctx pointer to symmetric decryption context previously created by
+ * ecconnect_sym_decrypt_create
+ * @param [in] auth_tag pointer to buffer of truncated auth tag
+ * @param [in] auth_tag_length length of auth_tag, from @ref ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH
+ * to the full tag length
+ * @return result of operation, @ref ECCONNECT_SUCCESS on success and @ref ECCONNECT_FAIL on failure.
+ * @note Truncated tag is a prefix of the full tag produced by ecconnect_sym_aead_encrypt_final.
+ * Shorter tags make forgery more likely, use them only when the protocol fixes tag length.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_aead_decrypt_final_truncated(ecconnect_sym_ctx_t* ctx,
+                                                      const void* auth_tag,
+                                                      size_t auth_tag_length);
+
 /**
  * @brief destroy symmetric decryption context
  * @param [in] ctx pointer to symmetric decryption context previously created by
@@ -429,6 +516,37 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_final(ecconnect_sym_ctx_t* ctx,
  */
 ECCONNECT_API
 ecconnect_status_t ecconnect_sym_aead_decrypt_destroy(ecconnect_sym_ctx_t* ctx);
+
+/**
+ * @brief verify authentication tag of encrypted data without decrypting it
+ * @param [in] alg algorithm id for usage. See @ref ECCONNECT_SYM_ALGORITHMS
+ * @param [in] key pointer to key buffer
+ * @param [in] key_length length of key
+ * @param [in] iv pointer to iv buffer
+ * @param [in] iv_length length of iv
+ * @param [in] aad pointer to associated data buffer, may be NULL if aad_length is zero
+ * @param [in] aad_length length of associated data
+ * @param [in] cipher_data pointer to encrypted data buffer
+ * @param [in] cipher_data_length length of encrypted data
+ * @param [in] auth_tag pointer to buffer of auth tag
+ * @param [in] auth_tag_length length of auth_tag
+ * @return result of operation, @ref ECCONNECT_SUCCESS if the tag is valid and @ref ECCONNECT_FAIL
+ * otherwise.
+ * @note AES-GCM tags are checked by hashing encrypted data only, without running the cipher over it.
+ * Other algorithms decrypt data into a small internal buffer which is wiped afterwards.
+ */
+ECCONNECT_API
+ecconnect_status_t ecconnect_sym_aead_verify(uint32_t alg,
+                                             const void* key,
+                                             size_t key_length,
+                                             const void* iv,
+                                             size_t iv_length,
+                                             const void* aad,
+                                             size_t aad_length,
+                                             const void* cipher_data,
+                                             size_t cipher_data_length,
+                                             const void* auth_tag,
+                                             size_t auth_tag_length);
 /** @} */
 /** @} */
 /** @} */
@@ -30,6 +30,109 @@
 extern "C" {
 #endif
 
+/**
+ * Do not retry failed decryption with legacy key derivation.
+ *
+ * Builds with WITH_SCELL_COMPAT retry decryption of master key cells with
+ * the key derivation of Ecrypt 0.9.6 when authentication fails. Set this flag
+ * when data is known to be produced by later versions, so that every failed
+ * attempt (e.g., with a wrong key) costs one decryption instead of two.
+ * Has no effect in builds without WITH_SCELL_COMPAT.
+ */
+#define ECRYPT_SCELL_FLAG_STRICT 0x00000001
+
+/**
+ * Mark new master key cells with the key derivation variant used.
+ *
+ * Marked cells are always decrypted in strict mode, without trial decryption
+ * with legacy key derivation, regardless of ECRYPT_SCELL_FLAG_STRICT.
+ * Applies to seal and token protect modes, context imprint mode has no room
+ * for the mark.
+ *
+ * @warning Marked cells cannot be decrypted by earlier versions of Ecrypt.
+ */
+#define ECRYPT_SCELL_FLAG_MARK_KDF 0x00000002
+
+/**
+ * Store public key identifier in new master key cells.
+ *
+ * Key identifier is derived from the master key and takes 4 extra bytes.
+ * It allows key rings to pick the right key without trial decryption.
+ * Cells with key identifier are always decrypted in strict mode.
+ * Applies only to keyed contexts and key rings.
+ *
+ * @warning Cells with key identifier cannot be decrypted by earlier versions
+ * of Ecrypt.
+ *
+ * @see ecrypt_secure_cell_seal_ctx_set_flags
+ * @see ecrypt_secure_cell_key_ring_set_flags
+ */
+#define ECRYPT_SCELL_FLAG_KEY_ID 0x00000004
+
+/**
+ * Encrypt new master key cells with ChaCha20-Poly1305 instead of AES-GCM.
+ *
+ * ChaCha20-Poly1305 is faster on hosts without hardware AES support.
+ * Algorithm is recorded in the cell, so decryption does not need this flag.
+ * Applies to seal and token protect modes.
+ *
+ * @warning ChaCha20-Poly1305 cells cannot be decrypted by earlier versions
+ * of Ecrypt, or if the crypto engine lacks ChaCha20-Poly1305 support.
+ */
+#define ECRYPT_SCELL_FLAG_CHACHA20_POLY1305 0x00000008
+
+/**
+ * Use compact auth token encoding in new master key cells.
+ *
+ * Compact tokens store algorithm in a single byte, imply IV and tag length,
+ * and encode message length as a varint. This saves 14 bytes or more per
+ * cell, which matters for short messages. Decryption detects the encoding
+ * automatically, so it does not need this flag. Compact cells are always
+ * decrypted in strict mode. Applies to seal and token protect modes.
+ *
+ * @warning Compact cells cannot be decrypted by earlier versions of Ecrypt.
+ */
+#define ECRYPT_SCELL_FLAG_COMPACT 0x00000010
+
+/**
+ * Compress messages before encrypting them into new master key cells.
+ *
+ * Messages are compressed with a built-in LZ4-style codec. Uncompressed length
+ * is recorded in the cell and authenticated along with the compression mark,
+ * so decryption decompresses transparently and does not need this flag. Data
+ * is decompressed directly into the output buffer and never exceeds the
+ * recorded length, which cannot exceed 255 times the compressed length.
+ * Applies to seal mode only and cannot be combined with
+ * ECRYPT_SCELL_FLAG_COMPACT.
+ *
+ * Length of compressed cells depends on message content. Size queries return
+ * an upper bound, which is slightly larger than the message. Actual length
+ * is returned on success. Messages which do not get shorter are sealed
+ * without compression, as if this flag was not set.
+ *
+ * @warning Compression makes cell length depend on message content. Do not
+ * compress messages mixing secrets with data controlled by an attacker who can
+ * observe cell length.
+ *
+ * @warning Compressed cells cannot be decrypted by earlier versions of Ecrypt,
+ * in place, or with scatter/gather API.
+ */
+#define ECRYPT_SCELL_FLAG_COMPRESS 0x00000020
+
+/**
+ * Data fragment for scatter/gather Secure Cell API.
+ *
+ * Same as POSIX `struct iovec`. Fragments are processed in order as if they
+ * were concatenated. Input fragments are never modified.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_iov
+ */
+struct ecrypt_secure_cell_iovec_type {
+    void* base;
+    size_t length;
+};
+typedef struct ecrypt_secure_cell_iovec_type ecrypt_secure_cell_iovec_t;
+
 /**
  * @addtogroup ECRYPT
  * @{
@@ -68,6 +171,31 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal(const uint8_t* master_key,
                                                 uint8_t* encrypted_message,
                                                 size_t* encrypted_message_length);
 
+/**
+ * Same as ecrypt_secure_cell_encrypt_seal(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * With ECRYPT_SCELL_FLAG_COMPRESS the length returned by size query is
+ * an upper bound, actual cell length is written on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `flags` contain ECRYPT_SCELL_FLAG_KEY_ID,
+ * which applies only to keyed contexts.
+ *
+ * @see ECRYPT_SCELL_FLAG_MARK_KDF
+ * @see ECRYPT_SCELL_FLAG_COMPRESS
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_ex(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* user_context,
+                                                   size_t user_context_length,
+                                                   const uint8_t* message,
+                                                   size_t message_length,
+                                                   uint8_t* encrypted_message,
+                                                   size_t* encrypted_message_length,
+                                                   uint32_t flags);
+
 /**
  * @brief decrypt
  * @param [in] master_key master key
@@ -94,6 +222,431 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal(const uint8_t* master_key,
                                                 uint8_t* plain_message,
                                                 size_t* plain_message_length);
 
+/**
+ * Same as ecrypt_secure_cell_decrypt_seal(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * @see ECRYPT_SCELL_FLAG_STRICT
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_ex(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* user_context,
+                                                   size_t user_context_length,
+                                                   const uint8_t* encrypted_message,
+                                                   size_t encrypted_message_length,
+                                                   uint8_t* plain_message,
+                                                   size_t* plain_message_length,
+                                                   uint32_t flags);
+
+/**
+ * Verifies integrity of a sealed cell without decrypting it.
+ *
+ * @param [in]      master_key                  symmetric key
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           sealed cell to verify
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * Authentication tag is checked exactly as ecrypt_secure_cell_decrypt_seal()
+ * would check it, but no plaintext is produced. For AES-GCM cells this
+ * skips the keystream pass entirely, so it is considerably cheaper than
+ * decryption for large messages.
+ *
+ * @returns ECRYPT_SUCCESS if the cell is authentic.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ *
+ * @exception ECRYPT_FAIL if verification failed for any reason, be it invalid
+ * key, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_verify_seal(const uint8_t* master_key,
+                                               size_t master_key_length,
+                                               const uint8_t* user_context,
+                                               size_t user_context_length,
+                                               const uint8_t* encrypted_message,
+                                               size_t encrypted_message_length);
+
+/**
+ * Re-encrypts a sealed cell with another master key.
+ *
+ * @param [in]      old_master_key              master key used for encryption
+ * @param [in]      old_master_key_length       length of `old_master_key` in bytes
+ * @param [in]      new_master_key              master key to encrypt with
+ * @param [in]      new_master_key_length       length of `new_master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           sealed cell to re-encrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     resealed_message            output buffer for new sealed cell
+ * @param [in,out]  resealed_message_length     length of `resealed_message` in bytes
+ *
+ * Result is the same as ecrypt_secure_cell_decrypt_seal() with the old key
+ * followed by ecrypt_secure_cell_encrypt_seal() with the new one, but the
+ * plaintext is kept only in an internal buffer which is wiped afterwards.
+ *
+ * `resealed_message` may be the same buffer as `encrypted_message`,
+ * the input is consumed completely before any output is written.
+ * Usually the new cell has exactly the same length as the old one.
+ * Compressed cells are compressed again.
+ *
+ * You can pass NULL for `resealed_message` in order to determine appropriate
+ * buffer length. In this case no processing is performed, the expected length
+ * is written into provided location, and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * Use ecrypt_secure_cell_reseal_with_ctx() or ecrypt_secure_cell_reseal_batch()
+ * to process many cells efficiently.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been re-encrypted successfully
+ * and written into `resealed_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `resealed_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `old_master_key` or `new_master_key` is NULL or empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `resealed_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption or encryption failed for any reason.
+ * If it fails in place the contents of the buffer are unspecified.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_reseal(const uint8_t* old_master_key,
+                                          size_t old_master_key_length,
+                                          const uint8_t* new_master_key,
+                                          size_t new_master_key_length,
+                                          const uint8_t* user_context,
+                                          size_t user_context_length,
+                                          const uint8_t* encrypted_message,
+                                          size_t encrypted_message_length,
+                                          uint8_t* resealed_message,
+                                          size_t* resealed_message_length);
+
+/**
+ * Encrypts and puts the provided fragmented message into a sealed cell.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     fragments of message to encrypt
+ * @param [in]      message_count               number of `message` fragments
+ * @param [out]     encrypted_message           fragments of output buffer for sealed cell
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     encrypted_message_length    length of sealed cell in bytes
+ *
+ * This function produces the same sealed cell as ecrypt_secure_cell_encrypt_seal()
+ * would for concatenated message, writing it into concatenated output fragments.
+ * Data is processed fragment by fragment without intermediate copies.
+ *
+ * You can pass NULL for `encrypted_message` in order to determine appropriate
+ * buffer length. In this case no encryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ * The same happens if output fragments are too short in total.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and written into `encrypted_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or message is empty.
+ * @exception ECRYPT_INVALID_PARAMETER if some fragment is NULL but its length is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some internal reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_iov(const uint8_t* master_key,
+                                                    size_t master_key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const ecrypt_secure_cell_iovec_t* message,
+                                                    size_t message_count,
+                                                    const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                    size_t encrypted_message_count,
+                                                    size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from a fragmented sealed cell.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           fragments of sealed cell
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     plain_message               fragments of output buffer for decrypted message
+ * @param [in]      plain_message_count         number of `plain_message` fragments
+ * @param [out]     plain_message_length        length of decrypted message in bytes
+ *
+ * This function behaves as ecrypt_secure_cell_decrypt_seal() for concatenated
+ * input, writing the message into concatenated output fragments. Output is
+ * wiped if decryption fails.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case no decryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ * The same happens if output fragments are too short in total.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or sealed cell is empty.
+ * @exception ECRYPT_INVALID_PARAMETER if some fragment is NULL but its length is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if the cell is compressed.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_iov(const uint8_t* master_key,
+                                                    size_t master_key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                    size_t encrypted_message_count,
+                                                    const ecrypt_secure_cell_iovec_t* plain_message,
+                                                    size_t plain_message_count,
+                                                    size_t* plain_message_length);
+
+/**
+ * Encrypts a message into a sealed cell in place.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in,out]  cell                        buffer with the message, receives sealed cell
+ * @param [in,out]  cell_length                 length of `cell` in bytes
+ * @param [in]      message_length              length of the message in bytes
+ *
+ * Sealed cell is longer than the message by the length of the auth token.
+ * Call this function with NULL `cell` to learn the length of the cell.
+ * Then put the message at the end of a buffer of that length, leaving
+ * headroom for the auth token in front of it. The message is encrypted
+ * where it sits and the auth token is written into the headroom.
+ *
+ * Resulting cell is the same as produced by ecrypt_secure_cell_encrypt_seal().
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and `cell` contains the sealed cell now.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of the cell
+ * has been written to `cell_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `cell_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_in_place(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         uint8_t* cell,
+                                                         size_t* cell_length,
+                                                         size_t message_length);
+
+/**
+ * Decrypts a sealed cell in place.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in,out]  cell                        sealed cell, receives decrypted message
+ * @param [in]      cell_length                 length of `cell` in bytes
+ * @param [out]     plain_message               location of decrypted message in `cell`
+ * @param [out]     plain_message_length        length of decrypted message in bytes
+ *
+ * The message is decrypted where the ciphertext is, after the auth token.
+ *
+ * The cell is authenticated before it is decrypted. If decryption fails,
+ * `cell` is left intact and can be decrypted again, for example with
+ * another key.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `cell` is NULL or `cell_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message` or `plain_message_length` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if the cell is compressed, `cell` is left intact then.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_in_place(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         uint8_t* cell,
+                                                         size_t cell_length,
+                                                         uint8_t** plain_message,
+                                                         size_t* plain_message_length);
+
+/**
+ * Length of Secure Cell context digest in bytes.
+ *
+ * @see ecrypt_secure_cell_context_digest
+ */
+#define ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH 32
+
+/**
+ * Encrypts and puts the provided message into a sealed cell, binding it to
+ * separate key derivation context and associated data.
+ *
+ * @param [in]      master_key                  symmetric key
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      kdf_context                 context for key derivation, may be NULL
+ * @param [in]      kdf_context_length          length of `kdf_context` in bytes, may be zero
+ * @param [in]      aad                         associated data, may be NULL
+ * @param [in]      aad_length                  length of `aad` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for encrypted message
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * Regular Seal mode uses user context both for key derivation and as AEAD
+ * associated data, so it is processed twice for every message. Here
+ * `kdf_context` is used only for key derivation and `aad` is only
+ * authenticated by the cipher. Keep `kdf_context` short (e.g., a record ID)
+ * and pass large data like record headers as `aad`.
+ *
+ * If large associated data is shared by many messages, compute its digest
+ * once with ecrypt_secure_cell_context_digest() and pass the digest as
+ * `aad` or `kdf_context` instead.
+ *
+ * Both contexts are required for decryption, which must be performed with
+ * ecrypt_secure_cell_decrypt_seal_with_aad(). Passing the same data as
+ * `kdf_context` and `aad` produces regular sealed cells.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if `encrypted_message` is NULL or
+ * its length is not sufficient. Required length is written into
+ * `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `kdf_context` or `aad` is NULL but its length is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_aad(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* kdf_context,
+                                                         size_t kdf_context_length,
+                                                         const uint8_t* aad,
+                                                         size_t aad_length,
+                                                         const uint8_t* message,
+                                                         size_t message_length,
+                                                         uint8_t* encrypted_message,
+                                                         size_t* encrypted_message_length,
+                                                         uint32_t flags);
+
+/**
+ * Extracts the original message from a cell sealed with separate contexts.
+ *
+ * @param [in]      master_key                  symmetric key
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      kdf_context                 context for key derivation, may be NULL
+ * @param [in]      kdf_context_length          length of `kdf_context` in bytes, may be zero
+ * @param [in]      aad                         associated data, may be NULL
+ * @param [in]      aad_length                  length of `aad` in bytes, may be zero
+ * @param [in]      encrypted_message           encrypted message to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * `kdf_context` and `aad` must be the same as used during encryption.
+ * Decryption is always strict.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if `plain_message` is NULL or
+ * its length is not sufficient. Required length is written into
+ * `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `kdf_context` or `aad` is NULL but its length is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_with_aad
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_aad(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* kdf_context,
+                                                         size_t kdf_context_length,
+                                                         const uint8_t* aad,
+                                                         size_t aad_length,
+                                                         const uint8_t* encrypted_message,
+                                                         size_t encrypted_message_length,
+                                                         uint8_t* plain_message,
+                                                         size_t* plain_message_length,
+                                                         uint32_t flags);
+
+/**
+ * Computes digest of a context shared by many cells.
+ *
+ * @param [in]      context                     context data
+ * @param [in]      context_length              length of `context` in bytes
+ * @param [out]     digest                      output buffer for the digest
+ * @param [in,out]  digest_length               length of `digest` in bytes
+ *
+ * Digest is plain SHA-256 of the context, ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH
+ * bytes long. Compute it once and pass it to
+ * ecrypt_secure_cell_encrypt_seal_with_aad() so that large context is not
+ * hashed again for every cell.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if `digest` is NULL or its length is not
+ * sufficient. Required length is written into `digest_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL or `context_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `digest_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_context_digest(const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint8_t* digest,
+                                                  size_t* digest_length);
+
 /**
  * Encrypts and puts the provided message into a sealed cell.
  *
@@ -152,6 +705,59 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase(const uint8_t* p
                                                                 uint8_t* encrypted_message,
                                                                 size_t* encrypted_message_length);
 
+/**
+ * Same as ecrypt_secure_cell_encrypt_seal_with_passphrase(), with explicit
+ * PBKDF2 iteration count.
+ *
+ * @param [in]      iteration_count             number of PBKDF2 iterations, must not be zero
+ *
+ * The default iteration count is selected at build time. Use this function
+ * to trade key derivation time for resistance to brute force attacks, e.g.
+ * lower for interactive use and higher for long-term archives. The count is
+ * stored in the cell, so the cell is decrypted with
+ * ecrypt_secure_cell_decrypt_seal_with_passphrase() as usual and takes about
+ * as long as it took to encrypt.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `iteration_count` is zero.
+ *
+ * @see ecrypt_secure_cell_passphrase_calibrate_iterations
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase_ex(const uint8_t* passphrase,
+                                                                   size_t passphrase_length,
+                                                                   const uint8_t* user_context,
+                                                                   size_t user_context_length,
+                                                                   const uint8_t* message,
+                                                                   size_t message_length,
+                                                                   uint8_t* encrypted_message,
+                                                                   size_t* encrypted_message_length,
+                                                                   uint32_t iteration_count);
+
+/**
+ * Estimates PBKDF2 iteration count for a given key derivation time.
+ *
+ * @param [in]      target_milliseconds         desired key derivation time
+ * @param [out]     iteration_count             estimated iteration count
+ *
+ * Runs PBKDF2 on this machine with increasing iteration counts until the
+ * time can be measured reliably (at least 20 ms), then scales the result to
+ * `target_milliseconds`. Pass the count to
+ * ecrypt_secure_cell_encrypt_seal_with_passphrase_ex().
+ *
+ * The estimate reflects the current load of the machine and should be
+ * taken on the hardware that will decrypt the data. Results below 100,000
+ * iterations offer little protection against brute force attacks.
+ *
+ * @returns ECRYPT_SUCCESS if the estimate has been written.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `target_milliseconds` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `iteration_count` is NULL.
+ * @exception ECRYPT_FAIL if PBKDF2 failed.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_passphrase_calibrate_iterations(uint32_t target_milliseconds,
+                                                                   uint32_t* iteration_count);
+
 /**
  * Extracts the original message from a sealed cell.
  *
@@ -211,22 +817,1733 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase(const uint8_t* p
                                                                 uint8_t* plain_message,
                                                                 size_t* plain_message_length);
 
-/** @} */
-
 /**
- * @defgroup ECRYPT_SECURE_CELL_TOKEN_PROTECT_MODE token protect mode
- * @brief This API is designed for cases when underlying storage constraints do not allow the size
- * of the data to grow (so Secure cell seal API described above cannot be used), however the user
- * has access to a different storage location (ex. another table in the database) where he can store
- * needed security parameters
- * @{
+ * Passphrase Secure Cell context.
+ *
+ * @see ecrypt_secure_cell_passphrase_ctx_create
  */
+typedef struct ecrypt_secure_cell_passphrase_ctx_type ecrypt_secure_cell_passphrase_ctx_t;
 
 /**
- * @brief encrypt
- * @param [in] master_key master key
- * @param [in] master_key_length length of master_key
- * @param [in] user_context user defined context. May be set to NULL
+ * Prepares a passphrase for repeated Secure Cell operations.
+ *
+ * @param [in]      passphrase                  passphrase used for security
+ * @param [in]      passphrase_length           length of `passphrase` in bytes
+ *
+ * ecrypt_secure_cell_encrypt_seal_with_passphrase() runs PBKDF2 with fresh
+ * salt for every message, which is intentionally slow. Passphrase context
+ * runs PBKDF2 once, here, and keeps its output along with the salt and
+ * iteration count. Each message is then encrypted with a key derived from
+ * that output, message length, and associated context by a cheap KDF step,
+ * exactly like with master keys.
+ *
+ * Sealed cells produced with the context have the usual format and embed
+ * the salt and iteration count, so they can be decrypted with
+ * ecrypt_secure_cell_decrypt_seal_with_passphrase() given only the
+ * passphrase. However, all cells produced with one context share the salt,
+ * which reveals that they are encrypted with the same passphrase. Create
+ * a new context when this is not acceptable.
+ *
+ * A context may be used concurrently from multiple threads.
+ *
+ * Destroy the context with ecrypt_secure_cell_passphrase_ctx_destroy()
+ * after use. This wipes the passphrase and all key material kept by the context.
+ *
+ * @returns new passphrase context, or NULL if `passphrase` is NULL,
+ * `passphrase_length` is zero, or the context could not be created.
+ */
+ECRYPT_API
+ecrypt_secure_cell_passphrase_ctx_t* ecrypt_secure_cell_passphrase_ctx_create(const uint8_t* passphrase,
+                                                                              size_t passphrase_length);
+
+/**
+ * Destroys passphrase Secure Cell context.
+ *
+ * @param [in]      ctx                         passphrase context, may be NULL
+ *
+ * The context must not be in use by any thread when it is destroyed.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_passphrase_ctx_destroy(ecrypt_secure_cell_passphrase_ctx_t* ctx);
+
+/**
+ * Encrypts and puts the provided message into a sealed cell using passphrase context.
+ *
+ * @param [in]      ctx                         passphrase context
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for encrypted message
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * This function behaves as ecrypt_secure_cell_encrypt_seal_with_passphrase()
+ * with the passphrase used to create `ctx`, except that PBKDF2 is not run.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and written into `encrypted_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_with_passphrase_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ecrypt_secure_cell_passphrase_ctx_t* ctx,
+                                                                    const uint8_t* user_context,
+                                                                    size_t user_context_length,
+                                                                    const uint8_t* message,
+                                                                    size_t message_length,
+                                                                    uint8_t* encrypted_message,
+                                                                    size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from a sealed cell using passphrase context.
+ *
+ * @param [in]      ctx                         passphrase context
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           message to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_decrypt_seal_with_passphrase()
+ * with the passphrase used to create `ctx`. Cells which have been produced
+ * with `ctx` are decrypted without running PBKDF2. Any other cells encrypted
+ * with the same passphrase are decrypted as well, but at the usual cost.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * passphrase, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase_ctx(ecrypt_secure_cell_passphrase_ctx_t* ctx,
+                                                                    const uint8_t* user_context,
+                                                                    size_t user_context_length,
+                                                                    const uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    uint8_t* plain_message,
+                                                                    size_t* plain_message_length);
+
+/**
+ * Encrypts and puts the provided message into a key-wrapped passphrase cell.
+ *
+ * @param [in]      passphrase                  passphrase used for security
+ * @param [in]      passphrase_length           length of `passphrase` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for encrypted message
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * Unlike ecrypt_secure_cell_encrypt_seal_with_passphrase(), the message is
+ * encrypted with a random data key, as if with ecrypt_secure_cell_encrypt_seal().
+ * The passphrase only encrypts the data key which is stored in a short header
+ * in front of the message. This allows to change the passphrase of large
+ * cells with ecrypt_secure_cell_rewrap_passphrase() which rewrites only the
+ * header, regardless of message size.
+ *
+ * Key-wrapped cells have a different format from the regular passphrase cells.
+ * Decrypt them with ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase().
+ *
+ * You can pass NULL for `encrypted_message` in order to determine appropriate
+ * buffer length. In this case no encryption is performed, the expected length
+ * is written into provided location, and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and written into `encrypted_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `passphrase` is NULL or `passphrase_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_wrapped_passphrase(const uint8_t* passphrase,
+                                                                        size_t passphrase_length,
+                                                                        const uint8_t* user_context,
+                                                                        size_t user_context_length,
+                                                                        const uint8_t* message,
+                                                                        size_t message_length,
+                                                                        uint8_t* encrypted_message,
+                                                                        size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from a key-wrapped passphrase cell.
+ *
+ * @param [in]      passphrase                  passphrase used for security
+ * @param [in]      passphrase_length           length of `passphrase` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           message to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * The data key is decrypted from the header with the passphrase, then the
+ * message is decrypted with the data key. Both steps verify integrity.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case no decryption is performed (and no PBKDF2 is
+ * run), the expected length is written into provided location, and
+ * ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `passphrase` is NULL or `passphrase_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * passphrase, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_with_wrapped_passphrase
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase(const uint8_t* passphrase,
+                                                                        size_t passphrase_length,
+                                                                        const uint8_t* user_context,
+                                                                        size_t user_context_length,
+                                                                        const uint8_t* encrypted_message,
+                                                                        size_t encrypted_message_length,
+                                                                        uint8_t* plain_message,
+                                                                        size_t* plain_message_length);
+
+/**
+ * Determines length of the header of a key-wrapped passphrase cell.
+ *
+ * @param [in]      encrypted_message           beginning of key-wrapped cell
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     header_length               length of the header in bytes
+ *
+ * Only the first 20 bytes of the cell are needed, so the header of a large
+ * cell stored in a file can be read without reading the rest of it.
+ *
+ * @returns ECRYPT_SUCCESS if header length has been written.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` or `header_length` is NULL.
+ * @exception ECRYPT_FAIL if the data is too short or is not a key-wrapped cell.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_wrapped_passphrase_header_length(const uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    size_t* header_length);
+
+/**
+ * Changes passphrase of a key-wrapped passphrase cell.
+ *
+ * @param [in]      old_passphrase              passphrase used for encryption
+ * @param [in]      old_passphrase_length       length of `old_passphrase` in bytes
+ * @param [in]      new_passphrase              passphrase to use from now on
+ * @param [in]      new_passphrase_length       length of `new_passphrase` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in,out]  header                      header of key-wrapped cell
+ * @param [in]      header_length               length of `header` in bytes
+ *
+ * The data key is decrypted with the old passphrase and encrypted with the new
+ * one, using fresh salt and the same PBKDF2 iteration count. The header is
+ * rewritten in place and keeps its length. The message itself is not touched,
+ * so `header` may point to just the first `header_length` bytes of the cell
+ * as determined by ecrypt_secure_cell_wrapped_passphrase_header_length().
+ *
+ * Cells which are copies of each other share the data key. Changing
+ * passphrase of one copy does not make the old passphrase useless for
+ * the others.
+ *
+ * @returns ECRYPT_SUCCESS if the header has been rewritten.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `old_passphrase` or `new_passphrase` is NULL or empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `header` is NULL or `header_length` is not the header length.
+ *
+ * @exception ECRYPT_FAIL if the old passphrase or context is invalid, the header
+ * is corrupted or uses a legacy format, or encryption failed. The header is
+ * left intact in this case.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_rewrap_passphrase(const uint8_t* old_passphrase,
+                                                     size_t old_passphrase_length,
+                                                     const uint8_t* new_passphrase,
+                                                     size_t new_passphrase_length,
+                                                     const uint8_t* user_context,
+                                                     size_t user_context_length,
+                                                     uint8_t* header,
+                                                     size_t header_length);
+
+/**
+ * Keyed Secure Cell context.
+ *
+ * @see ecrypt_secure_cell_seal_ctx_create
+ */
+typedef struct ecrypt_secure_cell_seal_ctx_type ecrypt_secure_cell_seal_ctx_t;
+
+/**
+ * Prepares a master key for repeated Secure Cell operations.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ *
+ * Keyed context produces and accepts exactly the same sealed cells as
+ * ecrypt_secure_cell_encrypt_seal() and ecrypt_secure_cell_decrypt_seal()
+ * with the same master key. However, master key processing is done only
+ * once here and cipher contexts are reused between calls, which makes
+ * encryption of many small messages with the same key considerably faster.
+ *
+ * A context may be used concurrently from multiple threads. Each thread
+ * borrows its own scratch space for the duration of a call.
+ *
+ * Destroy the context with ecrypt_secure_cell_seal_ctx_destroy() after use.
+ * This wipes all key material kept by the context.
+ *
+ * @returns new keyed context, or NULL if `master_key` is NULL,
+ * `master_key_length` is zero, or the context could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_seal_ctx_t* ecrypt_secure_cell_seal_ctx_create(const uint8_t* master_key,
+                                                                  size_t master_key_length);
+
+/**
+ * Destroys keyed Secure Cell context.
+ *
+ * @param [in]      ctx                         keyed context, may be NULL
+ *
+ * The context must not be in use by any thread when it is destroyed.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_destroy(ecrypt_secure_cell_seal_ctx_t* ctx);
+
+/**
+ * Sets flags applied to all operations with keyed context.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * Flags are not synchronized, set them before sharing the context
+ * between threads.
+ *
+ * @returns ECRYPT_SUCCESS if flags have been set.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL or `flags` contain
+ * unknown values, or combine ECRYPT_SCELL_FLAG_COMPRESS with ECRYPT_SCELL_FLAG_COMPACT.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_set_flags(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                      uint32_t flags);
+
+/**
+ * Enables caching of derived keys in keyed context.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [in]      capacity                    maximum number of cached keys,
+ *                                              zero disables the cache
+ *
+ * Each message is encrypted with a key derived from the master key,
+ * message length, and associated context. With the cache enabled, messages
+ * which repeat a recently seen (length, context) pair skip key derivation.
+ * The least recently used key is evicted when the cache is full.
+ * Associated contexts longer than 128 bytes are not cached.
+ *
+ * Evicted keys are wiped. Changing capacity drops all cached keys and
+ * resets statistics. This is not synchronized, configure the cache before
+ * sharing the context between threads.
+ *
+ * @returns ECRYPT_SUCCESS if the cache has been configured.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_NO_MEMORY if the cache could not be allocated.
+ *
+ * @see ecrypt_secure_cell_seal_ctx_key_cache_stats
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_set_key_cache(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                          size_t capacity);
+
+/**
+ * Reports effectiveness of derived key cache.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [out]     hits                        number of derivations avoided
+ * @param [out]     misses                      number of keys derived while the cache was enabled
+ *
+ * Both counters are zero if the cache is disabled.
+ *
+ * @returns ECRYPT_SUCCESS if statistics have been written.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx`, `hits`, or `misses` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_key_cache_stats(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                            uint64_t* hits,
+                                                            uint64_t* misses);
+
+/**
+ * Encrypts and puts the provided message into a sealed cell using keyed context.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for encrypted message
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_encrypt_seal()
+ * with the master key used to create `ctx`.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and written into `encrypted_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_with_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* message,
+                                                         size_t message_length,
+                                                         uint8_t* encrypted_message,
+                                                         size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from a sealed cell using keyed context.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           message to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_decrypt_seal()
+ * with the master key used to create `ctx`.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, corrupted encrypted message, or some
+ * internal library failure.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_with_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* encrypted_message,
+                                                         size_t encrypted_message_length,
+                                                         uint8_t* plain_message,
+                                                         size_t* plain_message_length);
+
+/**
+ * Verifies integrity of a sealed cell using keyed context.
+ *
+ * @param [in]      ctx                         keyed context
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           sealed cell to verify
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_verify_seal()
+ * with the master key used to create `ctx`. Flags of `ctx` apply.
+ *
+ * @returns ECRYPT_SUCCESS if the cell is authentic.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ *
+ * @exception ECRYPT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECRYPT_FAIL if verification failed for any reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_with_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_verify_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* encrypted_message,
+                                                        size_t encrypted_message_length);
+
+/**
+ * Re-encrypts a sealed cell using keyed contexts.
+ *
+ * @param [in]      old_ctx                     keyed context of the old master key
+ * @param [in]      new_ctx                     keyed context of the new master key
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           sealed cell to re-encrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     resealed_message            output buffer for new sealed cell
+ * @param [in,out]  resealed_message_length     length of `resealed_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_reseal() with the
+ * master keys used to create the contexts. Flags of `old_ctx` apply to
+ * decryption, flags of `new_ctx` apply to encryption. Plaintext is kept
+ * in the scratch space of `old_ctx`, the buffer is reused between calls.
+ *
+ * Compressed cells are compressed again even if `new_ctx` does not have
+ * ECRYPT_SCELL_FLAG_COMPRESS, unless it uses ECRYPT_SCELL_FLAG_COMPACT.
+ * They keep their length if the token layout does not change, so such cells
+ * may be resealed in place. Otherwise the exact length of compressed output
+ * is known only after decryption: size queries report the upper bound, and
+ * smaller buffers are accepted if the new cell fits there.
+ *
+ * Both contexts may be shared by multiple threads resealing concurrently.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been re-encrypted successfully
+ * and written into `resealed_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `resealed_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `old_ctx` or `new_ctx` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `resealed_message_length` is NULL.
+ *
+ * @exception ECRYPT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECRYPT_FAIL if decryption or encryption failed for any reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_reseal_with_ctx(ecrypt_secure_cell_seal_ctx_t* old_ctx,
+                                                   ecrypt_secure_cell_seal_ctx_t* new_ctx,
+                                                   const uint8_t* user_context,
+                                                   size_t user_context_length,
+                                                   const uint8_t* encrypted_message,
+                                                   size_t encrypted_message_length,
+                                                   uint8_t* resealed_message,
+                                                   size_t* resealed_message_length);
+
+/**
+ * Secure Cell key ring.
+ *
+ * @see ecrypt_secure_cell_key_ring_create
+ */
+typedef struct ecrypt_secure_cell_key_ring_type ecrypt_secure_cell_key_ring_t;
+
+/**
+ * Prepares a set of master keys for decryption during key rotation.
+ *
+ * @param [in]      master_keys                 array of master keys
+ * @param [in]      master_key_lengths          lengths of `master_keys` in bytes
+ * @param [in]      key_count                   number of master keys
+ *
+ * The first key is the current one, it is used for encryption. All keys
+ * are used for decryption. Master key processing is done once for each key,
+ * as with ecrypt_secure_cell_seal_ctx_create().
+ *
+ * Cells with key identifier (see ECRYPT_SCELL_FLAG_KEY_ID) are decrypted
+ * with the matching key right away. Other cells are tried with each key,
+ * starting with the keys which decrypted something most recently.
+ *
+ * A key ring may be used concurrently from multiple threads.
+ *
+ * Destroy the key ring with ecrypt_secure_cell_key_ring_destroy() after use.
+ *
+ * @returns new key ring, or NULL if `master_keys` is NULL, `key_count` is zero,
+ * some key is NULL or empty, or the key ring could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_key_ring_t* ecrypt_secure_cell_key_ring_create(const uint8_t* const* master_keys,
+                                                                  const size_t* master_key_lengths,
+                                                                  size_t key_count);
+
+/**
+ * Destroys Secure Cell key ring.
+ *
+ * @param [in]      ring                        key ring, may be NULL
+ *
+ * The key ring must not be in use by any thread when it is destroyed.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_key_ring_destroy(ecrypt_secure_cell_key_ring_t* ring);
+
+/**
+ * Sets flags applied to all operations with key ring.
+ *
+ * @param [in]      ring                        key ring
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * Flags are not synchronized, set them before sharing the key ring
+ * between threads.
+ *
+ * @returns ECRYPT_SUCCESS if flags have been set.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ring` is NULL or `flags` contain
+ * unknown values.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_key_ring_set_flags(ecrypt_secure_cell_key_ring_t* ring,
+                                                      uint32_t flags);
+
+/**
+ * Encrypts and puts the provided message into a sealed cell using the current key.
+ *
+ * @param [in]      ring                        key ring
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for encrypted message
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * This function behaves exactly as ecrypt_secure_cell_encrypt_seal_with_ctx()
+ * with the first key of the ring.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_with_ctx
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_key_ring(ecrypt_secure_cell_key_ring_t* ring,
+                                                              const uint8_t* user_context,
+                                                              size_t user_context_length,
+                                                              const uint8_t* message,
+                                                              size_t message_length,
+                                                              uint8_t* encrypted_message,
+                                                              size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from a sealed cell using any key of the ring.
+ *
+ * @param [in]      ring                        key ring
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           message to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ * @param [out]     key_index                   index of the key which decrypted
+ *                                              the message, may be NULL
+ *
+ * Cell header is parsed once, then the keys are tried as described in
+ * ecrypt_secure_cell_key_ring_create(). Use `key_index` to find out whether
+ * the cell needs to be re-encrypted with the current key.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case no decryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `ring` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_NO_MEMORY if scratch space could not be allocated.
+ *
+ * @exception ECRYPT_FAIL if no key could decrypt the message, be it because
+ * of mismatched context data, corrupted encrypted message, or some internal
+ * library failure.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_key_ring(ecrypt_secure_cell_key_ring_t* ring,
+                                                              const uint8_t* user_context,
+                                                              size_t user_context_length,
+                                                              const uint8_t* encrypted_message,
+                                                              size_t encrypted_message_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length,
+                                                              size_t* key_index);
+
+/**
+ * Length of data key identifiers in envelope records.
+ */
+#define ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH 16
+
+/**
+ * Length of data keys wrapped by envelope callbacks.
+ */
+#define ECRYPT_SCELL_ENVELOPE_DATA_KEY_LENGTH 32
+
+/**
+ * Maximum length of a wrapped data key.
+ */
+#define ECRYPT_SCELL_ENVELOPE_MAX_WRAPPED_KEY_LENGTH 1024
+
+/**
+ * Wraps a data key with a key-encryption key.
+ *
+ * @param [in]      key_id                      identifier of the data key
+ * @param [in]      key_id_length               length of `key_id` in bytes
+ * @param [in]      data_key                    data key to wrap
+ * @param [in]      data_key_length             length of `data_key` in bytes
+ * @param [out]     wrapped_key                 output buffer for the wrapped key
+ * @param [in,out]  wrapped_key_length          length of `wrapped_key` in bytes
+ * @param [in]      user_data                   value passed to ecrypt_secure_cell_envelope_create()
+ *
+ * The callback may bind `key_id` to the wrapped key, e.g., as associated
+ * data of the key service. It must set `wrapped_key_length` to the actual
+ * length of the wrapped key, which may not exceed the provided one.
+ *
+ * @returns ECRYPT_SUCCESS if the key has been wrapped, any other value
+ * is returned to the caller of ecrypt_secure_cell_encrypt_envelope().
+ */
+typedef ecrypt_status_t (*ecrypt_secure_cell_envelope_wrap_callback)(const uint8_t* key_id,
+                                                                     size_t key_id_length,
+                                                                     const uint8_t* data_key,
+                                                                     size_t data_key_length,
+                                                                     uint8_t* wrapped_key,
+                                                                     size_t* wrapped_key_length,
+                                                                     void* user_data);
+
+/**
+ * Unwraps a data key with a key-encryption key.
+ *
+ * @param [in]      key_id                      identifier of the data key
+ * @param [in]      key_id_length               length of `key_id` in bytes
+ * @param [in]      wrapped_key                 wrapped data key
+ * @param [in]      wrapped_key_length          length of `wrapped_key` in bytes
+ * @param [out]     data_key                    output buffer for the data key
+ * @param [in,out]  data_key_length             length of `data_key` in bytes
+ * @param [in]      user_data                   value passed to ecrypt_secure_cell_envelope_create()
+ *
+ * @returns ECRYPT_SUCCESS if the key has been unwrapped, any other value
+ * is returned to the caller of ecrypt_secure_cell_decrypt_envelope().
+ */
+typedef ecrypt_status_t (*ecrypt_secure_cell_envelope_unwrap_callback)(const uint8_t* key_id,
+                                                                       size_t key_id_length,
+                                                                       const uint8_t* wrapped_key,
+                                                                       size_t wrapped_key_length,
+                                                                       uint8_t* data_key,
+                                                                       size_t* data_key_length,
+                                                                       void* user_data);
+
+/**
+ * Secure Cell envelope encryption state.
+ *
+ * @see ecrypt_secure_cell_envelope_create
+ */
+typedef struct ecrypt_secure_cell_envelope_type ecrypt_secure_cell_envelope_t;
+
+/**
+ * Prepares envelope encryption with an external key-encryption key.
+ *
+ * @param [in]      wrap                        callback wrapping data keys
+ * @param [in]      unwrap                      callback unwrapping data keys
+ * @param [in]      user_data                   value passed to callbacks, may be NULL
+ *
+ * Envelope records are sealed with random data keys. Data keys are wrapped
+ * by the key-encryption key which never leaves the key service, and each
+ * record carries the identifier and wrapped form of its data key.
+ *
+ * One data key encrypts many records until it reaches age or usage limits,
+ * then a new one is generated and wrapped. Unwrapped data keys are cached
+ * for decryption under the same limits. Therefore the key service is
+ * contacted only when a data key is rotated or is not in the cache.
+ * By default, the cache holds 64 keys, each used for at most 5 minutes
+ * and 2^20 records. See ecrypt_secure_cell_envelope_set_limits().
+ *
+ * An envelope may be used concurrently from multiple threads. Wrap callback
+ * is called with an internal lock held, unwrap callback may be called
+ * concurrently. Callbacks must not use the envelope.
+ *
+ * Destroy the envelope with ecrypt_secure_cell_envelope_destroy() after use.
+ *
+ * @returns new envelope, or NULL if `wrap` or `unwrap` is NULL, or the
+ * envelope could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_envelope_t* ecrypt_secure_cell_envelope_create(ecrypt_secure_cell_envelope_wrap_callback wrap,
+                                                                  ecrypt_secure_cell_envelope_unwrap_callback unwrap,
+                                                                  void* user_data);
+
+/**
+ * Destroys Secure Cell envelope.
+ *
+ * @param [in]      envelope                    envelope, may be NULL
+ *
+ * All cached data keys are wiped. The envelope must not be in use by any
+ * thread when it is destroyed.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_envelope_destroy(ecrypt_secure_cell_envelope_t* envelope);
+
+/**
+ * Sets limits of data key usage.
+ *
+ * @param [in]      envelope                    envelope
+ * @param [in]      cache_capacity              number of unwrapped keys to cache,
+ *                                              zero disables the cache
+ * @param [in]      max_age_seconds             time a data key may be used for,
+ *                                              zero means no limit
+ * @param [in]      max_uses                    number of records a data key may
+ *                                              encrypt, or decrypt from the cache,
+ *                                              zero means no limit
+ *
+ * Cached keys and the current data key are wiped, so the next record
+ * is encrypted with a new data key.
+ *
+ * @returns ECRYPT_SUCCESS if limits have been set.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `envelope` is NULL.
+ * @exception ECRYPT_NO_MEMORY if the cache could not be allocated.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_envelope_set_limits(ecrypt_secure_cell_envelope_t* envelope,
+                                                       size_t cache_capacity,
+                                                       uint32_t max_age_seconds,
+                                                       uint64_t max_uses);
+
+/**
+ * Reports how often the key service has been contacted.
+ *
+ * @param [in]      envelope                    envelope
+ * @param [out]     wrap_count                  number of wrap callback calls, may be NULL
+ * @param [out]     unwrap_count                number of unwrap callback calls, may be NULL
+ * @param [out]     cache_hits                  number of records decrypted with cached
+ *                                              data keys, may be NULL
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `envelope` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_envelope_stats(ecrypt_secure_cell_envelope_t* envelope,
+                                                  uint64_t* wrap_count,
+                                                  uint64_t* unwrap_count,
+                                                  uint64_t* cache_hits);
+
+/**
+ * Encrypts and puts the provided message into an envelope record.
+ *
+ * @param [in]      envelope                    envelope
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      message                     message to encrypt
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     encrypted_message           output buffer for the record
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * The record consists of a header with data key identifier and wrapped
+ * data key, followed by a sealed cell of the message encrypted with
+ * the data key as master key and `user_context` as associated data.
+ *
+ * You can pass NULL for `encrypted_message` in order to determine appropriate
+ * buffer length. In this case no encryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ * The length depends on the wrapped key length, which may change if the data
+ * key is rotated between the calls.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been encrypted successfully
+ * and written into `encrypted_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `envelope` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * Errors returned by the wrap callback are passed through.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_envelope(ecrypt_secure_cell_envelope_t* envelope,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* message,
+                                                    size_t message_length,
+                                                    uint8_t* encrypted_message,
+                                                    size_t* encrypted_message_length);
+
+/**
+ * Extracts the original message from an envelope record.
+ *
+ * @param [in]      envelope                    envelope
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           record to decrypt
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [out]     plain_message               output buffer for decrypted message
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * The data key is taken from the cache, or unwrapped with the callback
+ * if it is not there. Unwrapped keys are cached only after they decrypt
+ * the record successfully.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case the data key is not unwrapped, the expected
+ * length is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the message has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `envelope` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL or `encrypted_message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed, be it because of mismatched
+ * context data, corrupted record, or some internal library failure.
+ *
+ * Errors returned by the unwrap callback are passed through.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_envelope(ecrypt_secure_cell_envelope_t* envelope,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* encrypted_message,
+                                                    size_t encrypted_message_length,
+                                                    uint8_t* plain_message,
+                                                    size_t* plain_message_length);
+
+/**
+ * Secure Cell stream state.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_stream_create
+ * @see ecrypt_secure_cell_decrypt_seal_stream_create
+ */
+typedef struct ecrypt_secure_cell_stream_type ecrypt_secure_cell_stream_t;
+
+/**
+ * Starts encryption of a sealed stream.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      segment_length              plaintext length of a segment in bytes,
+ *                                              zero selects the default (64 KB)
+ *
+ * Sealed streams use a chunked format different from ordinary sealed cells.
+ * Data is split into segments of `segment_length` bytes, each one encrypted
+ * and authenticated separately. This allows to encrypt and decrypt data of
+ * any length (up to 2^64 bytes) using a constant amount of memory, and to
+ * decrypt arbitrary byte ranges with ecrypt_secure_cell_decrypt_seal_stream_range().
+ *
+ * Feed the data with ecrypt_secure_cell_encrypt_seal_stream_update(), finish
+ * the stream with ecrypt_secure_cell_encrypt_seal_stream_final(), then free
+ * the state with ecrypt_secure_cell_seal_stream_destroy().
+ *
+ * @returns new stream state, or NULL if parameters are invalid (e.g., if
+ * `segment_length` exceeds 16 MB) or the state could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_stream_t* ecrypt_secure_cell_encrypt_seal_stream_create(const uint8_t* master_key,
+                                                                           size_t master_key_length,
+                                                                           const uint8_t* user_context,
+                                                                           size_t user_context_length,
+                                                                           size_t segment_length);
+
+/**
+ * Encrypts next part of a sealed stream.
+ *
+ * @param [in]      stream                      stream state
+ * @param [in]      message                     next part of the message, may be NULL
+ * @param [in]      message_length              length of `message` in bytes, may be zero
+ * @param [out]     encrypted_message           output buffer for encrypted segments
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * Input is buffered until a complete segment is available. All complete
+ * segments are written into `encrypted_message`, the stream header is written
+ * before the first one. The amount of output may be zero.
+ *
+ * You can pass NULL for `encrypted_message` in order to determine appropriate
+ * buffer length. In this case no input is consumed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the input has been consumed and the output length
+ * has been written into `encrypted_message_length`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `stream` is NULL or is not an encryption stream.
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL but `message_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed or the stream has been finished.
+ * Failed streams cannot be used anymore.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_stream_update(ecrypt_secure_cell_stream_t* stream,
+                                                              const uint8_t* message,
+                                                              size_t message_length,
+                                                              uint8_t* encrypted_message,
+                                                              size_t* encrypted_message_length);
+
+/**
+ * Finishes encryption of a sealed stream.
+ *
+ * @param [in]      stream                      stream state
+ * @param [out]     encrypted_message           output buffer for the last segment
+ * @param [in,out]  encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * Writes the last segment and the stream trailer into `encrypted_message`.
+ * Output size can be queried by passing NULL for `encrypted_message`,
+ * it never exceeds `segment_length` + 44 bytes.
+ *
+ * @returns ECRYPT_SUCCESS if the stream has been finished successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `stream` is NULL or is not an encryption stream.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed or the stream has been finished.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_stream_final(ecrypt_secure_cell_stream_t* stream,
+                                                             uint8_t* encrypted_message,
+                                                             size_t* encrypted_message_length);
+
+/**
+ * Starts decryption of a sealed stream.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ *
+ * Feed the encrypted stream with ecrypt_secure_cell_decrypt_seal_stream_update(),
+ * finish it with ecrypt_secure_cell_decrypt_seal_stream_final(), then free
+ * the state with ecrypt_secure_cell_seal_stream_destroy().
+ *
+ * @returns new stream state, or NULL if parameters are invalid
+ * or the state could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_stream_t* ecrypt_secure_cell_decrypt_seal_stream_create(const uint8_t* master_key,
+                                                                           size_t master_key_length,
+                                                                           const uint8_t* user_context,
+                                                                           size_t user_context_length);
+
+/**
+ * Decrypts next part of a sealed stream.
+ *
+ * @param [in]      stream                      stream state
+ * @param [in]      encrypted_message           next part of the encrypted stream, may be NULL
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes, may be zero
+ * @param [out]     plain_message               output buffer for decrypted segments
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * Input is buffered until a complete segment is available. Each segment is
+ * authenticated before it is written into `plain_message`. The amount
+ * of output may be zero.
+ *
+ * @warning Segments are authenticated individually. Only a successful call to
+ * ecrypt_secure_cell_decrypt_seal_stream_final() confirms that the stream
+ * has not been truncated.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case no input is consumed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the input has been consumed and the output length
+ * has been written into `plain_message_length`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `stream` is NULL or is not a decryption stream.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` is NULL but `encrypted_message_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, or corrupted stream. Failed streams cannot
+ * be used anymore.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_update(ecrypt_secure_cell_stream_t* stream,
+                                                              const uint8_t* encrypted_message,
+                                                              size_t encrypted_message_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length);
+
+/**
+ * Finishes decryption of a sealed stream.
+ *
+ * @param [in]      stream                      stream state
+ * @param [out]     plain_message               output buffer for the last segment
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * Decrypts the last segment and verifies that the stream is complete.
+ * Output size can be queried by passing NULL for `plain_message`,
+ * it never exceeds `segment_length`.
+ *
+ * @returns ECRYPT_SUCCESS if the whole stream has been decrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `stream` is NULL or is not a decryption stream.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed, or the stream is truncated.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_final(ecrypt_secure_cell_stream_t* stream,
+                                                             uint8_t* plain_message,
+                                                             size_t* plain_message_length);
+
+/**
+ * Destroys sealed stream state.
+ *
+ * @param [in]      stream                      stream state, may be NULL
+ *
+ * Key material and buffered data are wiped.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_stream_destroy(ecrypt_secure_cell_stream_t* stream);
+
+/**
+ * Decrypts a range of bytes from a complete sealed stream.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_stream            complete encrypted stream
+ * @param [in]      encrypted_stream_length     length of `encrypted_stream` in bytes
+ * @param [in]      offset                      plaintext offset of the range
+ * @param [in]      length                      plaintext length of the range
+ * @param [out]     plain_message               output buffer for decrypted range
+ * @param [in,out]  plain_message_length        length of `plain_message` in bytes
+ *
+ * Only the segments covering the requested range are read and authenticated,
+ * so `encrypted_stream` may be a memory-mapped file of any size.
+ *
+ * You can pass NULL for `plain_message` in order to determine appropriate
+ * buffer length. In this case no decryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the range has been decrypted successfully
+ * and written into `plain_message`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_message_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_stream` is NULL or `encrypted_stream_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `length` is zero or the range is outside of the stream.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_message_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, mismatched context data, or corrupted stream.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_range(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const uint8_t* encrypted_stream,
+                                                             size_t encrypted_stream_length,
+                                                             uint64_t offset,
+                                                             size_t length,
+                                                             uint8_t* plain_message,
+                                                             size_t* plain_message_length);
+
+/**
+ * Secure Cell log segment writer.
+ *
+ * @see ecrypt_secure_cell_log_writer_create
+ * @see ecrypt_secure_cell_log_writer_resume
+ */
+typedef struct ecrypt_secure_cell_log_writer_type ecrypt_secure_cell_log_writer_t;
+
+/**
+ * Secure Cell log segment reader.
+ *
+ * @see ecrypt_secure_cell_log_reader_create
+ */
+typedef struct ecrypt_secure_cell_log_reader_type ecrypt_secure_cell_log_reader_t;
+
+/**
+ * Starts a new append-only log segment.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      segment_id                  identifier of the segment, e.g., its sequence number
+ * @param [in]      tag_length                  length of record authentication tags in bytes,
+ *                                              from 8 to 16, zero selects the default (8)
+ *
+ * Log segments hold many small records encrypted with one segment key.
+ * The key is derived once from the master key, segment ID, and a random salt,
+ * so records do not pay for key derivation and auth tokens of sealed cells.
+ * Each record is prefixed with its length and followed by a truncated tag,
+ * record nonces are counters which prevent reordering and removal of records.
+ *
+ * Add records with ecrypt_secure_cell_log_append() and write the output
+ * to the end of the segment file. When the segment is complete, seal it with
+ * ecrypt_secure_cell_log_seal(). Free the writer with
+ * ecrypt_secure_cell_log_writer_destroy().
+ *
+ * @warning Shorter tags reduce per-record overhead, but an attacker has about
+ * 2^-(8 * `tag_length`) chance to forge any given record. Segment seal always
+ * uses full-length tag.
+ *
+ * Writer must not be used concurrently from multiple threads.
+ *
+ * @returns new segment writer, or NULL if parameters are invalid
+ * or the writer could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_log_writer_t* ecrypt_secure_cell_log_writer_create(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      uint64_t segment_id,
+                                                                      size_t tag_length);
+
+/**
+ * Continues appending to an existing log segment.
+ *
+ * @param [in]      master_key                  master key used for the segment
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      segment                     segment written so far
+ * @param [in]      segment_length              length of `segment` in bytes
+ *
+ * All records of the segment are authenticated in order to continue their
+ * numbering. The segment must end at a record boundary. Output of the returned
+ * writer does not include the segment header again.
+ *
+ * @returns segment writer, or NULL if parameters are invalid, the segment is
+ * corrupted or already sealed, or the writer could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_log_writer_t* ecrypt_secure_cell_log_writer_resume(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      const uint8_t* segment,
+                                                                      size_t segment_length);
+
+/**
+ * Appends a record to log segment.
+ *
+ * @param [in]      writer                      segment writer
+ * @param [in]      record                      record to append, may be NULL if `record_length` is zero
+ * @param [in]      record_length               length of `record` in bytes, up to 16 MB
+ * @param [out]     output                      output buffer for encrypted record
+ * @param [in,out]  output_length               length of `output` in bytes
+ *
+ * Encrypted record is `record_length` + 4 + `tag_length` bytes long.
+ * Output of the first call to a new writer is preceded by 32-byte segment
+ * header. Output should be appended to the segment as is.
+ *
+ * You can pass NULL for `output` in order to determine appropriate buffer
+ * length. In this case the record is not appended, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the record has been appended and the output
+ * length has been written into `output_length`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `writer` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `record` is NULL but `record_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `record_length` exceeds 16 MB.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed or the segment has been sealed.
+ * Failed writers cannot be used anymore.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_append(ecrypt_secure_cell_log_writer_t* writer,
+                                              const uint8_t* record,
+                                              size_t record_length,
+                                              uint8_t* output,
+                                              size_t* output_length);
+
+/**
+ * Seals log segment.
+ *
+ * @param [in]      writer                      segment writer
+ * @param [out]     output                      output buffer for the seal
+ * @param [in,out]  output_length               length of `output` in bytes
+ *
+ * Writes the seal which authenticates the number of records and their total
+ * length with a full-length tag. Sealed segments cannot be truncated
+ * or extended unnoticed, see ecrypt_secure_cell_log_verify().
+ * The seal is 36 bytes long (plus the header if no records have been written).
+ * Output size can be queried by passing NULL for `output`.
+ *
+ * @returns ECRYPT_SUCCESS if the segment has been sealed successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `writer` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed or the segment has been sealed.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_seal(ecrypt_secure_cell_log_writer_t* writer,
+                                            uint8_t* output,
+                                            size_t* output_length);
+
+/**
+ * Destroys log segment writer.
+ *
+ * @param [in]      writer                      segment writer, may be NULL
+ *
+ * Key material is wiped. Destroying a writer does not seal the segment.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_writer_destroy(ecrypt_secure_cell_log_writer_t* writer);
+
+/**
+ * Starts reading a log segment.
+ *
+ * @param [in]      master_key                  master key used for the segment
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      segment                     complete or partial segment
+ * @param [in]      segment_length              length of `segment` in bytes
+ *
+ * Segment data is not copied, it is read in place and must stay valid until
+ * the reader is destroyed, so `segment` may be a memory-mapped file.
+ * Segment key is derived once here.
+ *
+ * Iterate over records with ecrypt_secure_cell_log_reader_next(), confirm
+ * that the segment is sealed with ecrypt_secure_cell_log_reader_final(),
+ * then free the reader with ecrypt_secure_cell_log_reader_destroy().
+ *
+ * @returns new segment reader, or NULL if parameters are invalid, segment
+ * header is corrupted, or the reader could not be allocated.
+ */
+ECRYPT_API
+ecrypt_secure_cell_log_reader_t* ecrypt_secure_cell_log_reader_create(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      const uint8_t* segment,
+                                                                      size_t segment_length);
+
+/**
+ * Decrypts next record of log segment.
+ *
+ * @param [in]      reader                      segment reader
+ * @param [out]     record                      output buffer for decrypted record
+ * @param [in,out]  record_length               length of `record` in bytes
+ * @param [out]     end                         set to true when there are no more records
+ *
+ * Each record is authenticated and decrypted directly from the segment into
+ * `record`. When the seal or the end of segment data is reached, `end` is set
+ * and `record_length` is set to zero.
+ *
+ * @warning Records are authenticated individually. Only a successful call to
+ * ecrypt_secure_cell_log_reader_final() confirms that the segment has been
+ * sealed and has not been truncated.
+ *
+ * You can pass NULL for `record` in order to determine appropriate buffer
+ * length. In this case the reader does not advance, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the next record has been decrypted, or the end
+ * of the segment has been reached.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `record_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `reader` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `record_length` or `end` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for any reason, be it invalid
+ * key, corrupted or incomplete record, or data after the seal. Failed readers
+ * cannot be used anymore.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_reader_next(ecrypt_secure_cell_log_reader_t* reader,
+                                                   uint8_t* record,
+                                                   size_t* record_length,
+                                                   bool* end);
+
+/**
+ * Checks that log segment has been read completely.
+ *
+ * @param [in]      reader                      segment reader
+ *
+ * @returns ECRYPT_SUCCESS if all records have been read and the segment seal
+ * has been authenticated.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `reader` is NULL.
+ *
+ * @exception ECRYPT_FAIL if the reader has not reached a valid seal, e.g.,
+ * if the segment is still open or has been truncated.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_reader_final(const ecrypt_secure_cell_log_reader_t* reader);
+
+/**
+ * Destroys log segment reader.
+ *
+ * @param [in]      reader                      segment reader, may be NULL
+ *
+ * Key material is wiped. Segment data is not touched.
+ *
+ * @returns ECRYPT_SUCCESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_reader_destroy(ecrypt_secure_cell_log_reader_t* reader);
+
+/**
+ * Verifies a sealed log segment as a whole.
+ *
+ * @param [in]      master_key                  master key used for the segment
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      segment                     complete segment
+ * @param [in]      segment_length              length of `segment` in bytes
+ *
+ * Authenticates every record and the seal without returning any plaintext.
+ * Segment is read in place, it may be a memory-mapped file.
+ *
+ * @returns ECRYPT_SUCCESS if the segment is sealed and authentic.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `segment` is NULL or `segment_length` is zero.
+ *
+ * @exception ECRYPT_FAIL if the segment is corrupted, truncated, or not sealed.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_log_verify(const uint8_t* master_key,
+                                              size_t master_key_length,
+                                              const uint8_t* segment,
+                                              size_t segment_length);
+
+/**
+ * Record descriptor for Secure Cell batch processing.
+ *
+ * `input`, `input_length`, `user_context`, `user_context_length` are provided
+ * by the caller and describe one record, same as for single-record calls.
+ *
+ * `output_offset`, `output_length`, and `status` are filled in by the batch
+ * call: location of the record's output in the output arena and the result
+ * of processing this particular record.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_batch
+ * @see ecrypt_secure_cell_decrypt_seal_batch
+ * @see ecrypt_secure_cell_reseal_batch
+ */
+struct ecrypt_secure_cell_batch_item_type {
+    const uint8_t* input;
+    size_t input_length;
+    const uint8_t* user_context;
+    size_t user_context_length;
+    size_t output_offset;
+    size_t output_length;
+    ecrypt_status_t status;
+};
+typedef struct ecrypt_secure_cell_batch_item_type ecrypt_secure_cell_batch_item_t;
+
+/**
+ * Encrypts many independent records into sealed cells.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in,out]  items                       array of record descriptors
+ * @param [in]      item_count                  number of elements in `items`
+ * @param [out]     output                      output arena for all sealed cells
+ * @param [in,out]  output_length               length of `output` in bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Each record is encrypted exactly as ecrypt_secure_cell_encrypt_seal() would
+ * do it with the same master key. Sealed cells are placed in the `output`
+ * arena back to back, in the order of `items`. Location of each cell is
+ * written into `output_offset` and `output_length` of its descriptor.
+ *
+ * Records are distributed between worker threads, the calling thread is
+ * used as one of them. Small batches are processed in the calling thread.
+ *
+ * You can pass NULL for `output` in order to determine appropriate arena size.
+ * In this case no encryption is performed, the expected length is written
+ * into provided location, record offsets are filled in, and
+ * ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * Invalid records (e.g., with empty input) are not encrypted and have
+ * ECRYPT_INVALID_PARAMETER status, they take no space in the arena.
+ *
+ * @returns ECRYPT_SUCCESS if all records have been encrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `items` is NULL or `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if some records could not be encrypted,
+ * check `status` of the descriptors for details.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_batch(const uint8_t* master_key,
+                                                      size_t master_key_length,
+                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                      size_t item_count,
+                                                      uint8_t* output,
+                                                      size_t* output_length,
+                                                      size_t thread_count);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_seal_batch(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * Flags apply to all records, as with ecrypt_secure_cell_seal_ctx_set_flags().
+ *
+ * With ECRYPT_SCELL_FLAG_COMPRESS each record gets space for the longest
+ * cell it may produce, and `output_length` of its descriptor is updated
+ * with the actual cell length. Cells are not back to back in this case.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `flags` contain unknown or incompatible values.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_batch_ex(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         ecrypt_secure_cell_batch_item_t* items,
+                                                         size_t item_count,
+                                                         uint8_t* output,
+                                                         size_t* output_length,
+                                                         size_t thread_count,
+                                                         uint32_t flags);
+
+/**
+ * Decrypts many independent sealed cells.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in,out]  items                       array of record descriptors
+ * @param [in]      item_count                  number of elements in `items`
+ * @param [out]     output                      output arena for all decrypted messages
+ * @param [in,out]  output_length               length of `output` in bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Each record is decrypted exactly as ecrypt_secure_cell_decrypt_seal() would
+ * do it with the same master key. Decrypted messages are placed in the `output`
+ * arena back to back, in the order of `items`. Location of each message is
+ * written into `output_offset` and `output_length` of its descriptor.
+ *
+ * You can pass NULL for `output` in order to determine appropriate arena size.
+ * In this case no decryption is performed, the expected length is written
+ * into provided location, record offsets are filled in, and
+ * ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * Records which cannot be parsed take no space in the arena. Records which
+ * fail to decrypt have their part of the arena wiped.
+ *
+ * @returns ECRYPT_SUCCESS if all records have been decrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `items` is NULL or `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if some records could not be decrypted,
+ * check `status` of the descriptors for details.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_batch(const uint8_t* master_key,
+                                                      size_t master_key_length,
+                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                      size_t item_count,
+                                                      uint8_t* output,
+                                                      size_t* output_length,
+                                                      size_t thread_count);
+
+/**
+ * Re-encrypts many independent sealed cells with another master key.
+ *
+ * @param [in]      old_master_key              master key used for encryption
+ * @param [in]      old_master_key_length       length of `old_master_key` in bytes
+ * @param [in]      new_master_key              master key to encrypt with
+ * @param [in]      new_master_key_length       length of `new_master_key` in bytes
+ * @param [in,out]  items                       array of record descriptors
+ * @param [in]      item_count                  number of elements in `items`
+ * @param [out]     output                      output arena for all new sealed cells
+ * @param [in,out]  output_length               length of `output` in bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Each record is processed exactly as ecrypt_secure_cell_reseal() would
+ * do it with the same master keys. New sealed cells are placed in the
+ * `output` arena back to back, in the order of `items`, same as with
+ * ecrypt_secure_cell_encrypt_seal_batch().
+ *
+ * Records can be resealed in place: if the inputs are already laid out
+ * back to back in `output` (as produced by the encryption batch call with
+ * default settings) then each new cell overwrites exactly its old one.
+ *
+ * You can pass NULL for `output` in order to determine appropriate arena size.
+ * In this case no processing is performed, the expected length is written
+ * into provided location, record offsets are filled in, and
+ * ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * Records which cannot be parsed take no space in the arena.
+ *
+ * @returns ECRYPT_SUCCESS if all records have been re-encrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `old_master_key` or `new_master_key` is NULL or empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `items` is NULL or `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if some records could not be re-encrypted,
+ * check `status` of the descriptors for details.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_reseal_batch(const uint8_t* old_master_key,
+                                                size_t old_master_key_length,
+                                                const uint8_t* new_master_key,
+                                                size_t new_master_key_length,
+                                                ecrypt_secure_cell_batch_item_t* items,
+                                                size_t item_count,
+                                                uint8_t* output,
+                                                size_t* output_length,
+                                                size_t thread_count);
+
+/**
+ * Decrypts many independent sealed cells encrypted with a passphrase.
+ *
+ * @param [in]      passphrase                  passphrase used for encryption
+ * @param [in]      passphrase_length           length of `passphrase` in bytes
+ * @param [in,out]  items                       array of record descriptors
+ * @param [in]      item_count                  number of elements in `items`
+ * @param [out]     output                      output arena for all decrypted messages
+ * @param [in,out]  output_length               length of `output` in bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Each record is decrypted exactly as ecrypt_secure_cell_decrypt_seal_with_passphrase()
+ * would do it with the same passphrase. Output is laid out in the arena
+ * in the same way as with ecrypt_secure_cell_decrypt_seal_batch().
+ *
+ * Decryption time is dominated by PBKDF2 which has to be computed for each
+ * cell with its own salt. Here PBKDF2 of several cells is computed together
+ * with SIMD instructions when the CPU supports them, see
+ * ecconnect_pbkdf2_sha256_batch(). Groups of cells are distributed between
+ * worker threads.
+ *
+ * You can pass NULL for `output` in order to determine appropriate arena size.
+ * In this case no decryption is performed, the expected length is written
+ * into provided location, record offsets are filled in, and
+ * ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * Records which cannot be parsed take no space in the arena. Records which
+ * fail to decrypt have their part of the arena wiped.
+ *
+ * @returns ECRYPT_SUCCESS if all records have been decrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `output_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `passphrase` is NULL or `passphrase_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `items` is NULL or `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if some records could not be decrypted,
+ * check `status` of the descriptors for details.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase_batch(const uint8_t* passphrase,
+                                                                      size_t passphrase_length,
+                                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                                      size_t item_count,
+                                                                      uint8_t* output,
+                                                                      size_t* output_length,
+                                                                      size_t thread_count);
+
+/** @} */
+
+/**
+ * @defgroup ECRYPT_SECURE_CELL_TOKEN_PROTECT_MODE token protect mode
+ * @brief This API is designed for cases when underlying storage constraints do not allow the size
+ * of the data to grow (so Secure cell seal API described above cannot be used), however the user
+ * has access to a different storage location (ex. another table in the database) where he can store
+ * needed security parameters
+ * @{
+ */
+
+/**
+ * @brief encrypt
+ * @param [in] master_key master key
+ * @param [in] master_key_length length of master_key
+ * @param [in] user_context user defined context. May be set to NULL
  * @param [in] user_context_length length of user_context
  * @param [in] message message to encrypt
  * @param [in] message_length length of message
@@ -244,46 +2561,351 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase(const uint8_t* p
  * additional authentication info store
  */
 ECRYPT_API
-ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect(const uint8_t* master_key,
-                                                         size_t master_key_length,
-                                                         const uint8_t* user_context,
-                                                         size_t user_context_length,
-                                                         const uint8_t* message,
-                                                         size_t message_length,
-                                                         uint8_t* context,
-                                                         size_t* context_length,
-                                                         uint8_t* encrypted_message,
-                                                         size_t* encrypted_message_length);
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* message,
+                                                         size_t message_length,
+                                                         uint8_t* context,
+                                                         size_t* context_length,
+                                                         uint8_t* encrypted_message,
+                                                         size_t* encrypted_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_token_protect(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * ECRYPT_SCELL_FLAG_COMPRESS is not accepted since encrypted message
+ * always has the same length as the message in Token Protect mode.
+ * ECRYPT_SCELL_FLAG_KEY_ID is not accepted either, it applies only to
+ * keyed contexts.
+ *
+ * @see ECRYPT_SCELL_FLAG_MARK_KDF
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_ex(const uint8_t* master_key,
+                                                            size_t master_key_length,
+                                                            const uint8_t* user_context,
+                                                            size_t user_context_length,
+                                                            const uint8_t* message,
+                                                            size_t message_length,
+                                                            uint8_t* context,
+                                                            size_t* context_length,
+                                                            uint8_t* encrypted_message,
+                                                            size_t* encrypted_message_length,
+                                                            uint32_t flags);
+
+/**
+ * @brief decrypt
+ * @param [in] master_key master key
+ * @param [in] master_key_length length of master_key
+ * @param [in] user_context user defined context. May be set to NULL
+ * @param [in] user_context_length length of user_context
+ * @param [in] encrypted_message message to decrypt
+ * @param [in] encrypted_message_length length of encrypted_message
+ * @param [in] context additional authentication info
+ * @param [in] context_length length of additional authentication info
+ * @param [out] plain_message buffer for plain message store. May be set to NULL for plain message
+ * length determination
+ * @param [in, out] plain_message_length length of plain_message
+ * @return ECRYPT_SUCCESS on success or ECRYPT_FAIL on failure
+ * @note If plain_message==NULL or plain_message_length is not enough for plain message store then
+ * ECRYPT_BUFFER_TOO_SMALL will return and plain_message_length will store length of buffer needed
+ * for plain1 message store
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* encrypted_message,
+                                                         size_t encrypted_message_length,
+                                                         const uint8_t* context,
+                                                         size_t context_length,
+                                                         uint8_t* plain_message,
+                                                         size_t* plain_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_decrypt_token_protect(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * @see ECRYPT_SCELL_FLAG_STRICT
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_ex(const uint8_t* master_key,
+                                                            size_t master_key_length,
+                                                            const uint8_t* user_context,
+                                                            size_t user_context_length,
+                                                            const uint8_t* encrypted_message,
+                                                            size_t encrypted_message_length,
+                                                            const uint8_t* context,
+                                                            size_t context_length,
+                                                            uint8_t* plain_message,
+                                                            size_t* plain_message_length,
+                                                            uint32_t flags);
+
+/**
+ * Verifies integrity of a Token Protect cell without decrypting it.
+ *
+ * @param [in]      master_key                  symmetric key
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      user_context                associated context data, may be NULL
+ * @param [in]      user_context_length         length of `user_context` in bytes, may be zero
+ * @param [in]      encrypted_message           encrypted data to verify
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ * @param [in]      context                     authentication token
+ * @param [in]      context_length              length of `context` in bytes
+ *
+ * @returns ECRYPT_SUCCESS if the token matches the data.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `user_context` is NULL but `user_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message` or `context` is NULL or empty.
+ *
+ * @exception ECRYPT_FAIL if verification failed for any reason.
+ *
+ * @see ecrypt_secure_cell_verify_seal
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_verify_token_protect(const uint8_t* master_key,
+                                                        size_t master_key_length,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* encrypted_message,
+                                                        size_t encrypted_message_length,
+                                                        const uint8_t* context,
+                                                        size_t context_length);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_token_protect(), with fragmented
+ * message and encrypted message.
+ *
+ * @param [in]      message                     fragments of message to encrypt
+ * @param [in]      message_count               number of `message` fragments
+ * @param [out]     encrypted_message           fragments of output buffer for encrypted message
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     encrypted_message_length    length of encrypted message in bytes
+ *
+ * Authentication token in `context` is not fragmented. Other parameters
+ * are the same as for contiguous version.
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_iov(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const ecrypt_secure_cell_iovec_t* message,
+                                                             size_t message_count,
+                                                             uint8_t* context,
+                                                             size_t* context_length,
+                                                             const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                             size_t encrypted_message_count,
+                                                             size_t* encrypted_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_decrypt_token_protect(), with fragmented
+ * encrypted message and decrypted message.
+ *
+ * @param [in]      encrypted_message           fragments of message to decrypt
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     plain_message               fragments of output buffer for decrypted message
+ * @param [in]      plain_message_count         number of `plain_message` fragments
+ * @param [out]     plain_message_length        length of decrypted message in bytes
+ *
+ * Authentication token in `context` is not fragmented. Other parameters
+ * are the same as for contiguous version. Output is wiped if decryption fails.
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_iov(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                             size_t encrypted_message_count,
+                                                             const uint8_t* context,
+                                                             size_t context_length,
+                                                             const ecrypt_secure_cell_iovec_t* plain_message,
+                                                             size_t plain_message_count,
+                                                             size_t* plain_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_token_protect(), but the message
+ * is encrypted in place.
+ *
+ * @param [in,out]  message                     message to encrypt, receives encrypted data
+ * @param [in]      message_length              length of `message` in bytes
+ *
+ * Encrypted data has the same length as the message. Pass NULL `context`
+ * to learn the length of the auth token, no encryption is done then.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_in_place(const uint8_t* master_key,
+                                                                  size_t master_key_length,
+                                                                  const uint8_t* user_context,
+                                                                  size_t user_context_length,
+                                                                  uint8_t* message,
+                                                                  size_t message_length,
+                                                                  uint8_t* context,
+                                                                  size_t* context_length);
+
+/**
+ * Same as ecrypt_secure_cell_decrypt_token_protect(), but the message
+ * is decrypted in place.
+ *
+ * @param [in,out]  encrypted_message           data to decrypt, receives decrypted message
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ *
+ * The message is authenticated before it is decrypted. If decryption fails,
+ * `encrypted_message` is left intact.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_in_place(const uint8_t* master_key,
+                                                                  size_t master_key_length,
+                                                                  const uint8_t* user_context,
+                                                                  size_t user_context_length,
+                                                                  uint8_t* encrypted_message,
+                                                                  size_t encrypted_message_length,
+                                                                  const uint8_t* context,
+                                                                  size_t context_length);
 
 /**
- * @brief decrypt
- * @param [in] master_key master key
- * @param [in] master_key_length length of master_key
- * @param [in] user_context user defined context. May be set to NULL
- * @param [in] user_context_length length of user_context
- * @param [in] encrypted_message message to decrypt
- * @param [in] encrypted_message_length length of encrypted_message
- * @param [in] context additional authentication info
- * @param [in] context_length length of additional authentication info
- * @param [out] plain_message buffer for plain message store. May be set to NULL for plain message
- * length determination
- * @param [in, out] plain_message_length length of plain_message
- * @return ECRYPT_SUCCESS on success or ECRYPT_FAIL on failure
- * @note If plain_message==NULL or plain_message_length is not enough for plain message store then
- * ECRYPT_BUFFER_TOO_SMALL will return and plain_message_length will store length of buffer needed
- * for plain1 message store
+ * Alignment of token stride in columnar Token Protect.
+ *
+ * @see ecrypt_secure_cell_encrypt_token_protect_column
+ */
+#define ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT 16
+
+/**
+ * Determines token stride of columnar Token Protect.
+ *
+ * @param [out]     token_stride                distance between tokens in bytes
+ *
+ * The stride is the default token length rounded up to
+ * ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT bytes.
+ *
+ * @returns ECRYPT_SUCCESS if the stride has been written.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `token_stride` is NULL.
  */
 ECRYPT_API
-ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect(const uint8_t* master_key,
-                                                         size_t master_key_length,
-                                                         const uint8_t* user_context,
-                                                         size_t user_context_length,
-                                                         const uint8_t* encrypted_message,
-                                                         size_t encrypted_message_length,
-                                                         const uint8_t* context,
-                                                         size_t context_length,
-                                                         uint8_t* plain_message,
-                                                         size_t* plain_message_length);
+ecrypt_status_t ecrypt_secure_cell_token_protect_column_stride(size_t* token_stride);
+
+/**
+ * Encrypts a column of values in Token Protect mode.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      values                      arena with all values
+ * @param [in]      offsets                     `item_count + 1` offsets of values in `values`
+ * @param [in]      item_count                  number of values
+ * @param [in]      user_contexts               arena with associated context data, may be NULL
+ * @param [in]      user_context_offsets        `item_count + 1` offsets of contexts, may be NULL
+ * @param [out]     encrypted_values            output arena for encrypted values
+ * @param [out]     tokens                      output array of authentication tokens
+ * @param [in,out]  tokens_length               length of `tokens` in bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Value `i` occupies bytes from `offsets[i]` up to `offsets[i + 1]`, relative
+ * to `offsets[0]` which is the start of `values`. Each value is encrypted as
+ * ecrypt_secure_cell_encrypt_token_protect() would do it with the same master
+ * key. Encrypted value has the same length and is written at the same offset
+ * into `encrypted_values`, which may be the same buffer as `values`.
+ *
+ * Token of value `i` is written at `i * stride` bytes into `tokens`, where the
+ * stride is returned by ecrypt_secure_cell_token_protect_column_stride().
+ * Tokens are padded with zeros up to the stride. Allocate `tokens` aligned to
+ * ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT bytes for vectorized scanning.
+ *
+ * Associated context of value `i`, if any, is described in the same way by
+ * `user_context_offsets` and `user_contexts`. Pass NULL for both to encrypt
+ * without context. Then derived keys are shared by values of the same length.
+ *
+ * Key material and cipher contexts are prepared once per call and reused for
+ * all values. Values are processed in blocks distributed between threads.
+ *
+ * You can pass NULL for `tokens` in order to determine appropriate length.
+ * In this case no encryption is performed, the expected length is written
+ * into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if all values have been encrypted successfully.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of tokens
+ * has been written to `tokens_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `values`, `offsets`, or `encrypted_values` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if offsets decrease or some value is empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `tokens_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * @see ecrypt_secure_cell_decrypt_token_protect_column
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_column(const uint8_t* master_key,
+                                                                size_t master_key_length,
+                                                                const uint8_t* values,
+                                                                const size_t* offsets,
+                                                                size_t item_count,
+                                                                const uint8_t* user_contexts,
+                                                                const size_t* user_context_offsets,
+                                                                uint8_t* encrypted_values,
+                                                                uint8_t* tokens,
+                                                                size_t* tokens_length,
+                                                                size_t thread_count);
+
+/**
+ * Decrypts a column of values in Token Protect mode.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      encrypted_values            arena with all encrypted values
+ * @param [in]      offsets                     `item_count + 1` offsets of values in `encrypted_values`
+ * @param [in]      item_count                  number of values
+ * @param [in]      user_contexts               arena with associated context data, may be NULL
+ * @param [in]      user_context_offsets        `item_count + 1` offsets of contexts, may be NULL
+ * @param [in]      tokens                      array of authentication tokens
+ * @param [in]      tokens_length               length of `tokens` in bytes
+ * @param [out]     values                      output arena for decrypted values
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Reverses ecrypt_secure_cell_encrypt_token_protect_column(). Token stride is
+ * `tokens_length / item_count`. Decrypted values are written at the same
+ * offsets into `values`, which may be the same buffer as `encrypted_values`.
+ *
+ * @returns ECRYPT_SUCCESS if all values have been decrypted successfully.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_values`, `offsets`, or `values` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `item_count` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if offsets decrease or some value is empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `tokens` is NULL or `tokens_length` is not a multiple of `item_count`.
+ *
+ * @exception ECRYPT_FAIL if decryption of any value failed, be it invalid key,
+ * mismatched context data, or corrupted data. Then the whole `values` arena is wiped.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_column(const uint8_t* master_key,
+                                                                size_t master_key_length,
+                                                                const uint8_t* encrypted_values,
+                                                                const size_t* offsets,
+                                                                size_t item_count,
+                                                                const uint8_t* user_contexts,
+                                                                const size_t* user_context_offsets,
+                                                                const uint8_t* tokens,
+                                                                size_t tokens_length,
+                                                                uint8_t* values,
+                                                                size_t thread_count);
 
 /** @} */
 
@@ -346,6 +2968,636 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint(const uint8_t* master
                                                            uint8_t* plain_message,
                                                            size_t* plain_message_length);
 
+/**
+ * Same as ecrypt_secure_cell_decrypt_context_imprint(), with extra flags.
+ *
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ *
+ * @see ECRYPT_SCELL_FLAG_STRICT
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_ex(const uint8_t* master_key,
+                                                              size_t master_key_length,
+                                                              const uint8_t* encrypted_message,
+                                                              size_t encrypted_message_length,
+                                                              const uint8_t* context,
+                                                              size_t context_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length,
+                                                              uint32_t flags);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_context_imprint(), with fragmented
+ * message and encrypted message.
+ *
+ * @param [in]      message                     fragments of message to encrypt
+ * @param [in]      message_count               number of `message` fragments
+ * @param [out]     encrypted_message           fragments of output buffer for encrypted message
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     encrypted_message_length    length of encrypted message in bytes
+ *
+ * @see ecrypt_secure_cell_encrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_iov(const uint8_t* master_key,
+                                                               size_t master_key_length,
+                                                               const ecrypt_secure_cell_iovec_t* message,
+                                                               size_t message_count,
+                                                               const uint8_t* context,
+                                                               size_t context_length,
+                                                               const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                               size_t encrypted_message_count,
+                                                               size_t* encrypted_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_decrypt_context_imprint(), with fragmented
+ * encrypted message and decrypted message.
+ *
+ * @param [in]      encrypted_message           fragments of message to decrypt
+ * @param [in]      encrypted_message_count     number of `encrypted_message` fragments
+ * @param [out]     plain_message               fragments of output buffer for decrypted message
+ * @param [in]      plain_message_count         number of `plain_message` fragments
+ * @param [out]     plain_message_length        length of decrypted message in bytes
+ *
+ * @see ecrypt_secure_cell_decrypt_seal_iov
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_iov(const uint8_t* master_key,
+                                                               size_t master_key_length,
+                                                               const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                               size_t encrypted_message_count,
+                                                               const uint8_t* context,
+                                                               size_t context_length,
+                                                               const ecrypt_secure_cell_iovec_t* plain_message,
+                                                               size_t plain_message_count,
+                                                               size_t* plain_message_length);
+
+/**
+ * Same as ecrypt_secure_cell_encrypt_context_imprint(), but the message
+ * is encrypted in place.
+ *
+ * @param [in,out]  message                     message to encrypt, receives encrypted data
+ * @param [in]      message_length              length of `message` in bytes
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_in_place(const uint8_t* master_key,
+                                                                    size_t master_key_length,
+                                                                    uint8_t* message,
+                                                                    size_t message_length,
+                                                                    const uint8_t* context,
+                                                                    size_t context_length);
+
+/**
+ * Same as ecrypt_secure_cell_decrypt_context_imprint(), but the message
+ * is decrypted in place.
+ *
+ * @param [in,out]  encrypted_message           data to decrypt, receives decrypted message
+ * @param [in]      encrypted_message_length    length of `encrypted_message` in bytes
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_in_place(const uint8_t* master_key,
+                                                                    size_t master_key_length,
+                                                                    uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    const uint8_t* context,
+                                                                    size_t context_length);
+
+/**
+ * Encrypts a range of a message in context imprint mode.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      message_range               part of the message to encrypt
+ * @param [in]      message_range_length        length of `message_range` in bytes
+ * @param [in]      offset                      offset of the range in the message
+ * @param [in]      message_length              length of the whole message in bytes
+ * @param [in]      context                     associated context data, must not be empty
+ * @param [in]      context_length              length of `context` in bytes
+ * @param [out]     encrypted_range             output buffer for encrypted range
+ * @param [in,out]  encrypted_range_length      length of `encrypted_range` in bytes
+ *
+ * Output is exactly the bytes at `offset` of the output produced by
+ * ecrypt_secure_cell_encrypt_context_imprint() for the whole message.
+ * The CTR counter is advanced directly to the requested block, so only
+ * `message_range_length` bytes are processed. Use this to update a part of
+ * a large imprinted message in place.
+ *
+ * @warning Context imprint mode is deterministic. Re-encrypting a range
+ * with different data reuses the keystream, so anyone who has seen both
+ * the old and the new ciphertext learns XOR of the old and new data.
+ *
+ * You can pass NULL for `encrypted_range` in order to determine appropriate
+ * buffer length. In this case no encryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the range has been encrypted successfully
+ * and written into `encrypted_range`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `encrypted_range_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `message_range` is NULL or `message_range_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if the range does not fit into `message_length`.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL or `context_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_range_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_range(const uint8_t* master_key,
+                                                                 size_t master_key_length,
+                                                                 const uint8_t* message_range,
+                                                                 size_t message_range_length,
+                                                                 size_t offset,
+                                                                 size_t message_length,
+                                                                 const uint8_t* context,
+                                                                 size_t context_length,
+                                                                 uint8_t* encrypted_range,
+                                                                 size_t* encrypted_range_length);
+
+/**
+ * Decrypts a range of a message in context imprint mode.
+ *
+ * @param [in]      master_key                  master key used for encryption
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      encrypted_range             part of the encrypted message
+ * @param [in]      encrypted_range_length      length of `encrypted_range` in bytes
+ * @param [in]      offset                      offset of the range in the message
+ * @param [in]      message_length              length of the whole encrypted message in bytes
+ * @param [in]      context                     associated context data, must not be empty
+ * @param [in]      context_length              length of `context` in bytes
+ * @param [out]     plain_range                 output buffer for decrypted range
+ * @param [in,out]  plain_range_length          length of `plain_range` in bytes
+ *
+ * Output is exactly the bytes at `offset` of the output produced by
+ * ecrypt_secure_cell_decrypt_context_imprint() for the whole message,
+ * but only `encrypted_range_length` bytes are read and processed.
+ * Encryption key depends on the message length, so the length of the
+ * whole message must be provided.
+ *
+ * You can pass NULL for `plain_range` in order to determine appropriate
+ * buffer length. In this case no decryption is performed, the expected length
+ * is written into provided location and ECRYPT_BUFFER_TOO_SMALL is returned.
+ *
+ * @returns ECRYPT_SUCCESS if the range has been decrypted successfully
+ * and written into `plain_range`.
+ *
+ * @returns ECRYPT_BUFFER_TOO_SMALL if only the expected length of output data
+ * has been written to `plain_range_length`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_range` is NULL or `encrypted_range_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if the range does not fit into `message_length`.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL or `context_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_range_length` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_range(const uint8_t* master_key,
+                                                                 size_t master_key_length,
+                                                                 const uint8_t* encrypted_range,
+                                                                 size_t encrypted_range_length,
+                                                                 size_t offset,
+                                                                 size_t message_length,
+                                                                 const uint8_t* context,
+                                                                 size_t context_length,
+                                                                 uint8_t* plain_range,
+                                                                 size_t* plain_range_length);
+
+/**
+ * Maximum length of blind index tags.
+ *
+ * @see ecrypt_secure_cell_blind_index
+ */
+#define ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH 32
+
+/**
+ * Computes blind index tag of a value for encrypted equality lookups.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      column_context              context of the indexed column, may be NULL
+ * @param [in]      column_context_length       length of `column_context` in bytes, may be zero
+ * @param [in]      value                       value to index, may be NULL if empty
+ * @param [in]      value_length                length of `value` in bytes, may be zero
+ * @param [out]     tag                         output buffer for the tag
+ * @param [in]      tag_length                  length of the tag in bytes (1..32)
+ *
+ * The tag is a keyed hash (HMAC-SHA-256 based ecconnect KDF) of the value
+ * with a key derived from `master_key` and `column_context`. Equal values
+ * in the same column have equal tags, so tags can be stored next to Secure
+ * Cell encrypted values and used as keys of a hash index. Lookups compute
+ * the tag of the query value and never decrypt anything. Tags do not reveal
+ * values without the master key. The master key may be the one used to
+ * encrypt the column.
+ *
+ * Tags of different lengths are prefixes of each other, so an index may be
+ * truncated later without recomputing it. Short tags collide: index lookups
+ * must confirm matches by decrypting the candidate rows.
+ *
+ * @warning Blind index reveals which rows have equal values, and their
+ * frequencies. Use different `column_context` for each column so that
+ * equal values in different columns have unrelated tags.
+ *
+ * @returns ECRYPT_SUCCESS if the tag has been written into `tag`.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `column_context` is NULL but `column_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `value` is NULL but `value_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `tag` is NULL or `tag_length` is not in [1, 32] range.
+ *
+ * @exception ECRYPT_FAIL if computation failed for some reason.
+ *
+ * @see ecrypt_secure_cell_blind_index_batch
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_blind_index(const uint8_t* master_key,
+                                               size_t master_key_length,
+                                               const uint8_t* column_context,
+                                               size_t column_context_length,
+                                               const uint8_t* value,
+                                               size_t value_length,
+                                               uint8_t* tag,
+                                               size_t tag_length);
+
+/**
+ * Computes blind index tags of a column of values.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      column_context              context of the indexed column, may be NULL
+ * @param [in]      column_context_length       length of `column_context` in bytes, may be zero
+ * @param [in]      values                      arena with all values
+ * @param [in]      offsets                     `item_count + 1` offsets of values in `values`
+ * @param [in]      item_count                  number of values
+ * @param [out]     tags                        output array of `item_count` tags
+ * @param [in]      tag_length                  length of each tag in bytes (1..32)
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Value `i` occupies bytes from `offsets[i]` up to `offsets[i + 1]`, relative
+ * to `offsets[0]` which is the start of `values`. Empty values are allowed.
+ * Its tag is written at `i * tag_length` bytes into `tags` and is the same as
+ * computed by ecrypt_secure_cell_blind_index(). The column key is derived only
+ * once per call.
+ *
+ * @returns ECRYPT_SUCCESS if all tags have been computed.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `column_context` is NULL but `column_context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `offsets` is NULL, `item_count` is zero, or offsets decrease.
+ * @exception ECRYPT_INVALID_PARAMETER if `values` is NULL but some value is not empty.
+ * @exception ECRYPT_INVALID_PARAMETER if `tags` is NULL or `tag_length` is not in [1, 32] range.
+ *
+ * @exception ECRYPT_FAIL if computation failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_blind_index_batch(const uint8_t* master_key,
+                                                     size_t master_key_length,
+                                                     const uint8_t* column_context,
+                                                     size_t column_context_length,
+                                                     const uint8_t* values,
+                                                     const size_t* offsets,
+                                                     size_t item_count,
+                                                     uint8_t* tags,
+                                                     size_t tag_length,
+                                                     size_t thread_count);
+
+/**
+ * Minimum length of a sector in bytes.
+ *
+ * @see ecrypt_secure_cell_encrypt_sector
+ */
+#define ECRYPT_SCELL_SECTOR_MIN_LENGTH 16
+
+/**
+ * Maximum length of a sector in bytes (16 MiB).
+ *
+ * @see ecrypt_secure_cell_encrypt_sector
+ */
+#define ECRYPT_SCELL_SECTOR_MAX_LENGTH (16 * 1024 * 1024)
+
+/**
+ * Encrypts a fixed-size sector of block storage.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      context                     context of the storage, may be NULL
+ * @param [in]      context_length              length of `context` in bytes, may be zero
+ * @param [in]      sector_number               number of the sector in the storage
+ * @param [in]      plain_sector                sector to encrypt
+ * @param [in]      sector_length               length of the sector in bytes
+ * @param [out]     encrypted_sector            output buffer of `sector_length` bytes
+ *
+ * Sector mode uses AES-256-XTS with a key derived from `master_key` and
+ * `context`, and with `sector_number` as the tweak. Encrypted sector has
+ * exactly the same length as the plaintext and there is no header, so pages
+ * of a file or a block device can be encrypted in place and accessed at
+ * random. `encrypted_sector` may be the same buffer as `plain_sector`.
+ *
+ * @warning Sector mode provides no integrity protection. Tampered sectors
+ * decrypt to garbage without any error. Rewriting a sector with new data
+ * reveals which 16-byte blocks of it have changed. Use different `context`
+ * for different storages which share a master key.
+ *
+ * @returns ECRYPT_SUCCESS if the sector has been encrypted.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL but `context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_length` is not in [16 bytes, 16 MiB] range.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_sector` or `encrypted_sector` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ *
+ * @see ecrypt_secure_cell_encrypt_sectors
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_sector(const uint8_t* master_key,
+                                                  size_t master_key_length,
+                                                  const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint64_t sector_number,
+                                                  const uint8_t* plain_sector,
+                                                  size_t sector_length,
+                                                  uint8_t* encrypted_sector);
+
+/**
+ * Decrypts a fixed-size sector of block storage.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      context                     context of the storage, may be NULL
+ * @param [in]      context_length              length of `context` in bytes, may be zero
+ * @param [in]      sector_number               number of the sector in the storage
+ * @param [in]      encrypted_sector            sector to decrypt
+ * @param [in]      sector_length               length of the sector in bytes
+ * @param [out]     plain_sector                output buffer of `sector_length` bytes
+ *
+ * `master_key`, `context`, and `sector_number` must be the same as used for
+ * encryption. `plain_sector` may be the same buffer as `encrypted_sector`.
+ *
+ * @returns ECRYPT_SUCCESS if the sector has been decrypted.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL but `context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_length` is not in [16 bytes, 16 MiB] range.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_sector` or `plain_sector` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_sector(const uint8_t* master_key,
+                                                  size_t master_key_length,
+                                                  const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint64_t sector_number,
+                                                  const uint8_t* encrypted_sector,
+                                                  size_t sector_length,
+                                                  uint8_t* plain_sector);
+
+/**
+ * Encrypts a run of consecutive sectors.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      context                     context of the storage, may be NULL
+ * @param [in]      context_length              length of `context` in bytes, may be zero
+ * @param [in]      first_sector_number         number of the first sector in the run
+ * @param [in]      plain_sectors               `sector_count` sectors to encrypt
+ * @param [in]      sector_length               length of each sector in bytes
+ * @param [in]      sector_count                number of sectors
+ * @param [out]     encrypted_sectors           output buffer of `sector_count * sector_length` bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Sector `i` of the run is encrypted exactly like ecrypt_secure_cell_encrypt_sector()
+ * does with `first_sector_number + i`. The key is derived and the cipher is set up
+ * only once per call (per thread), so this is much faster than a loop for small
+ * sectors. `encrypted_sectors` may be the same buffer as `plain_sectors`.
+ *
+ * @returns ECRYPT_SUCCESS if all sectors have been encrypted.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL but `context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_length` is not in [16 bytes, 16 MiB] range.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_count` is zero or sector numbers overflow.
+ * @exception ECRYPT_INVALID_PARAMETER if `plain_sectors` or `encrypted_sectors` is NULL.
+ *
+ * @exception ECRYPT_FAIL if encryption failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_encrypt_sectors(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* context,
+                                                   size_t context_length,
+                                                   uint64_t first_sector_number,
+                                                   const uint8_t* plain_sectors,
+                                                   size_t sector_length,
+                                                   size_t sector_count,
+                                                   uint8_t* encrypted_sectors,
+                                                   size_t thread_count);
+
+/**
+ * Decrypts a run of consecutive sectors.
+ *
+ * @param [in]      master_key                  master key to use for security
+ * @param [in]      master_key_length           length of `master_key` in bytes
+ * @param [in]      context                     context of the storage, may be NULL
+ * @param [in]      context_length              length of `context` in bytes, may be zero
+ * @param [in]      first_sector_number         number of the first sector in the run
+ * @param [in]      encrypted_sectors           `sector_count` sectors to decrypt
+ * @param [in]      sector_length               length of each sector in bytes
+ * @param [in]      sector_count                number of sectors
+ * @param [out]     plain_sectors               output buffer of `sector_count * sector_length` bytes
+ * @param [in]      thread_count                maximum number of threads to use,
+ *                                              zero selects one per online CPU
+ *
+ * Sector `i` of the run is decrypted exactly like ecrypt_secure_cell_decrypt_sector()
+ * does with `first_sector_number + i`. `plain_sectors` may be the same buffer
+ * as `encrypted_sectors`.
+ *
+ * @returns ECRYPT_SUCCESS if all sectors have been decrypted.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `master_key` is NULL or `master_key_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `context` is NULL but `context_length` is not zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_length` is not in [16 bytes, 16 MiB] range.
+ * @exception ECRYPT_INVALID_PARAMETER if `sector_count` is zero or sector numbers overflow.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_sectors` or `plain_sectors` is NULL.
+ *
+ * @exception ECRYPT_FAIL if decryption failed for some reason.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_decrypt_sectors(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* context,
+                                                   size_t context_length,
+                                                   uint64_t first_sector_number,
+                                                   const uint8_t* encrypted_sectors,
+                                                   size_t sector_length,
+                                                   size_t sector_count,
+                                                   uint8_t* plain_sectors,
+                                                   size_t thread_count);
+
+/**
+ * Computes length of a sealed cell without encrypting anything.
+ *
+ * @param [in]      message_length              length of the message in bytes
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ * @param [out]     output_length               length of the sealed cell in bytes
+ *
+ * Result is exactly the length produced by ecrypt_secure_cell_encrypt_seal_ex()
+ * and other master key Seal mode functions with the same flags, or by
+ * ecrypt_secure_cell_encrypt_seal_with_ctx() with a context using them.
+ * ECRYPT_SCELL_FLAG_KEY_ID is accepted here for contexts and key rings,
+ * one-shot functions reject it. With ECRYPT_SCELL_FLAG_COMPRESS this is
+ * the maximum length, actual cells are usually shorter.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `flags` combine ECRYPT_SCELL_FLAG_COMPRESS
+ * with ECRYPT_SCELL_FLAG_COMPACT.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_output_size(size_t message_length,
+                                                    uint32_t flags,
+                                                    size_t* output_length);
+
+/**
+ * Computes length of a cell sealed with a passphrase without encrypting anything.
+ *
+ * @param [in]      message_length              length of the message in bytes
+ * @param [out]     output_length               length of the sealed cell in bytes
+ *
+ * Result is exactly the length produced by
+ * ecrypt_secure_cell_encrypt_seal_with_passphrase().
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_seal_passphrase_output_size(size_t message_length,
+                                                               size_t* output_length);
+
+/**
+ * Computes length of Token Protect output without encrypting anything.
+ *
+ * @param [in]      message_length              length of the message in bytes
+ * @param [in]      flags                       combination of ECRYPT_SCELL_FLAG_* values
+ * @param [out]     token_length                length of the authentication token in bytes
+ *
+ * Encrypted message always has the same length as the message.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `token_length` is NULL.
+ * @exception ECRYPT_INVALID_PARAMETER if `flags` contain ECRYPT_SCELL_FLAG_COMPRESS.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_token_protect_output_size(size_t message_length,
+                                                             uint32_t flags,
+                                                             size_t* token_length);
+
+/**
+ * Computes length of Context Imprint output without encrypting anything.
+ *
+ * @param [in]      message_length              length of the message in bytes
+ * @param [out]     output_length               length of the encrypted message in bytes
+ *
+ * Context Imprint mode does not change the length of data.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `output_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_context_imprint_output_size(size_t message_length,
+                                                               size_t* output_length);
+
+/**
+ * Cipher used by a Secure Cell.
+ */
+typedef enum ecrypt_secure_cell_cipher {
+    /** AES in GCM mode. */
+    ECRYPT_SCELL_CIPHER_AES_GCM = 1,
+    /** ChaCha20-Poly1305. */
+    ECRYPT_SCELL_CIPHER_CHACHA20_POLY1305 = 2,
+} ecrypt_secure_cell_cipher_t;
+
+/**
+ * Key derivation function used by a Secure Cell.
+ */
+typedef enum ecrypt_secure_cell_kdf {
+    /** Cell is encrypted with a master key. */
+    ECRYPT_SCELL_KDF_MASTER_KEY = 1,
+    /** Cell is encrypted with a passphrase, key is derived with PBKDF2 HMAC-SHA-256. */
+    ECRYPT_SCELL_KDF_PBKDF2_HMAC_SHA256 = 2,
+} ecrypt_secure_cell_kdf_t;
+
+/**
+ * Secure Cell parameters stored in its header.
+ *
+ * @see ecrypt_secure_cell_inspect
+ */
+struct ecrypt_secure_cell_info_type {
+    /** Cipher used for encryption. */
+    ecrypt_secure_cell_cipher_t cipher;
+    /** Length of encryption key in bits. */
+    size_t key_bits;
+    /** Key derivation function. */
+    ecrypt_secure_cell_kdf_t kdf;
+    /** PBKDF2 iteration count, zero for master key cells. */
+    uint32_t pbkdf2_iterations;
+    /** Whether the cell carries key ID. */
+    bool has_key_id;
+    /** Key ID, if present. */
+    uint32_t key_id;
+    /** Whether the cell uses compact encoding. */
+    bool compact;
+    /** Whether the message is compressed, see ECRYPT_SCELL_FLAG_COMPRESS. */
+    bool compressed;
+    /** Length of the header (authentication token) in bytes. */
+    size_t auth_token_length;
+    /**
+     * Length of the plaintext in bytes. For compressed cells this is
+     * the length after decompression, encrypted data is shorter.
+     */
+    size_t message_length;
+};
+typedef struct ecrypt_secure_cell_info_type ecrypt_secure_cell_info_t;
+
+/**
+ * Parses the header of a Secure Cell without decrypting it.
+ *
+ * @param [in]      data                        sealed cell or authentication token
+ * @param [in]      data_length                 length of `data` in bytes
+ * @param [out]     info                        receives cell parameters
+ *
+ * Accepts cells produced in Seal mode and authentication tokens produced
+ * in Token Protect mode, with master keys and passphrases alike. No keys
+ * are derived, so this is cheap even for passphrase cells.
+ *
+ * Parameters are not authenticated until the cell is decrypted.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `data` is NULL or `data_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `info` is NULL.
+ *
+ * @exception ECRYPT_FAIL if `data` does not contain a valid header.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_cell_inspect(const uint8_t* data,
+                                           size_t data_length,
+                                           ecrypt_secure_cell_info_t* info);
+
 /** @} */
 /** @} */
 /** @} */
@@ -24,6 +24,7 @@
 
 #include <ecrypt/ecrypt_api.h>
 #include <ecrypt/ecrypt_error.h>
+#include <ecrypt/secure_cell.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -191,6 +192,108 @@ ecrypt_status_t ecrypt_secure_message_unwrap(const uint8_t* private_key,
                                              size_t wrapped_message_length,
                                              uint8_t* message,
                                              size_t* message_length);
+
+/**
+ * Computes length of an encrypted message without doing any cryptography.
+ *
+ * @param [in]      public_key                  peer public key
+ * @param [in]      public_key_length           length of `public_key` in bytes
+ * @param [in]      message_length              length of the message in bytes
+ * @param [out]     encrypted_message_length    length of the encrypted message in bytes
+ *
+ * Result is exactly the length produced by ecrypt_secure_message_encrypt()
+ * for a message of given length. Only the key type and size are used,
+ * the key itself is not parsed or validated.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `public_key` is not an EC or RSA key.
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero or too big.
+ * @exception ECRYPT_INVALID_PARAMETER if `encrypted_message_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_message_encrypt_output_size(const uint8_t* public_key,
+                                                          size_t public_key_length,
+                                                          size_t message_length,
+                                                          size_t* encrypted_message_length);
+
+/**
+ * Computes length of a signed message without doing any cryptography.
+ *
+ * @param [in]      private_key                 private key
+ * @param [in]      private_key_length          length of `private_key` in bytes
+ * @param [in]      message_length              length of the message in bytes
+ * @param [out]     signed_message_length       length of the signed message in bytes
+ *
+ * For RSA keys the result is exact. ECDSA signatures vary in length,
+ * so for EC keys the result is the maximum length, same as
+ * ecrypt_secure_message_sign() reports when asked for buffer size.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `private_key` is not an EC or RSA key.
+ * @exception ECRYPT_INVALID_PARAMETER if `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `signed_message_length` is NULL.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_message_sign_output_size(const uint8_t* private_key,
+                                                       size_t private_key_length,
+                                                       size_t message_length,
+                                                       size_t* signed_message_length);
+
+/**
+ * Kind of a Secure Message.
+ */
+typedef enum ecrypt_secure_message_kind {
+    /** Message signed with EC key. */
+    ECRYPT_SECURE_MESSAGE_KIND_EC_SIGNED = 1,
+    /** Message signed with RSA key. */
+    ECRYPT_SECURE_MESSAGE_KIND_RSA_SIGNED = 2,
+    /** Message encrypted with EC keys. */
+    ECRYPT_SECURE_MESSAGE_KIND_EC_ENCRYPTED = 3,
+    /** Message encrypted with RSA key. */
+    ECRYPT_SECURE_MESSAGE_KIND_RSA_ENCRYPTED = 4,
+} ecrypt_secure_message_kind_t;
+
+/**
+ * Secure Message parameters stored in its header.
+ *
+ * @see ecrypt_secure_message_inspect
+ */
+struct ecrypt_secure_message_info_type {
+    /** Kind of the message. */
+    ecrypt_secure_message_kind_t kind;
+    /** Length of the original message in bytes. */
+    size_t message_length;
+    /** Length of the signature in bytes, zero for encrypted messages. */
+    size_t signature_length;
+    /** Parameters of the embedded Secure Cell, only for encrypted messages. */
+    ecrypt_secure_cell_info_t cell;
+};
+typedef struct ecrypt_secure_message_info_type ecrypt_secure_message_info_t;
+
+/**
+ * Parses the header of a Secure Message without decrypting or verifying it.
+ *
+ * @param [in]      message                     signed or encrypted message
+ * @param [in]      message_length              length of `message` in bytes
+ * @param [out]     info                        receives message parameters
+ *
+ * No keys are needed and no cryptography is performed. Parameters are not
+ * authenticated until the message is decrypted or verified.
+ *
+ * @returns ECRYPT_SUCCESS on success.
+ *
+ * @exception ECRYPT_INVALID_PARAMETER if `message` is NULL or `message_length` is zero.
+ * @exception ECRYPT_INVALID_PARAMETER if `info` is NULL.
+ *
+ * @exception ECRYPT_FAIL if `message` does not contain a valid header.
+ */
+ECRYPT_API
+ecrypt_status_t ecrypt_secure_message_inspect(const uint8_t* message,
+                                              size_t message_length,
+                                              ecrypt_secure_message_info_t* info);
+
 /** @} */
 /** @} */
 
@@ -118,6 +118,14 @@ ecrypt_status_t secure_session_unwrap(secure_session_t* session_ctx,
                                       void* message,
                                       size_t* message_length);
 
+/**
+ * Computes length of a message wrapped by secure_session_wrap().
+ *
+ * Wrapping overhead is constant, so no session is needed.
+ */
+ECRYPT_API
+ecrypt_status_t secure_session_wrap_output_size(size_t message_length, size_t* wrapped_message_length);
+
 /* Trying to mimic socket functions */
 ECRYPT_API
 ssize_t secure_session_send(secure_session_t* session_ctx, const void* message, size_t message_length);
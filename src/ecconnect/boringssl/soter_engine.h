@@ -17,9 +17,12 @@
 #ifndef ECCONNECT_BORINGSSL_ENGINE_H
 #define ECCONNECT_BORINGSSL_ENGINE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <openssl/evp.h>
+#include <openssl/poly1305.h>
+#include <openssl/sha.h>
 
 #include "ecconnect/ecconnect_asym_sign.h"
 
@@ -27,9 +30,37 @@ struct ecconnect_hash_ctx_type {
     EVP_MD_CTX evp_md_ctx;
 };
 
+/* HMAC-SHA-256 states with key pads already absorbed */
+struct ecconnect_kdf_ctx_type {
+    SHA256_CTX inner;
+    SHA256_CTX outer;
+};
+
+/* Hash state reused by ecconnect_kdf_ctx_derive_with_state() */
+struct ecconnect_kdf_state_type {
+    SHA256_CTX hash;
+};
+
+/*
+ * BoringSSL has ChaCha20-Poly1305 only as one-shot EVP_AEAD, while ecconnect
+ * AEAD interface is incremental, so RFC 8439 is assembled from primitives.
+ */
+struct ecconnect_chacha20_poly1305_ctx {
+    uint8_t key[32];
+    uint8_t nonce[12];
+    uint32_t counter;
+    uint8_t keystream[64];
+    size_t keystream_used;
+    poly1305_state poly1305;
+    uint64_t aad_length;
+    uint64_t data_length;
+    bool aad_done;
+};
+
 struct ecconnect_sym_ctx_type {
     uint32_t alg;
     EVP_CIPHER_CTX evp_sym_ctx;
+    struct ecconnect_chacha20_poly1305_ctx chacha20_poly1305;
 };
 
 struct ecconnect_asym_cipher_type {
@@ -17,8 +17,13 @@
 #include "ecconnect/ecconnect_kdf.h"
 
 #include <limits.h>
+#include <string.h>
 
 #include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "ecconnect/boringssl/ecconnect_engine.h"
+#include "ecconnect/ecconnect_wipe.h"
 
 ecconnect_status_t ecconnect_pbkdf2_sha256(const uint8_t* passphrase,
                                    size_t passphrase_length,
@@ -51,3 +56,158 @@ ecconnect_status_t ecconnect_pbkdf2_sha256(const uint8_t* passphrase,
 
     return (res == 1) ? ECCONNECT_SUCCESS : ECCONNECT_FAIL;
 }
+
+ecconnect_kdf_ctx_t* ecconnect_kdf_ctx_create(const void* key, size_t key_length)
+{
+    ecconnect_kdf_ctx_t* ctx = NULL;
+    uint8_t key_pad[SHA256_CBLOCK] = {0};
+    size_t i;
+
+    ECCONNECT_CHECK_PARAM_(key != NULL);
+    ECCONNECT_CHECK_PARAM_(key_length != 0);
+
+    ctx = calloc(1, sizeof(*ctx));
+    ECCONNECT_CHECK_MALLOC_(ctx);
+
+    /* Long keys are hashed first, short ones are padded with zeros (RFC 2104) */
+    if (key_length > sizeof(key_pad)) {
+        SHA256(key, key_length, key_pad);
+    } else {
+        memcpy(key_pad, key, key_length);
+    }
+
+    for (i = 0; i < sizeof(key_pad); i++) {
+        key_pad[i] ^= 0x36;
+    }
+    if (!SHA256_Init(&ctx->inner) || !SHA256_Update(&ctx->inner, key_pad, sizeof(key_pad))) {
+        goto err;
+    }
+
+    for (i = 0; i < sizeof(key_pad); i++) {
+        key_pad[i] ^= 0x36 ^ 0x5c;
+    }
+    if (!SHA256_Init(&ctx->outer) || !SHA256_Update(&ctx->outer, key_pad, sizeof(key_pad))) {
+        goto err;
+    }
+
+    ecconnect_wipe(key_pad, sizeof(key_pad));
+    return ctx;
+
+err:
+    ecconnect_wipe(key_pad, sizeof(key_pad));
+    ecconnect_kdf_ctx_destroy(ctx);
+    return NULL;
+}
+
+static ecconnect_status_t ecconnect_kdf_ctx_derive_(const ecconnect_kdf_ctx_t* ctx,
+                                                   SHA256_CTX* hash,
+                                                   const char* label,
+                                                   const ecconnect_kdf_context_buf_t* context,
+                                                   size_t context_count,
+                                                   void* output,
+                                                   size_t output_length)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    uint8_t out[SHA256_DIGEST_LENGTH] = {0, 0, 0, 1};
+    size_t i;
+
+    ECCONNECT_CHECK_PARAM(label != NULL);
+    ECCONNECT_CHECK_PARAM(output != NULL);
+    ECCONNECT_CHECK_PARAM(output_length != 0);
+    ECCONNECT_CHECK_PARAM(output_length <= sizeof(out));
+    if (context_count > 0) {
+        ECCONNECT_CHECK_PARAM(context != NULL);
+    }
+
+    /*
+     * Copies keep the shared context intact for concurrent users.
+     * Same layout as ecconnect_kdf(): counter, label, 0x00, context.
+     */
+    memcpy(hash, &ctx->inner, sizeof(*hash));
+    if (!SHA256_Update(hash, out, 4) || !SHA256_Update(hash, label, strlen(label))
+        || !SHA256_Update(hash, out, 1)) {
+        goto err;
+    }
+    for (i = 0; i < context_count; i++) {
+        if (context[i].data) {
+            if (!SHA256_Update(hash, context[i].data, context[i].length)) {
+                goto err;
+            }
+        }
+    }
+    if (!SHA256_Final(out, hash)) {
+        goto err;
+    }
+
+    memcpy(hash, &ctx->outer, sizeof(*hash));
+    if (!SHA256_Update(hash, out, sizeof(out)) || !SHA256_Final(out, hash)) {
+        goto err;
+    }
+
+    memcpy(output, out, output_length);
+    res = ECCONNECT_SUCCESS;
+
+err:
+    ecconnect_wipe(hash, sizeof(*hash));
+    ecconnect_wipe(out, sizeof(out));
+
+    if (res != ECCONNECT_SUCCESS) {
+        ecconnect_wipe(output, output_length);
+    }
+
+    return res;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_derive(const ecconnect_kdf_ctx_t* ctx,
+                                            const char* label,
+                                            const ecconnect_kdf_context_buf_t* context,
+                                            size_t context_count,
+                                            void* output,
+                                            size_t output_length)
+{
+    /* Stack state is as cheap as it gets with BoringSSL */
+    SHA256_CTX hash;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+
+    return ecconnect_kdf_ctx_derive_(ctx, &hash, label, context, context_count, output, output_length);
+}
+
+ecconnect_kdf_state_t* ecconnect_kdf_state_create(void)
+{
+    ecconnect_kdf_state_t* state = calloc(1, sizeof(*state));
+    ECCONNECT_CHECK_MALLOC_(state);
+    return state;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_derive_with_state(const ecconnect_kdf_ctx_t* ctx,
+                                                       ecconnect_kdf_state_t* state,
+                                                       const char* label,
+                                                       const ecconnect_kdf_context_buf_t* context,
+                                                       size_t context_count,
+                                                       void* output,
+                                                       size_t output_length)
+{
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(state != NULL);
+
+    return ecconnect_kdf_ctx_derive_(ctx, &state->hash, label, context, context_count, output, output_length);
+}
+
+ecconnect_status_t ecconnect_kdf_state_destroy(ecconnect_kdf_state_t* state)
+{
+    if (state) {
+        ecconnect_wipe(state, sizeof(*state));
+        free(state);
+    }
+    return ECCONNECT_SUCCESS;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_destroy(ecconnect_kdf_ctx_t* ctx)
+{
+    if (ctx) {
+        ecconnect_wipe(ctx, sizeof(*ctx));
+        free(ctx);
+    }
+    return ECCONNECT_SUCCESS;
+}
@@ -16,16 +16,23 @@
 
 #include "ecconnect/ecconnect_sym.h"
 
+#include <limits.h>
 #include <string.h>
 
+#include <openssl/chacha.h>
 #include <openssl/cipher.h>
 #include <openssl/err.h>
+#include <openssl/mem.h>
 
 #include "ecconnect/boringssl/ecconnect_engine.h"
+#include "ecconnect/ecconnect_gcm.h"
+#include "ecconnect/ecconnect_wipe.h"
 
 #define ECCONNECT_SYM_MAX_KEY_LENGTH 128
 #define ECCONNECT_SYM_MAX_IV_LENGTH 16
 #define ECCONNECT_AES_GCM_AUTH_TAG_LENGTH 16
+#define ECCONNECT_CHACHA20_BLOCK_LENGTH 64
+#define ECCONNECT_CHACHA20_NONCE_LENGTH 12
 
 ecconnect_status_t ecconnect_pbkdf2(const uint8_t* password,
                             const size_t password_length,
@@ -120,6 +127,168 @@ const EVP_CIPHER* algid_to_evp_aead(uint32_t alg)
     return NULL;
 }
 
+/* Block cipher of AES-GCM, for computing the hash subkey */
+static const EVP_CIPHER* algid_to_evp_gcm_block(uint32_t alg)
+{
+    switch (alg & (ECCONNECT_SYM_ALG_MASK | ECCONNECT_SYM_PADDING_MASK | ECCONNECT_SYM_KEY_LENGTH_MASK)) {
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_256_KEY_LENGTH:
+        return EVP_aes_256_ecb();
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_192_KEY_LENGTH:
+        return EVP_aes_192_ecb();
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_128_KEY_LENGTH:
+        return EVP_aes_128_ecb();
+    }
+    return NULL;
+}
+
+static bool algid_is_chacha20_poly1305(uint32_t alg)
+{
+    return (alg & (ECCONNECT_SYM_ALG_MASK | ECCONNECT_SYM_PADDING_MASK | ECCONNECT_SYM_KEY_LENGTH_MASK))
+           == (ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_256_KEY_LENGTH);
+}
+
+static void chacha20_poly1305_init(struct ecconnect_chacha20_poly1305_ctx* ctx,
+                                   const uint8_t* key,
+                                   const uint8_t* nonce)
+{
+    uint8_t poly1305_key[32] = {0};
+
+    memcpy(ctx->key, key, sizeof(ctx->key));
+    memcpy(ctx->nonce, nonce, sizeof(ctx->nonce));
+    /* One-time Poly1305 key is the first half of block 0, data starts at block 1 */
+    CRYPTO_chacha_20(poly1305_key, poly1305_key, sizeof(poly1305_key), ctx->key, ctx->nonce, 0);
+    CRYPTO_poly1305_init(&ctx->poly1305, poly1305_key);
+    ecconnect_wipe(poly1305_key, sizeof(poly1305_key));
+
+    ctx->counter = 1;
+    ctx->keystream_used = sizeof(ctx->keystream);
+    ctx->aad_length = 0;
+    ctx->data_length = 0;
+    ctx->aad_done = false;
+}
+
+static void chacha20_poly1305_pad16(struct ecconnect_chacha20_poly1305_ctx* ctx, uint64_t length)
+{
+    static const uint8_t zeros[16] = {0};
+
+    if (length % 16 != 0) {
+        CRYPTO_poly1305_update(&ctx->poly1305, zeros, 16 - (size_t)(length % 16));
+    }
+}
+
+static void chacha20_poly1305_finish_aad(struct ecconnect_chacha20_poly1305_ctx* ctx)
+{
+    if (!ctx->aad_done) {
+        chacha20_poly1305_pad16(ctx, ctx->aad_length);
+        ctx->aad_done = true;
+    }
+}
+
+static void chacha20_poly1305_xor(struct ecconnect_chacha20_poly1305_ctx* ctx,
+                                  const uint8_t* in,
+                                  size_t length,
+                                  uint8_t* out)
+{
+    size_t blocks_length = 0;
+    size_t i = 0;
+
+    /* Leftover keystream of the previous call */
+    while (length > 0 && ctx->keystream_used < sizeof(ctx->keystream)) {
+        *out++ = *in++ ^ ctx->keystream[ctx->keystream_used++];
+        length--;
+    }
+
+    blocks_length = length - length % ECCONNECT_CHACHA20_BLOCK_LENGTH;
+    if (blocks_length > 0) {
+        CRYPTO_chacha_20(out, in, blocks_length, ctx->key, ctx->nonce, ctx->counter);
+        ctx->counter += (uint32_t)(blocks_length / ECCONNECT_CHACHA20_BLOCK_LENGTH);
+        in += blocks_length;
+        out += blocks_length;
+        length -= blocks_length;
+    }
+
+    if (length > 0) {
+        memset(ctx->keystream, 0, sizeof(ctx->keystream));
+        CRYPTO_chacha_20(ctx->keystream, ctx->keystream, sizeof(ctx->keystream), ctx->key, ctx->nonce, ctx->counter);
+        ctx->counter++;
+        for (i = 0; i < length; i++) {
+            out[i] = in[i] ^ ctx->keystream[i];
+        }
+        ctx->keystream_used = length;
+    }
+}
+
+static ecconnect_status_t chacha20_poly1305_aad(struct ecconnect_chacha20_poly1305_ctx* ctx,
+                                                const void* aad,
+                                                size_t aad_length)
+{
+    /* Associated data must precede the message */
+    ECCONNECT_CHECK(!ctx->aad_done);
+    CRYPTO_poly1305_update(&ctx->poly1305, aad, aad_length);
+    ctx->aad_length += aad_length;
+    return ECCONNECT_SUCCESS;
+}
+
+static ecconnect_status_t chacha20_poly1305_update(struct ecconnect_chacha20_poly1305_ctx* ctx,
+                                                   const void* in_data,
+                                                   size_t in_data_length,
+                                                   void* out_data,
+                                                   size_t* out_data_length,
+                                                   bool encrypt)
+{
+    if (out_data == NULL || *out_data_length < in_data_length) {
+        *out_data_length = in_data_length;
+        return ECCONNECT_BUFFER_TOO_SMALL;
+    }
+    chacha20_poly1305_finish_aad(ctx);
+    /* Poly1305 authenticates ciphertext, take it before it is overwritten */
+    if (!encrypt) {
+        CRYPTO_poly1305_update(&ctx->poly1305, in_data, in_data_length);
+    }
+    chacha20_poly1305_xor(ctx, in_data, in_data_length, out_data);
+    if (encrypt) {
+        CRYPTO_poly1305_update(&ctx->poly1305, out_data, in_data_length);
+    }
+    ctx->data_length += in_data_length;
+    *out_data_length = in_data_length;
+    return ECCONNECT_SUCCESS;
+}
+
+static void chacha20_poly1305_final(struct ecconnect_chacha20_poly1305_ctx* ctx, uint8_t* auth_tag)
+{
+    uint8_t lengths[16];
+    size_t i = 0;
+
+    chacha20_poly1305_finish_aad(ctx);
+    chacha20_poly1305_pad16(ctx, ctx->data_length);
+    for (i = 0; i < 8; i++) {
+        lengths[i] = (uint8_t)(ctx->aad_length >> (8 * i));
+        lengths[8 + i] = (uint8_t)(ctx->data_length >> (8 * i));
+    }
+    CRYPTO_poly1305_update(&ctx->poly1305, lengths, sizeof(lengths));
+    CRYPTO_poly1305_finish(&ctx->poly1305, auth_tag);
+}
+
+static ecconnect_status_t chacha20_poly1305_ctx_setup(ecconnect_sym_ctx_t* ctx,
+                                                      const void* key,
+                                                      const size_t key_length,
+                                                      const void* salt,
+                                                      const size_t salt_length,
+                                                      const void* iv,
+                                                      const size_t iv_length)
+{
+    uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
+    size_t key_length_ = (ctx->alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+
+    /* There is no way to provide nonce later, unlike with EVP */
+    ECCONNECT_CHECK_PARAM(iv != NULL && iv_length >= ECCONNECT_CHACHA20_NONCE_LENGTH);
+    ECCONNECT_CHECK(ecconnect_withkdf(ctx->alg, key, key_length, salt, salt_length, key_, &key_length_)
+                    == ECCONNECT_SUCCESS);
+    chacha20_poly1305_init(&ctx->chacha20_poly1305, key_, iv);
+    ecconnect_wipe(key_, sizeof(key_));
+    return ECCONNECT_SUCCESS;
+}
+
 ecconnect_sym_ctx_t* ecconnect_sym_ctx_init(const uint32_t alg,
                                     const void* key,
                                     const size_t key_length,
@@ -144,7 +313,8 @@ ecconnect_sym_ctx_t* ecconnect_sym_ctx_init(const uint32_t alg,
     ECCONNECT_CHECK_MALLOC_(ctx);
     ctx->alg = alg;
     uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
-    size_t key_length_ = (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+    /* XTS takes a pair of AES keys, so use the length expected by the cipher */
+    size_t key_length_ = (size_t)EVP_CIPHER_key_length(evp);
     EVP_CIPHER_CTX_init(&(ctx->evp_sym_ctx));
     ECCONNECT_IF_FAIL_(ecconnect_withkdf(alg, key, key_length, salt, salt_length, key_, &key_length_)
                        == ECCONNECT_SUCCESS,
@@ -168,7 +338,21 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_ctx_init(const uint32_t alg,
                                          const size_t iv_length,
                                          bool encrypt)
 {
-    const EVP_CIPHER* evp = algid_to_evp_aead(alg);
+    const EVP_CIPHER* evp = NULL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    if (algid_is_chacha20_poly1305(alg)) {
+        ECCONNECT_CHECK_PARAM_(key != NULL);
+        ECCONNECT_CHECK_PARAM_(key_length != 0);
+        ctx = calloc(1, sizeof(ecconnect_sym_ctx_t));
+        ECCONNECT_CHECK_MALLOC_(ctx);
+        ctx->alg = alg;
+        EVP_CIPHER_CTX_init(&(ctx->evp_sym_ctx));
+        ECCONNECT_IF_FAIL_(chacha20_poly1305_ctx_setup(ctx, key, key_length, salt, salt_length, iv, iv_length)
+                               == ECCONNECT_SUCCESS,
+                           ecconnect_sym_encrypt_destroy(ctx));
+        return ctx;
+    }
+    evp = algid_to_evp_aead(alg);
     ECCONNECT_CHECK_PARAM_(evp != NULL);
     ECCONNECT_CHECK_PARAM_(key != NULL);
     ECCONNECT_CHECK_PARAM_(key_length != 0);
@@ -178,7 +362,6 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_ctx_init(const uint32_t alg,
     if (iv != NULL) {
         ECCONNECT_CHECK_PARAM_(iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
     }
-    ecconnect_sym_ctx_t* ctx = NULL;
     ctx = malloc(sizeof(ecconnect_sym_ctx_t));
     ECCONNECT_CHECK_MALLOC_(ctx);
     ctx->alg = alg;
@@ -198,6 +381,66 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_ctx_init(const uint32_t alg,
     return ctx;
 }
 
+ecconnect_status_t ecconnect_sym_ctx_reset(ecconnect_sym_ctx_t* ctx,
+                                    const void* iv,
+                                    const size_t iv_length,
+                                    bool encrypt)
+{
+    const EVP_CIPHER* evp = NULL;
+    int res = 0;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(iv != NULL);
+    evp = algid_to_evp(ctx->alg);
+    ECCONNECT_CHECK(evp != NULL);
+    ECCONNECT_CHECK_PARAM(iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
+    /* Cipher and key schedule are kept, only IV is updated */
+    if (encrypt) {
+        res = EVP_EncryptInit_ex(&(ctx->evp_sym_ctx), NULL, NULL, NULL, iv);
+    } else {
+        res = EVP_DecryptInit_ex(&(ctx->evp_sym_ctx), NULL, NULL, NULL, iv);
+    }
+    ECCONNECT_CHECK(res == 1);
+    return ECCONNECT_SUCCESS;
+}
+
+ecconnect_status_t ecconnect_sym_aead_ctx_reset(ecconnect_sym_ctx_t* ctx,
+                                         const void* key,
+                                         const size_t key_length,
+                                         const void* iv,
+                                         const size_t iv_length,
+                                         bool encrypt)
+{
+    const EVP_CIPHER* evp = NULL;
+    uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
+    size_t key_length_ = 0;
+    int res = 0;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(key != NULL);
+    ECCONNECT_CHECK_PARAM(key_length != 0);
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        return chacha20_poly1305_ctx_setup(ctx, key, key_length, NULL, 0, iv, iv_length);
+    }
+    evp = algid_to_evp_aead(ctx->alg);
+    ECCONNECT_CHECK(evp != NULL);
+    if (iv != NULL) {
+        ECCONNECT_CHECK_PARAM(iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
+    }
+    key_length_ = (ctx->alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+    ECCONNECT_CHECK(ecconnect_withkdf(ctx->alg, key, key_length, NULL, 0, key_, &key_length_)
+                    == ECCONNECT_SUCCESS);
+    /* Cipher is already set up, only key schedule and IV are updated */
+    if (encrypt) {
+        res = EVP_EncryptInit_ex(&(ctx->evp_sym_ctx), NULL, NULL, key_, iv);
+    } else {
+        res = EVP_DecryptInit_ex(&(ctx->evp_sym_ctx), NULL, NULL, key_, iv);
+    }
+    ecconnect_wipe(key_, sizeof(key_));
+    ECCONNECT_CHECK(res == 1);
+    return ECCONNECT_SUCCESS;
+}
+
 ecconnect_status_t ecconnect_sym_ctx_update(ecconnect_sym_ctx_t* ctx,
                                     const void* in_data,
                                     const size_t in_data_length,
@@ -256,6 +499,7 @@ ecconnect_status_t ecconnect_sym_aead_ctx_final(ecconnect_sym_ctx_t* ctx, bool e
 ecconnect_status_t ecconnect_sym_ctx_destroy(ecconnect_sym_ctx_t* ctx)
 {
     EVP_CIPHER_CTX_cleanup(&(ctx->evp_sym_ctx));
+    ecconnect_wipe(&(ctx->chacha20_poly1305), sizeof(ctx->chacha20_poly1305));
     free(ctx);
     return ECCONNECT_SUCCESS;
 }
@@ -291,6 +535,11 @@ ecconnect_status_t ecconnect_sym_encrypt_final(ecconnect_sym_ctx_t* ctx, void* c
     return ecconnect_sym_ctx_final(ctx, cipher_data, cipher_data_length, true);
 }
 
+ecconnect_status_t ecconnect_sym_encrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, const size_t iv_length)
+{
+    return ecconnect_sym_ctx_reset(ctx, iv, iv_length, true);
+}
+
 ecconnect_status_t ecconnect_sym_encrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
@@ -327,6 +576,11 @@ ecconnect_status_t ecconnect_sym_decrypt_final(ecconnect_sym_ctx_t* ctx, void* p
     return ecconnect_sym_ctx_final(ctx, plain_data, plain_data_length, false);
 }
 
+ecconnect_status_t ecconnect_sym_decrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, const size_t iv_length)
+{
+    return ecconnect_sym_ctx_reset(ctx, iv, iv_length, false);
+}
+
 ecconnect_status_t ecconnect_sym_decrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
@@ -349,6 +603,14 @@ ecconnect_status_t ecconnect_sym_aead_encrypt_update(ecconnect_sym_ctx_t* ctx,
                                              void* cipher_data,
                                              size_t* cipher_data_length)
 {
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        return chacha20_poly1305_update(&(ctx->chacha20_poly1305),
+                                        plain_data,
+                                        plain_data_length,
+                                        cipher_data,
+                                        cipher_data_length,
+                                        true);
+    }
     if (cipher_data == NULL
         || (*cipher_data_length)
                < (plain_data_length + EVP_CIPHER_CTX_block_size(&(ctx->evp_sym_ctx)) - 1)) {
@@ -359,11 +621,23 @@ ecconnect_status_t ecconnect_sym_aead_encrypt_update(ecconnect_sym_ctx_t* ctx,
     return ecconnect_sym_ctx_update(ctx, plain_data, plain_data_length, cipher_data, cipher_data_length, true);
 }
 
+ecconnect_status_t ecconnect_sym_aead_encrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            const size_t key_length,
+                                            const void* iv,
+                                            const size_t iv_length)
+{
+    return ecconnect_sym_aead_ctx_reset(ctx, key, key_length, iv, iv_length, true);
+}
+
 ecconnect_status_t ecconnect_sym_aead_encrypt_aad(ecconnect_sym_ctx_t* ctx,
                                           const void* plain_data,
                                           const size_t plain_data_length)
 {
     size_t tmp = 0;
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        return chacha20_poly1305_aad(&(ctx->chacha20_poly1305), plain_data, plain_data_length);
+    }
     return ecconnect_sym_ctx_update(ctx, plain_data, plain_data_length, NULL, &tmp, true);
 }
 
@@ -376,6 +650,11 @@ ecconnect_status_t ecconnect_sym_aead_encrypt_final(ecconnect_sym_ctx_t* ctx, vo
         (*auth_tag_length) = ECCONNECT_AES_GCM_AUTH_TAG_LENGTH;
         return ECCONNECT_BUFFER_TOO_SMALL;
     }
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        chacha20_poly1305_final(&(ctx->chacha20_poly1305), auth_tag);
+        (*auth_tag_length) = ECCONNECT_AES_GCM_AUTH_TAG_LENGTH;
+        return ECCONNECT_SUCCESS;
+    }
     ECCONNECT_CHECK(ecconnect_sym_aead_ctx_final(ctx, true) == ECCONNECT_SUCCESS);
     ECCONNECT_CHECK(EVP_CIPHER_CTX_ctrl(&(ctx->evp_sym_ctx),
                                     EVP_CTRL_GCM_GET_TAG,
@@ -407,6 +686,14 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_update(ecconnect_sym_ctx_t* ctx,
                                              void* plain_data,
                                              size_t* plain_data_length)
 {
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        return chacha20_poly1305_update(&(ctx->chacha20_poly1305),
+                                        cipher_data,
+                                        cipher_data_length,
+                                        plain_data,
+                                        plain_data_length,
+                                        false);
+    }
     if (plain_data == NULL
         || (*plain_data_length)
                < (cipher_data_length + EVP_CIPHER_CTX_block_size(&(ctx->evp_sym_ctx)) - 1)) {
@@ -416,11 +703,23 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_update(ecconnect_sym_ctx_t* ctx,
     return ecconnect_sym_ctx_update(ctx, cipher_data, cipher_data_length, plain_data, plain_data_length, false);
 }
 
+ecconnect_status_t ecconnect_sym_aead_decrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            const size_t key_length,
+                                            const void* iv,
+                                            const size_t iv_length)
+{
+    return ecconnect_sym_aead_ctx_reset(ctx, key, key_length, iv, iv_length, false);
+}
+
 ecconnect_status_t ecconnect_sym_aead_decrypt_aad(ecconnect_sym_ctx_t* ctx,
                                           const void* plain_data,
                                           const size_t plain_data_length)
 {
     size_t tmp = 0;
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        return chacha20_poly1305_aad(&(ctx->chacha20_poly1305), plain_data, plain_data_length);
+    }
     return ecconnect_sym_ctx_update(ctx, plain_data, plain_data_length, NULL, &tmp, false);
 }
 
@@ -431,6 +730,15 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_final(ecconnect_sym_ctx_t* ctx,
     ECCONNECT_CHECK_PARAM(auth_tag != NULL);
     ECCONNECT_CHECK_PARAM(auth_tag_length >= ECCONNECT_AES_GCM_AUTH_TAG_LENGTH);
     ECCONNECT_CHECK(ctx != NULL);
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        uint8_t expected_tag[ECCONNECT_AES_GCM_AUTH_TAG_LENGTH];
+        int mismatch = 0;
+        chacha20_poly1305_final(&(ctx->chacha20_poly1305), expected_tag);
+        mismatch = CRYPTO_memcmp(expected_tag, auth_tag, sizeof(expected_tag));
+        ecconnect_wipe(expected_tag, sizeof(expected_tag));
+        ECCONNECT_CHECK(mismatch == 0);
+        return ECCONNECT_SUCCESS;
+    }
     ECCONNECT_IF_FAIL(EVP_CIPHER_CTX_ctrl(&(ctx->evp_sym_ctx),
                                       EVP_CTRL_GCM_SET_TAG,
                                       ECCONNECT_AES_GCM_AUTH_TAG_LENGTH,
@@ -438,7 +746,169 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_final(ecconnect_sym_ctx_t* ctx,
                   ecconnect_sym_aead_decrypt_destroy(ctx));
     return ecconnect_sym_aead_ctx_final(ctx, false);
 }
+ecconnect_status_t ecconnect_sym_aead_decrypt_final_truncated(ecconnect_sym_ctx_t* ctx,
+                                                      const void* auth_tag,
+                                                      const size_t auth_tag_length)
+{
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(auth_tag != NULL);
+    ECCONNECT_CHECK_PARAM(auth_tag_length >= ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH
+                          && auth_tag_length <= ECCONNECT_AES_GCM_AUTH_TAG_LENGTH);
+    if (algid_is_chacha20_poly1305(ctx->alg)) {
+        uint8_t expected_tag[ECCONNECT_AES_GCM_AUTH_TAG_LENGTH];
+        int mismatch = 0;
+        chacha20_poly1305_final(&(ctx->chacha20_poly1305), expected_tag);
+        mismatch = CRYPTO_memcmp(expected_tag, auth_tag, auth_tag_length);
+        ecconnect_wipe(expected_tag, sizeof(expected_tag));
+        ECCONNECT_CHECK(mismatch == 0);
+        return ECCONNECT_SUCCESS;
+    }
+    /* EVP compares only as many bytes of the tag as it has been given */
+    ECCONNECT_CHECK(EVP_CIPHER_CTX_ctrl(&(ctx->evp_sym_ctx), EVP_CTRL_GCM_SET_TAG, (int)auth_tag_length, (void*)auth_tag)
+                    == 1);
+    return ecconnect_sym_aead_ctx_final(ctx, false);
+}
 ecconnect_status_t ecconnect_sym_aead_decrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
 }
+
+/* Feeds data as associated data, in chunks suitable for EVP */
+static ecconnect_status_t ecconnect_sym_evp_aad(EVP_CIPHER_CTX* ctx, const uint8_t* data, size_t length)
+{
+    size_t chunk_length = 0;
+    int out_length = 0;
+
+    while (length > 0) {
+        chunk_length = (length > INT_MAX) ? INT_MAX : length;
+        ECCONNECT_CHECK(EVP_DecryptUpdate(ctx, NULL, &out_length, data, (int)chunk_length) == 1);
+        data += chunk_length;
+        length -= chunk_length;
+    }
+    return ECCONNECT_SUCCESS;
+}
+
+static ecconnect_status_t ecconnect_sym_gcm_verify(const EVP_CIPHER* gcm,
+                                                   const EVP_CIPHER* block,
+                                                   const uint8_t* key,
+                                                   const void* iv,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* cipher_data,
+                                                   size_t cipher_data_length,
+                                                   const uint8_t* auth_tag)
+{
+    static const uint8_t zeros[ECCONNECT_GCM_BLOCK_LENGTH] = {0};
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    EVP_CIPHER_CTX block_ctx;
+    EVP_CIPHER_CTX gcm_ctx;
+    uint8_t h[ECCONNECT_GCM_BLOCK_LENGTH] = {0};
+    uint8_t gmac_tag[ECCONNECT_AES_GCM_AUTH_TAG_LENGTH] = {0};
+    int out_length = 0;
+
+    EVP_CIPHER_CTX_init(&block_ctx);
+    EVP_CIPHER_CTX_init(&gcm_ctx);
+
+    /* Hash subkey is encryption of zero block */
+    if (EVP_EncryptInit_ex(&block_ctx, block, NULL, key, NULL) != 1
+        || EVP_CIPHER_CTX_set_padding(&block_ctx, 0) != 1
+        || EVP_EncryptUpdate(&block_ctx, h, &out_length, zeros, sizeof(zeros)) != 1
+        || out_length != sizeof(h)) {
+        goto out;
+    }
+
+    /* GMAC of pad(A) || C, with the tag adjusted for different length block */
+    if (EVP_DecryptInit_ex(&gcm_ctx, gcm, NULL, key, iv) != 1) {
+        goto out;
+    }
+    if (ecconnect_sym_evp_aad(&gcm_ctx, aad, aad_length) != ECCONNECT_SUCCESS
+        || ecconnect_sym_evp_aad(&gcm_ctx, zeros, ecconnect_gcm_aad_padding(aad_length)) != ECCONNECT_SUCCESS
+        || ecconnect_sym_evp_aad(&gcm_ctx, cipher_data, cipher_data_length) != ECCONNECT_SUCCESS) {
+        goto out;
+    }
+    memcpy(gmac_tag, auth_tag, sizeof(gmac_tag));
+    ecconnect_gcm_gmac_to_gcm_tag(h, aad_length, cipher_data_length, gmac_tag);
+    if (EVP_CIPHER_CTX_ctrl(&gcm_ctx, EVP_CTRL_GCM_SET_TAG, sizeof(gmac_tag), gmac_tag) != 1) {
+        goto out;
+    }
+    if (EVP_DecryptFinal_ex(&gcm_ctx, h, &out_length) != 1) {
+        goto out;
+    }
+    res = ECCONNECT_SUCCESS;
+
+out:
+    ecconnect_wipe(h, sizeof(h));
+    ecconnect_wipe(gmac_tag, sizeof(gmac_tag));
+    EVP_CIPHER_CTX_cleanup(&block_ctx);
+    EVP_CIPHER_CTX_cleanup(&gcm_ctx);
+    return res;
+}
+
+/* Poly1305 is computed over ciphertext, there is no need to decrypt it */
+static ecconnect_status_t ecconnect_sym_chacha20_poly1305_verify(const uint8_t* key,
+                                                                 const uint8_t* iv,
+                                                                 const uint8_t* aad,
+                                                                 size_t aad_length,
+                                                                 const uint8_t* cipher_data,
+                                                                 size_t cipher_data_length,
+                                                                 const uint8_t* auth_tag)
+{
+    struct ecconnect_chacha20_poly1305_ctx ctx;
+    uint8_t expected_tag[ECCONNECT_AES_GCM_AUTH_TAG_LENGTH];
+    int mismatch = 0;
+
+    chacha20_poly1305_init(&ctx, key, iv);
+    CRYPTO_poly1305_update(&ctx.poly1305, aad, aad_length);
+    ctx.aad_length = aad_length;
+    chacha20_poly1305_finish_aad(&ctx);
+    CRYPTO_poly1305_update(&ctx.poly1305, cipher_data, cipher_data_length);
+    ctx.data_length = cipher_data_length;
+    chacha20_poly1305_final(&ctx, expected_tag);
+
+    mismatch = CRYPTO_memcmp(expected_tag, auth_tag, sizeof(expected_tag));
+    ecconnect_wipe(expected_tag, sizeof(expected_tag));
+    ecconnect_wipe(&ctx, sizeof(ctx));
+    return (mismatch == 0) ? ECCONNECT_SUCCESS : ECCONNECT_FAIL;
+}
+
+ecconnect_status_t ecconnect_sym_aead_verify(const uint32_t alg,
+                                             const void* key,
+                                             const size_t key_length,
+                                             const void* iv,
+                                             const size_t iv_length,
+                                             const void* aad,
+                                             const size_t aad_length,
+                                             const void* cipher_data,
+                                             const size_t cipher_data_length,
+                                             const void* auth_tag,
+                                             const size_t auth_tag_length)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    const EVP_CIPHER* evp = algid_to_evp_aead(alg);
+    const EVP_CIPHER* block = algid_to_evp_gcm_block(alg);
+    bool chacha20_poly1305 = algid_is_chacha20_poly1305(alg);
+    uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
+    size_t key_length_ = (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+
+    ECCONNECT_CHECK_PARAM((evp != NULL && block != NULL) || chacha20_poly1305);
+    ECCONNECT_CHECK_PARAM(key != NULL && key_length != 0);
+    ECCONNECT_CHECK_PARAM(iv != NULL && iv_length >= ECCONNECT_CHACHA20_NONCE_LENGTH);
+    if (aad_length != 0) {
+        ECCONNECT_CHECK_PARAM(aad != NULL);
+    }
+    if (cipher_data_length != 0) {
+        ECCONNECT_CHECK_PARAM(cipher_data != NULL);
+    }
+    ECCONNECT_CHECK_PARAM(auth_tag != NULL && auth_tag_length >= ECCONNECT_AES_GCM_AUTH_TAG_LENGTH);
+
+    res = ecconnect_withkdf(alg, key, key_length, NULL, 0, key_, &key_length_);
+    if (res == ECCONNECT_SUCCESS) {
+        if (chacha20_poly1305) {
+            res = ecconnect_sym_chacha20_poly1305_verify(key_, iv, aad, aad_length, cipher_data, cipher_data_length, auth_tag);
+        } else {
+            res = ecconnect_sym_gcm_verify(evp, block, key_, iv, aad, aad_length, cipher_data, cipher_data_length, auth_tag);
+        }
+    }
+    ecconnect_wipe(key_, sizeof(key_));
+    return res;
+}
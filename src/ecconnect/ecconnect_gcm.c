@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecconnect/ecconnect_gcm.h"
+
+#include <string.h>
+
+#include "ecconnect/ecconnect_wipe.h"
+
+static uint64_t load_uint64BE(const uint8_t* p)
+{
+    uint64_t v = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void store_uint64BE(uint8_t* p, uint64_t v)
+{
+    size_t i = 0;
+
+    for (i = 0; i < 8; i++) {
+        p[7 - i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/*
+ * Multiplication in GF(2^128) as defined by NIST SP 800-38D, Algorithm 1.
+ * This is done once per message so speed does not matter here, but it must
+ * not branch on secret data.
+ */
+static void gf128_mul(const uint8_t x[ECCONNECT_GCM_BLOCK_LENGTH],
+                      const uint8_t y[ECCONNECT_GCM_BLOCK_LENGTH],
+                      uint8_t out[ECCONNECT_GCM_BLOCK_LENGTH])
+{
+    uint64_t z_hi = 0;
+    uint64_t z_lo = 0;
+    uint64_t v_hi = load_uint64BE(y);
+    uint64_t v_lo = load_uint64BE(y + 8);
+    uint64_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 128; i++) {
+        mask = 0 - (uint64_t)((x[i / 8] >> (7 - i % 8)) & 1);
+        z_hi ^= v_hi & mask;
+        z_lo ^= v_lo & mask;
+
+        mask = 0 - (v_lo & 1);
+        v_lo = (v_lo >> 1) | (v_hi << 63);
+        v_hi = (v_hi >> 1) ^ (UINT64_C(0xe100000000000000) & mask);
+    }
+
+    store_uint64BE(out, z_hi);
+    store_uint64BE(out + 8, z_lo);
+}
+
+void ecconnect_gcm_gmac_to_gcm_tag(const uint8_t h[ECCONNECT_GCM_BLOCK_LENGTH],
+                                   uint64_t aad_length,
+                                   uint64_t ciphertext_length,
+                                   uint8_t tag[ECCONNECT_GCM_BLOCK_LENGTH])
+{
+    uint8_t lengths[ECCONNECT_GCM_BLOCK_LENGTH];
+    uint8_t correction[ECCONNECT_GCM_BLOCK_LENGTH];
+    uint64_t gmac_length = aad_length + ecconnect_gcm_aad_padding(aad_length) + ciphertext_length;
+    size_t i = 0;
+
+    /* Lengths are in bits: GCM has (A, C), GMAC has (pad(A) || C, 0) */
+    store_uint64BE(lengths, (aad_length * 8) ^ (gmac_length * 8));
+    store_uint64BE(lengths + 8, ciphertext_length * 8);
+
+    gf128_mul(lengths, h, correction);
+    for (i = 0; i < ECCONNECT_GCM_BLOCK_LENGTH; i++) {
+        tag[i] ^= correction[i];
+    }
+    ecconnect_wipe(correction, sizeof(correction));
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ECCONNECT_GCM_H
+#define ECCONNECT_GCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ECCONNECT_GCM_BLOCK_LENGTH 16
+
+/*
+ * GCM tag of (A, C) differs from GMAC tag of pad(A) || C with the same key
+ * and IV only in the final length block of GHASH. Since GHASH is linear,
+ * the difference is (L_gcm ^ L_gmac) * H, where H is the hash subkey.
+ * This allows to authenticate ciphertext without decrypting it, using
+ * ciphertext as associated data.
+ *
+ * Converts GMAC tag into GCM tag in place (or vice versa).
+ */
+void ecconnect_gcm_gmac_to_gcm_tag(const uint8_t h[ECCONNECT_GCM_BLOCK_LENGTH],
+                                   uint64_t aad_length,
+                                   uint64_t ciphertext_length,
+                                   uint8_t tag[ECCONNECT_GCM_BLOCK_LENGTH]);
+
+/* Length of zero padding after associated data */
+static inline size_t ecconnect_gcm_aad_padding(uint64_t aad_length)
+{
+    return (size_t)((ECCONNECT_GCM_BLOCK_LENGTH - aad_length % ECCONNECT_GCM_BLOCK_LENGTH)
+                    % ECCONNECT_GCM_BLOCK_LENGTH);
+}
+
+#endif /* ECCONNECT_GCM_H */
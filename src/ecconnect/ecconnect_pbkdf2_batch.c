@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecconnect/ecconnect_kdf.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecconnect/ecconnect_wipe.h"
+
+/*
+ * PBKDF2-HMAC-SHA-256 spends nearly all its time computing
+ *
+ *     U_j = HMAC(P, U_{j-1})
+ *
+ * which is two SHA-256 compressions of a single padded block, starting from
+ * HMAC inner and outer states that depend only on the passphrase. Independent
+ * chains (different passphrases, salts, or output blocks) are put into SIMD
+ * lanes and computed in lockstep. Key setup and the first iteration which
+ * processes the salt are done one chain at a time.
+ *
+ * Without SIMD support each job is passed to ecconnect_pbkdf2_sha256() which
+ * may use hardware SHA-256 instructions of the backend.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ECCONNECT_PBKDF2_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define SHA256_BLOCK_LENGTH 64
+#define SHA256_DIGEST_LENGTH 32
+#define SHA256_STATE_WORDS 8
+
+/* Inner and outer HMAC messages of iterations 2+ are 96 bytes long */
+#define PBKDF2_ITERATION_BITS ((SHA256_BLOCK_LENGTH + SHA256_DIGEST_LENGTH) * 8)
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_iv[SHA256_STATE_WORDS] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t load_uint32BE(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store_uint32BE(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress(uint32_t state[SHA256_STATE_WORDS], const uint8_t block[SHA256_BLOCK_LENGTH])
+{
+    uint32_t w[64];
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    uint32_t f = state[5];
+    uint32_t g = state[6];
+    uint32_t h = state[7];
+    uint32_t t1 = 0;
+    uint32_t t2 = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = load_uint32BE(block + 4 * i);
+    }
+    for (i = 16; i < 64; i++) {
+        w[i] = w[i - 16] + (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7]
+               + (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+    }
+    for (i = 0; i < 64; i++) {
+        t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+
+    ecconnect_wipe(w, sizeof(w));
+}
+
+/* Plain SHA-256 which can continue from an intermediate state */
+struct sha256_ctx {
+    uint32_t state[SHA256_STATE_WORDS];
+    uint8_t buffer[SHA256_BLOCK_LENGTH];
+    size_t buffered;
+    uint64_t length;
+};
+
+static void sha256_resume(struct sha256_ctx* ctx, const uint32_t state[SHA256_STATE_WORDS], uint64_t length)
+{
+    memcpy(ctx->state, state, sizeof(ctx->state));
+    ctx->buffered = 0;
+    ctx->length = length;
+}
+
+static void sha256_update(struct sha256_ctx* ctx, const uint8_t* data, size_t length)
+{
+    size_t chunk = 0;
+
+    ctx->length += length;
+    while (length > 0) {
+        chunk = SHA256_BLOCK_LENGTH - ctx->buffered;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(ctx->buffer + ctx->buffered, data, chunk);
+        ctx->buffered += chunk;
+        data += chunk;
+        length -= chunk;
+        if (ctx->buffered == SHA256_BLOCK_LENGTH) {
+            sha256_compress(ctx->state, ctx->buffer);
+            ctx->buffered = 0;
+        }
+    }
+}
+
+static void sha256_final(struct sha256_ctx* ctx, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    uint64_t bits = ctx->length * 8;
+    size_t i = 0;
+
+    ctx->buffer[ctx->buffered++] = 0x80;
+    if (ctx->buffered > SHA256_BLOCK_LENGTH - 8) {
+        memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_LENGTH - ctx->buffered);
+        sha256_compress(ctx->state, ctx->buffer);
+        ctx->buffered = 0;
+    }
+    memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_LENGTH - 8 - ctx->buffered);
+    store_uint32BE(ctx->buffer + SHA256_BLOCK_LENGTH - 8, (uint32_t)(bits >> 32));
+    store_uint32BE(ctx->buffer + SHA256_BLOCK_LENGTH - 4, (uint32_t)bits);
+    sha256_compress(ctx->state, ctx->buffer);
+
+    for (i = 0; i < SHA256_STATE_WORDS; i++) {
+        store_uint32BE(digest + 4 * i, ctx->state[i]);
+    }
+    ecconnect_wipe(ctx, sizeof(*ctx));
+}
+
+/*
+ * One PBKDF2 chain: output block `index` of a job. Vector kernels read
+ * the HMAC states and U_1, and leave the XOR of all U_j in `t`.
+ */
+struct pbkdf2_lane {
+    uint32_t inner[SHA256_STATE_WORDS];
+    uint32_t outer[SHA256_STATE_WORDS];
+    uint32_t u[SHA256_STATE_WORDS];
+    uint32_t t[SHA256_STATE_WORDS];
+};
+
+static void pbkdf2_lane_init(struct pbkdf2_lane* lane, const ecconnect_pbkdf2_sha256_job_t* job, uint32_t index)
+{
+    uint8_t key[SHA256_BLOCK_LENGTH] = {0};
+    uint8_t pad[SHA256_BLOCK_LENGTH];
+    uint8_t index_bytes[4];
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    struct sha256_ctx ctx;
+    size_t i = 0;
+
+    if (job->passphrase_length > SHA256_BLOCK_LENGTH) {
+        sha256_resume(&ctx, sha256_iv, 0);
+        sha256_update(&ctx, job->passphrase, job->passphrase_length);
+        sha256_final(&ctx, key);
+    } else {
+        memcpy(key, job->passphrase, job->passphrase_length);
+    }
+
+    for (i = 0; i < SHA256_BLOCK_LENGTH; i++) {
+        pad[i] = key[i] ^ 0x36;
+    }
+    memcpy(lane->inner, sha256_iv, sizeof(lane->inner));
+    sha256_compress(lane->inner, pad);
+    for (i = 0; i < SHA256_BLOCK_LENGTH; i++) {
+        pad[i] = key[i] ^ 0x5c;
+    }
+    memcpy(lane->outer, sha256_iv, sizeof(lane->outer));
+    sha256_compress(lane->outer, pad);
+
+    /* U_1 = HMAC(P, S || INT(i)) */
+    store_uint32BE(index_bytes, index);
+    sha256_resume(&ctx, lane->inner, SHA256_BLOCK_LENGTH);
+    if (job->salt_length != 0) {
+        sha256_update(&ctx, job->salt, job->salt_length);
+    }
+    sha256_update(&ctx, index_bytes, sizeof(index_bytes));
+    sha256_final(&ctx, digest);
+    sha256_resume(&ctx, lane->outer, SHA256_BLOCK_LENGTH);
+    sha256_update(&ctx, digest, sizeof(digest));
+    sha256_final(&ctx, digest);
+
+    for (i = 0; i < SHA256_STATE_WORDS; i++) {
+        lane->u[i] = load_uint32BE(digest + 4 * i);
+    }
+    memcpy(lane->t, lane->u, sizeof(lane->t));
+
+    ecconnect_wipe(key, sizeof(key));
+    ecconnect_wipe(pad, sizeof(pad));
+    ecconnect_wipe(digest, sizeof(digest));
+}
+
+#ifdef ECCONNECT_PBKDF2_X86_SIMD
+
+/*
+ * The same kernel is instantiated for each vector width. VEC_* macros
+ * are defined by each instance and map onto 32-bit lane operations.
+ */
+#define PBKDF2_VEC_ROR(x, n) VEC_OR(VEC_SRLI((x), (n)), VEC_SLLI((x), 32 - (n)))
+
+#define PBKDF2_VEC_COMPRESS(s, w)                                                                  \
+    do {                                                                                           \
+        vec_t a_ = (s)[0], b_ = (s)[1], c_ = (s)[2], d_ = (s)[3];                                  \
+        vec_t e_ = (s)[4], f_ = (s)[5], g_ = (s)[6], h_ = (s)[7];                                  \
+        vec_t t1_, t2_;                                                                            \
+        size_t r_;                                                                                 \
+        for (r_ = 0; r_ < 64; r_++) {                                                              \
+            if (r_ >= 16) {                                                                        \
+                vec_t w15_ = (w)[(r_ + 1) & 15];                                                   \
+                vec_t w2_ = (w)[(r_ + 14) & 15];                                                   \
+                vec_t s0_ = VEC_XOR(VEC_XOR(PBKDF2_VEC_ROR(w15_, 7), PBKDF2_VEC_ROR(w15_, 18)),    \
+                                    VEC_SRLI(w15_, 3));                                            \
+                vec_t s1_ = VEC_XOR(VEC_XOR(PBKDF2_VEC_ROR(w2_, 17), PBKDF2_VEC_ROR(w2_, 19)),     \
+                                    VEC_SRLI(w2_, 10));                                            \
+                (w)[r_ & 15] = VEC_ADD(VEC_ADD((w)[r_ & 15], s0_), VEC_ADD((w)[(r_ + 9) & 15], s1_)); \
+            }                                                                                      \
+            t1_ = VEC_ADD(h_,                                                                      \
+                          VEC_XOR(VEC_XOR(PBKDF2_VEC_ROR(e_, 6), PBKDF2_VEC_ROR(e_, 11)),          \
+                                  PBKDF2_VEC_ROR(e_, 25)));                                        \
+            t1_ = VEC_ADD(t1_, VEC_XOR(VEC_AND(e_, f_), VEC_ANDNOT(e_, g_)));                      \
+            t1_ = VEC_ADD(t1_, VEC_ADD(VEC_SET1((int)sha256_k[r_]), (w)[r_ & 15]));                \
+            t2_ = VEC_XOR(VEC_XOR(PBKDF2_VEC_ROR(a_, 2), PBKDF2_VEC_ROR(a_, 13)),                  \
+                          PBKDF2_VEC_ROR(a_, 22));                                                 \
+            t2_ = VEC_ADD(t2_, VEC_XOR(VEC_XOR(VEC_AND(a_, b_), VEC_AND(a_, c_)), VEC_AND(b_, c_))); \
+            h_ = g_;                                                                               \
+            g_ = f_;                                                                               \
+            f_ = e_;                                                                               \
+            e_ = VEC_ADD(d_, t1_);                                                                 \
+            d_ = c_;                                                                               \
+            c_ = b_;                                                                               \
+            b_ = a_;                                                                               \
+            a_ = VEC_ADD(t1_, t2_);                                                                \
+        }                                                                                          \
+        (s)[0] = VEC_ADD((s)[0], a_);                                                              \
+        (s)[1] = VEC_ADD((s)[1], b_);                                                              \
+        (s)[2] = VEC_ADD((s)[2], c_);                                                              \
+        (s)[3] = VEC_ADD((s)[3], d_);                                                              \
+        (s)[4] = VEC_ADD((s)[4], e_);                                                              \
+        (s)[5] = VEC_ADD((s)[5], f_);                                                              \
+        (s)[6] = VEC_ADD((s)[6], g_);                                                              \
+        (s)[7] = VEC_ADD((s)[7], h_);                                                              \
+    } while (0)
+
+/*
+ * Runs iterations 2..`iterations` for `lanes` chains. Words of the same
+ * index from all chains are kept in one vector for the whole loop.
+ */
+#define PBKDF2_VEC_KERNEL(lanes, chains, iterations)                                               \
+    do {                                                                                           \
+        uint32_t words_[VEC_LANES];                                                                \
+        vec_t inner_[SHA256_STATE_WORDS], outer_[SHA256_STATE_WORDS];                              \
+        vec_t u_[SHA256_STATE_WORDS], t_[SHA256_STATE_WORDS];                                      \
+        vec_t s_[SHA256_STATE_WORDS], w_[16];                                                      \
+        size_t i_, l_, j_;                                                                         \
+        for (i_ = 0; i_ < SHA256_STATE_WORDS; i_++) {                                              \
+            for (l_ = 0; l_ < VEC_LANES; l_++) {                                                   \
+                words_[l_] = (lanes)[l_ < (chains) ? l_ : 0].inner[i_];                            \
+            }                                                                                      \
+            inner_[i_] = VEC_LOAD(words_);                                                         \
+            for (l_ = 0; l_ < VEC_LANES; l_++) {                                                   \
+                words_[l_] = (lanes)[l_ < (chains) ? l_ : 0].outer[i_];                            \
+            }                                                                                      \
+            outer_[i_] = VEC_LOAD(words_);                                                         \
+            for (l_ = 0; l_ < VEC_LANES; l_++) {                                                   \
+                words_[l_] = (lanes)[l_ < (chains) ? l_ : 0].u[i_];                                \
+            }                                                                                      \
+            u_[i_] = VEC_LOAD(words_);                                                             \
+            t_[i_] = u_[i_];                                                                       \
+        }                                                                                          \
+        for (j_ = 1; j_ < (iterations); j_++) {                                                    \
+            for (i_ = 0; i_ < SHA256_STATE_WORDS; i_++) {                                          \
+                s_[i_] = inner_[i_];                                                               \
+                w_[i_] = u_[i_];                                                                   \
+            }                                                                                      \
+            w_[8] = VEC_SET1((int)0x80000000);                                                     \
+            for (i_ = 9; i_ < 15; i_++) {                                                          \
+                w_[i_] = VEC_SET1(0);                                                              \
+            }                                                                                      \
+            w_[15] = VEC_SET1(PBKDF2_ITERATION_BITS);                                              \
+            PBKDF2_VEC_COMPRESS(s_, w_);                                                           \
+            for (i_ = 0; i_ < SHA256_STATE_WORDS; i_++) {                                          \
+                w_[i_] = s_[i_];                                                                   \
+                s_[i_] = outer_[i_];                                                               \
+            }                                                                                      \
+            w_[8] = VEC_SET1((int)0x80000000);                                                     \
+            for (i_ = 9; i_ < 15; i_++) {                                                          \
+                w_[i_] = VEC_SET1(0);                                                              \
+            }                                                                                      \
+            w_[15] = VEC_SET1(PBKDF2_ITERATION_BITS);                                              \
+            PBKDF2_VEC_COMPRESS(s_, w_);                                                           \
+            for (i_ = 0; i_ < SHA256_STATE_WORDS; i_++) {                                          \
+                u_[i_] = s_[i_];                                                                   \
+                t_[i_] = VEC_XOR(t_[i_], u_[i_]);                                                  \
+            }                                                                                      \
+        }                                                                                          \
+        for (i_ = 0; i_ < SHA256_STATE_WORDS; i_++) {                                              \
+            VEC_STORE(words_, t_[i_]);                                                             \
+            for (l_ = 0; l_ < (chains); l_++) {                                                    \
+                (lanes)[l_].t[i_] = words_[l_];                                                    \
+            }                                                                                      \
+        }                                                                                          \
+        ecconnect_wipe(words_, sizeof(words_));                                                    \
+        ecconnect_wipe(inner_, sizeof(inner_));                                                    \
+        ecconnect_wipe(outer_, sizeof(outer_));                                                    \
+        ecconnect_wipe(u_, sizeof(u_));                                                            \
+        ecconnect_wipe(t_, sizeof(t_));                                                            \
+        ecconnect_wipe(s_, sizeof(s_));                                                            \
+        ecconnect_wipe(w_, sizeof(w_));                                                            \
+    } while (0)
+
+#define vec_t __m128i
+#define VEC_LANES 4
+#define VEC_ADD _mm_add_epi32
+#define VEC_XOR _mm_xor_si128
+#define VEC_AND _mm_and_si128
+#define VEC_ANDNOT _mm_andnot_si128
+#define VEC_OR _mm_or_si128
+#define VEC_SRLI _mm_srli_epi32
+#define VEC_SLLI _mm_slli_epi32
+#define VEC_SET1 _mm_set1_epi32
+#define VEC_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define VEC_STORE(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+
+__attribute__((target("sse2"))) static void pbkdf2_kernel_x4(struct pbkdf2_lane* lanes,
+                                                             size_t chains,
+                                                             size_t iterations)
+{
+    PBKDF2_VEC_KERNEL(lanes, chains, iterations);
+}
+
+#undef vec_t
+#undef VEC_LANES
+#undef VEC_ADD
+#undef VEC_XOR
+#undef VEC_AND
+#undef VEC_ANDNOT
+#undef VEC_OR
+#undef VEC_SRLI
+#undef VEC_SLLI
+#undef VEC_SET1
+#undef VEC_LOAD
+#undef VEC_STORE
+
+#define vec_t __m256i
+#define VEC_LANES 8
+#define VEC_ADD _mm256_add_epi32
+#define VEC_XOR _mm256_xor_si256
+#define VEC_AND _mm256_and_si256
+#define VEC_ANDNOT _mm256_andnot_si256
+#define VEC_OR _mm256_or_si256
+#define VEC_SRLI _mm256_srli_epi32
+#define VEC_SLLI _mm256_slli_epi32
+#define VEC_SET1 _mm256_set1_epi32
+#define VEC_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define VEC_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+
+__attribute__((target("avx2"))) static void pbkdf2_kernel_x8(struct pbkdf2_lane* lanes,
+                                                             size_t chains,
+                                                             size_t iterations)
+{
+    PBKDF2_VEC_KERNEL(lanes, chains, iterations);
+}
+
+#undef vec_t
+#undef VEC_LANES
+#undef VEC_ADD
+#undef VEC_XOR
+#undef VEC_AND
+#undef VEC_ANDNOT
+#undef VEC_OR
+#undef VEC_SRLI
+#undef VEC_SLLI
+#undef VEC_SET1
+#undef VEC_LOAD
+#undef VEC_STORE
+
+#endif /* ECCONNECT_PBKDF2_X86_SIMD */
+
+typedef void (*pbkdf2_kernel_fn)(struct pbkdf2_lane* lanes, size_t chains, size_t iterations);
+
+/* Picks the widest kernel supported by the CPU, returns its lane count */
+static size_t pbkdf2_select_kernel(pbkdf2_kernel_fn* kernel)
+{
+#ifdef ECCONNECT_PBKDF2_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *kernel = pbkdf2_kernel_x8;
+        return 8;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *kernel = pbkdf2_kernel_x4;
+        return 4;
+    }
+#endif
+    *kernel = NULL;
+    return 1;
+}
+
+#define PBKDF2_MAX_LANES 8
+
+static bool pbkdf2_job_valid(const ecconnect_pbkdf2_sha256_job_t* job)
+{
+    if (!job->passphrase || job->passphrase_length == 0) {
+        return false;
+    }
+    if (!job->salt && job->salt_length != 0) {
+        return false;
+    }
+    if (job->iterations == 0 || !job->key || job->key_length == 0) {
+        return false;
+    }
+    /* Block index is a 32-bit integer */
+    if ((job->key_length - 1) / SHA256_DIGEST_LENGTH >= UINT32_MAX) {
+        return false;
+    }
+    return true;
+}
+
+static size_t pbkdf2_job_blocks(const ecconnect_pbkdf2_sha256_job_t* job)
+{
+    return (job->key_length + SHA256_DIGEST_LENGTH - 1) / SHA256_DIGEST_LENGTH;
+}
+
+/* Chain of a job output block, jobs are processed in groups of such chains */
+struct pbkdf2_chain {
+    size_t job;
+    uint32_t index;
+    bool done;
+};
+
+static void pbkdf2_chain_store(const struct pbkdf2_lane* lane,
+                               const ecconnect_pbkdf2_sha256_job_t* job,
+                               uint32_t index)
+{
+    uint8_t block[SHA256_DIGEST_LENGTH];
+    size_t offset = (size_t)(index - 1) * SHA256_DIGEST_LENGTH;
+    size_t length = job->key_length - offset;
+    size_t i = 0;
+
+    for (i = 0; i < SHA256_STATE_WORDS; i++) {
+        store_uint32BE(block + 4 * i, lane->t[i]);
+    }
+    if (length > SHA256_DIGEST_LENGTH) {
+        length = SHA256_DIGEST_LENGTH;
+    }
+    memcpy(job->key + offset, block, length);
+    ecconnect_wipe(block, sizeof(block));
+}
+
+ecconnect_status_t ecconnect_pbkdf2_sha256_batch(const ecconnect_pbkdf2_sha256_job_t* jobs, size_t job_count)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    struct pbkdf2_lane lanes[PBKDF2_MAX_LANES];
+    struct pbkdf2_chain* chains = NULL;
+    size_t group[PBKDF2_MAX_LANES];
+    pbkdf2_kernel_fn kernel = NULL;
+    size_t lane_count = 0;
+    size_t chain_count = 0;
+    size_t group_size = 0;
+    size_t iterations = 0;
+    size_t i = 0;
+    size_t j = 0;
+    uint32_t k = 0;
+
+    ECCONNECT_CHECK_PARAM(jobs != NULL && job_count != 0);
+    for (i = 0; i < job_count; i++) {
+        ECCONNECT_CHECK_PARAM(pbkdf2_job_valid(&jobs[i]));
+        if (pbkdf2_job_blocks(&jobs[i]) > SIZE_MAX - chain_count) {
+            return ECCONNECT_INVALID_PARAMETER;
+        }
+        chain_count += pbkdf2_job_blocks(&jobs[i]);
+    }
+
+    lane_count = pbkdf2_select_kernel(&kernel);
+    if (!kernel) {
+        for (i = 0; i < job_count; i++) {
+            res = ecconnect_pbkdf2_sha256(jobs[i].passphrase,
+                                          jobs[i].passphrase_length,
+                                          jobs[i].salt,
+                                          jobs[i].salt_length,
+                                          jobs[i].iterations,
+                                          jobs[i].key,
+                                          jobs[i].key_length);
+            if (res != ECCONNECT_SUCCESS) {
+                return res;
+            }
+        }
+        return ECCONNECT_SUCCESS;
+    }
+
+    chains = calloc(chain_count, sizeof(*chains));
+    if (!chains) {
+        return ECCONNECT_NO_MEMORY;
+    }
+    for (i = 0, j = 0; i < job_count; i++) {
+        for (k = 1; k <= pbkdf2_job_blocks(&jobs[i]); k++, j++) {
+            chains[j].job = i;
+            chains[j].index = k;
+        }
+    }
+
+    /*
+     * Lanes run in lockstep so a group takes chains with the same iteration
+     * count. Usually all jobs use the same count and this is a single pass.
+     */
+    for (i = 0; i < chain_count; i++) {
+        if (chains[i].done) {
+            continue;
+        }
+        iterations = jobs[chains[i].job].iterations;
+        group_size = 0;
+        for (j = i; j < chain_count && group_size < lane_count; j++) {
+            if (!chains[j].done && jobs[chains[j].job].iterations == iterations) {
+                chains[j].done = true;
+                group[group_size++] = j;
+            }
+        }
+
+        for (j = 0; j < group_size; j++) {
+            pbkdf2_lane_init(&lanes[j], &jobs[chains[group[j]].job], chains[group[j]].index);
+        }
+        kernel(lanes, group_size, iterations);
+        for (j = 0; j < group_size; j++) {
+            pbkdf2_chain_store(&lanes[j], &jobs[chains[group[j]].job], chains[group[j]].index);
+        }
+    }
+
+    ecconnect_wipe(lanes, sizeof(lanes));
+    free(chains);
+
+    return ECCONNECT_SUCCESS;
+}
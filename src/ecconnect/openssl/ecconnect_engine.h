@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <openssl/evp.h>
+#include <openssl/sha.h>
 
 #include "ecconnect/ecconnect_asym_sign.h"
 
@@ -36,6 +37,18 @@ struct ecconnect_hash_ctx_type {
     EVP_MD_CTX* evp_md_ctx;
 };
 
+/* HMAC-SHA-256 states with key pads already absorbed */
+struct ecconnect_kdf_ctx_type {
+    /* SHA-256 states after absorbing HMAC pads, copied by each derivation */
+    EVP_MD_CTX* inner;
+    EVP_MD_CTX* outer;
+};
+
+/* Digest context reused by ecconnect_kdf_ctx_derive_with_state() */
+struct ecconnect_kdf_state_type {
+    EVP_MD_CTX* hash;
+};
+
 struct ecconnect_sym_ctx_type {
     uint32_t alg;
     EVP_CIPHER_CTX* evp_sym_ctx;
@@ -17,8 +17,13 @@
 #include "ecconnect/ecconnect_kdf.h"
 
 #include <limits.h>
+#include <string.h>
 
 #include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "ecconnect/openssl/ecconnect_engine.h"
+#include "ecconnect/ecconnect_wipe.h"
 
 ecconnect_status_t ecconnect_pbkdf2_sha256(const uint8_t* passphrase,
                                    size_t passphrase_length,
@@ -54,3 +59,186 @@ ecconnect_status_t ecconnect_pbkdf2_sha256(const uint8_t* passphrase,
 
     return (res == 1) ? ECCONNECT_SUCCESS : ECCONNECT_FAIL;
 }
+
+ecconnect_kdf_ctx_t* ecconnect_kdf_ctx_create(const void* key, size_t key_length)
+{
+    ecconnect_kdf_ctx_t* ctx = NULL;
+    uint8_t key_pad[SHA256_CBLOCK] = {0};
+    size_t i;
+
+    ECCONNECT_CHECK_PARAM_(key != NULL);
+    ECCONNECT_CHECK_PARAM_(key_length != 0);
+
+    ctx = calloc(1, sizeof(*ctx));
+    ECCONNECT_CHECK_MALLOC_(ctx);
+
+    ctx->inner = EVP_MD_CTX_create();
+    ctx->outer = EVP_MD_CTX_create();
+    if (!ctx->inner || !ctx->outer) {
+        goto err;
+    }
+
+    /* Long keys are hashed first, short ones are padded with zeros (RFC 2104) */
+    if (key_length > sizeof(key_pad)) {
+        if (!EVP_Digest(key, key_length, key_pad, NULL, EVP_sha256(), NULL)) {
+            goto err;
+        }
+    } else {
+        memcpy(key_pad, key, key_length);
+    }
+
+    for (i = 0; i < sizeof(key_pad); i++) {
+        key_pad[i] ^= 0x36;
+    }
+    if (!EVP_DigestInit_ex(ctx->inner, EVP_sha256(), NULL)
+        || !EVP_DigestUpdate(ctx->inner, key_pad, sizeof(key_pad))) {
+        goto err;
+    }
+
+    for (i = 0; i < sizeof(key_pad); i++) {
+        key_pad[i] ^= 0x36 ^ 0x5c;
+    }
+    if (!EVP_DigestInit_ex(ctx->outer, EVP_sha256(), NULL)
+        || !EVP_DigestUpdate(ctx->outer, key_pad, sizeof(key_pad))) {
+        goto err;
+    }
+
+    ecconnect_wipe(key_pad, sizeof(key_pad));
+    return ctx;
+
+err:
+    ecconnect_wipe(key_pad, sizeof(key_pad));
+    ecconnect_kdf_ctx_destroy(ctx);
+    return NULL;
+}
+
+static ecconnect_status_t ecconnect_kdf_ctx_derive_(const ecconnect_kdf_ctx_t* ctx,
+                                                   EVP_MD_CTX* hash,
+                                                   const char* label,
+                                                   const ecconnect_kdf_context_buf_t* context,
+                                                   size_t context_count,
+                                                   void* output,
+                                                   size_t output_length)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    uint8_t out[SHA256_DIGEST_LENGTH] = {0, 0, 0, 1};
+    size_t i;
+
+    ECCONNECT_CHECK_PARAM(label != NULL);
+    ECCONNECT_CHECK_PARAM(output != NULL);
+    ECCONNECT_CHECK_PARAM(output_length != 0);
+    ECCONNECT_CHECK_PARAM(output_length <= sizeof(out));
+    if (context_count > 0) {
+        ECCONNECT_CHECK_PARAM(context != NULL);
+    }
+
+    /*
+     * Copies keep the shared context intact for concurrent users.
+     * Same layout as ecconnect_kdf(): counter, label, 0x00, context.
+     */
+    if (!EVP_MD_CTX_copy_ex(hash, ctx->inner) || !EVP_DigestUpdate(hash, out, 4)
+        || !EVP_DigestUpdate(hash, label, strlen(label)) || !EVP_DigestUpdate(hash, out, 1)) {
+        goto err;
+    }
+    for (i = 0; i < context_count; i++) {
+        if (context[i].data) {
+            if (!EVP_DigestUpdate(hash, context[i].data, context[i].length)) {
+                goto err;
+            }
+        }
+    }
+    if (!EVP_DigestFinal_ex(hash, out, NULL)) {
+        goto err;
+    }
+
+    if (!EVP_MD_CTX_copy_ex(hash, ctx->outer) || !EVP_DigestUpdate(hash, out, sizeof(out))
+        || !EVP_DigestFinal_ex(hash, out, NULL)) {
+        goto err;
+    }
+
+    memcpy(output, out, output_length);
+    res = ECCONNECT_SUCCESS;
+
+err:
+    ecconnect_wipe(out, sizeof(out));
+
+    if (res != ECCONNECT_SUCCESS) {
+        ecconnect_wipe(output, output_length);
+    }
+
+    return res;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_derive(const ecconnect_kdf_ctx_t* ctx,
+                                            const char* label,
+                                            const ecconnect_kdf_context_buf_t* context,
+                                            size_t context_count,
+                                            void* output,
+                                            size_t output_length)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    EVP_MD_CTX* hash = NULL;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+
+    hash = EVP_MD_CTX_create();
+    if (!hash) {
+        return ECCONNECT_NO_MEMORY;
+    }
+
+    res = ecconnect_kdf_ctx_derive_(ctx, hash, label, context, context_count, output, output_length);
+
+    /* Digest state is cleansed by OpenSSL */
+    EVP_MD_CTX_destroy(hash);
+
+    return res;
+}
+
+ecconnect_kdf_state_t* ecconnect_kdf_state_create(void)
+{
+    ecconnect_kdf_state_t* state = calloc(1, sizeof(*state));
+    ECCONNECT_CHECK_MALLOC_(state);
+
+    state->hash = EVP_MD_CTX_create();
+    if (!state->hash) {
+        free(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_derive_with_state(const ecconnect_kdf_ctx_t* ctx,
+                                                       ecconnect_kdf_state_t* state,
+                                                       const char* label,
+                                                       const ecconnect_kdf_context_buf_t* context,
+                                                       size_t context_count,
+                                                       void* output,
+                                                       size_t output_length)
+{
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(state != NULL);
+
+    /* Copies overwrite previous digest state, no need to reset it */
+    return ecconnect_kdf_ctx_derive_(ctx, state->hash, label, context, context_count, output, output_length);
+}
+
+ecconnect_status_t ecconnect_kdf_state_destroy(ecconnect_kdf_state_t* state)
+{
+    if (state) {
+        /* Digest state is cleansed by OpenSSL */
+        EVP_MD_CTX_destroy(state->hash);
+        free(state);
+    }
+    return ECCONNECT_SUCCESS;
+}
+
+ecconnect_status_t ecconnect_kdf_ctx_destroy(ecconnect_kdf_ctx_t* ctx)
+{
+    if (ctx) {
+        EVP_MD_CTX_destroy(ctx->inner);
+        EVP_MD_CTX_destroy(ctx->outer);
+        free(ctx);
+    }
+    return ECCONNECT_SUCCESS;
+}
@@ -16,12 +16,15 @@
 
 #include "ecconnect/ecconnect_sym.h"
 
+#include <limits.h>
 #include <string.h>
 
 #include <openssl/err.h>
 #include <openssl/evp.h>
 
+#include "ecconnect/ecconnect_gcm.h"
 #include "ecconnect/openssl/ecconnect_engine.h"
+#include "ecconnect/ecconnect_wipe.h"
 
 #define ECCONNECT_SYM_MAX_KEY_LENGTH 128
 #define ECCONNECT_SYM_MAX_IV_LENGTH 16
@@ -108,6 +111,25 @@ const EVP_CIPHER* algid_to_evp_aead(uint32_t alg)
         return EVP_aes_192_gcm();
     case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_128_KEY_LENGTH:
         return EVP_aes_128_gcm();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA) \
+    && !defined(OPENSSL_NO_POLY1305)
+    case ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_256_KEY_LENGTH:
+        return EVP_chacha20_poly1305();
+#endif
+    }
+    return NULL;
+}
+
+/* Block cipher of AES-GCM, for computing the hash subkey */
+static const EVP_CIPHER* algid_to_evp_gcm_block(uint32_t alg)
+{
+    switch (alg & (ECCONNECT_SYM_ALG_MASK | ECCONNECT_SYM_PADDING_MASK | ECCONNECT_SYM_KEY_LENGTH_MASK)) {
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_256_KEY_LENGTH:
+        return EVP_aes_256_ecb();
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_192_KEY_LENGTH:
+        return EVP_aes_192_ecb();
+    case ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_128_KEY_LENGTH:
+        return EVP_aes_128_ecb();
     }
     return NULL;
 }
@@ -136,7 +158,8 @@ ecconnect_sym_ctx_t* ecconnect_sym_ctx_init(const uint32_t alg,
     ECCONNECT_CHECK_MALLOC_(ctx);
     ctx->alg = alg;
     uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
-    size_t key_length_ = (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+    /* XTS takes a pair of AES keys, so use the length expected by the cipher */
+    size_t key_length_ = (size_t)EVP_CIPHER_key_length(evp);
     // EVP_CIPHER_CTX_init(ctx->evp_sym_ctx);
     ctx->evp_sym_ctx = EVP_CIPHER_CTX_new();
     if (!ctx->evp_sym_ctx) {
@@ -199,6 +222,63 @@ ecconnect_sym_ctx_t* ecconnect_sym_aead_ctx_init(const uint32_t alg,
     return ctx;
 }
 
+ecconnect_status_t ecconnect_sym_ctx_reset(ecconnect_sym_ctx_t* ctx,
+                                    const void* iv,
+                                    const size_t iv_length,
+                                    bool encrypt)
+{
+    const EVP_CIPHER* evp = NULL;
+    int res = 0;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(iv != NULL);
+    evp = algid_to_evp(ctx->alg);
+    ECCONNECT_CHECK(evp != NULL);
+    ECCONNECT_CHECK_PARAM(iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
+    /* Cipher and key schedule are kept, only IV is updated */
+    if (encrypt) {
+        res = EVP_EncryptInit_ex(ctx->evp_sym_ctx, NULL, NULL, NULL, iv);
+    } else {
+        res = EVP_DecryptInit_ex(ctx->evp_sym_ctx, NULL, NULL, NULL, iv);
+    }
+    ECCONNECT_CHECK(res == 1);
+    return ECCONNECT_SUCCESS;
+}
+
+ecconnect_status_t ecconnect_sym_aead_ctx_reset(ecconnect_sym_ctx_t* ctx,
+                                         const void* key,
+                                         const size_t key_length,
+                                         const void* iv,
+                                         const size_t iv_length,
+                                         bool encrypt)
+{
+    const EVP_CIPHER* evp = NULL;
+    uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
+    size_t key_length_ = 0;
+    int res = 0;
+
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(key != NULL);
+    ECCONNECT_CHECK_PARAM(key_length != 0);
+    evp = algid_to_evp_aead(ctx->alg);
+    ECCONNECT_CHECK(evp != NULL);
+    if (iv != NULL) {
+        ECCONNECT_CHECK_PARAM(iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
+    }
+    key_length_ = (ctx->alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+    ECCONNECT_CHECK(ecconnect_withkdf(ctx->alg, key, key_length, NULL, 0, key_, &key_length_)
+                    == ECCONNECT_SUCCESS);
+    /* Cipher is already set up, only key schedule and IV are updated */
+    if (encrypt) {
+        res = EVP_EncryptInit_ex(ctx->evp_sym_ctx, NULL, NULL, key_, iv);
+    } else {
+        res = EVP_DecryptInit_ex(ctx->evp_sym_ctx, NULL, NULL, key_, iv);
+    }
+    ecconnect_wipe(key_, sizeof(key_));
+    ECCONNECT_CHECK(res == 1);
+    return ECCONNECT_SUCCESS;
+}
+
 ecconnect_status_t ecconnect_sym_ctx_update(ecconnect_sym_ctx_t* ctx,
                                     const void* in_data,
                                     const size_t in_data_length,
@@ -287,6 +367,11 @@ ecconnect_status_t ecconnect_sym_encrypt_final(ecconnect_sym_ctx_t* ctx, void* c
     return ecconnect_sym_ctx_final(ctx, cipher_data, cipher_data_length, true);
 }
 
+ecconnect_status_t ecconnect_sym_encrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, const size_t iv_length)
+{
+    return ecconnect_sym_ctx_reset(ctx, iv, iv_length, true);
+}
+
 ecconnect_status_t ecconnect_sym_encrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
@@ -324,6 +409,11 @@ ecconnect_status_t ecconnect_sym_decrypt_final(ecconnect_sym_ctx_t* ctx, void* p
     return ecconnect_sym_ctx_final(ctx, plain_data, plain_data_length, false);
 }
 
+ecconnect_status_t ecconnect_sym_decrypt_reset(ecconnect_sym_ctx_t* ctx, const void* iv, const size_t iv_length)
+{
+    return ecconnect_sym_ctx_reset(ctx, iv, iv_length, false);
+}
+
 ecconnect_status_t ecconnect_sym_decrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
@@ -357,6 +447,15 @@ ecconnect_status_t ecconnect_sym_aead_encrypt_update(ecconnect_sym_ctx_t* ctx,
     return ecconnect_sym_ctx_update(ctx, plain_data, plain_data_length, cipher_data, cipher_data_length, true);
 }
 
+ecconnect_status_t ecconnect_sym_aead_encrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            const size_t key_length,
+                                            const void* iv,
+                                            const size_t iv_length)
+{
+    return ecconnect_sym_aead_ctx_reset(ctx, key, key_length, iv, iv_length, true);
+}
+
 ecconnect_status_t ecconnect_sym_aead_encrypt_aad(ecconnect_sym_ctx_t* ctx,
                                           const void* plain_data,
                                           const size_t plain_data_length)
@@ -375,6 +474,7 @@ ecconnect_status_t ecconnect_sym_aead_encrypt_final(ecconnect_sym_ctx_t* ctx, vo
         return ECCONNECT_BUFFER_TOO_SMALL;
     }
     ECCONNECT_CHECK(ecconnect_sym_aead_ctx_final(ctx, true) == ECCONNECT_SUCCESS);
+    /* GCM controls are aliases of generic AEAD ones, ChaCha20-Poly1305 uses them too */
     ECCONNECT_CHECK(EVP_CIPHER_CTX_ctrl(ctx->evp_sym_ctx,
                                     EVP_CTRL_GCM_GET_TAG,
                                     ECCONNECT_AES_GCM_AUTH_TAG_LENGTH,
@@ -415,6 +515,15 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_update(ecconnect_sym_ctx_t* ctx,
     return ecconnect_sym_ctx_update(ctx, cipher_data, cipher_data_length, plain_data, plain_data_length, false);
 }
 
+ecconnect_status_t ecconnect_sym_aead_decrypt_reset(ecconnect_sym_ctx_t* ctx,
+                                            const void* key,
+                                            const size_t key_length,
+                                            const void* iv,
+                                            const size_t iv_length)
+{
+    return ecconnect_sym_aead_ctx_reset(ctx, key, key_length, iv, iv_length, false);
+}
+
 ecconnect_status_t ecconnect_sym_aead_decrypt_aad(ecconnect_sym_ctx_t* ctx,
                                           const void* plain_data,
                                           const size_t plain_data_length)
@@ -438,7 +547,205 @@ ecconnect_status_t ecconnect_sym_aead_decrypt_final(ecconnect_sym_ctx_t* ctx,
     return ecconnect_sym_aead_ctx_final(ctx, false);
 }
 
+ecconnect_status_t ecconnect_sym_aead_decrypt_final_truncated(ecconnect_sym_ctx_t* ctx,
+                                                      const void* auth_tag,
+                                                      const size_t auth_tag_length)
+{
+    ECCONNECT_CHECK_PARAM(ctx != NULL);
+    ECCONNECT_CHECK_PARAM(auth_tag != NULL);
+    ECCONNECT_CHECK_PARAM(auth_tag_length >= ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH
+                          && auth_tag_length <= ECCONNECT_AES_GCM_AUTH_TAG_LENGTH);
+    /* EVP compares only as many bytes of the tag as it has been given */
+    ECCONNECT_CHECK(EVP_CIPHER_CTX_ctrl(ctx->evp_sym_ctx, EVP_CTRL_GCM_SET_TAG, (int)auth_tag_length, (void*)auth_tag)
+                    == 1);
+    return ecconnect_sym_aead_ctx_final(ctx, false);
+}
+
 ecconnect_status_t ecconnect_sym_aead_decrypt_destroy(ecconnect_sym_ctx_t* ctx)
 {
     return ecconnect_sym_ctx_destroy(ctx);
 }
+
+/* Feeds data as associated data, in chunks suitable for EVP */
+static ecconnect_status_t ecconnect_sym_evp_aad(EVP_CIPHER_CTX* ctx, const uint8_t* data, size_t length)
+{
+    size_t chunk_length = 0;
+    int out_length = 0;
+
+    while (length > 0) {
+        chunk_length = (length > INT_MAX) ? INT_MAX : length;
+        ECCONNECT_CHECK(EVP_DecryptUpdate(ctx, NULL, &out_length, data, (int)chunk_length) == 1);
+        data += chunk_length;
+        length -= chunk_length;
+    }
+    return ECCONNECT_SUCCESS;
+}
+
+static ecconnect_status_t ecconnect_sym_gcm_verify(const EVP_CIPHER* gcm,
+                                                   const EVP_CIPHER* block,
+                                                   const uint8_t* key,
+                                                   const void* iv,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* cipher_data,
+                                                   size_t cipher_data_length,
+                                                   const uint8_t* auth_tag)
+{
+    static const uint8_t zeros[ECCONNECT_GCM_BLOCK_LENGTH] = {0};
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    EVP_CIPHER_CTX* block_ctx = NULL;
+    EVP_CIPHER_CTX* gcm_ctx = NULL;
+    uint8_t h[ECCONNECT_GCM_BLOCK_LENGTH] = {0};
+    uint8_t gmac_tag[ECCONNECT_AES_GCM_AUTH_TAG_LENGTH] = {0};
+    int out_length = 0;
+
+    block_ctx = EVP_CIPHER_CTX_new();
+    gcm_ctx = EVP_CIPHER_CTX_new();
+    if (!block_ctx || !gcm_ctx) {
+        res = ECCONNECT_NO_MEMORY;
+        goto out;
+    }
+
+    /* Hash subkey is encryption of zero block */
+    if (EVP_EncryptInit_ex(block_ctx, block, NULL, key, NULL) != 1
+        || EVP_CIPHER_CTX_set_padding(block_ctx, 0) != 1
+        || EVP_EncryptUpdate(block_ctx, h, &out_length, zeros, sizeof(zeros)) != 1
+        || out_length != sizeof(h)) {
+        goto out;
+    }
+
+    /* GMAC of pad(A) || C, with the tag adjusted for different length block */
+    if (EVP_DecryptInit_ex(gcm_ctx, gcm, NULL, key, iv) != 1) {
+        goto out;
+    }
+    if (ecconnect_sym_evp_aad(gcm_ctx, aad, aad_length) != ECCONNECT_SUCCESS
+        || ecconnect_sym_evp_aad(gcm_ctx, zeros, ecconnect_gcm_aad_padding(aad_length)) != ECCONNECT_SUCCESS
+        || ecconnect_sym_evp_aad(gcm_ctx, cipher_data, cipher_data_length) != ECCONNECT_SUCCESS) {
+        goto out;
+    }
+    memcpy(gmac_tag, auth_tag, sizeof(gmac_tag));
+    ecconnect_gcm_gmac_to_gcm_tag(h, aad_length, cipher_data_length, gmac_tag);
+    if (EVP_CIPHER_CTX_ctrl(gcm_ctx, EVP_CTRL_GCM_SET_TAG, sizeof(gmac_tag), gmac_tag) != 1) {
+        goto out;
+    }
+    /* Tag comparison is done in constant time by OpenSSL */
+    if (EVP_DecryptFinal_ex(gcm_ctx, h, &out_length) != 1) {
+        goto out;
+    }
+    res = ECCONNECT_SUCCESS;
+
+out:
+    ecconnect_wipe(h, sizeof(h));
+    ecconnect_wipe(gmac_tag, sizeof(gmac_tag));
+    EVP_CIPHER_CTX_free(block_ctx);
+    EVP_CIPHER_CTX_free(gcm_ctx);
+    return res;
+}
+
+/* Generic fallback, plaintext goes through a small buffer and is wiped */
+static ecconnect_status_t ecconnect_sym_aead_verify_by_decryption(const uint32_t alg,
+                                                                  const void* key,
+                                                                  const size_t key_length,
+                                                                  const void* iv,
+                                                                  const size_t iv_length,
+                                                                  const uint8_t* aad,
+                                                                  const size_t aad_length,
+                                                                  const uint8_t* cipher_data,
+                                                                  size_t cipher_data_length,
+                                                                  const void* auth_tag)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    uint8_t plain_data[1024];
+    size_t chunk_length = 0;
+    size_t plain_data_length = 0;
+
+    ctx = ecconnect_sym_aead_decrypt_create(alg, key, key_length, NULL, 0, iv, iv_length);
+    if (!ctx) {
+        return ECCONNECT_FAIL;
+    }
+    if (aad_length != 0) {
+        res = ecconnect_sym_aead_decrypt_aad(ctx, aad, aad_length);
+        if (res != ECCONNECT_SUCCESS) {
+            goto out;
+        }
+    }
+    while (cipher_data_length > 0) {
+        /* Leave room for possible block buffering, AEAD ciphers are stream ones though */
+        chunk_length = sizeof(plain_data) - ECCONNECT_GCM_BLOCK_LENGTH;
+        if (chunk_length > cipher_data_length) {
+            chunk_length = cipher_data_length;
+        }
+        plain_data_length = sizeof(plain_data);
+        res = ecconnect_sym_aead_decrypt_update(ctx, cipher_data, chunk_length, plain_data, &plain_data_length);
+        if (res != ECCONNECT_SUCCESS) {
+            goto out;
+        }
+        cipher_data += chunk_length;
+        cipher_data_length -= chunk_length;
+    }
+    if (EVP_CIPHER_CTX_ctrl(ctx->evp_sym_ctx,
+                            EVP_CTRL_GCM_SET_TAG,
+                            ECCONNECT_AES_GCM_AUTH_TAG_LENGTH,
+                            (void*)auth_tag)
+        != 1) {
+        res = ECCONNECT_FAIL;
+        goto out;
+    }
+    res = ecconnect_sym_aead_ctx_final(ctx, false);
+
+out:
+    ecconnect_wipe(plain_data, sizeof(plain_data));
+    ecconnect_sym_aead_decrypt_destroy(ctx);
+    return res;
+}
+
+ecconnect_status_t ecconnect_sym_aead_verify(const uint32_t alg,
+                                             const void* key,
+                                             const size_t key_length,
+                                             const void* iv,
+                                             const size_t iv_length,
+                                             const void* aad,
+                                             const size_t aad_length,
+                                             const void* cipher_data,
+                                             const size_t cipher_data_length,
+                                             const void* auth_tag,
+                                             const size_t auth_tag_length)
+{
+    ecconnect_status_t res = ECCONNECT_FAIL;
+    const EVP_CIPHER* evp = algid_to_evp_aead(alg);
+    const EVP_CIPHER* block = algid_to_evp_gcm_block(alg);
+    uint8_t key_[ECCONNECT_SYM_MAX_KEY_LENGTH];
+    size_t key_length_ = (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+
+    ECCONNECT_CHECK_PARAM(evp != NULL);
+    ECCONNECT_CHECK_PARAM(key != NULL && key_length != 0);
+    ECCONNECT_CHECK_PARAM(iv != NULL && iv_length >= (size_t)EVP_CIPHER_iv_length(evp));
+    if (aad_length != 0) {
+        ECCONNECT_CHECK_PARAM(aad != NULL);
+    }
+    if (cipher_data_length != 0) {
+        ECCONNECT_CHECK_PARAM(cipher_data != NULL);
+    }
+    ECCONNECT_CHECK_PARAM(auth_tag != NULL && auth_tag_length >= ECCONNECT_AES_GCM_AUTH_TAG_LENGTH);
+
+    if (!block) {
+        return ecconnect_sym_aead_verify_by_decryption(alg,
+                                                       key,
+                                                       key_length,
+                                                       iv,
+                                                       iv_length,
+                                                       aad,
+                                                       aad_length,
+                                                       cipher_data,
+                                                       cipher_data_length,
+                                                       auth_tag);
+    }
+
+    res = ecconnect_withkdf(alg, key, key_length, NULL, 0, key_, &key_length_);
+    if (res == ECCONNECT_SUCCESS) {
+        res = ecconnect_sym_gcm_verify(evp, block, key_, iv, aad, aad_length, cipher_data, cipher_data_length, auth_tag);
+    }
+    ecconnect_wipe(key_, sizeof(key_));
+    return res;
+}
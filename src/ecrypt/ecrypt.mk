@@ -62,7 +62,7 @@ $(BIN_PATH)/$(LIBECRYPT_A): $(ECRYPT_OBJ)
 	@echo -n "link "
 	@$(BUILD_CMD)
 
-$(BIN_PATH)/$(LIBECRYPT_SO): CMD = $(CC) -shared -o $@ $(filter %.o %.a, $^) $(LDFLAGS) -lecconnect $(LIBECRYPT_SO_LDFLAGS)
+$(BIN_PATH)/$(LIBECRYPT_SO): CMD = $(CC) -shared -o $@ $(filter %.o %.a, $^) $(LDFLAGS) -lecconnect -lpthread $(LIBECRYPT_SO_LDFLAGS)
 
 $(BIN_PATH)/$(LIBECRYPT_SO): $(BIN_PATH)/$(LIBECCONNECT_SO) $(ECRYPT_OBJ)
 	@mkdir -p $(@D)
@@ -29,6 +29,13 @@ static inline uint8_t* stream_write_uint64LE(uint8_t* buffer, uint64_t value)
     return buffer + sizeof(encoded);
 }
 
+static inline const uint8_t* stream_read_uint64LE(const uint8_t* buffer, uint64_t* value)
+{
+    memmove(value, buffer, sizeof(*value));
+    *value = le64toh(*value);
+    return buffer + sizeof(*value);
+}
+
 static inline uint8_t* stream_write_uint32LE(uint8_t* buffer, uint32_t value)
 {
     uint32_t encoded = htole32(value);
@@ -19,18 +19,21 @@
 #include "ecrypt/secure_cell_seal_passphrase.h"
 #include "ecrypt/sym_enc_message.h"
 
-ecrypt_status_t ecrypt_secure_cell_encrypt_seal(const uint8_t* master_key,
-                                                const size_t master_key_length,
-                                                const uint8_t* user_context,
-                                                const size_t user_context_length,
-                                                const uint8_t* message,
-                                                const size_t message_length,
-                                                uint8_t* encrypted_message,
-                                                size_t* encrypted_message_length)
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_ex(const uint8_t* master_key,
+                                                   const size_t master_key_length,
+                                                   const uint8_t* user_context,
+                                                   const size_t user_context_length,
+                                                   const uint8_t* message,
+                                                   const size_t message_length,
+                                                   uint8_t* encrypted_message,
+                                                   size_t* encrypted_message_length,
+                                                   uint32_t flags)
 {
+    ecrypt_status_t res = ECRYPT_FAIL;
     size_t ctx_length_;
     size_t msg_length_;
     size_t total_length;
+    size_t reserved_ctx_length;
 
     ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
     ECRYPT_STATUS_CHECK(ecrypt_auth_sym_encrypt_message(master_key,
@@ -42,7 +45,8 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal(const uint8_t* master_key,
                                                         NULL,
                                                         &ctx_length_,
                                                         NULL,
-                                                        &msg_length_),
+                                                        &msg_length_,
+                                                        flags),
                         ECRYPT_BUFFER_TOO_SMALL);
 
     total_length = ctx_length_ + msg_length_;
@@ -51,17 +55,84 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal(const uint8_t* master_key,
         return ECRYPT_BUFFER_TOO_SMALL;
     }
 
-    *encrypted_message_length = total_length;
-    return ecrypt_auth_sym_encrypt_message(master_key,
+    reserved_ctx_length = ctx_length_;
+    res = ecrypt_auth_sym_encrypt_message(master_key,
+                                          master_key_length,
+                                          message,
+                                          message_length,
+                                          user_context,
+                                          user_context_length,
+                                          encrypted_message,
+                                          &ctx_length_,
+                                          encrypted_message + ctx_length_,
+                                          &msg_length_,
+                                          flags);
+    /* Compressed cells may be shorter than expected */
+    if (res == ECRYPT_SUCCESS) {
+        ecrypt_scell_seal_pack(encrypted_message, reserved_ctx_length, ctx_length_, msg_length_);
+        *encrypted_message_length = ctx_length_ + msg_length_;
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal(const uint8_t* master_key,
+                                                const size_t master_key_length,
+                                                const uint8_t* user_context,
+                                                const size_t user_context_length,
+                                                const uint8_t* message,
+                                                const size_t message_length,
+                                                uint8_t* encrypted_message,
+                                                size_t* encrypted_message_length)
+{
+    return ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                              master_key_length,
+                                              user_context,
+                                              user_context_length,
+                                              message,
+                                              message_length,
+                                              encrypted_message,
+                                              encrypted_message_length,
+                                              0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_ex(const uint8_t* master_key,
+                                                   const size_t master_key_length,
+                                                   const uint8_t* user_context,
+                                                   const size_t user_context_length,
+                                                   const uint8_t* encrypted_message,
+                                                   const size_t encrypted_message_length,
+                                                   uint8_t* plain_message,
+                                                   size_t* plain_message_length,
+                                                   uint32_t flags)
+{
+    size_t ctx_length_ = 0;
+    size_t msg_length_ = 0;
+    ECRYPT_STATUS_CHECK(ecrypt_auth_sym_decrypt_message(master_key,
+                                                        master_key_length,
+                                                        user_context,
+                                                        user_context_length,
+                                                        encrypted_message,
+                                                        encrypted_message_length,
+                                                        NULL,
+                                                        0,
+                                                        NULL,
+                                                        &msg_length_,
+                                                        flags),
+                        ECRYPT_BUFFER_TOO_SMALL);
+    ECRYPT_STATUS_CHECK(ecrypt_scell_seal_auth_token_size(encrypted_message, encrypted_message_length, &ctx_length_),
+                        ECRYPT_SUCCESS);
+    msg_length_ = encrypted_message_length - ctx_length_;
+    return ecrypt_auth_sym_decrypt_message(master_key,
                                            master_key_length,
-                                           message,
-                                           message_length,
                                            user_context,
                                            user_context_length,
                                            encrypted_message,
-                                           &ctx_length_,
+                                           ctx_length_,
                                            encrypted_message + ctx_length_,
-                                           &msg_length_);
+                                           msg_length_,
+                                           plain_message,
+                                           plain_message_length,
+                                           flags);
 }
 
 ecrypt_status_t ecrypt_secure_cell_decrypt_seal(const uint8_t* master_key,
@@ -72,6 +143,24 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal(const uint8_t* master_key,
                                                 const size_t encrypted_message_length,
                                                 uint8_t* plain_message,
                                                 size_t* plain_message_length)
+{
+    return ecrypt_secure_cell_decrypt_seal_ex(master_key,
+                                              master_key_length,
+                                              user_context,
+                                              user_context_length,
+                                              encrypted_message,
+                                              encrypted_message_length,
+                                              plain_message,
+                                              plain_message_length,
+                                              0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_verify_seal(const uint8_t* master_key,
+                                               const size_t master_key_length,
+                                               const uint8_t* user_context,
+                                               const size_t user_context_length,
+                                               const uint8_t* encrypted_message,
+                                               const size_t encrypted_message_length)
 {
     size_t ctx_length_ = 0;
     size_t msg_length_ = 0;
@@ -84,22 +173,62 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal(const uint8_t* master_key,
                                                         NULL,
                                                         0,
                                                         NULL,
-                                                        &msg_length_),
+                                                        &msg_length_,
+                                                        0),
                         ECRYPT_BUFFER_TOO_SMALL);
-    if (encrypted_message_length < msg_length_) {
-        return ECRYPT_INVALID_PARAMETER;
+    ECRYPT_STATUS_CHECK(ecrypt_scell_seal_auth_token_size(encrypted_message, encrypted_message_length, &ctx_length_),
+                        ECRYPT_SUCCESS);
+    msg_length_ = encrypted_message_length - ctx_length_;
+    return ecrypt_auth_sym_verify_message(master_key,
+                                          master_key_length,
+                                          user_context,
+                                          user_context_length,
+                                          encrypted_message,
+                                          ctx_length_,
+                                          encrypted_message + ctx_length_,
+                                          msg_length_,
+                                          0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_reseal(const uint8_t* old_master_key,
+                                          size_t old_master_key_length,
+                                          const uint8_t* new_master_key,
+                                          size_t new_master_key_length,
+                                          const uint8_t* user_context,
+                                          size_t user_context_length,
+                                          const uint8_t* encrypted_message,
+                                          size_t encrypted_message_length,
+                                          uint8_t* resealed_message,
+                                          size_t* resealed_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecrypt_secure_cell_seal_ctx_t* old_ctx = NULL;
+    ecrypt_secure_cell_seal_ctx_t* new_ctx = NULL;
+
+    ECRYPT_CHECK_PARAM(old_master_key != NULL && old_master_key_length != 0);
+    ECRYPT_CHECK_PARAM(new_master_key != NULL && new_master_key_length != 0);
+
+    old_ctx = ecrypt_secure_cell_seal_ctx_create(old_master_key, old_master_key_length);
+    new_ctx = ecrypt_secure_cell_seal_ctx_create(new_master_key, new_master_key_length);
+    if (!old_ctx || !new_ctx) {
+        res = ECRYPT_NO_MEMORY;
+        goto out;
     }
-    ctx_length_ = encrypted_message_length - msg_length_;
-    return ecrypt_auth_sym_decrypt_message(master_key,
-                                           master_key_length,
-                                           user_context,
-                                           user_context_length,
-                                           encrypted_message,
-                                           ctx_length_,
-                                           encrypted_message + ctx_length_,
-                                           msg_length_,
-                                           plain_message,
-                                           plain_message_length);
+
+    res = ecrypt_secure_cell_reseal_with_ctx(old_ctx,
+                                             new_ctx,
+                                             user_context,
+                                             user_context_length,
+                                             encrypted_message,
+                                             encrypted_message_length,
+                                             resealed_message,
+                                             resealed_message_length);
+
+out:
+    ecrypt_secure_cell_seal_ctx_destroy(new_ctx);
+    ecrypt_secure_cell_seal_ctx_destroy(old_ctx);
+
+    return res;
 }
 
 ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase(const uint8_t* passphrase,
@@ -110,6 +239,27 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase(const uint8_t* p
                                                                 size_t message_length,
                                                                 uint8_t* encrypted_message,
                                                                 size_t* encrypted_message_length)
+{
+    return ecrypt_secure_cell_encrypt_seal_with_passphrase_ex(passphrase,
+                                                              passphrase_length,
+                                                              user_context,
+                                                              user_context_length,
+                                                              message,
+                                                              message_length,
+                                                              encrypted_message,
+                                                              encrypted_message_length,
+                                                              ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase_ex(const uint8_t* passphrase,
+                                                                   size_t passphrase_length,
+                                                                   const uint8_t* user_context,
+                                                                   size_t user_context_length,
+                                                                   const uint8_t* message,
+                                                                   size_t message_length,
+                                                                   uint8_t* encrypted_message,
+                                                                   size_t* encrypted_message_length,
+                                                                   uint32_t iteration_count)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     size_t auth_token_length = 0;
@@ -122,16 +272,17 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase(const uint8_t* p
      * Since Seal mode prepends authentication token to the message
      * we need to get the size of this token at first.
      */
-    res = ecrypt_auth_sym_encrypt_message_with_passphrase(passphrase,
-                                                          passphrase_length,
-                                                          message,
-                                                          message_length,
-                                                          user_context,
-                                                          user_context_length,
-                                                          NULL,
-                                                          &auth_token_length,
-                                                          NULL,
-                                                          &ciphertext_length);
+    res = ecrypt_auth_sym_encrypt_message_with_passphrase_ex(passphrase,
+                                                             passphrase_length,
+                                                             message,
+                                                             message_length,
+                                                             user_context,
+                                                             user_context_length,
+                                                             NULL,
+                                                             &auth_token_length,
+                                                             NULL,
+                                                             &ciphertext_length,
+                                                             iteration_count);
     if (res != ECRYPT_BUFFER_TOO_SMALL) {
         return res;
     }
@@ -142,16 +293,17 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase(const uint8_t* p
         return ECRYPT_BUFFER_TOO_SMALL;
     }
 
-    res = ecrypt_auth_sym_encrypt_message_with_passphrase(passphrase,
-                                                          passphrase_length,
-                                                          message,
-                                                          message_length,
-                                                          user_context,
-                                                          user_context_length,
-                                                          encrypted_message,
-                                                          &auth_token_length,
-                                                          encrypted_message + auth_token_length,
-                                                          &ciphertext_length);
+    res = ecrypt_auth_sym_encrypt_message_with_passphrase_ex(passphrase,
+                                                             passphrase_length,
+                                                             message,
+                                                             message_length,
+                                                             user_context,
+                                                             user_context_length,
+                                                             encrypted_message,
+                                                             &auth_token_length,
+                                                             encrypted_message + auth_token_length,
+                                                             &ciphertext_length,
+                                                             iteration_count);
     if (res == ECRYPT_SUCCESS || res == ECRYPT_BUFFER_TOO_SMALL) {
         *encrypted_message_length = auth_token_length + ciphertext_length;
     }
@@ -217,6 +369,34 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase(const uint8_t* p
     return res;
 }
 
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_ex(const uint8_t* master_key,
+                                                            const size_t master_key_length,
+                                                            const uint8_t* user_context,
+                                                            const size_t user_context_length,
+                                                            const uint8_t* message,
+                                                            const size_t message_length,
+                                                            uint8_t* context,
+                                                            size_t* context_length,
+                                                            uint8_t* encrypted_message,
+                                                            size_t* encrypted_message_length,
+                                                            uint32_t flags)
+{
+    /* Token Protect keeps ciphertext length equal to message length */
+    ECRYPT_CHECK_PARAM(!(flags & ECRYPT_SCELL_FLAG_COMPRESS));
+
+    return ecrypt_auth_sym_encrypt_message(master_key,
+                                           master_key_length,
+                                           message,
+                                           message_length,
+                                           user_context,
+                                           user_context_length,
+                                           context,
+                                           context_length,
+                                           encrypted_message,
+                                           encrypted_message_length,
+                                           flags);
+}
+
 ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect(const uint8_t* master_key,
                                                          const size_t master_key_length,
                                                          const uint8_t* user_context,
@@ -228,16 +408,42 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect(const uint8_t* master_k
                                                          uint8_t* encrypted_message,
                                                          size_t* encrypted_message_length)
 {
-    return ecrypt_auth_sym_encrypt_message(master_key,
+    return ecrypt_secure_cell_encrypt_token_protect_ex(master_key,
+                                                       master_key_length,
+                                                       user_context,
+                                                       user_context_length,
+                                                       message,
+                                                       message_length,
+                                                       context,
+                                                       context_length,
+                                                       encrypted_message,
+                                                       encrypted_message_length,
+                                                       0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_ex(const uint8_t* master_key,
+                                                            const size_t master_key_length,
+                                                            const uint8_t* user_context,
+                                                            const size_t user_context_length,
+                                                            const uint8_t* encrypted_message,
+                                                            const size_t encrypted_message_length,
+                                                            const uint8_t* context,
+                                                            const size_t context_length,
+                                                            uint8_t* plain_message,
+                                                            size_t* plain_message_length,
+                                                            uint32_t flags)
+{
+    return ecrypt_auth_sym_decrypt_message(master_key,
                                            master_key_length,
-                                           message,
-                                           message_length,
                                            user_context,
                                            user_context_length,
                                            context,
                                            context_length,
                                            encrypted_message,
-                                           encrypted_message_length);
+                                           encrypted_message_length,
+                                           plain_message,
+                                           plain_message_length,
+                                           flags);
 }
 
 ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect(const uint8_t* master_key,
@@ -251,16 +457,37 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect(const uint8_t* master_k
                                                          uint8_t* plain_message,
                                                          size_t* plain_message_length)
 {
-    return ecrypt_auth_sym_decrypt_message(master_key,
-                                           master_key_length,
-                                           user_context,
-                                           user_context_length,
-                                           context,
-                                           context_length,
-                                           encrypted_message,
-                                           encrypted_message_length,
-                                           plain_message,
-                                           plain_message_length);
+    return ecrypt_secure_cell_decrypt_token_protect_ex(master_key,
+                                                       master_key_length,
+                                                       user_context,
+                                                       user_context_length,
+                                                       encrypted_message,
+                                                       encrypted_message_length,
+                                                       context,
+                                                       context_length,
+                                                       plain_message,
+                                                       plain_message_length,
+                                                       0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_verify_token_protect(const uint8_t* master_key,
+                                                        const size_t master_key_length,
+                                                        const uint8_t* user_context,
+                                                        const size_t user_context_length,
+                                                        const uint8_t* encrypted_message,
+                                                        const size_t encrypted_message_length,
+                                                        const uint8_t* context,
+                                                        const size_t context_length)
+{
+    return ecrypt_auth_sym_verify_message(master_key,
+                                          master_key_length,
+                                          user_context,
+                                          user_context_length,
+                                          context,
+                                          context_length,
+                                          encrypted_message,
+                                          encrypted_message_length,
+                                          0);
 }
 
 ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint(const uint8_t* master_key,
@@ -282,6 +509,27 @@ ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint(const uint8_t* master
                                         encrypted_message_length);
 }
 
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_ex(const uint8_t* master_key,
+                                                              const size_t master_key_length,
+                                                              const uint8_t* encrypted_message,
+                                                              const size_t encrypted_message_length,
+                                                              const uint8_t* context,
+                                                              const size_t context_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length,
+                                                              uint32_t flags)
+{
+    return ecrypt_sym_decrypt_message_u(master_key,
+                                        master_key_length,
+                                        context,
+                                        context_length,
+                                        encrypted_message,
+                                        encrypted_message_length,
+                                        plain_message,
+                                        plain_message_length,
+                                        flags);
+}
+
 ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint(const uint8_t* master_key,
                                                            const size_t master_key_length,
                                                            const uint8_t* encrypted_message,
@@ -291,12 +539,13 @@ ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint(const uint8_t* master
                                                            uint8_t* plain_message,
                                                            size_t* plain_message_length)
 {
-    return ecrypt_sym_decrypt_message_u(master_key,
-                                        master_key_length,
-                                        context,
-                                        context_length,
-                                        encrypted_message,
-                                        encrypted_message_length,
-                                        plain_message,
-                                        plain_message_length);
+    return ecrypt_secure_cell_decrypt_context_imprint_ex(master_key,
+                                                         master_key_length,
+                                                         encrypted_message,
+                                                         encrypted_message_length,
+                                                         context,
+                                                         context_length,
+                                                         plain_message,
+                                                         plain_message_length,
+                                                         0);
 }
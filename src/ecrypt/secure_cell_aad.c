@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell.h"
+
+#include <ecconnect/ecconnect.h>
+
+#include "ecrypt/sym_enc_message.h"
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_aad(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* kdf_context,
+                                                         size_t kdf_context_length,
+                                                         const uint8_t* aad,
+                                                         size_t aad_length,
+                                                         const uint8_t* message,
+                                                         size_t message_length,
+                                                         uint8_t* encrypted_message,
+                                                         size_t* encrypted_message_length,
+                                                         uint32_t flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = 0;
+    size_t ciphertext_length = 0;
+    size_t total_length = 0;
+
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    res = ecrypt_auth_sym_encrypt_message_aad(master_key,
+                                              master_key_length,
+                                              message,
+                                              message_length,
+                                              kdf_context,
+                                              kdf_context_length,
+                                              aad,
+                                              aad_length,
+                                              NULL,
+                                              &auth_token_length,
+                                              NULL,
+                                              &ciphertext_length,
+                                              flags);
+    if (res != ECRYPT_BUFFER_TOO_SMALL) {
+        return res;
+    }
+
+    total_length = auth_token_length + ciphertext_length;
+    if (!encrypted_message || *encrypted_message_length < total_length) {
+        *encrypted_message_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_auth_sym_encrypt_message_aad(master_key,
+                                              master_key_length,
+                                              message,
+                                              message_length,
+                                              kdf_context,
+                                              kdf_context_length,
+                                              aad,
+                                              aad_length,
+                                              encrypted_message,
+                                              &auth_token_length,
+                                              encrypted_message + auth_token_length,
+                                              &ciphertext_length,
+                                              flags);
+    if (res == ECRYPT_SUCCESS) {
+        *encrypted_message_length = auth_token_length + ciphertext_length;
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_aad(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* kdf_context,
+                                                         size_t kdf_context_length,
+                                                         const uint8_t* aad,
+                                                         size_t aad_length,
+                                                         const uint8_t* encrypted_message,
+                                                         size_t encrypted_message_length,
+                                                         uint8_t* plain_message,
+                                                         size_t* plain_message_length,
+                                                         uint32_t flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = 0;
+    size_t message_length = 0;
+
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    /* Ecrypt 0.9.6 could not produce such cells, no need to try its KDF */
+    flags |= ECRYPT_SCELL_FLAG_STRICT;
+
+    res = ecrypt_auth_sym_decrypt_message_aad(master_key,
+                                              master_key_length,
+                                              kdf_context,
+                                              kdf_context_length,
+                                              aad,
+                                              aad_length,
+                                              encrypted_message,
+                                              encrypted_message_length,
+                                              NULL,
+                                              0,
+                                              NULL,
+                                              &message_length,
+                                              flags);
+    if (res != ECRYPT_BUFFER_TOO_SMALL) {
+        return res;
+    }
+    res = ecrypt_scell_seal_auth_token_size(encrypted_message, encrypted_message_length, &auth_token_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    message_length = encrypted_message_length - auth_token_length;
+
+    return ecrypt_auth_sym_decrypt_message_aad(master_key,
+                                               master_key_length,
+                                               kdf_context,
+                                               kdf_context_length,
+                                               aad,
+                                               aad_length,
+                                               encrypted_message,
+                                               auth_token_length,
+                                               encrypted_message + auth_token_length,
+                                               message_length,
+                                               plain_message,
+                                               plain_message_length,
+                                               flags);
+}
+
+ecrypt_status_t ecrypt_secure_cell_context_digest(const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint8_t* digest,
+                                                  size_t* digest_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_hash_ctx_t* hash = NULL;
+
+    ECRYPT_CHECK_PARAM(context != NULL && context_length != 0);
+    ECRYPT_CHECK_PARAM(digest_length != NULL);
+
+    if (!digest || *digest_length < ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH) {
+        *digest_length = ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    hash = ecconnect_hash_create(ECCONNECT_HASH_SHA256);
+    if (!hash) {
+        return ECRYPT_NO_MEMORY;
+    }
+    res = ecconnect_hash_update(hash, context, context_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto out;
+    }
+    *digest_length = ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH;
+    res = ecconnect_hash_final(hash, digest, digest_length);
+
+out:
+    ecconnect_hash_destroy(hash);
+    return res;
+}
@@ -53,6 +53,16 @@
 #define ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS (ECRYPT_DEFAULT_PBKDF2_ITERATIONS)
 #endif
 
+#ifdef ECRYPT_AUTH_SYM_ALG_CHACHA20_POLY1305
+#define ECRYPT_AUTH_SYM_KEY_LENGTH ECCONNECT_SYM_256_KEY_LENGTH
+#define ECRYPT_AUTH_SYM_ALG (ECCONNECT_SYM_CHACHA20_POLY1305 | ECRYPT_AUTH_SYM_KEY_LENGTH)
+#define ECRYPT_AUTH_SYM_IV_LENGTH 12
+#define ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH 16
+#define ECRYPT_AUTH_SYM_PASSPHRASE_ALG (ECRYPT_AUTH_SYM_ALG | ECCONNECT_SYM_PBKDF2)
+#define ECRYPT_AUTH_SYM_PBKDF2_SALT_LENGTH 16
+#define ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS (ECRYPT_DEFAULT_PBKDF2_ITERATIONS)
+#endif
+
 /*default values*/
 #ifndef ECRYPT_AUTH_SYM_ALG
 #define ECRYPT_AUTH_SYM_KEY_LENGTH ECCONNECT_SYM_256_KEY_LENGTH
@@ -66,6 +76,9 @@
 
 #define ECRYPT_AUTH_SYM_MAX_KEY_LENGTH ECCONNECT_SYM_256_KEY_LENGTH
 
+/* Selected with ECRYPT_SCELL_FLAG_CHACHA20_POLY1305, same IV and tag length */
+#define ECRYPT_AUTH_SYM_ALG_CHACHA20_POLY1305_256 (ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_256_KEY_LENGTH)
+
 #ifdef ECRYPT_SYM_ALG_AES_256_CTR
 #define ECRYPT_SYM_KEY_LENGTH ECCONNECT_SYM_256_KEY_LENGTH
 #define ECRYPT_SYM_ALG (ECCONNECT_SYM_AES_CTR | ECRYPT_SYM_KEY_LENGTH)
@@ -92,6 +105,34 @@
 #define ECRYPT_SYM_IV_LENGTH 16
 #endif
 
+/*
+ * Reserved algorithm ID bit marking master key cells which are known to use
+ * current KDF context (32-bit message length). Such cells are never decrypted
+ * with Ecrypt 0.9.6 compatibility KDF. See ECRYPT_SCELL_FLAG_MARK_KDF.
+ *
+ * This is not an ecconnect bit, strip it before passing algorithm ID there.
+ */
+#define ECRYPT_AUTH_SYM_ALG_KDF_CURRENT 0x00001000
+
+/*
+ * Reserved algorithm ID bit marking master key cells which carry 32-bit key ID
+ * after the authentication tag. Implies ECRYPT_AUTH_SYM_ALG_KDF_CURRENT.
+ * See ECRYPT_SCELL_FLAG_KEY_ID.
+ *
+ * This is not an ecconnect bit, strip it before passing algorithm ID there.
+ */
+#define ECRYPT_AUTH_SYM_ALG_KEY_ID 0x00002000
+
+/*
+ * Reserved algorithm ID bit marking master key cells with compressed message.
+ * Such cells carry 32-bit uncompressed length after the authentication tag
+ * (and key ID, if any), message length is the length of compressed data.
+ * Implies ECRYPT_AUTH_SYM_ALG_KDF_CURRENT. See ECRYPT_SCELL_FLAG_COMPRESS.
+ *
+ * This is not an ecconnect bit, strip it before passing algorithm ID there.
+ */
+#define ECRYPT_AUTH_SYM_ALG_COMPRESSED 0x00004000
+
 static inline bool ecconnect_alg_reserved_bits_valid(uint32_t alg)
 {
     static const uint32_t used_bits = ECCONNECT_SYM_KEY_LENGTH_MASK | ECCONNECT_SYM_PADDING_MASK
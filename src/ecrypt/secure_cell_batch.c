@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell_batch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_seal_context.h"
+#include "ecrypt/sym_enc_message.h"
+
+struct ecrypt_scell_batch_queue {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t count;
+    size_t chunk;
+    ecrypt_scell_batch_fn fn;
+    void* arg;
+};
+
+static void* ecrypt_scell_batch_worker(void* param)
+{
+    struct ecrypt_scell_batch_queue* queue = param;
+    size_t begin = 0;
+    size_t end = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        begin = queue->next;
+        end = begin + queue->chunk;
+        if (end > queue->count) {
+            end = queue->count;
+        }
+        queue->next = end;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (begin >= end) {
+            break;
+        }
+        for (; begin < end; begin++) {
+            queue->fn(queue->arg, begin);
+        }
+    }
+    return NULL;
+}
+
+static size_t ecrypt_scell_batch_thread_count(size_t count, size_t thread_count, size_t min_items_per_thread)
+{
+    size_t max_threads = count / min_items_per_thread;
+
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    if (thread_count > max_threads) {
+        thread_count = max_threads;
+    }
+    return (thread_count != 0) ? thread_count : 1;
+}
+
+static ecrypt_status_t ecrypt_scell_batch_run_(size_t count,
+                                               size_t thread_count,
+                                               size_t min_items_per_thread,
+                                               size_t chunk,
+                                               ecrypt_scell_batch_fn fn,
+                                               void* arg)
+{
+    struct ecrypt_scell_batch_queue queue;
+    pthread_t* threads = NULL;
+    size_t started = 0;
+    size_t i = 0;
+
+    thread_count = ecrypt_scell_batch_thread_count(count, thread_count, min_items_per_thread);
+    if (thread_count == 1) {
+        for (i = 0; i < count; i++) {
+            fn(arg, i);
+        }
+        return ECRYPT_SUCCESS;
+    }
+
+    queue.next = 0;
+    queue.count = count;
+    queue.chunk = chunk;
+    queue.fn = fn;
+    queue.arg = arg;
+    if (pthread_mutex_init(&queue.lock, NULL) != 0) {
+        return ECRYPT_FAIL;
+    }
+
+    /* The calling thread is a worker too */
+    threads = calloc(thread_count - 1, sizeof(pthread_t));
+    if (threads) {
+        for (started = 0; started < thread_count - 1; started++) {
+            if (pthread_create(&threads[started], NULL, ecrypt_scell_batch_worker, &queue) != 0) {
+                /* Continue with the threads we have */
+                break;
+            }
+        }
+    }
+
+    ecrypt_scell_batch_worker(&queue);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&queue.lock);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_scell_batch_run(size_t count, size_t thread_count, ecrypt_scell_batch_fn fn, void* arg)
+{
+    return ecrypt_scell_batch_run_(count,
+                                   thread_count,
+                                   ECRYPT_SCELL_BATCH_MIN_ITEMS_PER_THREAD,
+                                   ECRYPT_SCELL_BATCH_CHUNK_ITEMS,
+                                   fn,
+                                   arg);
+}
+
+ecrypt_status_t ecrypt_scell_batch_run_each(size_t count, size_t thread_count, ecrypt_scell_batch_fn fn, void* arg)
+{
+    return ecrypt_scell_batch_run_(count, thread_count, 1, 1, fn, arg);
+}
+
+enum ecrypt_scell_batch_op {
+    ECRYPT_SCELL_BATCH_ENCRYPT,
+    ECRYPT_SCELL_BATCH_DECRYPT,
+    ECRYPT_SCELL_BATCH_RESEAL,
+};
+
+struct ecrypt_scell_seal_batch {
+    ecrypt_secure_cell_seal_ctx_t* ctx;
+    /* Only for reseal */
+    ecrypt_secure_cell_seal_ctx_t* new_ctx;
+    ecrypt_secure_cell_batch_item_t* items;
+    uint8_t* output;
+};
+
+static void ecrypt_scell_encrypt_seal_batch_item(void* arg, size_t index)
+{
+    struct ecrypt_scell_seal_batch* batch = arg;
+    ecrypt_secure_cell_batch_item_t* item = &batch->items[index];
+    size_t output_length = item->output_length;
+
+    if (item->status != ECRYPT_SUCCESS) {
+        return;
+    }
+    item->status = ecrypt_secure_cell_encrypt_seal_with_ctx(batch->ctx,
+                                                            item->user_context,
+                                                            item->user_context_length,
+                                                            item->input,
+                                                            item->input_length,
+                                                            batch->output + item->output_offset,
+                                                            &output_length);
+    if (item->status == ECRYPT_SUCCESS) {
+        item->output_length = output_length;
+    }
+}
+
+static void ecrypt_scell_decrypt_seal_batch_item(void* arg, size_t index)
+{
+    struct ecrypt_scell_seal_batch* batch = arg;
+    ecrypt_secure_cell_batch_item_t* item = &batch->items[index];
+    size_t output_length = item->output_length;
+
+    if (item->status != ECRYPT_SUCCESS) {
+        return;
+    }
+    item->status = ecrypt_secure_cell_decrypt_seal_with_ctx(batch->ctx,
+                                                            item->user_context,
+                                                            item->user_context_length,
+                                                            item->input,
+                                                            item->input_length,
+                                                            batch->output + item->output_offset,
+                                                            &output_length);
+    if (item->status == ECRYPT_SUCCESS) {
+        item->output_length = output_length;
+    } else {
+        /* Do not leave unauthenticated plaintext around */
+        ecconnect_wipe(batch->output + item->output_offset, item->output_length);
+    }
+}
+
+static void ecrypt_scell_reseal_batch_item(void* arg, size_t index)
+{
+    struct ecrypt_scell_seal_batch* batch = arg;
+    ecrypt_secure_cell_batch_item_t* item = &batch->items[index];
+    size_t output_length = item->output_length;
+
+    if (item->status != ECRYPT_SUCCESS) {
+        return;
+    }
+    item->status = ecrypt_secure_cell_reseal_with_ctx(batch->ctx,
+                                                      batch->new_ctx,
+                                                      item->user_context,
+                                                      item->user_context_length,
+                                                      item->input,
+                                                      item->input_length,
+                                                      batch->output + item->output_offset,
+                                                      &output_length);
+    if (item->status == ECRYPT_SUCCESS) {
+        item->output_length = output_length;
+    }
+}
+
+static ecrypt_status_t ecrypt_scell_batch_item_valid(const ecrypt_secure_cell_batch_item_t* item)
+{
+    if (item->input == NULL || item->input_length == 0) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    if (item->user_context == NULL && item->user_context_length != 0) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+/*
+ * Lays out records in the output arena back to back. Records which are
+ * invalid get their status set and take no space.
+ */
+static ecrypt_status_t ecrypt_scell_seal_batch_layout(ecrypt_secure_cell_batch_item_t* items,
+                                                      size_t item_count,
+                                                      enum ecrypt_scell_batch_op op,
+                                                      uint32_t flags,
+                                                      size_t* total_length)
+{
+    size_t offset = 0;
+    size_t length = 0;
+    size_t auth_token_length = 0;
+    size_t i = 0;
+    uint32_t message_length = 0;
+    uint32_t reseal_flags = 0;
+
+    for (i = 0; i < item_count; i++) {
+        ecrypt_secure_cell_batch_item_t* item = &items[i];
+
+        item->output_offset = offset;
+        item->output_length = 0;
+        item->status = ecrypt_scell_batch_item_valid(item);
+        if (item->status != ECRYPT_SUCCESS) {
+            continue;
+        }
+
+        if (op == ECRYPT_SCELL_BATCH_ENCRYPT) {
+            /* Compressed records get space for the worst case */
+            item->status = ecrypt_secure_cell_seal_output_size(item->input_length, flags, &length);
+            if (item->status != ECRYPT_SUCCESS) {
+                continue;
+            }
+        } else {
+            item->status = ecrypt_scell_auth_token_key_message_size(item->input,
+                                                                   item->input_length,
+                                                                   &message_length);
+            if (item->status != ECRYPT_SUCCESS) {
+                continue;
+            }
+            if (message_length == 0
+                || ecrypt_scell_seal_auth_token_size(item->input, item->input_length, &auth_token_length)
+                       != ECRYPT_SUCCESS) {
+                item->status = ECRYPT_FAIL;
+                continue;
+            }
+            length = message_length;
+            if (op == ECRYPT_SCELL_BATCH_RESEAL) {
+                /*
+                 * Compressed records are compressed again and keep their length
+                 * if the token layout stays the same, otherwise reserve the
+                 * upper bound. See ecrypt_secure_cell_reseal_with_ctx().
+                 */
+                reseal_flags = ecrypt_scell_auth_token_key_is_compressed(item->input, item->input_length)
+                                   ? ECRYPT_SCELL_FLAG_COMPRESS
+                                   : 0;
+                if (reseal_flags != 0
+                    && auth_token_length == ecrypt_scell_ctx_auth_token_size(reseal_flags, message_length)) {
+                    length = item->input_length;
+                } else {
+                    item->status = ecrypt_secure_cell_seal_output_size(message_length, reseal_flags, &length);
+                    if (item->status != ECRYPT_SUCCESS) {
+                        continue;
+                    }
+                }
+            }
+        }
+
+        if (length > SIZE_MAX - offset) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        item->output_length = length;
+        offset += length;
+    }
+
+    *total_length = offset;
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_seal_batch(const uint8_t* master_key,
+                                               size_t master_key_length,
+                                               const uint8_t* new_master_key,
+                                               size_t new_master_key_length,
+                                               ecrypt_secure_cell_batch_item_t* items,
+                                               size_t item_count,
+                                               uint8_t* output,
+                                               size_t* output_length,
+                                               size_t thread_count,
+                                               enum ecrypt_scell_batch_op op,
+                                               uint32_t flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_seal_batch batch;
+    ecrypt_scell_batch_fn fn = NULL;
+    size_t total_length = 0;
+    size_t i = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (op == ECRYPT_SCELL_BATCH_RESEAL) {
+        ECRYPT_CHECK_PARAM(new_master_key != NULL && new_master_key_length != 0);
+    }
+    ECRYPT_CHECK_PARAM(items != NULL && item_count != 0);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+    ECRYPT_CHECK_PARAM(ecrypt_scell_ctx_flags_valid(flags));
+
+    res = ecrypt_scell_seal_batch_layout(items, item_count, op, flags, &total_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (!output || *output_length < total_length) {
+        *output_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    batch.ctx = ecrypt_secure_cell_seal_ctx_create(master_key, master_key_length);
+    if (!batch.ctx) {
+        return ECRYPT_NO_MEMORY;
+    }
+    res = ecrypt_secure_cell_seal_ctx_set_flags(batch.ctx, flags);
+    if (res != ECRYPT_SUCCESS) {
+        ecrypt_secure_cell_seal_ctx_destroy(batch.ctx);
+        return res;
+    }
+    batch.new_ctx = NULL;
+    if (op == ECRYPT_SCELL_BATCH_RESEAL) {
+        batch.new_ctx = ecrypt_secure_cell_seal_ctx_create(new_master_key, new_master_key_length);
+        if (!batch.new_ctx) {
+            ecrypt_secure_cell_seal_ctx_destroy(batch.ctx);
+            return ECRYPT_NO_MEMORY;
+        }
+    }
+    batch.items = items;
+    batch.output = output;
+
+    switch (op) {
+    case ECRYPT_SCELL_BATCH_ENCRYPT:
+        fn = ecrypt_scell_encrypt_seal_batch_item;
+        break;
+    case ECRYPT_SCELL_BATCH_DECRYPT:
+        fn = ecrypt_scell_decrypt_seal_batch_item;
+        break;
+    case ECRYPT_SCELL_BATCH_RESEAL:
+        fn = ecrypt_scell_reseal_batch_item;
+        break;
+    }
+    res = ecrypt_scell_batch_run(item_count, thread_count, fn, &batch);
+    ecrypt_secure_cell_seal_ctx_destroy(batch.new_ctx);
+    ecrypt_secure_cell_seal_ctx_destroy(batch.ctx);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *output_length = total_length;
+    for (i = 0; i < item_count; i++) {
+        if (items[i].status != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+    }
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_batch_ex(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         ecrypt_secure_cell_batch_item_t* items,
+                                                         size_t item_count,
+                                                         uint8_t* output,
+                                                         size_t* output_length,
+                                                         size_t thread_count,
+                                                         uint32_t flags)
+{
+    return ecrypt_scell_seal_batch(master_key,
+                                   master_key_length,
+                                   NULL,
+                                   0,
+                                   items,
+                                   item_count,
+                                   output,
+                                   output_length,
+                                   thread_count,
+                                   ECRYPT_SCELL_BATCH_ENCRYPT,
+                                   flags);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_batch(const uint8_t* master_key,
+                                                      size_t master_key_length,
+                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                      size_t item_count,
+                                                      uint8_t* output,
+                                                      size_t* output_length,
+                                                      size_t thread_count)
+{
+    return ecrypt_secure_cell_encrypt_seal_batch_ex(master_key,
+                                                    master_key_length,
+                                                    items,
+                                                    item_count,
+                                                    output,
+                                                    output_length,
+                                                    thread_count,
+                                                    0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_batch(const uint8_t* master_key,
+                                                      size_t master_key_length,
+                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                      size_t item_count,
+                                                      uint8_t* output,
+                                                      size_t* output_length,
+                                                      size_t thread_count)
+{
+    return ecrypt_scell_seal_batch(master_key,
+                                   master_key_length,
+                                   NULL,
+                                   0,
+                                   items,
+                                   item_count,
+                                   output,
+                                   output_length,
+                                   thread_count,
+                                   ECRYPT_SCELL_BATCH_DECRYPT,
+                                   0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_reseal_batch(const uint8_t* old_master_key,
+                                                size_t old_master_key_length,
+                                                const uint8_t* new_master_key,
+                                                size_t new_master_key_length,
+                                                ecrypt_secure_cell_batch_item_t* items,
+                                                size_t item_count,
+                                                uint8_t* output,
+                                                size_t* output_length,
+                                                size_t thread_count)
+{
+    return ecrypt_scell_seal_batch(old_master_key,
+                                   old_master_key_length,
+                                   new_master_key,
+                                   new_master_key_length,
+                                   items,
+                                   item_count,
+                                   output,
+                                   output_length,
+                                   thread_count,
+                                   ECRYPT_SCELL_BATCH_RESEAL,
+                                   0);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @internal
+ * @file secure_cell_batch.h
+ * @brief Secure Cell batch processing
+ *
+ * @warning Structures and functions declared in this file are considered
+ * implementation details and may change without notice.
+ */
+
+#ifndef ECRYPT_SECURE_CELL_BATCH_H
+#define ECRYPT_SECURE_CELL_BATCH_H
+
+#include <ecrypt/ecrypt_error.h>
+
+/* Do not spawn a worker thread for less records than this */
+#define ECRYPT_SCELL_BATCH_MIN_ITEMS_PER_THREAD 16
+
+/* Records are handed out to workers in chunks of this size */
+#define ECRYPT_SCELL_BATCH_CHUNK_ITEMS 64
+
+typedef void (*ecrypt_scell_batch_fn)(void* arg, size_t index);
+
+/*
+ * Calls fn(arg, i) for each i in [0, count) using up to thread_count threads
+ * (zero means one per online CPU). The calling thread takes part in the work.
+ * Each index is processed exactly once, in no particular order.
+ */
+ecrypt_status_t ecrypt_scell_batch_run(size_t count, size_t thread_count, ecrypt_scell_batch_fn fn, void* arg);
+
+/*
+ * Same as ecrypt_scell_batch_run() for expensive items: they are handed
+ * out one by one and each may get its own thread.
+ */
+ecrypt_status_t ecrypt_scell_batch_run_each(size_t count, size_t thread_count, ecrypt_scell_batch_fn fn, void* arg);
+
+#endif /* ECRYPT_SECURE_CELL_BATCH_H */
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_batch.h"
+
+/*
+ * Column key is derived from the master key and column context, then each
+ * tag is ecconnect KDF of the value with the column key. ecconnect KDF does
+ * not mix output length into HMAC, so shorter tags are prefixes of longer ones.
+ */
+#define ECRYPT_SCELL_BLIND_INDEX_KEY_LABEL "Ecrypt secure cell blind index key"
+#define ECRYPT_SCELL_BLIND_INDEX_TAG_LABEL "Ecrypt secure cell blind index"
+
+#define ECRYPT_SCELL_BLIND_INDEX_KEY_LENGTH 32
+
+/* Values are handed out to threads in blocks of this size */
+#define ECRYPT_SCELL_BLIND_INDEX_BLOCK_ITEMS 256
+
+static ecconnect_kdf_ctx_t* ecrypt_scell_blind_index_ctx(const uint8_t* master_key,
+                                                        size_t master_key_length,
+                                                        const uint8_t* column_context,
+                                                        size_t column_context_length)
+{
+    ecconnect_kdf_ctx_t* kdf = NULL;
+    uint8_t column_key[ECRYPT_SCELL_BLIND_INDEX_KEY_LENGTH] = {0};
+    ecconnect_kdf_context_buf_t context = {column_context, column_context_length};
+
+    if (ecconnect_kdf(master_key,
+                      master_key_length,
+                      ECRYPT_SCELL_BLIND_INDEX_KEY_LABEL,
+                      &context,
+                      1,
+                      column_key,
+                      sizeof(column_key))
+        == ECCONNECT_SUCCESS) {
+        kdf = ecconnect_kdf_ctx_create(column_key, sizeof(column_key));
+    }
+
+    ecconnect_wipe(column_key, sizeof(column_key));
+
+    return kdf;
+}
+
+static ecrypt_status_t ecrypt_scell_blind_index_tag(const ecconnect_kdf_ctx_t* kdf,
+                                                   const uint8_t* value,
+                                                   size_t value_length,
+                                                   uint8_t* tag,
+                                                   size_t tag_length)
+{
+    ecconnect_kdf_context_buf_t context = {value, value_length};
+
+    return ecconnect_kdf_ctx_derive(kdf, ECRYPT_SCELL_BLIND_INDEX_TAG_LABEL, &context, 1, tag, tag_length);
+}
+
+ecrypt_status_t ecrypt_secure_cell_blind_index(const uint8_t* master_key,
+                                               size_t master_key_length,
+                                               const uint8_t* column_context,
+                                               size_t column_context_length,
+                                               const uint8_t* value,
+                                               size_t value_length,
+                                               uint8_t* tag,
+                                               size_t tag_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_kdf_ctx_t* kdf = NULL;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (column_context_length != 0) {
+        ECRYPT_CHECK_PARAM(column_context != NULL);
+    }
+    if (value_length != 0) {
+        ECRYPT_CHECK_PARAM(value != NULL);
+    }
+    ECRYPT_CHECK_PARAM(tag != NULL);
+    ECRYPT_CHECK_PARAM(tag_length != 0 && tag_length <= ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH);
+
+    kdf = ecrypt_scell_blind_index_ctx(master_key, master_key_length, column_context, column_context_length);
+    if (!kdf) {
+        return ECRYPT_FAIL;
+    }
+
+    res = ecrypt_scell_blind_index_tag(kdf, value, value_length, tag, tag_length);
+
+    ecconnect_kdf_ctx_destroy(kdf);
+
+    return res;
+}
+
+struct ecrypt_scell_blind_index_batch {
+    const ecconnect_kdf_ctx_t* kdf;
+    const uint8_t* values;
+    const size_t* offsets;
+    size_t item_count;
+    uint8_t* tags;
+    size_t tag_length;
+    /* One per block */
+    ecrypt_status_t* status;
+};
+
+static void ecrypt_scell_blind_index_block(void* arg, size_t block)
+{
+    struct ecrypt_scell_blind_index_batch* batch = arg;
+    size_t begin = block * ECRYPT_SCELL_BLIND_INDEX_BLOCK_ITEMS;
+    size_t end = begin + ECRYPT_SCELL_BLIND_INDEX_BLOCK_ITEMS;
+    size_t i = 0;
+
+    if (end > batch->item_count) {
+        end = batch->item_count;
+    }
+
+    for (i = begin; i < end; i++) {
+        batch->status[block] = ecrypt_scell_blind_index_tag(batch->kdf,
+                                                            batch->values + batch->offsets[i]
+                                                                - batch->offsets[0],
+                                                            batch->offsets[i + 1] - batch->offsets[i],
+                                                            batch->tags + i * batch->tag_length,
+                                                            batch->tag_length);
+        if (batch->status[block] != ECRYPT_SUCCESS) {
+            break;
+        }
+    }
+}
+
+ecrypt_status_t ecrypt_secure_cell_blind_index_batch(const uint8_t* master_key,
+                                                     size_t master_key_length,
+                                                     const uint8_t* column_context,
+                                                     size_t column_context_length,
+                                                     const uint8_t* values,
+                                                     const size_t* offsets,
+                                                     size_t item_count,
+                                                     uint8_t* tags,
+                                                     size_t tag_length,
+                                                     size_t thread_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_blind_index_batch batch;
+    ecconnect_kdf_ctx_t* kdf = NULL;
+    size_t block_count = 0;
+    size_t i = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (column_context_length != 0) {
+        ECRYPT_CHECK_PARAM(column_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(offsets != NULL && item_count != 0);
+    ECRYPT_CHECK_PARAM(values != NULL || offsets[item_count] == offsets[0]);
+    for (i = 0; i < item_count; i++) {
+        ECRYPT_CHECK_PARAM(offsets[i] <= offsets[i + 1]);
+    }
+    ECRYPT_CHECK_PARAM(tags != NULL);
+    ECRYPT_CHECK_PARAM(tag_length != 0 && tag_length <= ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH);
+
+    block_count = (item_count + ECRYPT_SCELL_BLIND_INDEX_BLOCK_ITEMS - 1) / ECRYPT_SCELL_BLIND_INDEX_BLOCK_ITEMS;
+    batch.status = calloc(block_count, sizeof(*batch.status));
+    if (!batch.status) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    kdf = ecrypt_scell_blind_index_ctx(master_key, master_key_length, column_context, column_context_length);
+    if (!kdf) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    batch.kdf = kdf;
+    batch.values = values;
+    batch.offsets = offsets;
+    batch.item_count = item_count;
+    batch.tags = tags;
+    batch.tag_length = tag_length;
+
+    res = ecrypt_scell_batch_run_each(block_count, thread_count, ecrypt_scell_blind_index_block, &batch);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    for (i = 0; i < block_count; i++) {
+        if (batch.status[i] != ECRYPT_SUCCESS) {
+            res = batch.status[i];
+            break;
+        }
+    }
+
+error:
+    ecconnect_kdf_ctx_destroy(kdf);
+    free(batch.status);
+
+    return res;
+}
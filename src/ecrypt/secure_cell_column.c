@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_batch.h"
+#include "ecrypt/secure_cell_seal_context.h"
+
+/*
+ * Records are processed in blocks, each block holds one scratch space
+ * (with its cipher contexts) for all its records. Blocks are distributed
+ * between threads.
+ */
+#define ECRYPT_SCELL_COLUMN_BLOCK_ITEMS ECRYPT_SCELL_BATCH_CHUNK_ITEMS
+
+/*
+ * Without per-record context the derived key depends only on value length,
+ * so a column usually needs just a handful of distinct keys.
+ */
+#define ECRYPT_SCELL_COLUMN_KEY_CACHE_CAPACITY 64
+
+struct ecrypt_scell_column {
+    ecrypt_secure_cell_seal_ctx_t* ctx;
+    const uint8_t* input;
+    const size_t* offsets;
+    size_t item_count;
+    const uint8_t* user_contexts;
+    const size_t* user_context_offsets;
+    uint8_t* output;
+    uint8_t* tokens;
+    size_t token_stride;
+    /* One per block */
+    ecrypt_status_t* status;
+};
+
+static ecrypt_status_t ecrypt_scell_column_check_offsets(const size_t* offsets, size_t item_count, bool nonempty)
+{
+    size_t i = 0;
+
+    for (i = 0; i < item_count; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        if (nonempty && offsets[i + 1] == offsets[i]) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_column_check(const uint8_t* input,
+                                                 const size_t* offsets,
+                                                 size_t item_count,
+                                                 const uint8_t* user_contexts,
+                                                 const size_t* user_context_offsets)
+{
+    ECRYPT_CHECK_PARAM(input != NULL && offsets != NULL && item_count != 0);
+    if (user_context_offsets) {
+        ECRYPT_CHECK_PARAM(user_contexts != NULL
+                           || user_context_offsets[item_count] == user_context_offsets[0]);
+        ECRYPT_STATUS_CHECK(ecrypt_scell_column_check_offsets(user_context_offsets, item_count, false),
+                            ECRYPT_SUCCESS);
+    }
+    return ecrypt_scell_column_check_offsets(offsets, item_count, true);
+}
+
+static void ecrypt_scell_column_record(const struct ecrypt_scell_column* column,
+                                       size_t index,
+                                       const uint8_t** user_context,
+                                       size_t* user_context_length,
+                                       size_t* offset,
+                                       size_t* length)
+{
+    *offset = column->offsets[index] - column->offsets[0];
+    *length = column->offsets[index + 1] - column->offsets[index];
+    *user_context = NULL;
+    *user_context_length = 0;
+    if (column->user_context_offsets) {
+        *user_context = column->user_contexts + column->user_context_offsets[index]
+                        - column->user_context_offsets[0];
+        *user_context_length = column->user_context_offsets[index + 1]
+                               - column->user_context_offsets[index];
+    }
+}
+
+static void ecrypt_scell_encrypt_column_block(void* arg, size_t block)
+{
+    struct ecrypt_scell_column* column = arg;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    /* IVs for the whole block are generated at once */
+    uint8_t ivs[ECRYPT_SCELL_COLUMN_BLOCK_ITEMS][ECRYPT_AUTH_SYM_IV_LENGTH];
+    size_t begin = block * ECRYPT_SCELL_COLUMN_BLOCK_ITEMS;
+    size_t end = begin + ECRYPT_SCELL_COLUMN_BLOCK_ITEMS;
+    size_t i = 0;
+
+    if (end > column->item_count) {
+        end = column->item_count;
+    }
+
+    column->status[block] = ecconnect_rand(&ivs[0][0], (end - begin) * sizeof(ivs[0]));
+    if (column->status[block] != ECRYPT_SUCCESS) {
+        return;
+    }
+
+    scratch = ecrypt_scell_scratch_acquire(column->ctx);
+    if (!scratch) {
+        column->status[block] = ECRYPT_NO_MEMORY;
+        return;
+    }
+
+    for (i = begin; i < end; i++) {
+        const uint8_t* user_context = NULL;
+        size_t user_context_length = 0;
+        size_t offset = 0;
+        size_t length = 0;
+        uint8_t* token = column->tokens + i * column->token_stride;
+        size_t token_length = column->token_stride;
+
+        ecrypt_scell_column_record(column, i, &user_context, &user_context_length, &offset, &length);
+
+        column->status[block] = ecrypt_scell_ctx_encrypt_detached(column->ctx,
+                                                                  scratch,
+                                                                  user_context,
+                                                                  user_context_length,
+                                                                  column->input + offset,
+                                                                  length,
+                                                                  token,
+                                                                  &token_length,
+                                                                  column->output + offset,
+                                                                  ivs[i - begin]);
+        if (column->status[block] != ECRYPT_SUCCESS) {
+            break;
+        }
+        /* Keep padding deterministic */
+        memset(token + token_length, 0, column->token_stride - token_length);
+    }
+
+    ecrypt_scell_scratch_release(column->ctx, scratch);
+    ecconnect_wipe(ivs, sizeof(ivs));
+}
+
+static void ecrypt_scell_decrypt_column_block(void* arg, size_t block)
+{
+    struct ecrypt_scell_column* column = arg;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    size_t begin = block * ECRYPT_SCELL_COLUMN_BLOCK_ITEMS;
+    size_t end = begin + ECRYPT_SCELL_COLUMN_BLOCK_ITEMS;
+    size_t i = 0;
+
+    if (end > column->item_count) {
+        end = column->item_count;
+    }
+
+    scratch = ecrypt_scell_scratch_acquire(column->ctx);
+    if (!scratch) {
+        column->status[block] = ECRYPT_NO_MEMORY;
+        return;
+    }
+
+    for (i = begin; i < end; i++) {
+        const uint8_t* user_context = NULL;
+        size_t user_context_length = 0;
+        size_t offset = 0;
+        size_t length = 0;
+
+        ecrypt_scell_column_record(column, i, &user_context, &user_context_length, &offset, &length);
+
+        column->status[block] = ecrypt_scell_ctx_decrypt_detached(column->ctx,
+                                                                  scratch,
+                                                                  user_context,
+                                                                  user_context_length,
+                                                                  column->tokens + i * column->token_stride,
+                                                                  column->token_stride,
+                                                                  column->input + offset,
+                                                                  length,
+                                                                  column->output + offset);
+        if (column->status[block] != ECRYPT_SUCCESS) {
+            break;
+        }
+    }
+
+    ecrypt_scell_scratch_release(column->ctx, scratch);
+}
+
+static ecrypt_status_t ecrypt_scell_column_run(struct ecrypt_scell_column* column,
+                                               const uint8_t* master_key,
+                                               size_t master_key_length,
+                                               size_t thread_count,
+                                               ecrypt_scell_batch_fn fn)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t block_count = (column->item_count + ECRYPT_SCELL_COLUMN_BLOCK_ITEMS - 1)
+                         / ECRYPT_SCELL_COLUMN_BLOCK_ITEMS;
+    size_t i = 0;
+
+    column->status = calloc(block_count, sizeof(*column->status));
+    if (!column->status) {
+        return ECRYPT_NO_MEMORY;
+    }
+    column->ctx = ecrypt_secure_cell_seal_ctx_create(master_key, master_key_length);
+    if (!column->ctx) {
+        res = ECRYPT_NO_MEMORY;
+        goto error;
+    }
+    if (!column->user_context_offsets) {
+        res = ecrypt_secure_cell_seal_ctx_set_key_cache(column->ctx, ECRYPT_SCELL_COLUMN_KEY_CACHE_CAPACITY);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+    }
+
+    res = ecrypt_scell_batch_run_each(block_count, thread_count, fn, column);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    for (i = 0; i < block_count; i++) {
+        if (column->status[i] != ECRYPT_SUCCESS) {
+            res = column->status[i];
+            break;
+        }
+    }
+
+error:
+    ecrypt_secure_cell_seal_ctx_destroy(column->ctx);
+    free(column->status);
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_token_protect_column_stride(size_t* token_stride)
+{
+    size_t token_length = 0;
+
+    ECRYPT_CHECK_PARAM(token_stride != NULL);
+
+    token_length = ecrypt_scell_auth_token_key_default_size();
+    *token_stride = (token_length + ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT - 1)
+                    / ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT * ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT;
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_column(const uint8_t* master_key,
+                                                                size_t master_key_length,
+                                                                const uint8_t* values,
+                                                                const size_t* offsets,
+                                                                size_t item_count,
+                                                                const uint8_t* user_contexts,
+                                                                const size_t* user_context_offsets,
+                                                                uint8_t* encrypted_values,
+                                                                uint8_t* tokens,
+                                                                size_t* tokens_length,
+                                                                size_t thread_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_column column;
+    size_t token_stride = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    res = ecrypt_scell_column_check(values, offsets, item_count, user_contexts, user_context_offsets);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(encrypted_values != NULL);
+    ECRYPT_CHECK_PARAM(tokens_length != NULL);
+
+    ecrypt_secure_cell_token_protect_column_stride(&token_stride);
+    if (item_count > SIZE_MAX / token_stride) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    if (!tokens || *tokens_length < item_count * token_stride) {
+        *tokens_length = item_count * token_stride;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    memset(&column, 0, sizeof(column));
+    column.input = values;
+    column.offsets = offsets;
+    column.item_count = item_count;
+    column.user_contexts = user_contexts;
+    column.user_context_offsets = user_context_offsets;
+    column.output = encrypted_values;
+    column.tokens = tokens;
+    column.token_stride = token_stride;
+
+    res = ecrypt_scell_column_run(&column,
+                                  master_key,
+                                  master_key_length,
+                                  thread_count,
+                                  ecrypt_scell_encrypt_column_block);
+    if (res == ECRYPT_SUCCESS) {
+        *tokens_length = item_count * token_stride;
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_column(const uint8_t* master_key,
+                                                                size_t master_key_length,
+                                                                const uint8_t* encrypted_values,
+                                                                const size_t* offsets,
+                                                                size_t item_count,
+                                                                const uint8_t* user_contexts,
+                                                                const size_t* user_context_offsets,
+                                                                const uint8_t* tokens,
+                                                                size_t tokens_length,
+                                                                uint8_t* values,
+                                                                size_t thread_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_column column;
+    size_t token_stride = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    res = ecrypt_scell_column_check(encrypted_values, offsets, item_count, user_contexts, user_context_offsets);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(tokens != NULL && tokens_length % item_count == 0);
+    ECRYPT_CHECK_PARAM(values != NULL);
+
+    /* Tokens of all records have the same stride, whatever it is */
+    token_stride = tokens_length / item_count;
+    ECRYPT_CHECK_PARAM(token_stride != 0);
+
+    memset(&column, 0, sizeof(column));
+    column.input = encrypted_values;
+    column.offsets = offsets;
+    column.item_count = item_count;
+    column.user_contexts = user_contexts;
+    column.user_context_offsets = user_context_offsets;
+    column.output = values;
+    /* Tokens are not modified */
+    column.tokens = (uint8_t*)tokens;
+    column.token_stride = token_stride;
+
+    res = ecrypt_scell_column_run(&column,
+                                  master_key,
+                                  master_key_length,
+                                  thread_count,
+                                  ecrypt_scell_decrypt_column_block);
+    if (res != ECRYPT_SUCCESS) {
+        /* Do not leave unauthenticated plaintext around */
+        ecconnect_wipe(values, offsets[item_count] - offsets[0]);
+    }
+    return res;
+}
@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * Envelope record layout:
+ *
+ *   uint32  magic (ECRYPT_SCELL_ENVELOPE_MAGIC)
+ *   byte[]  data key ID (ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH bytes)
+ *   uint32  wrapped data key length
+ *   byte[]  wrapped data key
+ *   byte[]  body: master key sealed cell with the data key as master key
+ *
+ * All integers are little-endian. The body uses user context of the record.
+ */
+#define ECRYPT_SCELL_ENVELOPE_MAGIC 0x31564e45 /* "ENV1" */
+
+#define ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH \
+    (sizeof(uint32_t) + ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH + sizeof(uint32_t))
+
+#define ECRYPT_SCELL_ENVELOPE_DEFAULT_CACHE_CAPACITY 64
+#define ECRYPT_SCELL_ENVELOPE_DEFAULT_MAX_AGE_SECONDS 300
+#define ECRYPT_SCELL_ENVELOPE_DEFAULT_MAX_USES (UINT64_C(1) << 20)
+
+#define ECRYPT_NS_PER_SECOND UINT64_C(1000000000)
+
+struct ecrypt_scell_envelope_key {
+    bool valid;
+    uint8_t key_id[ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH];
+    uint8_t data_key[ECRYPT_SCELL_ENVELOPE_DATA_KEY_LENGTH];
+    /* Cached keys are used only for records with the same wrapped key */
+    uint8_t wrapped_key[ECRYPT_SCELL_ENVELOPE_MAX_WRAPPED_KEY_LENGTH];
+    size_t wrapped_key_length;
+    uint64_t created_ns;
+    uint64_t uses;
+    /* Recency stamp for eviction */
+    uint64_t last_used;
+};
+
+struct ecrypt_secure_cell_envelope_type {
+    ecrypt_secure_cell_envelope_wrap_callback wrap;
+    ecrypt_secure_cell_envelope_unwrap_callback unwrap;
+    void* user_data;
+
+    /* Zero means no limit */
+    uint64_t max_age_ns;
+    uint64_t max_uses;
+
+    /* Data key used for encryption, rotated when limits are reached */
+    pthread_mutex_t encrypt_lock;
+    struct ecrypt_scell_envelope_key current;
+    uint64_t wrap_count;
+
+    /* Unwrapped data keys used for decryption */
+    pthread_mutex_t cache_lock;
+    struct ecrypt_scell_envelope_key* cache;
+    size_t cache_capacity;
+    uint64_t cache_clock;
+    uint64_t cache_hits;
+    uint64_t unwrap_count;
+};
+
+static uint64_t ecrypt_monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * ECRYPT_NS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static bool ecrypt_scell_envelope_key_expired(const ecrypt_secure_cell_envelope_t* envelope,
+                                              const struct ecrypt_scell_envelope_key* key,
+                                              uint64_t now)
+{
+    if (envelope->max_age_ns != 0 && now - key->created_ns >= envelope->max_age_ns) {
+        return true;
+    }
+    if (envelope->max_uses != 0 && key->uses >= envelope->max_uses) {
+        return true;
+    }
+    return false;
+}
+
+static struct ecrypt_scell_envelope_key* ecrypt_scell_envelope_cache_alloc(size_t capacity)
+{
+    if (capacity == 0) {
+        return NULL;
+    }
+    return calloc(capacity, sizeof(struct ecrypt_scell_envelope_key));
+}
+
+static void ecrypt_scell_envelope_cache_free(struct ecrypt_scell_envelope_key* cache, size_t capacity)
+{
+    if (cache) {
+        ecconnect_wipe(cache, capacity * sizeof(*cache));
+        free(cache);
+    }
+}
+
+ecrypt_secure_cell_envelope_t* ecrypt_secure_cell_envelope_create(ecrypt_secure_cell_envelope_wrap_callback wrap,
+                                                                  ecrypt_secure_cell_envelope_unwrap_callback unwrap,
+                                                                  void* user_data)
+{
+    ecrypt_secure_cell_envelope_t* envelope = NULL;
+
+    ECRYPT_CHECK_PARAM_(wrap != NULL && unwrap != NULL);
+
+    envelope = calloc(1, sizeof(*envelope));
+    ECRYPT_CHECK_MALLOC_(envelope);
+
+    if (pthread_mutex_init(&envelope->encrypt_lock, NULL) != 0) {
+        free(envelope);
+        return NULL;
+    }
+    if (pthread_mutex_init(&envelope->cache_lock, NULL) != 0) {
+        pthread_mutex_destroy(&envelope->encrypt_lock);
+        free(envelope);
+        return NULL;
+    }
+
+    envelope->cache = ecrypt_scell_envelope_cache_alloc(ECRYPT_SCELL_ENVELOPE_DEFAULT_CACHE_CAPACITY);
+    if (!envelope->cache) {
+        ecrypt_secure_cell_envelope_destroy(envelope);
+        return NULL;
+    }
+    envelope->cache_capacity = ECRYPT_SCELL_ENVELOPE_DEFAULT_CACHE_CAPACITY;
+
+    envelope->wrap = wrap;
+    envelope->unwrap = unwrap;
+    envelope->user_data = user_data;
+    envelope->max_age_ns = ECRYPT_SCELL_ENVELOPE_DEFAULT_MAX_AGE_SECONDS * ECRYPT_NS_PER_SECOND;
+    envelope->max_uses = ECRYPT_SCELL_ENVELOPE_DEFAULT_MAX_USES;
+
+    return envelope;
+}
+
+ecrypt_status_t ecrypt_secure_cell_envelope_destroy(ecrypt_secure_cell_envelope_t* envelope)
+{
+    if (!envelope) {
+        return ECRYPT_SUCCESS;
+    }
+
+    ecrypt_scell_envelope_cache_free(envelope->cache, envelope->cache_capacity);
+    ecconnect_wipe(&envelope->current, sizeof(envelope->current));
+    pthread_mutex_destroy(&envelope->cache_lock);
+    pthread_mutex_destroy(&envelope->encrypt_lock);
+    free(envelope);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_envelope_set_limits(ecrypt_secure_cell_envelope_t* envelope,
+                                                       size_t cache_capacity,
+                                                       uint32_t max_age_seconds,
+                                                       uint64_t max_uses)
+{
+    struct ecrypt_scell_envelope_key* cache = NULL;
+
+    ECRYPT_CHECK_PARAM(envelope != NULL);
+
+    if (cache_capacity != 0) {
+        cache = ecrypt_scell_envelope_cache_alloc(cache_capacity);
+        if (!cache) {
+            return ECRYPT_NO_MEMORY;
+        }
+    }
+
+    /* Existing keys may violate new limits, start over */
+    pthread_mutex_lock(&envelope->encrypt_lock);
+    pthread_mutex_lock(&envelope->cache_lock);
+
+    ecrypt_scell_envelope_cache_free(envelope->cache, envelope->cache_capacity);
+    envelope->cache = cache;
+    envelope->cache_capacity = cache_capacity;
+    ecconnect_wipe(&envelope->current, sizeof(envelope->current));
+
+    envelope->max_age_ns = (uint64_t)max_age_seconds * ECRYPT_NS_PER_SECOND;
+    envelope->max_uses = max_uses;
+
+    pthread_mutex_unlock(&envelope->cache_lock);
+    pthread_mutex_unlock(&envelope->encrypt_lock);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_envelope_stats(ecrypt_secure_cell_envelope_t* envelope,
+                                                  uint64_t* wrap_count,
+                                                  uint64_t* unwrap_count,
+                                                  uint64_t* cache_hits)
+{
+    ECRYPT_CHECK_PARAM(envelope != NULL);
+
+    if (wrap_count) {
+        pthread_mutex_lock(&envelope->encrypt_lock);
+        *wrap_count = envelope->wrap_count;
+        pthread_mutex_unlock(&envelope->encrypt_lock);
+    }
+    pthread_mutex_lock(&envelope->cache_lock);
+    if (unwrap_count) {
+        *unwrap_count = envelope->unwrap_count;
+    }
+    if (cache_hits) {
+        *cache_hits = envelope->cache_hits;
+    }
+    pthread_mutex_unlock(&envelope->cache_lock);
+
+    return ECRYPT_SUCCESS;
+}
+
+/* Remembers unwrapped key, replacing expired or least recently used one */
+static void ecrypt_scell_envelope_cache_put(ecrypt_secure_cell_envelope_t* envelope,
+                                            const struct ecrypt_scell_envelope_key* key)
+{
+    struct ecrypt_scell_envelope_key* same = NULL;
+    struct ecrypt_scell_envelope_key* unused = NULL;
+    struct ecrypt_scell_envelope_key* oldest = NULL;
+    struct ecrypt_scell_envelope_key* slot = NULL;
+    uint64_t now = ecrypt_monotonic_ns();
+    size_t i = 0;
+
+    pthread_mutex_lock(&envelope->cache_lock);
+
+    /* Key IDs are unique within the cache */
+    for (i = 0; i < envelope->cache_capacity && !same; i++) {
+        struct ecrypt_scell_envelope_key* entry = &envelope->cache[i];
+        if (!entry->valid || ecrypt_scell_envelope_key_expired(envelope, entry, now)) {
+            if (!unused) {
+                unused = entry;
+            }
+        } else if (memcmp(entry->key_id, key->key_id, sizeof(key->key_id)) == 0) {
+            same = entry;
+        } else if (!oldest || entry->last_used < oldest->last_used) {
+            oldest = entry;
+        }
+    }
+    slot = same ? same : unused ? unused : oldest;
+
+    if (slot) {
+        ecconnect_wipe(slot, sizeof(*slot));
+        memcpy(slot, key, sizeof(*slot));
+        slot->valid = true;
+        slot->created_ns = now;
+        slot->uses = 0;
+        slot->last_used = ++envelope->cache_clock;
+    }
+
+    pthread_mutex_unlock(&envelope->cache_lock);
+}
+
+/* Copies cached data key for the record, if any, and counts its use */
+static bool ecrypt_scell_envelope_cache_get(ecrypt_secure_cell_envelope_t* envelope,
+                                            const uint8_t* key_id,
+                                            const uint8_t* wrapped_key,
+                                            size_t wrapped_key_length,
+                                            uint8_t* data_key)
+{
+    uint64_t now = ecrypt_monotonic_ns();
+    bool found = false;
+    size_t i = 0;
+
+    pthread_mutex_lock(&envelope->cache_lock);
+
+    for (i = 0; i < envelope->cache_capacity; i++) {
+        struct ecrypt_scell_envelope_key* entry = &envelope->cache[i];
+        if (!entry->valid || memcmp(entry->key_id, key_id, sizeof(entry->key_id)) != 0) {
+            continue;
+        }
+        if (ecrypt_scell_envelope_key_expired(envelope, entry, now)) {
+            ecconnect_wipe(entry, sizeof(*entry));
+            break;
+        }
+        if (entry->wrapped_key_length != wrapped_key_length
+            || memcmp(entry->wrapped_key, wrapped_key, wrapped_key_length) != 0) {
+            break;
+        }
+        memcpy(data_key, entry->data_key, sizeof(entry->data_key));
+        entry->uses++;
+        entry->last_used = ++envelope->cache_clock;
+        found = true;
+        break;
+    }
+
+    if (found) {
+        envelope->cache_hits++;
+    } else {
+        envelope->unwrap_count++;
+    }
+
+    pthread_mutex_unlock(&envelope->cache_lock);
+
+    return found;
+}
+
+/* Called with encrypt_lock held */
+static ecrypt_status_t ecrypt_scell_envelope_rotate(ecrypt_secure_cell_envelope_t* envelope)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_envelope_key* key = &envelope->current;
+
+    ecconnect_wipe(key, sizeof(*key));
+
+    res = ecconnect_rand(key->key_id, sizeof(key->key_id));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecconnect_rand(key->data_key, sizeof(key->data_key));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    key->wrapped_key_length = sizeof(key->wrapped_key);
+    res = envelope->wrap(key->key_id,
+                         sizeof(key->key_id),
+                         key->data_key,
+                         sizeof(key->data_key),
+                         key->wrapped_key,
+                         &key->wrapped_key_length,
+                         envelope->user_data);
+    envelope->wrap_count++;
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    if (key->wrapped_key_length == 0 || key->wrapped_key_length > sizeof(key->wrapped_key)) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    key->valid = true;
+    key->created_ns = ecrypt_monotonic_ns();
+
+    /* Records written with this key are likely to be read back soon */
+    ecrypt_scell_envelope_cache_put(envelope, key);
+
+    return ECRYPT_SUCCESS;
+
+error:
+    ecconnect_wipe(key, sizeof(*key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_envelope(ecrypt_secure_cell_envelope_t* envelope,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* message,
+                                                    size_t message_length,
+                                                    uint8_t* encrypted_message,
+                                                    size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_envelope_key* key = NULL;
+    uint8_t data_key[ECRYPT_SCELL_ENVELOPE_DATA_KEY_LENGTH] = {0};
+    size_t header_length = 0;
+    size_t body_length = 0;
+    uint8_t* buffer = NULL;
+
+    ECRYPT_CHECK_PARAM(envelope != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    /* Body length does not depend on the key, any non-empty one will do */
+    res = ecrypt_secure_cell_encrypt_seal(data_key,
+                                          sizeof(data_key),
+                                          user_context,
+                                          user_context_length,
+                                          message,
+                                          message_length,
+                                          NULL,
+                                          &body_length);
+    if (res != ECRYPT_BUFFER_TOO_SMALL) {
+        return res;
+    }
+
+    pthread_mutex_lock(&envelope->encrypt_lock);
+
+    key = &envelope->current;
+    if (!key->valid || ecrypt_scell_envelope_key_expired(envelope, key, ecrypt_monotonic_ns())) {
+        res = ecrypt_scell_envelope_rotate(envelope);
+        if (res != ECRYPT_SUCCESS) {
+            goto unlock;
+        }
+    }
+
+    header_length = ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH + key->wrapped_key_length;
+    if (body_length > SIZE_MAX - header_length) {
+        res = ECRYPT_INVALID_PARAMETER;
+        goto unlock;
+    }
+    if (!encrypted_message || *encrypted_message_length < header_length + body_length) {
+        *encrypted_message_length = header_length + body_length;
+        res = ECRYPT_BUFFER_TOO_SMALL;
+        goto unlock;
+    }
+
+    buffer = encrypted_message;
+    buffer = stream_write_uint32LE(buffer, ECRYPT_SCELL_ENVELOPE_MAGIC);
+    buffer = stream_write_bytes(buffer, key->key_id, sizeof(key->key_id));
+    buffer = stream_write_uint32LE(buffer, (uint32_t)key->wrapped_key_length);
+    buffer = stream_write_bytes(buffer, key->wrapped_key, key->wrapped_key_length);
+
+    memcpy(data_key, key->data_key, sizeof(data_key));
+    key->uses++;
+    res = ECRYPT_SUCCESS;
+
+unlock:
+    pthread_mutex_unlock(&envelope->encrypt_lock);
+
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_secure_cell_encrypt_seal(data_key,
+                                          sizeof(data_key),
+                                          user_context,
+                                          user_context_length,
+                                          message,
+                                          message_length,
+                                          encrypted_message + header_length,
+                                          &body_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    *encrypted_message_length = header_length + body_length;
+
+error:
+    ecconnect_wipe(data_key, sizeof(data_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_envelope(ecrypt_secure_cell_envelope_t* envelope,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* encrypted_message,
+                                                    size_t encrypted_message_length,
+                                                    uint8_t* plain_message,
+                                                    size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_envelope_key key;
+    const uint8_t* key_id = NULL;
+    const uint8_t* wrapped_key = NULL;
+    const uint8_t* body = NULL;
+    size_t body_length = 0;
+    size_t data_key_length = 0;
+    uint32_t magic = 0;
+    uint32_t wrapped_key_length = 0;
+    uint32_t message_length = 0;
+    bool cached = false;
+
+    ECRYPT_CHECK_PARAM(envelope != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    if (encrypted_message_length < ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    stream_read_uint32LE(encrypted_message, &magic);
+    key_id = encrypted_message + sizeof(uint32_t);
+    stream_read_uint32LE(key_id + ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH, &wrapped_key_length);
+    wrapped_key = encrypted_message + ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH;
+
+    if (magic != ECRYPT_SCELL_ENVELOPE_MAGIC) {
+        return ECRYPT_FAIL;
+    }
+    if (wrapped_key_length == 0 || wrapped_key_length > ECRYPT_SCELL_ENVELOPE_MAX_WRAPPED_KEY_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    if (encrypted_message_length - ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH <= wrapped_key_length) {
+        return ECRYPT_FAIL;
+    }
+    body = wrapped_key + wrapped_key_length;
+    body_length = encrypted_message_length - ECRYPT_SCELL_ENVELOPE_HEADER_LENGTH - wrapped_key_length;
+
+    /* Answer size queries without unwrapping the data key */
+    res = ecrypt_scell_auth_token_key_message_size(body, body_length, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (!plain_message || *plain_message_length < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    memset(&key, 0, sizeof(key));
+
+    cached = ecrypt_scell_envelope_cache_get(envelope, key_id, wrapped_key, wrapped_key_length, key.data_key);
+    if (!cached) {
+        data_key_length = sizeof(key.data_key);
+        res = envelope->unwrap(key_id,
+                               ECRYPT_SCELL_ENVELOPE_KEY_ID_LENGTH,
+                               wrapped_key,
+                               wrapped_key_length,
+                               key.data_key,
+                               &data_key_length,
+                               envelope->user_data);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        if (data_key_length != sizeof(key.data_key)) {
+            res = ECRYPT_FAIL;
+            goto error;
+        }
+    }
+
+    res = ecrypt_secure_cell_decrypt_seal(key.data_key,
+                                          sizeof(key.data_key),
+                                          user_context,
+                                          user_context_length,
+                                          body,
+                                          body_length,
+                                          plain_message,
+                                          plain_message_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Cache only keys which have been proven to decrypt the record */
+    if (!cached) {
+        memcpy(key.key_id, key_id, sizeof(key.key_id));
+        memcpy(key.wrapped_key, wrapped_key, wrapped_key_length);
+        key.wrapped_key_length = wrapped_key_length;
+        ecrypt_scell_envelope_cache_put(envelope, &key);
+    }
+
+error:
+    ecconnect_wipe(&key, sizeof(key));
+
+    return res;
+}
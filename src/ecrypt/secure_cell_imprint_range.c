@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ecconnect/ecconnect_sym.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/sym_enc_message.h"
+
+/* AES block, the unit of CTR counter */
+#define ECRYPT_SCELL_IMPRINT_BLOCK_LENGTH 16
+
+/*
+ * CTR counter is the whole IV taken as 128-bit big-endian integer. Keystream
+ * for byte `offset` starts at counter value IV + offset / 16.
+ */
+static void ecrypt_scell_imprint_advance_iv(uint8_t* iv, size_t iv_length, uint64_t blocks)
+{
+    size_t i = iv_length;
+    unsigned carry = 0;
+
+    while (i > 0 && (blocks != 0 || carry != 0)) {
+        unsigned sum = iv[i - 1] + (unsigned)(blocks & 0xFF) + carry;
+        iv[i - 1] = (uint8_t)sum;
+        carry = sum >> 8;
+        blocks >>= 8;
+        i--;
+    }
+}
+
+/* See ecrypt_sym_encrypt_message_u() and ecrypt_sym_decrypt_message_u() */
+static ecrypt_status_t ecrypt_scell_imprint_range(const uint8_t* master_key,
+                                                  size_t master_key_length,
+                                                  const uint8_t* input,
+                                                  size_t input_length,
+                                                  size_t offset,
+                                                  size_t message_length,
+                                                  const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint8_t* output,
+                                                  size_t* output_length,
+                                                  bool encrypt)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    uint8_t derived_key[ECRYPT_SYM_KEY_LENGTH / 8] = {0};
+    uint8_t iv[ECRYPT_SYM_IV_LENGTH] = {0};
+    uint8_t skip[ECRYPT_SCELL_IMPRINT_BLOCK_LENGTH] = {0};
+    size_t skip_length = offset % ECRYPT_SCELL_IMPRINT_BLOCK_LENGTH;
+    size_t length = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    ECRYPT_CHECK_PARAM(input != NULL && input_length != 0);
+    ECRYPT_CHECK_PARAM(context != NULL && context_length != 0);
+    ECRYPT_CHECK_PARAM(offset < message_length && input_length <= message_length - offset);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    if (!output || *output_length < input_length) {
+        *output_length = input_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    /* Key depends on the length of the whole message, not the range */
+    res = ecrypt_sym_derive_encryption_key(master_key,
+                                           master_key_length,
+                                           message_length,
+                                           derived_key,
+                                           sizeof(derived_key));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_sym_derive_encryption_iv(derived_key, sizeof(derived_key), context, context_length, iv, sizeof(iv));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    ecrypt_scell_imprint_advance_iv(iv, sizeof(iv), (uint64_t)(offset / ECRYPT_SCELL_IMPRINT_BLOCK_LENGTH));
+
+    if (encrypt) {
+        ctx = ecconnect_sym_encrypt_create(ECRYPT_SYM_ALG, derived_key, sizeof(derived_key), NULL, 0, iv, sizeof(iv));
+    } else {
+        ctx = ecconnect_sym_decrypt_create(ECRYPT_SYM_ALG, derived_key, sizeof(derived_key), NULL, 0, iv, sizeof(iv));
+    }
+    if (!ctx) {
+        res = ECRYPT_NO_MEMORY;
+        goto error;
+    }
+
+    /* Discard keystream preceding the offset within its block */
+    if (skip_length != 0) {
+        length = sizeof(skip);
+        if (encrypt) {
+            res = ecconnect_sym_encrypt_update(ctx, skip, skip_length, skip, &length);
+        } else {
+            res = ecconnect_sym_decrypt_update(ctx, skip, skip_length, skip, &length);
+        }
+        if (res != ECRYPT_SUCCESS || length != skip_length) {
+            res = ECRYPT_FAIL;
+            goto error;
+        }
+    }
+
+    length = *output_length;
+    if (encrypt) {
+        res = ecconnect_sym_encrypt_update(ctx, input, input_length, output, &length);
+    } else {
+        res = ecconnect_sym_decrypt_update(ctx, input, input_length, output, &length);
+    }
+    /* CTR mode does not buffer anything, there is no need to finalize */
+    if (res != ECRYPT_SUCCESS || length != input_length) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    *output_length = input_length;
+
+error:
+    if (ctx) {
+        if (encrypt) {
+            ecconnect_sym_encrypt_destroy(ctx);
+        } else {
+            ecconnect_sym_decrypt_destroy(ctx);
+        }
+    }
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+    ecconnect_wipe(iv, sizeof(iv));
+    ecconnect_wipe(skip, sizeof(skip));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_range(const uint8_t* master_key,
+                                                                 size_t master_key_length,
+                                                                 const uint8_t* message_range,
+                                                                 size_t message_range_length,
+                                                                 size_t offset,
+                                                                 size_t message_length,
+                                                                 const uint8_t* context,
+                                                                 size_t context_length,
+                                                                 uint8_t* encrypted_range,
+                                                                 size_t* encrypted_range_length)
+{
+    return ecrypt_scell_imprint_range(master_key,
+                                      master_key_length,
+                                      message_range,
+                                      message_range_length,
+                                      offset,
+                                      message_length,
+                                      context,
+                                      context_length,
+                                      encrypted_range,
+                                      encrypted_range_length,
+                                      true);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_range(const uint8_t* master_key,
+                                                                 size_t master_key_length,
+                                                                 const uint8_t* encrypted_range,
+                                                                 size_t encrypted_range_length,
+                                                                 size_t offset,
+                                                                 size_t message_length,
+                                                                 const uint8_t* context,
+                                                                 size_t context_length,
+                                                                 uint8_t* plain_range,
+                                                                 size_t* plain_range_length)
+{
+    return ecrypt_scell_imprint_range(master_key,
+                                      master_key_length,
+                                      encrypted_range,
+                                      encrypted_range_length,
+                                      offset,
+                                      message_length,
+                                      context,
+                                      context_length,
+                                      plain_range,
+                                      plain_range_length,
+                                      false);
+}
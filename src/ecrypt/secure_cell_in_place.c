@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * In-place variants produce and accept exactly the same data as the regular
+ * API. All ciphers used by Secure Cell are stream ciphers, so the same
+ * buffer is passed as both input and output to the cipher context.
+ * ecrypt_auth_sym_decrypt_message() checks the tag before decrypting
+ * in place, so failed attempts leave the data intact.
+ */
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_in_place(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         uint8_t* cell,
+                                                         size_t* cell_length,
+                                                         size_t message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = ecrypt_scell_auth_token_key_default_size();
+    size_t ciphertext_length = message_length;
+    size_t total_length = 0;
+
+    ECRYPT_CHECK_PARAM(cell_length != NULL);
+    ECRYPT_CHECK_PARAM(message_length != 0 && message_length <= UINT32_MAX);
+
+    total_length = auth_token_length + message_length;
+    if (!cell || *cell_length < total_length) {
+        *cell_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_auth_sym_encrypt_message(master_key,
+                                          master_key_length,
+                                          cell + auth_token_length,
+                                          message_length,
+                                          user_context,
+                                          user_context_length,
+                                          cell,
+                                          &auth_token_length,
+                                          cell + auth_token_length,
+                                          &ciphertext_length,
+                                          0);
+    if (res == ECRYPT_SUCCESS) {
+        *cell_length = auth_token_length + ciphertext_length;
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_in_place(const uint8_t* master_key,
+                                                         size_t master_key_length,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         uint8_t* cell,
+                                                         size_t cell_length,
+                                                         uint8_t** plain_message,
+                                                         size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint32_t message_length = 0;
+    size_t auth_token_length = 0;
+    size_t plain_length = 0;
+
+    ECRYPT_CHECK_PARAM(cell != NULL && cell_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message != NULL && plain_message_length != NULL);
+    /* Compressed messages do not fit in place, leave them intact */
+    ECRYPT_CHECK_PARAM(!ecrypt_scell_auth_token_key_is_compressed(cell, cell_length));
+
+    res = ecrypt_scell_auth_token_key_message_size(cell, cell_length, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    /* We should not overflow here. If we do then the message is corrupted. */
+    if (message_length == 0 || cell_length < message_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    auth_token_length = cell_length - message_length;
+    plain_length = message_length;
+
+    res = ecrypt_auth_sym_decrypt_message(master_key,
+                                          master_key_length,
+                                          user_context,
+                                          user_context_length,
+                                          cell,
+                                          auth_token_length,
+                                          cell + auth_token_length,
+                                          message_length,
+                                          cell + auth_token_length,
+                                          &plain_length,
+                                          0);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *plain_message = cell + auth_token_length;
+    *plain_message_length = plain_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_in_place(const uint8_t* master_key,
+                                                                  size_t master_key_length,
+                                                                  const uint8_t* user_context,
+                                                                  size_t user_context_length,
+                                                                  uint8_t* message,
+                                                                  size_t message_length,
+                                                                  uint8_t* context,
+                                                                  size_t* context_length)
+{
+    size_t encrypted_message_length = message_length;
+
+    return ecrypt_auth_sym_encrypt_message(master_key,
+                                           master_key_length,
+                                           message,
+                                           message_length,
+                                           user_context,
+                                           user_context_length,
+                                           context,
+                                           context_length,
+                                           context ? message : NULL,
+                                           &encrypted_message_length,
+                                           0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_in_place(const uint8_t* master_key,
+                                                                  size_t master_key_length,
+                                                                  const uint8_t* user_context,
+                                                                  size_t user_context_length,
+                                                                  uint8_t* encrypted_message,
+                                                                  size_t encrypted_message_length,
+                                                                  const uint8_t* context,
+                                                                  size_t context_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint32_t expected_message_length = 0;
+    size_t message_length = encrypted_message_length;
+
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(context != NULL && context_length != 0);
+
+    /* Messages that obviously do not match the token are left intact */
+    res = ecrypt_scell_auth_token_key_message_size(context, context_length, &expected_message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (expected_message_length != encrypted_message_length) {
+        return ECRYPT_FAIL;
+    }
+
+    return ecrypt_auth_sym_decrypt_message(master_key,
+                                           master_key_length,
+                                           user_context,
+                                           user_context_length,
+                                           context,
+                                           context_length,
+                                           encrypted_message,
+                                           encrypted_message_length,
+                                           encrypted_message,
+                                           &message_length,
+                                           0);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_in_place(const uint8_t* master_key,
+                                                                    size_t master_key_length,
+                                                                    uint8_t* message,
+                                                                    size_t message_length,
+                                                                    const uint8_t* context,
+                                                                    size_t context_length)
+{
+    size_t encrypted_message_length = message_length;
+
+    return ecrypt_sym_encrypt_message_u(master_key,
+                                        master_key_length,
+                                        context,
+                                        context_length,
+                                        message,
+                                        message_length,
+                                        message,
+                                        &encrypted_message_length);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_in_place(const uint8_t* master_key,
+                                                                    size_t master_key_length,
+                                                                    uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    const uint8_t* context,
+                                                                    size_t context_length)
+{
+    size_t message_length = encrypted_message_length;
+
+    return ecrypt_sym_decrypt_message_u(master_key,
+                                        master_key_length,
+                                        context,
+                                        context_length,
+                                        encrypted_message,
+                                        encrypted_message_length,
+                                        encrypted_message,
+                                        &message_length,
+                                        0);
+}
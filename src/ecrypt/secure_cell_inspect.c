@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell.h"
+
+#include <string.h>
+
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/secure_cell_seal_passphrase.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * Output sizes depend only on message length and flags. These functions
+ * must stay in sync with what encryption functions actually produce.
+ */
+
+static size_t ecrypt_scell_key_token_size(size_t message_length, uint32_t flags)
+{
+    size_t size = ecrypt_scell_auth_token_key_flags_size(flags, message_length);
+    if (flags & ECRYPT_SCELL_FLAG_KEY_ID) {
+        size += sizeof(uint32_t);
+    }
+    return size;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_output_size(size_t message_length,
+                                                    uint32_t flags,
+                                                    size_t* output_length)
+{
+    ECRYPT_CHECK_PARAM(message_length != 0 && message_length <= UINT32_MAX);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        ECRYPT_CHECK_PARAM(!(flags & ECRYPT_SCELL_FLAG_COMPACT));
+    }
+
+    /* Compressed cells are usually shorter, this is the upper bound */
+    *output_length = ecrypt_scell_key_token_size(message_length, flags)
+                     + (size_t)ecrypt_scell_ciphertext_max_size(flags, message_length);
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_passphrase_output_size(size_t message_length,
+                                                               size_t* output_length)
+{
+    ECRYPT_CHECK_PARAM(message_length != 0 && message_length <= UINT32_MAX);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    *output_length = ecrypt_scell_auth_token_passphrase_default_size() + message_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_token_protect_output_size(size_t message_length,
+                                                             uint32_t flags,
+                                                             size_t* token_length)
+{
+    ECRYPT_CHECK_PARAM(message_length != 0 && message_length <= UINT32_MAX);
+    ECRYPT_CHECK_PARAM(token_length != NULL);
+    ECRYPT_CHECK_PARAM(!(flags & ECRYPT_SCELL_FLAG_COMPRESS));
+
+    *token_length = ecrypt_scell_key_token_size(message_length, flags);
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_context_imprint_output_size(size_t message_length,
+                                                               size_t* output_length)
+{
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    *output_length = message_length;
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_info_set_alg(ecrypt_secure_cell_info_t* info, uint32_t alg)
+{
+    if (!ecconnect_alg_reserved_bits_valid(alg)) {
+        return ECRYPT_FAIL;
+    }
+    switch (alg & ECCONNECT_SYM_ALG_MASK) {
+    case ECCONNECT_SYM_AES_GCM & ECCONNECT_SYM_ALG_MASK:
+        info->cipher = ECRYPT_SCELL_CIPHER_AES_GCM;
+        break;
+    case ECCONNECT_SYM_CHACHA20_POLY1305 & ECCONNECT_SYM_ALG_MASK:
+        info->cipher = ECRYPT_SCELL_CIPHER_CHACHA20_POLY1305;
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    switch (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) {
+    case ECCONNECT_SYM_256_KEY_LENGTH:
+    case ECCONNECT_SYM_192_KEY_LENGTH:
+    case ECCONNECT_SYM_128_KEY_LENGTH:
+        info->key_bits = alg & ECCONNECT_SYM_KEY_LENGTH_MASK;
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_inspect_key(const uint8_t* data,
+                                                size_t data_length,
+                                                ecrypt_secure_cell_info_t* info)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_key hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    res = ecrypt_read_scell_auth_token_key(data, data_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    /* Token size depends on the marks, compute it before stripping them */
+    info->auth_token_length = (size_t)ecrypt_scell_auth_token_key_size(&hdr);
+    info->has_key_id = (hdr.alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) != 0;
+    info->key_id = hdr.key_id;
+    info->compact = hdr.compact;
+    info->compressed = (hdr.alg & ECRYPT_AUTH_SYM_ALG_COMPRESSED) != 0;
+    info->message_length = info->compressed ? hdr.uncompressed_length : hdr.message_length;
+    info->kdf = ECRYPT_SCELL_KDF_MASTER_KEY;
+    ecrypt_scell_auth_token_key_strip_marks(&hdr);
+
+    if (ecconnect_alg_kdf(hdr.alg) != ECCONNECT_SYM_NOKDF) {
+        return ECRYPT_FAIL;
+    }
+    return ecrypt_scell_info_set_alg(info, hdr.alg);
+}
+
+static ecrypt_status_t ecrypt_scell_inspect_passphrase(const uint8_t* data,
+                                                       size_t data_length,
+                                                       ecrypt_secure_cell_info_t* info)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_passphrase hdr;
+    struct ecrypt_scell_pbkdf2_context kdf;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&kdf, 0, sizeof(kdf));
+    res = ecrypt_read_scell_auth_token_passphrase(data, data_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    res = ecrypt_read_scell_pbkdf2_context(&hdr, &kdf);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    info->auth_token_length = (size_t)ecrypt_scell_auth_token_passphrase_size(&hdr);
+    info->message_length = hdr.message_length;
+    info->kdf = ECRYPT_SCELL_KDF_PBKDF2_HMAC_SHA256;
+    info->pbkdf2_iterations = kdf.iteration_count;
+
+    return ecrypt_scell_info_set_alg(info, hdr.alg);
+}
+
+ecrypt_status_t ecrypt_secure_cell_inspect(const uint8_t* data,
+                                           size_t data_length,
+                                           ecrypt_secure_cell_info_t* info)
+{
+    uint32_t alg = 0;
+
+    ECRYPT_CHECK_PARAM(data != NULL && data_length != 0);
+    ECRYPT_CHECK_PARAM(info != NULL);
+
+    memset(info, 0, sizeof(*info));
+
+    if (ecrypt_scell_auth_token_key_is_compact(data, data_length)) {
+        return ecrypt_scell_inspect_key(data, data_length, info);
+    }
+    if (data_length < sizeof(alg)) {
+        return ECRYPT_FAIL;
+    }
+    stream_read_uint32LE(data, &alg);
+    switch (ecconnect_alg_kdf(alg)) {
+    case ECCONNECT_SYM_NOKDF:
+        return ecrypt_scell_inspect_key(data, data_length, info);
+    case ECCONNECT_SYM_PBKDF2:
+        return ecrypt_scell_inspect_passphrase(data, data_length, info);
+    default:
+        return ECRYPT_FAIL;
+    }
+}
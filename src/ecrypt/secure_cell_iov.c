@@ -0,0 +1,905 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_sym.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * Scatter/gather variants produce and accept exactly the same data as
+ * contiguous API. Cipher contexts are fed fragment by fragment, so data
+ * is never copied into temporary buffers. Only short auth tokens are
+ * gathered into stack buffers for parsing.
+ */
+
+/* Longest auth token accepted from fragmented input (with some spare room) */
+#define ECRYPT_SCELL_IOV_MAX_AUTH_TOKEN_LENGTH 128
+
+struct ecrypt_scell_iov_cursor {
+    const ecrypt_secure_cell_iovec_t* iov;
+    size_t count;
+    size_t index;
+    size_t offset;
+};
+
+typedef ecconnect_status_t (*ecrypt_scell_iov_update_fn)(ecconnect_sym_ctx_t* ctx,
+                                                         const void* input,
+                                                         size_t input_length,
+                                                         void* output,
+                                                         size_t* output_length);
+
+static void ecrypt_scell_iov_cursor_init(struct ecrypt_scell_iov_cursor* cursor,
+                                         const ecrypt_secure_cell_iovec_t* iov,
+                                         size_t count)
+{
+    cursor->iov = iov;
+    cursor->count = count;
+    cursor->index = 0;
+    cursor->offset = 0;
+}
+
+static ecrypt_status_t ecrypt_scell_iov_length(const ecrypt_secure_cell_iovec_t* iov,
+                                               size_t count,
+                                               size_t* length)
+{
+    size_t total = 0;
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (iov[i].base == NULL && iov[i].length != 0) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        if (iov[i].length > SIZE_MAX - total) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        total += iov[i].length;
+    }
+
+    *length = total;
+    return ECRYPT_SUCCESS;
+}
+
+/* Returns length of contiguous data at cursor position, skipping empty fragments */
+static size_t ecrypt_scell_iov_span(struct ecrypt_scell_iov_cursor* cursor, uint8_t** data)
+{
+    while (cursor->index < cursor->count && cursor->offset == cursor->iov[cursor->index].length) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+    if (cursor->index == cursor->count) {
+        return 0;
+    }
+    *data = (uint8_t*)cursor->iov[cursor->index].base + cursor->offset;
+    return cursor->iov[cursor->index].length - cursor->offset;
+}
+
+static size_t ecrypt_scell_iov_min(size_t a, size_t b)
+{
+    return (a < b) ? a : b;
+}
+
+/*
+ * Cursor helpers below expect the caller to check that there is enough data.
+ * They stop at the end of vector anyway.
+ */
+
+static void ecrypt_scell_iov_skip(struct ecrypt_scell_iov_cursor* cursor, size_t length)
+{
+    uint8_t* data = NULL;
+    size_t span = 0;
+
+    while (length > 0) {
+        span = ecrypt_scell_iov_min(ecrypt_scell_iov_span(cursor, &data), length);
+        if (span == 0) {
+            break;
+        }
+        cursor->offset += span;
+        length -= span;
+    }
+}
+
+static void ecrypt_scell_iov_gather(struct ecrypt_scell_iov_cursor* cursor, uint8_t* output, size_t length)
+{
+    uint8_t* data = NULL;
+    size_t span = 0;
+
+    while (length > 0) {
+        span = ecrypt_scell_iov_min(ecrypt_scell_iov_span(cursor, &data), length);
+        if (span == 0) {
+            break;
+        }
+        memcpy(output, data, span);
+        cursor->offset += span;
+        output += span;
+        length -= span;
+    }
+}
+
+static void ecrypt_scell_iov_scatter(struct ecrypt_scell_iov_cursor* cursor, const uint8_t* input, size_t length)
+{
+    uint8_t* data = NULL;
+    size_t span = 0;
+
+    while (length > 0) {
+        span = ecrypt_scell_iov_min(ecrypt_scell_iov_span(cursor, &data), length);
+        if (span == 0) {
+            break;
+        }
+        memcpy(data, input, span);
+        cursor->offset += span;
+        input += span;
+        length -= span;
+    }
+}
+
+static void ecrypt_scell_iov_wipe(struct ecrypt_scell_iov_cursor* cursor, size_t length)
+{
+    uint8_t* data = NULL;
+    size_t span = 0;
+
+    while (length > 0) {
+        span = ecrypt_scell_iov_min(ecrypt_scell_iov_span(cursor, &data), length);
+        if (span == 0) {
+            break;
+        }
+        ecconnect_wipe(data, span);
+        cursor->offset += span;
+        length -= span;
+    }
+}
+
+/*
+ * Runs cipher over fragmented input and output. Only stream-like modes
+ * (GCM, CTR) are supported: output length must match input length.
+ */
+static ecrypt_status_t ecrypt_scell_iov_update(ecconnect_sym_ctx_t* ctx,
+                                               ecrypt_scell_iov_update_fn update,
+                                               struct ecrypt_scell_iov_cursor* input,
+                                               struct ecrypt_scell_iov_cursor* output,
+                                               size_t length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t* input_data = NULL;
+    uint8_t* output_data = NULL;
+    size_t span = 0;
+    size_t output_length = 0;
+
+    while (length > 0) {
+        span = ecrypt_scell_iov_min(ecrypt_scell_iov_span(input, &input_data),
+                                    ecrypt_scell_iov_span(output, &output_data));
+        span = ecrypt_scell_iov_min(span, length);
+        if (span == 0) {
+            return ECRYPT_FAIL;
+        }
+        output_length = span;
+        res = update(ctx, input_data, span, output_data, &output_length);
+        if (res != ECRYPT_SUCCESS || output_length != span) {
+            return ECRYPT_FAIL;
+        }
+        input->offset += span;
+        output->offset += span;
+        length -= span;
+    }
+
+    return ECRYPT_SUCCESS;
+}
+
+/* See ecrypt_auth_sym_encrypt_message_() */
+static ecrypt_status_t ecrypt_scell_iov_auth_encrypt(const uint8_t* key,
+                                                     size_t key_length,
+                                                     const uint8_t* user_context,
+                                                     size_t user_context_length,
+                                                     struct ecrypt_scell_iov_cursor* message,
+                                                     size_t message_length,
+                                                     uint8_t* auth_token,
+                                                     struct ecrypt_scell_iov_cursor* encrypted_message)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t iv[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t auth_tag[ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+    size_t auth_tag_length = sizeof(auth_tag);
+    struct ecrypt_scell_auth_token_key hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.alg = ECRYPT_AUTH_SYM_ALG;
+    hdr.iv = iv;
+    hdr.iv_length = sizeof(iv);
+    hdr.auth_tag = auth_tag;
+    hdr.auth_tag_length = sizeof(auth_tag);
+    hdr.message_length = (uint32_t)message_length;
+
+    res = ecrypt_auth_sym_kdf_context(hdr.message_length, kdf_context, &kdf_context_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_auth_sym_derive_encryption_key(hdr.alg,
+                                                key,
+                                                key_length,
+                                                kdf_context,
+                                                kdf_context_length,
+                                                user_context,
+                                                user_context_length,
+                                                derived_key,
+                                                &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecconnect_rand(iv, sizeof(iv));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    ctx = ecconnect_sym_aead_encrypt_create(hdr.alg, derived_key, derived_key_length, NULL, 0, iv, sizeof(iv));
+    if (!ctx) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+    if (user_context != NULL || user_context_length != 0) {
+        res = ecconnect_sym_aead_encrypt_aad(ctx, user_context, user_context_length);
+        if (res != ECRYPT_SUCCESS) {
+            res = ECRYPT_FAIL;
+            goto error;
+        }
+    }
+    res = ecrypt_scell_iov_update(ctx, ecconnect_sym_aead_encrypt_update, message, encrypted_message, message_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecconnect_sym_aead_encrypt_final(ctx, auth_tag, &auth_tag_length);
+    if (res != ECRYPT_SUCCESS || auth_tag_length != sizeof(auth_tag)) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    res = ecrypt_write_scell_auth_token_key(&hdr, auth_token, ecrypt_scell_auth_token_key_default_size());
+
+error:
+    if (ctx) {
+        ecconnect_sym_aead_encrypt_destroy(ctx);
+    }
+    ecconnect_wipe(iv, sizeof(iv));
+    ecconnect_wipe(auth_tag, sizeof(auth_tag));
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+
+    return res;
+}
+
+/* See ecrypt_auth_sym_decrypt_message_(). Cursors are copied to allow retries. */
+static ecrypt_status_t ecrypt_scell_iov_auth_decrypt(const uint8_t* key,
+                                                     size_t key_length,
+                                                     const uint8_t* user_context,
+                                                     size_t user_context_length,
+                                                     const struct ecrypt_scell_auth_token_key* hdr,
+                                                     bool compat,
+                                                     struct ecrypt_scell_iov_cursor encrypted_message,
+                                                     struct ecrypt_scell_iov_cursor message)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    /* Use maximum possible length, not the default one */
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+
+    if (compat) {
+#ifdef SCELL_COMPAT
+        res = ecrypt_auth_sym_kdf_context_compat(hdr->message_length, kdf_context, &kdf_context_length);
+#else
+        res = ECRYPT_FAIL;
+#endif
+    } else {
+        res = ecrypt_auth_sym_kdf_context(hdr->message_length, kdf_context, &kdf_context_length);
+    }
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_auth_sym_derive_encryption_key(hdr->alg,
+                                                key,
+                                                key_length,
+                                                kdf_context,
+                                                kdf_context_length,
+                                                user_context,
+                                                user_context_length,
+                                                derived_key,
+                                                &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    ctx = ecconnect_sym_aead_decrypt_create(hdr->alg, derived_key, derived_key_length, NULL, 0, hdr->iv, hdr->iv_length);
+    if (!ctx) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+    if (user_context != NULL || user_context_length != 0) {
+        res = ecconnect_sym_aead_decrypt_aad(ctx, user_context, user_context_length);
+        if (res != ECRYPT_SUCCESS) {
+            res = ECRYPT_FAIL;
+            goto error;
+        }
+    }
+    res = ecrypt_scell_iov_update(ctx,
+                                  ecconnect_sym_aead_decrypt_update,
+                                  &encrypted_message,
+                                  &message,
+                                  hdr->message_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecconnect_sym_aead_decrypt_final(ctx, hdr->auth_tag, hdr->auth_tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+error:
+    if (ctx) {
+        ecconnect_sym_aead_decrypt_destroy(ctx);
+    }
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_iov_auth_decrypt_with_retry(const uint8_t* key,
+                                                                size_t key_length,
+                                                                const uint8_t* user_context,
+                                                                size_t user_context_length,
+                                                                const struct ecrypt_scell_auth_token_key* hdr,
+                                                                uint32_t flags,
+                                                                struct ecrypt_scell_iov_cursor encrypted_message,
+                                                                struct ecrypt_scell_iov_cursor message)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+
+    res = ecrypt_scell_iov_auth_decrypt(key,
+                                        key_length,
+                                        user_context,
+                                        user_context_length,
+                                        hdr,
+                                        false,
+                                        encrypted_message,
+                                        message);
+    /* See ecrypt_auth_sym_decrypt_message_() */
+#ifdef SCELL_COMPAT
+    if (res != ECRYPT_SUCCESS && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
+        res = ecrypt_scell_iov_auth_decrypt(key,
+                                            key_length,
+                                            user_context,
+                                            user_context_length,
+                                            hdr,
+                                            true,
+                                            encrypted_message,
+                                            message);
+    }
+#else
+    UNUSED(flags);
+#endif
+
+    /* Do not leave unauthenticated plaintext around */
+    if (res != ECRYPT_SUCCESS) {
+        ecrypt_scell_iov_wipe(&message, hdr->message_length);
+    }
+
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_iov_parse_auth_token(const uint8_t* auth_token,
+                                                         size_t auth_token_length,
+                                                         size_t encrypted_message_length,
+                                                         struct ecrypt_scell_auth_token_key* hdr,
+                                                         uint32_t* flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+
+    memset(hdr, 0, sizeof(*hdr));
+    res = ecrypt_read_scell_auth_token_key(auth_token, auth_token_length, hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    *flags = ecrypt_scell_auth_token_key_strip_marks(hdr);
+
+    /* Check that message header is consistent with our expectations */
+    if (hdr->message_length != encrypted_message_length) {
+        return ECRYPT_FAIL;
+    }
+    /* Compressed data cannot be decrypted fragment by fragment */
+    if (hdr->uncompressed_length != 0) {
+        return ECRYPT_FAIL;
+    }
+    if (!ecconnect_alg_reserved_bits_valid(hdr->alg)) {
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_iov(const uint8_t* master_key,
+                                                    size_t master_key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const ecrypt_secure_cell_iovec_t* message,
+                                                    size_t message_count,
+                                                    const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                    size_t encrypted_message_count,
+                                                    size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_iov_cursor input;
+    struct ecrypt_scell_iov_cursor output;
+    struct ecrypt_scell_iov_cursor output_token;
+    uint8_t auth_token[ECRYPT_SCELL_IOV_MAX_AUTH_TOKEN_LENGTH] = {0};
+    size_t auth_token_length = ecrypt_scell_auth_token_key_default_size();
+    size_t message_length = 0;
+    size_t output_capacity = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(message != NULL && message_count != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    res = ecrypt_scell_iov_length(message, message_count, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    if (encrypted_message) {
+        res = ecrypt_scell_iov_length(encrypted_message, encrypted_message_count, &output_capacity);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    if (!encrypted_message || output_capacity < auth_token_length + message_length) {
+        *encrypted_message_length = auth_token_length + message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    ecrypt_scell_iov_cursor_init(&input, message, message_count);
+    ecrypt_scell_iov_cursor_init(&output, encrypted_message, encrypted_message_count);
+    /* Auth token goes first, but it is complete only after encryption */
+    output_token = output;
+    ecrypt_scell_iov_skip(&output, auth_token_length);
+
+    res = ecrypt_scell_iov_auth_encrypt(master_key,
+                                        master_key_length,
+                                        user_context,
+                                        user_context_length,
+                                        &input,
+                                        message_length,
+                                        auth_token,
+                                        &output);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ecrypt_scell_iov_scatter(&output_token, auth_token, auth_token_length);
+
+    *encrypted_message_length = auth_token_length + message_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_iov(const uint8_t* master_key,
+                                                    size_t master_key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                    size_t encrypted_message_count,
+                                                    const ecrypt_secure_cell_iovec_t* plain_message,
+                                                    size_t plain_message_count,
+                                                    size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_iov_cursor input;
+    struct ecrypt_scell_iov_cursor output;
+    struct ecrypt_scell_auth_token_key hdr;
+    uint8_t auth_token[ECRYPT_SCELL_IOV_MAX_AUTH_TOKEN_LENGTH] = {0};
+    size_t auth_token_length = 0;
+    size_t encrypted_message_length = 0;
+    size_t output_capacity = 0;
+    uint32_t message_length = 0;
+    uint32_t flags = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_count != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    res = ecrypt_scell_iov_length(encrypted_message, encrypted_message_count, &encrypted_message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message_length != 0);
+
+    /* Do a quick guess without parsing the message too deeply here */
+    ecrypt_scell_iov_cursor_init(&input, encrypted_message, encrypted_message_count);
+    ecrypt_scell_iov_gather(&input,
+                            auth_token,
+                            ecrypt_scell_iov_min(encrypted_message_length,
+                                                 ecrypt_scell_auth_token_key_min_size));
+    /* Only the beginning of the token has been gathered, do not look further */
+    if (ecrypt_scell_auth_token_key_is_compressed(auth_token, encrypted_message_length)) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    res = ecrypt_scell_auth_token_key_message_size(auth_token, encrypted_message_length, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    if (plain_message) {
+        res = ecrypt_scell_iov_length(plain_message, plain_message_count, &output_capacity);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    if (!plain_message || output_capacity < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    /* We should not overflow here. If we do then the message is corrupted. */
+    if (encrypted_message_length < message_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    auth_token_length = encrypted_message_length - message_length;
+    if (auth_token_length > sizeof(auth_token)) {
+        return ECRYPT_FAIL;
+    }
+
+    ecrypt_scell_iov_cursor_init(&input, encrypted_message, encrypted_message_count);
+    ecrypt_scell_iov_gather(&input, auth_token, auth_token_length);
+    res = ecrypt_scell_iov_parse_auth_token(auth_token, auth_token_length, message_length, &hdr, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    ecrypt_scell_iov_cursor_init(&output, plain_message, plain_message_count);
+    res = ecrypt_scell_iov_auth_decrypt_with_retry(master_key,
+                                                   master_key_length,
+                                                   user_context,
+                                                   user_context_length,
+                                                   &hdr,
+                                                   flags,
+                                                   input,
+                                                   output);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *plain_message_length = message_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_token_protect_iov(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const ecrypt_secure_cell_iovec_t* message,
+                                                             size_t message_count,
+                                                             uint8_t* context,
+                                                             size_t* context_length,
+                                                             const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                             size_t encrypted_message_count,
+                                                             size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_iov_cursor input;
+    struct ecrypt_scell_iov_cursor output;
+    size_t auth_token_length = ecrypt_scell_auth_token_key_default_size();
+    size_t message_length = 0;
+    size_t output_capacity = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(message != NULL && message_count != 0);
+    ECRYPT_CHECK_PARAM(context_length != NULL);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    res = ecrypt_scell_iov_length(message, message_count, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    if (encrypted_message) {
+        res = ecrypt_scell_iov_length(encrypted_message, encrypted_message_count, &output_capacity);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    if (!context || *context_length < auth_token_length || !encrypted_message
+        || output_capacity < message_length) {
+        *context_length = auth_token_length;
+        *encrypted_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    ecrypt_scell_iov_cursor_init(&input, message, message_count);
+    ecrypt_scell_iov_cursor_init(&output, encrypted_message, encrypted_message_count);
+    res = ecrypt_scell_iov_auth_encrypt(master_key,
+                                        master_key_length,
+                                        user_context,
+                                        user_context_length,
+                                        &input,
+                                        message_length,
+                                        context,
+                                        &output);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *context_length = auth_token_length;
+    *encrypted_message_length = message_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_token_protect_iov(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                             size_t encrypted_message_count,
+                                                             const uint8_t* context,
+                                                             size_t context_length,
+                                                             const ecrypt_secure_cell_iovec_t* plain_message,
+                                                             size_t plain_message_count,
+                                                             size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_iov_cursor input;
+    struct ecrypt_scell_iov_cursor output;
+    struct ecrypt_scell_auth_token_key hdr;
+    size_t encrypted_message_length = 0;
+    size_t output_capacity = 0;
+    uint32_t message_length = 0;
+    uint32_t flags = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(context != NULL && context_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    /* Do a quick guess without parsing the message too deeply here */
+    res = ecrypt_scell_auth_token_key_message_size(context, context_length, &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    if (plain_message) {
+        res = ecrypt_scell_iov_length(plain_message, plain_message_count, &output_capacity);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    if (!plain_message || output_capacity < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    /* encrypted_message may be omitted when only querying plaintext size */
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_count != 0);
+    res = ecrypt_scell_iov_length(encrypted_message, encrypted_message_count, &encrypted_message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message_length != 0);
+
+    res = ecrypt_scell_iov_parse_auth_token(context, context_length, encrypted_message_length, &hdr, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    ecrypt_scell_iov_cursor_init(&input, encrypted_message, encrypted_message_count);
+    ecrypt_scell_iov_cursor_init(&output, plain_message, plain_message_count);
+    res = ecrypt_scell_iov_auth_decrypt_with_retry(master_key,
+                                                   master_key_length,
+                                                   user_context,
+                                                   user_context_length,
+                                                   &hdr,
+                                                   flags,
+                                                   input,
+                                                   output);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *plain_message_length = message_length;
+    return ECRYPT_SUCCESS;
+}
+
+/* See ecrypt_sym_encrypt_message_u() and ecrypt_sym_decrypt_message_u() */
+static ecrypt_status_t ecrypt_scell_iov_context_imprint(const uint8_t* master_key,
+                                                        size_t master_key_length,
+                                                        const uint8_t* context,
+                                                        size_t context_length,
+                                                        const ecrypt_secure_cell_iovec_t* input,
+                                                        size_t input_count,
+                                                        const ecrypt_secure_cell_iovec_t* output,
+                                                        size_t output_count,
+                                                        size_t* output_length,
+                                                        bool encrypt)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    struct ecrypt_scell_iov_cursor input_cursor;
+    struct ecrypt_scell_iov_cursor output_cursor;
+    uint8_t derived_key[ECRYPT_SYM_KEY_LENGTH / 8] = {0};
+    uint8_t iv[ECRYPT_SYM_IV_LENGTH] = {0};
+    uint8_t tail[ECRYPT_SYM_IV_LENGTH] = {0};
+    size_t tail_length = 0;
+    size_t input_length = 0;
+    size_t output_capacity = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    ECRYPT_CHECK_PARAM(input != NULL && input_count != 0);
+    ECRYPT_CHECK_PARAM(context != NULL && context_length != 0);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    res = ecrypt_scell_iov_length(input, input_count, &input_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(input_length != 0);
+
+    if (output) {
+        res = ecrypt_scell_iov_length(output, output_count, &output_capacity);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    if (!output || output_capacity < input_length) {
+        *output_length = input_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_sym_derive_encryption_key(master_key,
+                                           master_key_length,
+                                           input_length,
+                                           derived_key,
+                                           sizeof(derived_key));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_sym_derive_encryption_iv(derived_key, sizeof(derived_key), context, context_length, iv, sizeof(iv));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    if (encrypt) {
+        ctx = ecconnect_sym_encrypt_create(ECRYPT_SYM_ALG, derived_key, sizeof(derived_key), NULL, 0, iv, sizeof(iv));
+    } else {
+        ctx = ecconnect_sym_decrypt_create(ECRYPT_SYM_ALG, derived_key, sizeof(derived_key), NULL, 0, iv, sizeof(iv));
+    }
+    if (!ctx) {
+        res = ECRYPT_NO_MEMORY;
+        goto error;
+    }
+
+    ecrypt_scell_iov_cursor_init(&input_cursor, input, input_count);
+    ecrypt_scell_iov_cursor_init(&output_cursor, output, output_count);
+    res = ecrypt_scell_iov_update(ctx,
+                                  encrypt ? ecconnect_sym_encrypt_update : ecconnect_sym_decrypt_update,
+                                  &input_cursor,
+                                  &output_cursor,
+                                  input_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    /* CTR mode does not buffer anything, there should be no tail */
+    tail_length = sizeof(tail);
+    if (encrypt) {
+        res = ecconnect_sym_encrypt_final(ctx, tail, &tail_length);
+    } else {
+        res = ecconnect_sym_decrypt_final(ctx, tail, &tail_length);
+    }
+    if (res != ECRYPT_SUCCESS || tail_length != 0) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    /*
+     * Unlike ecrypt_sym_decrypt_message_u() this does not retry with Ecrypt 0.9.6
+     * KDF: CTR mode cannot detect a wrong key, so that retry never triggers
+     * on valid input.
+     */
+    *output_length = input_length;
+
+error:
+    if (ctx) {
+        if (encrypt) {
+            ecconnect_sym_encrypt_destroy(ctx);
+        } else {
+            ecconnect_sym_decrypt_destroy(ctx);
+        }
+    }
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+    ecconnect_wipe(iv, sizeof(iv));
+    ecconnect_wipe(tail, sizeof(tail));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_context_imprint_iov(const uint8_t* master_key,
+                                                               size_t master_key_length,
+                                                               const ecrypt_secure_cell_iovec_t* message,
+                                                               size_t message_count,
+                                                               const uint8_t* context,
+                                                               size_t context_length,
+                                                               const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                               size_t encrypted_message_count,
+                                                               size_t* encrypted_message_length)
+{
+    return ecrypt_scell_iov_context_imprint(master_key,
+                                            master_key_length,
+                                            context,
+                                            context_length,
+                                            message,
+                                            message_count,
+                                            encrypted_message,
+                                            encrypted_message_count,
+                                            encrypted_message_length,
+                                            true);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_context_imprint_iov(const uint8_t* master_key,
+                                                               size_t master_key_length,
+                                                               const ecrypt_secure_cell_iovec_t* encrypted_message,
+                                                               size_t encrypted_message_count,
+                                                               const uint8_t* context,
+                                                               size_t context_length,
+                                                               const ecrypt_secure_cell_iovec_t* plain_message,
+                                                               size_t plain_message_count,
+                                                               size_t* plain_message_length)
+{
+    return ecrypt_scell_iov_context_imprint(master_key,
+                                            master_key_length,
+                                            context,
+                                            context_length,
+                                            encrypted_message,
+                                            encrypted_message_count,
+                                            plain_message,
+                                            plain_message_count,
+                                            plain_message_length,
+                                            false);
+}
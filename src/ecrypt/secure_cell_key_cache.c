@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell_key_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/sym_enc_message.h"
+
+#define ECRYPT_SCELL_KEY_CACHE_NONE SIZE_MAX
+
+struct ecrypt_scell_key_cache_entry {
+    uint64_t hash;
+    uint32_t alg;
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH];
+    size_t kdf_context_length;
+    uint8_t user_context[ECRYPT_SCELL_KEY_CACHE_MAX_CONTEXT_LENGTH];
+    size_t user_context_length;
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8];
+    size_t derived_key_length;
+
+    /* Next entry in the same hash bucket */
+    size_t bucket_next;
+    /* Neighbours in recency list, most recently used first */
+    size_t lru_prev;
+    size_t lru_next;
+};
+
+struct ecrypt_scell_key_cache {
+    pthread_mutex_t lock;
+
+    struct ecrypt_scell_key_cache_entry* entries;
+    size_t capacity;
+    size_t count;
+
+    size_t* buckets;
+    size_t bucket_mask;
+
+    size_t lru_head;
+    size_t lru_tail;
+
+    uint64_t hits;
+    uint64_t misses;
+};
+
+struct ecrypt_scell_key_cache* ecrypt_scell_key_cache_create(size_t capacity)
+{
+    struct ecrypt_scell_key_cache* cache = NULL;
+    size_t bucket_count = 1;
+    size_t i = 0;
+
+    if (capacity == 0) {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->entries = calloc(capacity, sizeof(*cache->entries));
+    if (!cache->entries) {
+        goto error;
+    }
+    while (bucket_count < capacity) {
+        bucket_count <<= 1;
+    }
+    cache->buckets = calloc(bucket_count, sizeof(*cache->buckets));
+    if (!cache->buckets) {
+        goto error;
+    }
+    for (i = 0; i < bucket_count; i++) {
+        cache->buckets[i] = ECRYPT_SCELL_KEY_CACHE_NONE;
+    }
+
+    cache->capacity = capacity;
+    cache->bucket_mask = bucket_count - 1;
+    cache->lru_head = ECRYPT_SCELL_KEY_CACHE_NONE;
+    cache->lru_tail = ECRYPT_SCELL_KEY_CACHE_NONE;
+
+    return cache;
+
+error:
+    free(cache->entries);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+    return NULL;
+}
+
+void ecrypt_scell_key_cache_destroy(struct ecrypt_scell_key_cache* cache)
+{
+    if (!cache) {
+        return;
+    }
+    ecconnect_wipe(cache->entries, cache->capacity * sizeof(*cache->entries));
+    free(cache->entries);
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+static bool ecrypt_scell_key_cache_tuple_cacheable(const struct ecrypt_scell_key_cache_tuple* tuple)
+{
+    return tuple->kdf_context_length <= ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH
+           && tuple->user_context_length <= ECRYPT_SCELL_KEY_CACHE_MAX_CONTEXT_LENGTH;
+}
+
+/* FNV-1a, entries are compared in full anyway */
+static uint64_t ecrypt_scell_key_cache_hash_bytes(uint64_t hash, const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static uint64_t ecrypt_scell_key_cache_hash(const struct ecrypt_scell_key_cache_tuple* tuple)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    uint8_t lengths[12];
+
+    stream_write_uint32LE(lengths, tuple->alg);
+    stream_write_uint32LE(lengths + 4, (uint32_t)tuple->kdf_context_length);
+    stream_write_uint32LE(lengths + 8, (uint32_t)tuple->user_context_length);
+
+    hash = ecrypt_scell_key_cache_hash_bytes(hash, lengths, sizeof(lengths));
+    hash = ecrypt_scell_key_cache_hash_bytes(hash, tuple->kdf_context, tuple->kdf_context_length);
+    hash = ecrypt_scell_key_cache_hash_bytes(hash, tuple->user_context, tuple->user_context_length);
+    return hash;
+}
+
+static bool ecrypt_scell_key_cache_entry_matches(const struct ecrypt_scell_key_cache_entry* entry,
+                                                 uint64_t hash,
+                                                 const struct ecrypt_scell_key_cache_tuple* tuple)
+{
+    if (entry->hash != hash || entry->alg != tuple->alg) {
+        return false;
+    }
+    if (entry->kdf_context_length != tuple->kdf_context_length
+        || entry->user_context_length != tuple->user_context_length) {
+        return false;
+    }
+    if (memcmp(entry->kdf_context, tuple->kdf_context, tuple->kdf_context_length) != 0) {
+        return false;
+    }
+    if (tuple->user_context_length != 0
+        && memcmp(entry->user_context, tuple->user_context, tuple->user_context_length) != 0) {
+        return false;
+    }
+    return true;
+}
+
+static size_t ecrypt_scell_key_cache_find(const struct ecrypt_scell_key_cache* cache,
+                                          uint64_t hash,
+                                          const struct ecrypt_scell_key_cache_tuple* tuple)
+{
+    size_t index = cache->buckets[hash & cache->bucket_mask];
+
+    while (index != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        if (ecrypt_scell_key_cache_entry_matches(&cache->entries[index], hash, tuple)) {
+            break;
+        }
+        index = cache->entries[index].bucket_next;
+    }
+    return index;
+}
+
+static void ecrypt_scell_key_cache_lru_unlink(struct ecrypt_scell_key_cache* cache, size_t index)
+{
+    struct ecrypt_scell_key_cache_entry* entry = &cache->entries[index];
+
+    if (entry->lru_prev != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+}
+
+static void ecrypt_scell_key_cache_lru_push(struct ecrypt_scell_key_cache* cache, size_t index)
+{
+    struct ecrypt_scell_key_cache_entry* entry = &cache->entries[index];
+
+    entry->lru_prev = ECRYPT_SCELL_KEY_CACHE_NONE;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        cache->entries[cache->lru_head].lru_prev = index;
+    } else {
+        cache->lru_tail = index;
+    }
+    cache->lru_head = index;
+}
+
+static void ecrypt_scell_key_cache_bucket_unlink(struct ecrypt_scell_key_cache* cache, size_t index)
+{
+    size_t* link = &cache->buckets[cache->entries[index].hash & cache->bucket_mask];
+
+    while (*link != index) {
+        link = &cache->entries[*link].bucket_next;
+    }
+    *link = cache->entries[index].bucket_next;
+}
+
+bool ecrypt_scell_key_cache_get(struct ecrypt_scell_key_cache* cache,
+                                const struct ecrypt_scell_key_cache_tuple* tuple,
+                                uint8_t* derived_key,
+                                size_t derived_key_length)
+{
+    struct ecrypt_scell_key_cache_entry* entry = NULL;
+    uint64_t hash = 0;
+    size_t index = ECRYPT_SCELL_KEY_CACHE_NONE;
+    bool found = false;
+
+    if (ecrypt_scell_key_cache_tuple_cacheable(tuple)) {
+        hash = ecrypt_scell_key_cache_hash(tuple);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (ecrypt_scell_key_cache_tuple_cacheable(tuple)) {
+        index = ecrypt_scell_key_cache_find(cache, hash, tuple);
+    }
+    if (index != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        entry = &cache->entries[index];
+        if (entry->derived_key_length == derived_key_length) {
+            memcpy(derived_key, entry->derived_key, derived_key_length);
+            if (cache->lru_head != index) {
+                ecrypt_scell_key_cache_lru_unlink(cache, index);
+                ecrypt_scell_key_cache_lru_push(cache, index);
+            }
+            found = true;
+        }
+    }
+    if (found) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return found;
+}
+
+void ecrypt_scell_key_cache_put(struct ecrypt_scell_key_cache* cache,
+                                const struct ecrypt_scell_key_cache_tuple* tuple,
+                                const uint8_t* derived_key,
+                                size_t derived_key_length)
+{
+    struct ecrypt_scell_key_cache_entry* entry = NULL;
+    uint64_t hash = 0;
+    size_t index = 0;
+    size_t bucket = 0;
+
+    if (!ecrypt_scell_key_cache_tuple_cacheable(tuple)) {
+        return;
+    }
+    if (derived_key_length > sizeof(entry->derived_key)) {
+        return;
+    }
+    hash = ecrypt_scell_key_cache_hash(tuple);
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Another thread might have derived the same key meanwhile */
+    if (ecrypt_scell_key_cache_find(cache, hash, tuple) != ECRYPT_SCELL_KEY_CACHE_NONE) {
+        goto out;
+    }
+
+    if (cache->count < cache->capacity) {
+        index = cache->count++;
+    } else {
+        index = cache->lru_tail;
+        ecrypt_scell_key_cache_lru_unlink(cache, index);
+        ecrypt_scell_key_cache_bucket_unlink(cache, index);
+    }
+    entry = &cache->entries[index];
+    ecconnect_wipe(entry, sizeof(*entry));
+
+    entry->hash = hash;
+    entry->alg = tuple->alg;
+    memcpy(entry->kdf_context, tuple->kdf_context, tuple->kdf_context_length);
+    entry->kdf_context_length = tuple->kdf_context_length;
+    if (tuple->user_context_length != 0) {
+        memcpy(entry->user_context, tuple->user_context, tuple->user_context_length);
+    }
+    entry->user_context_length = tuple->user_context_length;
+    memcpy(entry->derived_key, derived_key, derived_key_length);
+    entry->derived_key_length = derived_key_length;
+
+    bucket = hash & cache->bucket_mask;
+    entry->bucket_next = cache->buckets[bucket];
+    cache->buckets[bucket] = index;
+    ecrypt_scell_key_cache_lru_push(cache, index);
+
+out:
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void ecrypt_scell_key_cache_stats(struct ecrypt_scell_key_cache* cache, uint64_t* hits, uint64_t* misses)
+{
+    pthread_mutex_lock(&cache->lock);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @internal
+ * @file secure_cell_key_cache.h
+ * @brief Cache of derived Secure Cell keys
+ *
+ * @warning Structures and functions declared in this file are considered
+ * implementation details and may change without notice.
+ */
+
+#ifndef ECRYPT_SECURE_CELL_KEY_CACHE_H
+#define ECRYPT_SECURE_CELL_KEY_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longer user contexts are not cached */
+#define ECRYPT_SCELL_KEY_CACHE_MAX_CONTEXT_LENGTH 128
+
+/*
+ * Derived key depends only on these inputs (the master key is fixed
+ * for a cache). Buffers are referenced, not owned.
+ */
+struct ecrypt_scell_key_cache_tuple {
+    uint32_t alg;
+    const uint8_t* kdf_context;
+    size_t kdf_context_length;
+    const uint8_t* user_context;
+    size_t user_context_length;
+};
+
+struct ecrypt_scell_key_cache;
+
+struct ecrypt_scell_key_cache* ecrypt_scell_key_cache_create(size_t capacity);
+
+/* Wipes all cached keys */
+void ecrypt_scell_key_cache_destroy(struct ecrypt_scell_key_cache* cache);
+
+/*
+ * Copies cached key for the tuple into `derived_key` which must have room
+ * for `derived_key_length` bytes. Returns false and counts a miss if there
+ * is no such key.
+ */
+bool ecrypt_scell_key_cache_get(struct ecrypt_scell_key_cache* cache,
+                                const struct ecrypt_scell_key_cache_tuple* tuple,
+                                uint8_t* derived_key,
+                                size_t derived_key_length);
+
+/* Remembers derived key, evicting the least recently used one if full */
+void ecrypt_scell_key_cache_put(struct ecrypt_scell_key_cache* cache,
+                                const struct ecrypt_scell_key_cache_tuple* tuple,
+                                const uint8_t* derived_key,
+                                size_t derived_key_length);
+
+void ecrypt_scell_key_cache_stats(struct ecrypt_scell_key_cache* cache, uint64_t* hits, uint64_t* misses);
+
+#endif /* ECRYPT_SECURE_CELL_KEY_CACHE_H */
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_seal_context.h"
+
+/* Rings up to this size are tried without allocating memory */
+#define ECRYPT_SCELL_KEY_RING_INLINE_KEYS 16
+
+struct ecrypt_secure_cell_key_ring_type {
+    /* Keyed contexts, the first one is used for encryption */
+    ecrypt_secure_cell_seal_ctx_t** keys;
+    size_t key_count;
+
+    uint32_t flags;
+
+    /* Key indices, most recently successful first */
+    pthread_mutex_t order_lock;
+    size_t* order;
+};
+
+ecrypt_secure_cell_key_ring_t* ecrypt_secure_cell_key_ring_create(const uint8_t* const* master_keys,
+                                                                  const size_t* master_key_lengths,
+                                                                  size_t key_count)
+{
+    ecrypt_secure_cell_key_ring_t* ring = NULL;
+    size_t i = 0;
+
+    ECRYPT_CHECK_PARAM_(master_keys != NULL && master_key_lengths != NULL);
+    ECRYPT_CHECK_PARAM_(key_count != 0);
+    for (i = 0; i < key_count; i++) {
+        ECRYPT_CHECK_PARAM_(master_keys[i] != NULL && master_key_lengths[i] != 0);
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    ECRYPT_CHECK_MALLOC_(ring);
+
+    if (pthread_mutex_init(&ring->order_lock, NULL) != 0) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->keys = calloc(key_count, sizeof(*ring->keys));
+    ring->order = calloc(key_count, sizeof(*ring->order));
+    if (!ring->keys || !ring->order) {
+        goto error;
+    }
+
+    for (i = 0; i < key_count; i++) {
+        ring->keys[i] = ecrypt_secure_cell_seal_ctx_create(master_keys[i], master_key_lengths[i]);
+        if (!ring->keys[i]) {
+            goto error;
+        }
+        ring->key_count++;
+        ring->order[i] = i;
+    }
+
+    return ring;
+
+error:
+    ecrypt_secure_cell_key_ring_destroy(ring);
+    return NULL;
+}
+
+ecrypt_status_t ecrypt_secure_cell_key_ring_destroy(ecrypt_secure_cell_key_ring_t* ring)
+{
+    size_t i = 0;
+
+    if (!ring) {
+        return ECRYPT_SUCCESS;
+    }
+
+    for (i = 0; i < ring->key_count; i++) {
+        ecrypt_secure_cell_seal_ctx_destroy(ring->keys[i]);
+    }
+    free(ring->keys);
+    free(ring->order);
+    pthread_mutex_destroy(&ring->order_lock);
+    free(ring);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_key_ring_set_flags(ecrypt_secure_cell_key_ring_t* ring, uint32_t flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+
+    ECRYPT_CHECK_PARAM(ring != NULL);
+
+    /* Only the current key encrypts, it validates the flags as well */
+    res = ecrypt_secure_cell_seal_ctx_set_flags(ring->keys[0], flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ring->flags = flags;
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_key_ring(ecrypt_secure_cell_key_ring_t* ring,
+                                                              const uint8_t* user_context,
+                                                              size_t user_context_length,
+                                                              const uint8_t* message,
+                                                              size_t message_length,
+                                                              uint8_t* encrypted_message,
+                                                              size_t* encrypted_message_length)
+{
+    ECRYPT_CHECK_PARAM(ring != NULL);
+
+    return ecrypt_secure_cell_encrypt_seal_with_ctx(ring->keys[0],
+                                                    user_context,
+                                                    user_context_length,
+                                                    message,
+                                                    message_length,
+                                                    encrypted_message,
+                                                    encrypted_message_length);
+}
+
+static void ecrypt_scell_key_ring_order_snapshot(ecrypt_secure_cell_key_ring_t* ring, size_t* order)
+{
+    pthread_mutex_lock(&ring->order_lock);
+    memcpy(order, ring->order, ring->key_count * sizeof(*order));
+    pthread_mutex_unlock(&ring->order_lock);
+}
+
+static void ecrypt_scell_key_ring_promote(ecrypt_secure_cell_key_ring_t* ring, size_t key_index)
+{
+    size_t i = 0;
+
+    pthread_mutex_lock(&ring->order_lock);
+    /* Move to front, keeping relative order of the rest */
+    for (i = 0; i < ring->key_count; i++) {
+        if (ring->order[i] == key_index) {
+            break;
+        }
+    }
+    for (; i > 0; i--) {
+        ring->order[i] = ring->order[i - 1];
+    }
+    ring->order[0] = key_index;
+    pthread_mutex_unlock(&ring->order_lock);
+}
+
+static ecrypt_status_t ecrypt_scell_key_ring_try_keys(ecrypt_secure_cell_key_ring_t* ring,
+                                                      struct ecrypt_scell_scratch* scratch,
+                                                      const struct ecrypt_scell_auth_token_key* hdr,
+                                                      bool compat,
+                                                      const size_t* order,
+                                                      const uint8_t* user_context,
+                                                      size_t user_context_length,
+                                                      const uint8_t* ciphertext,
+                                                      uint8_t* plain_message,
+                                                      size_t* plain_message_length,
+                                                      size_t* key_index)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t message_length = *plain_message_length;
+    size_t i = 0;
+
+    for (i = 0; i < ring->key_count; i++) {
+        *plain_message_length = message_length;
+        res = ecrypt_scell_ctx_decrypt_parsed(ring->keys[order[i]],
+                                              scratch,
+                                              hdr,
+                                              compat,
+                                              user_context,
+                                              user_context_length,
+                                              ciphertext,
+                                              plain_message,
+                                              plain_message_length);
+        if (res == ECRYPT_SUCCESS) {
+            *key_index = order[i];
+            return ECRYPT_SUCCESS;
+        }
+    }
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_key_ring_try_key_id(ecrypt_secure_cell_key_ring_t* ring,
+                                                        struct ecrypt_scell_scratch* scratch,
+                                                        const struct ecrypt_scell_auth_token_key* hdr,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* ciphertext,
+                                                        uint8_t* plain_message,
+                                                        size_t* plain_message_length,
+                                                        size_t* key_index)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t message_length = *plain_message_length;
+    size_t i = 0;
+
+    /*
+     * Key IDs are short so collisions are possible, but very unlikely.
+     * Comparing them is much cheaper than trial decryption anyway.
+     */
+    for (i = 0; i < ring->key_count; i++) {
+        if (ring->keys[i]->key_id != hdr->key_id) {
+            continue;
+        }
+        *plain_message_length = message_length;
+        res = ecrypt_scell_ctx_decrypt_parsed(ring->keys[i],
+                                              scratch,
+                                              hdr,
+                                              false,
+                                              user_context,
+                                              user_context_length,
+                                              ciphertext,
+                                              plain_message,
+                                              plain_message_length);
+        if (res == ECRYPT_SUCCESS) {
+            *key_index = i;
+            return ECRYPT_SUCCESS;
+        }
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_key_ring(ecrypt_secure_cell_key_ring_t* ring,
+                                                              const uint8_t* user_context,
+                                                              size_t user_context_length,
+                                                              const uint8_t* encrypted_message,
+                                                              size_t encrypted_message_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length,
+                                                              size_t* key_index)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    struct ecrypt_scell_auth_token_key hdr;
+    const uint8_t* ciphertext = NULL;
+    size_t inline_order[ECRYPT_SCELL_KEY_RING_INLINE_KEYS];
+    size_t* order = inline_order;
+    size_t found_index = 0;
+    uint32_t message_length = 0;
+    uint32_t flags = 0;
+
+    ECRYPT_CHECK_PARAM(ring != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    res = ecrypt_scell_auth_token_key_message_size(encrypted_message,
+                                                   encrypted_message_length,
+                                                   &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (!plain_message || *plain_message_length < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_scell_seal_parse(encrypted_message, encrypted_message_length, &hdr, &ciphertext, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    /* Key ID flag of the ring affects only encryption, cells are dispatched by their own mark */
+    flags |= ring->flags & ~ECRYPT_SCELL_FLAG_KEY_ID;
+
+    /* Scratch space does not depend on the key, borrow it from the first one */
+    scratch = ecrypt_scell_scratch_acquire(ring->keys[0]);
+    if (!scratch) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    if (flags & ECRYPT_SCELL_FLAG_KEY_ID) {
+        res = ecrypt_scell_key_ring_try_key_id(ring,
+                                               scratch,
+                                               &hdr,
+                                               user_context,
+                                               user_context_length,
+                                               ciphertext,
+                                               plain_message,
+                                               plain_message_length,
+                                               &found_index);
+        goto out;
+    }
+
+    if (ring->key_count > ECRYPT_SCELL_KEY_RING_INLINE_KEYS) {
+        order = calloc(ring->key_count, sizeof(*order));
+        if (!order) {
+            res = ECRYPT_NO_MEMORY;
+            goto out;
+        }
+    }
+    ecrypt_scell_key_ring_order_snapshot(ring, order);
+
+    res = ecrypt_scell_key_ring_try_keys(ring,
+                                         scratch,
+                                         &hdr,
+                                         false,
+                                         order,
+                                         user_context,
+                                         user_context_length,
+                                         ciphertext,
+                                         plain_message,
+                                         plain_message_length,
+                                         &found_index);
+    /* Legacy KDF is tried only after all keys fail with the current one */
+#ifdef SCELL_COMPAT
+    if (res != ECRYPT_SUCCESS && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
+        res = ecrypt_scell_key_ring_try_keys(ring,
+                                             scratch,
+                                             &hdr,
+                                             true,
+                                             order,
+                                             user_context,
+                                             user_context_length,
+                                             ciphertext,
+                                             plain_message,
+                                             plain_message_length,
+                                             &found_index);
+    }
+#endif
+    if (res == ECRYPT_SUCCESS && order[0] != found_index) {
+        ecrypt_scell_key_ring_promote(ring, found_index);
+    }
+
+    if (order != inline_order) {
+        free(order);
+    }
+
+out:
+    ecrypt_scell_scratch_release(ring->keys[0], scratch);
+
+    if (res == ECRYPT_SUCCESS) {
+        if (key_index) {
+            *key_index = found_index;
+        }
+    } else {
+        /* Do not leave unauthenticated plaintext around */
+        ecconnect_wipe(plain_message, message_length);
+    }
+
+    return res;
+}
@@ -0,0 +1,779 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/ecrypt_portable_endian.h"
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/secure_cell_seal_context.h"
+
+/*
+ * Log segment layout:
+ *
+ *   Header
+ *     uint32  algorithm ID
+ *     uint32  record tag length
+ *     uint64  segment ID
+ *     byte[]  salt (ECRYPT_SCELL_LOG_SALT_LENGTH bytes)
+ *
+ *   Records (repeated)
+ *     uint32  record length
+ *     byte[]  encrypted record (record length bytes)
+ *     byte[]  truncated authentication tag (record tag length bytes)
+ *
+ *   Seal (optional, always the last one)
+ *     uint32  ECRYPT_SCELL_LOG_SEAL_MARK
+ *     uint64  record count
+ *     uint64  total length of records
+ *     byte[]  authentication tag (ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH bytes)
+ *
+ * All integers are little-endian. Segment key is derived from the master key
+ * with the whole header as KDF context, so it is unique per segment and the
+ * header is authenticated implicitly. Nonces are counters: the first 4 bytes
+ * are ECRYPT_SCELL_LOG_NONCE_RECORD or ECRYPT_SCELL_LOG_NONCE_SEAL, the last
+ * 8 bytes are record index. This prevents reordering and removal of records.
+ * Seal authenticates its body as associated data of an empty message and
+ * prevents truncation of sealed segments.
+ */
+#define ECRYPT_SCELL_LOG_KDF_KEY_LABEL "Ecrypt secure cell log key"
+
+#define ECRYPT_SCELL_LOG_SALT_LENGTH 16
+#define ECRYPT_SCELL_LOG_HEADER_LENGTH (2 * sizeof(uint32_t) + sizeof(uint64_t) + ECRYPT_SCELL_LOG_SALT_LENGTH)
+#define ECRYPT_SCELL_LOG_SEAL_BODY_LENGTH (2 * sizeof(uint64_t))
+#define ECRYPT_SCELL_LOG_SEAL_LENGTH \
+    (sizeof(uint32_t) + ECRYPT_SCELL_LOG_SEAL_BODY_LENGTH + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH)
+
+#define ECRYPT_SCELL_LOG_SEAL_MARK 0xFFFFFFFF
+#define ECRYPT_SCELL_LOG_NONCE_RECORD 0
+#define ECRYPT_SCELL_LOG_NONCE_SEAL 1
+
+#define ECRYPT_SCELL_LOG_DEFAULT_TAG_LENGTH 8
+/* Limits records to what cipher contexts take in one go */
+#define ECRYPT_SCELL_LOG_MAX_RECORD_LENGTH (16 * 1024 * 1024)
+
+struct ecrypt_scell_log_header {
+    uint32_t alg;
+    uint32_t tag_length;
+    uint64_t segment_id;
+    const uint8_t* salt;
+};
+
+struct ecrypt_secure_cell_log_writer_type {
+    bool failed;
+    bool sealed;
+    /* Resumed segments already have the header */
+    bool header_written;
+
+    uint8_t header[ECRYPT_SCELL_LOG_HEADER_LENGTH];
+    struct ecrypt_scell_log_header hdr;
+
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8];
+    size_t key_length;
+
+    uint64_t record_count;
+    uint64_t total_length;
+
+    struct ecrypt_scell_scratch scratch;
+};
+
+struct ecrypt_secure_cell_log_reader_type {
+    bool failed;
+    bool finished;
+    bool sealed;
+
+    /* Not owned, must outlive the reader */
+    const uint8_t* segment;
+    size_t segment_length;
+    size_t offset;
+
+    struct ecrypt_scell_log_header hdr;
+
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8];
+    size_t key_length;
+
+    uint64_t record_count;
+    uint64_t total_length;
+
+    struct ecrypt_scell_scratch scratch;
+};
+
+static void ecrypt_write_scell_log_header(const struct ecrypt_scell_log_header* hdr, uint8_t* buffer)
+{
+    buffer = stream_write_uint32LE(buffer, hdr->alg);
+    buffer = stream_write_uint32LE(buffer, hdr->tag_length);
+    buffer = stream_write_uint64LE(buffer, hdr->segment_id);
+    buffer = stream_write_bytes(buffer, hdr->salt, ECRYPT_SCELL_LOG_SALT_LENGTH);
+}
+
+static ecrypt_status_t ecrypt_read_scell_log_header(const uint8_t* buffer,
+                                                    size_t buffer_length,
+                                                    struct ecrypt_scell_log_header* hdr)
+{
+    if (buffer_length < ECRYPT_SCELL_LOG_HEADER_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    buffer = stream_read_uint32LE(buffer, &hdr->alg);
+    buffer = stream_read_uint32LE(buffer, &hdr->tag_length);
+    buffer = stream_read_uint64LE(buffer, &hdr->segment_id);
+    buffer = stream_read_bytes(buffer, &hdr->salt, ECRYPT_SCELL_LOG_SALT_LENGTH);
+    if (!ecconnect_alg_reserved_bits_valid(hdr->alg)) {
+        return ECRYPT_FAIL;
+    }
+    switch (hdr->alg & (ECCONNECT_SYM_ALG_MASK | ECCONNECT_SYM_PADDING_MASK)) {
+    case ECCONNECT_SYM_AES_GCM:
+    case ECCONNECT_SYM_CHACHA20_POLY1305:
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    if (ecconnect_alg_kdf(hdr->alg) != ECCONNECT_SYM_NOKDF) {
+        return ECRYPT_FAIL;
+    }
+    if (hdr->tag_length < ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH
+        || hdr->tag_length > ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_log_derive_key(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* header,
+                                                   uint32_t alg,
+                                                   uint8_t* key,
+                                                   size_t* key_length)
+{
+    ecconnect_kdf_context_buf_t kdf_ctx = {header, ECRYPT_SCELL_LOG_HEADER_LENGTH};
+    size_t required_length = ecconnect_alg_key_length(alg);
+    switch (required_length) {
+    case ECCONNECT_SYM_256_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_192_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_128_KEY_LENGTH / 8:
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    if (*key_length < required_length) {
+        return ECRYPT_FAIL;
+    }
+    *key_length = required_length;
+
+    return ecconnect_kdf(master_key,
+                         master_key_length,
+                         ECRYPT_SCELL_LOG_KDF_KEY_LABEL,
+                         &kdf_ctx,
+                         1,
+                         key,
+                         *key_length);
+}
+
+static void ecrypt_scell_log_nonce(uint32_t kind, uint64_t index, uint8_t* nonce)
+{
+    nonce = stream_write_uint32LE(nonce, kind);
+    nonce = stream_write_uint64LE(nonce, index);
+}
+
+static void ecrypt_scell_log_scratch_cleanup(struct ecrypt_scell_scratch* scratch)
+{
+    if (scratch->aead_encrypt) {
+        ecconnect_sym_aead_encrypt_destroy(scratch->aead_encrypt);
+        scratch->aead_encrypt = NULL;
+    }
+    if (scratch->aead_decrypt) {
+        ecconnect_sym_aead_decrypt_destroy(scratch->aead_decrypt);
+        scratch->aead_decrypt = NULL;
+    }
+}
+
+/*
+ * Encrypts a record or a seal body (as associated data of an empty message).
+ * Only the first `tag_length` bytes of the authentication tag are written.
+ */
+static ecrypt_status_t ecrypt_scell_log_seal_record(struct ecrypt_scell_scratch* scratch,
+                                                    const struct ecrypt_scell_log_header* hdr,
+                                                    const uint8_t* key,
+                                                    size_t key_length,
+                                                    uint32_t kind,
+                                                    uint64_t index,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    const uint8_t* record,
+                                                    size_t record_length,
+                                                    uint8_t* output,
+                                                    uint8_t* auth_tag,
+                                                    size_t tag_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t nonce[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t full_tag[ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH] = {0};
+    uint32_t full_tag_length = sizeof(full_tag);
+    size_t encrypted_length = record_length;
+    /* Empty records still need a valid pointer */
+    static const uint8_t empty = 0;
+
+    ecrypt_scell_log_nonce(kind, index, nonce);
+
+    res = ecrypt_scell_scratch_plain_encrypt(scratch,
+                                             hdr->alg,
+                                             key,
+                                             key_length,
+                                             nonce,
+                                             sizeof(nonce),
+                                             aad,
+                                             aad_length,
+                                             record_length ? record : &empty,
+                                             record_length,
+                                             output,
+                                             &encrypted_length,
+                                             full_tag,
+                                             &full_tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    if (encrypted_length != record_length || full_tag_length != sizeof(full_tag)) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+    memcpy(auth_tag, full_tag, tag_length);
+
+error:
+    ecconnect_wipe(full_tag, sizeof(full_tag));
+    return res;
+}
+
+/*
+ * Authenticates and decrypts a record, or authenticates a seal body.
+ * If `output` is NULL the record is only authenticated, plaintext goes
+ * through a small buffer which is wiped afterwards.
+ */
+static ecrypt_status_t ecrypt_scell_log_open_record(struct ecrypt_scell_scratch* scratch,
+                                                    const struct ecrypt_scell_log_header* hdr,
+                                                    const uint8_t* key,
+                                                    size_t key_length,
+                                                    uint32_t kind,
+                                                    uint64_t index,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    const uint8_t* record,
+                                                    size_t record_length,
+                                                    uint8_t* output,
+                                                    const uint8_t* auth_tag,
+                                                    size_t tag_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t nonce[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t chunk[1024];
+    size_t chunk_length = 0;
+    size_t decrypted_length = 0;
+
+    ecrypt_scell_log_nonce(kind, index, nonce);
+
+    if (scratch->aead_decrypt && scratch->aead_decrypt_alg == hdr->alg) {
+        res = ecconnect_sym_aead_decrypt_reset(scratch->aead_decrypt, key, key_length, nonce, sizeof(nonce));
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    } else {
+        if (scratch->aead_decrypt) {
+            ecconnect_sym_aead_decrypt_destroy(scratch->aead_decrypt);
+        }
+        scratch->aead_decrypt = ecconnect_sym_aead_decrypt_create(hdr->alg, key, key_length, NULL, 0, nonce, sizeof(nonce));
+        scratch->aead_decrypt_alg = hdr->alg;
+        ECRYPT_CHECK(scratch->aead_decrypt != NULL);
+    }
+
+    if (aad_length != 0) {
+        res = ecconnect_sym_aead_decrypt_aad(scratch->aead_decrypt, aad, aad_length);
+        if (res != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+    }
+    if (output) {
+        if (record_length != 0) {
+            decrypted_length = record_length;
+            res = ecconnect_sym_aead_decrypt_update(scratch->aead_decrypt,
+                                                    record,
+                                                    record_length,
+                                                    output,
+                                                    &decrypted_length);
+            if (res != ECRYPT_SUCCESS) {
+                goto error;
+            }
+        }
+    } else {
+        while (record_length > 0) {
+            chunk_length = (record_length < sizeof(chunk)) ? record_length : sizeof(chunk);
+            decrypted_length = sizeof(chunk);
+            res = ecconnect_sym_aead_decrypt_update(scratch->aead_decrypt,
+                                                    record,
+                                                    chunk_length,
+                                                    chunk,
+                                                    &decrypted_length);
+            if (res != ECRYPT_SUCCESS) {
+                goto error;
+            }
+            record += chunk_length;
+            record_length -= chunk_length;
+        }
+    }
+    res = ecconnect_sym_aead_decrypt_final_truncated(scratch->aead_decrypt, auth_tag, tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ECRYPT_SUCCESS;
+
+error:
+    if (!output) {
+        ecconnect_wipe(chunk, sizeof(chunk));
+    } else if (res != ECRYPT_SUCCESS && record_length != 0) {
+        ecconnect_wipe(output, record_length);
+    }
+    return (res == ECRYPT_SUCCESS) ? ECRYPT_SUCCESS : ECRYPT_FAIL;
+}
+
+ecrypt_secure_cell_log_reader_t* ecrypt_secure_cell_log_reader_create(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      const uint8_t* segment,
+                                                                      size_t segment_length)
+{
+    ecrypt_secure_cell_log_reader_t* reader = NULL;
+
+    ECRYPT_CHECK_PARAM_(master_key != NULL && master_key_length != 0);
+    ECRYPT_CHECK_PARAM_(segment != NULL && segment_length != 0);
+
+    reader = calloc(1, sizeof(*reader));
+    ECRYPT_CHECK_MALLOC_(reader);
+
+    if (ecrypt_read_scell_log_header(segment, segment_length, &reader->hdr) != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    reader->key_length = sizeof(reader->key);
+    if (ecrypt_scell_log_derive_key(master_key,
+                                    master_key_length,
+                                    segment,
+                                    reader->hdr.alg,
+                                    reader->key,
+                                    &reader->key_length)
+        != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    reader->segment = segment;
+    reader->segment_length = segment_length;
+    reader->offset = ECRYPT_SCELL_LOG_HEADER_LENGTH;
+    return reader;
+
+error:
+    ecrypt_secure_cell_log_reader_destroy(reader);
+    return NULL;
+}
+
+static ecrypt_status_t ecrypt_scell_log_reader_seal(ecrypt_secure_cell_log_reader_t* reader)
+{
+    const uint8_t* body = reader->segment + reader->offset + sizeof(uint32_t);
+    const uint8_t* auth_tag = body + ECRYPT_SCELL_LOG_SEAL_BODY_LENGTH;
+    uint64_t record_count = 0;
+    uint64_t total_length = 0;
+
+    /* Nothing may follow the seal */
+    if (reader->segment_length - reader->offset != ECRYPT_SCELL_LOG_SEAL_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    stream_read_uint64LE(stream_read_uint64LE(body, &record_count), &total_length);
+    if (record_count != reader->record_count || total_length != reader->total_length) {
+        return ECRYPT_FAIL;
+    }
+    return ecrypt_scell_log_open_record(&reader->scratch,
+                                        &reader->hdr,
+                                        reader->key,
+                                        reader->key_length,
+                                        ECRYPT_SCELL_LOG_NONCE_SEAL,
+                                        record_count,
+                                        body,
+                                        ECRYPT_SCELL_LOG_SEAL_BODY_LENGTH,
+                                        NULL,
+                                        0,
+                                        NULL,
+                                        auth_tag,
+                                        ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH);
+}
+
+/* With `verify_only` the record is authenticated and skipped without output */
+static ecrypt_status_t ecrypt_scell_log_reader_step(ecrypt_secure_cell_log_reader_t* reader,
+                                                    bool verify_only,
+                                                    uint8_t* record,
+                                                    size_t* record_length,
+                                                    bool* end)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t available = 0;
+    uint32_t length = 0;
+
+    if (reader->failed) {
+        return ECRYPT_FAIL;
+    }
+    if (reader->finished || reader->offset == reader->segment_length) {
+        reader->finished = true;
+        *record_length = 0;
+        *end = true;
+        return ECRYPT_SUCCESS;
+    }
+
+    available = reader->segment_length - reader->offset;
+    if (available < sizeof(uint32_t)) {
+        goto error;
+    }
+    stream_read_uint32LE(reader->segment + reader->offset, &length);
+    available -= sizeof(uint32_t);
+
+    if (length == ECRYPT_SCELL_LOG_SEAL_MARK) {
+        if (ecrypt_scell_log_reader_seal(reader) != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        reader->offset = reader->segment_length;
+        reader->finished = true;
+        reader->sealed = true;
+        *record_length = 0;
+        *end = true;
+        return ECRYPT_SUCCESS;
+    }
+
+    if (length > ECRYPT_SCELL_LOG_MAX_RECORD_LENGTH || available < length + (size_t)reader->hdr.tag_length) {
+        goto error;
+    }
+    if (reader->record_count == UINT64_MAX) {
+        goto error;
+    }
+    if (!verify_only && (!record || *record_length < length)) {
+        *record_length = length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_scell_log_open_record(&reader->scratch,
+                                       &reader->hdr,
+                                       reader->key,
+                                       reader->key_length,
+                                       ECRYPT_SCELL_LOG_NONCE_RECORD,
+                                       reader->record_count,
+                                       NULL,
+                                       0,
+                                       reader->segment + reader->offset + sizeof(uint32_t),
+                                       length,
+                                       verify_only ? NULL : record,
+                                       reader->segment + reader->offset + sizeof(uint32_t) + length,
+                                       reader->hdr.tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    reader->offset += sizeof(uint32_t) + length + reader->hdr.tag_length;
+    reader->record_count++;
+    reader->total_length += length;
+    *record_length = length;
+    *end = false;
+    return ECRYPT_SUCCESS;
+
+error:
+    reader->failed = true;
+    return ECRYPT_FAIL;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_reader_next(ecrypt_secure_cell_log_reader_t* reader,
+                                                   uint8_t* record,
+                                                   size_t* record_length,
+                                                   bool* end)
+{
+    ECRYPT_CHECK_PARAM(reader != NULL);
+    ECRYPT_CHECK_PARAM(record_length != NULL);
+    ECRYPT_CHECK_PARAM(end != NULL);
+
+    return ecrypt_scell_log_reader_step(reader, false, record, record_length, end);
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_reader_final(const ecrypt_secure_cell_log_reader_t* reader)
+{
+    ECRYPT_CHECK_PARAM(reader != NULL);
+
+    if (reader->failed || !reader->sealed) {
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_reader_destroy(ecrypt_secure_cell_log_reader_t* reader)
+{
+    if (!reader) {
+        return ECRYPT_SUCCESS;
+    }
+    ecrypt_scell_log_scratch_cleanup(&reader->scratch);
+    ecconnect_wipe(reader, sizeof(*reader));
+    free(reader);
+    return ECRYPT_SUCCESS;
+}
+
+/* Authenticates all records, `reader` is left at the end of the segment */
+static ecrypt_status_t ecrypt_scell_log_reader_skip_all(ecrypt_secure_cell_log_reader_t* reader)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t record_length = 0;
+    bool end = false;
+
+    while (!end) {
+        res = ecrypt_scell_log_reader_step(reader, true, NULL, &record_length, &end);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    }
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_verify(const uint8_t* master_key,
+                                              size_t master_key_length,
+                                              const uint8_t* segment,
+                                              size_t segment_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecrypt_secure_cell_log_reader_t* reader = NULL;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    ECRYPT_CHECK_PARAM(segment != NULL && segment_length != 0);
+
+    reader = ecrypt_secure_cell_log_reader_create(master_key, master_key_length, segment, segment_length);
+    if (!reader) {
+        return ECRYPT_FAIL;
+    }
+    res = ecrypt_scell_log_reader_skip_all(reader);
+    if (res == ECRYPT_SUCCESS) {
+        res = ecrypt_secure_cell_log_reader_final(reader);
+    }
+    ecrypt_secure_cell_log_reader_destroy(reader);
+    return res;
+}
+
+ecrypt_secure_cell_log_writer_t* ecrypt_secure_cell_log_writer_create(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      uint64_t segment_id,
+                                                                      size_t tag_length)
+{
+    ecrypt_secure_cell_log_writer_t* writer = NULL;
+    uint8_t salt[ECRYPT_SCELL_LOG_SALT_LENGTH] = {0};
+
+    if (tag_length == 0) {
+        tag_length = ECRYPT_SCELL_LOG_DEFAULT_TAG_LENGTH;
+    }
+    ECRYPT_CHECK_PARAM_(master_key != NULL && master_key_length != 0);
+    ECRYPT_CHECK_PARAM_(tag_length >= ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH
+                        && tag_length <= ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH);
+
+    writer = calloc(1, sizeof(*writer));
+    ECRYPT_CHECK_MALLOC_(writer);
+
+    if (ecconnect_rand(salt, sizeof(salt)) != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    writer->hdr.alg = ECRYPT_AUTH_SYM_ALG;
+    writer->hdr.tag_length = (uint32_t)tag_length;
+    writer->hdr.segment_id = segment_id;
+    writer->hdr.salt = salt;
+    ecrypt_write_scell_log_header(&writer->hdr, writer->header);
+    /* Point into the writer, not at the stack */
+    writer->hdr.salt = writer->header + ECRYPT_SCELL_LOG_HEADER_LENGTH - ECRYPT_SCELL_LOG_SALT_LENGTH;
+
+    writer->key_length = sizeof(writer->key);
+    if (ecrypt_scell_log_derive_key(master_key,
+                                    master_key_length,
+                                    writer->header,
+                                    writer->hdr.alg,
+                                    writer->key,
+                                    &writer->key_length)
+        != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    return writer;
+
+error:
+    ecrypt_secure_cell_log_writer_destroy(writer);
+    return NULL;
+}
+
+ecrypt_secure_cell_log_writer_t* ecrypt_secure_cell_log_writer_resume(const uint8_t* master_key,
+                                                                      size_t master_key_length,
+                                                                      const uint8_t* segment,
+                                                                      size_t segment_length)
+{
+    ecrypt_secure_cell_log_writer_t* writer = NULL;
+    ecrypt_secure_cell_log_reader_t* reader = NULL;
+
+    reader = ecrypt_secure_cell_log_reader_create(master_key, master_key_length, segment, segment_length);
+    if (!reader) {
+        return NULL;
+    }
+    /* Counter must continue after the last authentic record */
+    if (ecrypt_scell_log_reader_skip_all(reader) != ECRYPT_SUCCESS || reader->sealed) {
+        goto error;
+    }
+
+    writer = calloc(1, sizeof(*writer));
+    if (!writer) {
+        goto error;
+    }
+    memcpy(writer->header, segment, ECRYPT_SCELL_LOG_HEADER_LENGTH);
+    writer->hdr = reader->hdr;
+    writer->hdr.salt = writer->header + ECRYPT_SCELL_LOG_HEADER_LENGTH - ECRYPT_SCELL_LOG_SALT_LENGTH;
+    writer->header_written = true;
+    memcpy(writer->key, reader->key, reader->key_length);
+    writer->key_length = reader->key_length;
+    writer->record_count = reader->record_count;
+    writer->total_length = reader->total_length;
+
+    ecrypt_secure_cell_log_reader_destroy(reader);
+    return writer;
+
+error:
+    ecrypt_secure_cell_log_reader_destroy(reader);
+    return NULL;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_append(ecrypt_secure_cell_log_writer_t* writer,
+                                              const uint8_t* record,
+                                              size_t record_length,
+                                              uint8_t* output,
+                                              size_t* output_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t header_length = 0;
+    size_t required_length = 0;
+    uint8_t* out = output;
+
+    ECRYPT_CHECK_PARAM(writer != NULL);
+    if (record_length != 0) {
+        ECRYPT_CHECK_PARAM(record != NULL);
+    }
+    ECRYPT_CHECK_PARAM(record_length <= ECRYPT_SCELL_LOG_MAX_RECORD_LENGTH);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    if (writer->failed || writer->sealed || writer->record_count == UINT64_MAX) {
+        return ECRYPT_FAIL;
+    }
+
+    header_length = writer->header_written ? 0 : ECRYPT_SCELL_LOG_HEADER_LENGTH;
+    required_length = header_length + sizeof(uint32_t) + record_length + writer->hdr.tag_length;
+    if (!output || *output_length < required_length) {
+        *output_length = required_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    if (header_length != 0) {
+        out = stream_write_bytes(out, writer->header, header_length);
+    }
+    out = stream_write_uint32LE(out, (uint32_t)record_length);
+    res = ecrypt_scell_log_seal_record(&writer->scratch,
+                                       &writer->hdr,
+                                       writer->key,
+                                       writer->key_length,
+                                       ECRYPT_SCELL_LOG_NONCE_RECORD,
+                                       writer->record_count,
+                                       NULL,
+                                       0,
+                                       record,
+                                       record_length,
+                                       out,
+                                       out + record_length,
+                                       writer->hdr.tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        ecconnect_wipe(output, required_length);
+        writer->failed = true;
+        return res;
+    }
+
+    writer->header_written = true;
+    writer->record_count++;
+    writer->total_length += record_length;
+    *output_length = required_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_seal(ecrypt_secure_cell_log_writer_t* writer,
+                                            uint8_t* output,
+                                            size_t* output_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t header_length = 0;
+    size_t required_length = 0;
+    uint8_t* out = output;
+    uint8_t* body = NULL;
+
+    ECRYPT_CHECK_PARAM(writer != NULL);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    if (writer->failed || writer->sealed) {
+        return ECRYPT_FAIL;
+    }
+
+    header_length = writer->header_written ? 0 : ECRYPT_SCELL_LOG_HEADER_LENGTH;
+    required_length = header_length + ECRYPT_SCELL_LOG_SEAL_LENGTH;
+    if (!output || *output_length < required_length) {
+        *output_length = required_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    if (header_length != 0) {
+        out = stream_write_bytes(out, writer->header, header_length);
+    }
+    out = stream_write_uint32LE(out, ECRYPT_SCELL_LOG_SEAL_MARK);
+    body = out;
+    out = stream_write_uint64LE(out, writer->record_count);
+    out = stream_write_uint64LE(out, writer->total_length);
+    res = ecrypt_scell_log_seal_record(&writer->scratch,
+                                       &writer->hdr,
+                                       writer->key,
+                                       writer->key_length,
+                                       ECRYPT_SCELL_LOG_NONCE_SEAL,
+                                       writer->record_count,
+                                       body,
+                                       ECRYPT_SCELL_LOG_SEAL_BODY_LENGTH,
+                                       NULL,
+                                       0,
+                                       out,
+                                       out,
+                                       ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH);
+    if (res != ECRYPT_SUCCESS) {
+        ecconnect_wipe(output, required_length);
+        writer->failed = true;
+        return res;
+    }
+
+    writer->header_written = true;
+    writer->sealed = true;
+    *output_length = required_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_log_writer_destroy(ecrypt_secure_cell_log_writer_t* writer)
+{
+    if (!writer) {
+        return ECRYPT_SUCCESS;
+    }
+    ecrypt_scell_log_scratch_cleanup(&writer->scratch);
+    ecconnect_wipe(writer, sizeof(*writer));
+    free(writer);
+    return ECRYPT_SUCCESS;
+}
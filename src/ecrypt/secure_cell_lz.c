@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell_lz.h"
+
+#include <string.h>
+
+#define ECRYPT_SCELL_LZ_MIN_MATCH 4
+#define ECRYPT_SCELL_LZ_MAX_OFFSET 65535
+/* Last match must start at least this far from the end of input */
+#define ECRYPT_SCELL_LZ_MATCH_LIMIT 12
+/* Last bytes of input are always literals */
+#define ECRYPT_SCELL_LZ_LAST_LITERALS 5
+
+#define ECRYPT_SCELL_LZ_HASH_BITS 12
+
+/* Skip faster through data which does not compress */
+#define ECRYPT_SCELL_LZ_SKIP_SHIFT 6
+
+static inline uint32_t ecrypt_scell_lz_read32(const uint8_t* p)
+{
+    uint32_t value = 0;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t ecrypt_scell_lz_hash(uint32_t value)
+{
+    return (value * 2654435761U) >> (32 - ECRYPT_SCELL_LZ_HASH_BITS);
+}
+
+static uint8_t* ecrypt_scell_lz_write_length(uint8_t* op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+static uint8_t* ecrypt_scell_lz_write_literals(uint8_t* op, uint8_t* token, const uint8_t* literals, size_t length)
+{
+    if (length >= 15) {
+        *token = 15 << 4;
+        op = ecrypt_scell_lz_write_length(op, length - 15);
+    } else {
+        *token = (uint8_t)(length << 4);
+    }
+    memcpy(op, literals, length);
+    return op + length;
+}
+
+ecrypt_status_t ecrypt_scell_lz_compress(const uint8_t* input,
+                                         size_t input_length,
+                                         uint8_t* output,
+                                         size_t* output_length)
+{
+    /* Positions of recently seen 4-byte sequences */
+    uint32_t table[1 << ECRYPT_SCELL_LZ_HASH_BITS];
+    const uint8_t* ip = input;
+    const uint8_t* anchor = input;
+    const uint8_t* end = input + input_length;
+    uint8_t* op = output;
+    uint8_t* token = NULL;
+
+    ECRYPT_CHECK_PARAM(input != NULL && input_length != 0);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    /* With enough space there is no need to check bounds while compressing */
+    if (!output || *output_length < ecrypt_scell_lz_bound(input_length)) {
+        *output_length = (size_t)ecrypt_scell_lz_bound(input_length);
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    memset(table, 0, sizeof(table));
+
+    if (input_length > ECRYPT_SCELL_LZ_MATCH_LIMIT) {
+        const uint8_t* match_limit = end - ECRYPT_SCELL_LZ_MATCH_LIMIT;
+        const uint8_t* extend_limit = end - ECRYPT_SCELL_LZ_LAST_LITERALS;
+
+        while (ip < match_limit) {
+            uint32_t sequence = ecrypt_scell_lz_read32(ip);
+            uint32_t hash = ecrypt_scell_lz_hash(sequence);
+            const uint8_t* candidate = input + table[hash];
+            const uint8_t* match_end = NULL;
+            size_t match_length = 0;
+            size_t offset = 0;
+
+            /* Input length is limited to 32 bits by the cell format */
+            table[hash] = (uint32_t)(ip - input);
+
+            if (candidate >= ip || (size_t)(ip - candidate) > ECRYPT_SCELL_LZ_MAX_OFFSET
+                || ecrypt_scell_lz_read32(candidate) != sequence) {
+                ip += 1 + ((size_t)(ip - anchor) >> ECRYPT_SCELL_LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            match_end = ip + ECRYPT_SCELL_LZ_MIN_MATCH;
+            candidate += ECRYPT_SCELL_LZ_MIN_MATCH;
+            while (match_end < extend_limit && *match_end == *candidate) {
+                match_end++;
+                candidate++;
+            }
+            match_length = (size_t)(match_end - ip) - ECRYPT_SCELL_LZ_MIN_MATCH;
+            offset = (size_t)(match_end - candidate);
+
+            token = op++;
+            op = ecrypt_scell_lz_write_literals(op, token, anchor, (size_t)(ip - anchor));
+            *op++ = (uint8_t)(offset & 0xFF);
+            *op++ = (uint8_t)(offset >> 8);
+            if (match_length >= 15) {
+                *token |= 15;
+                op = ecrypt_scell_lz_write_length(op, match_length - 15);
+            } else {
+                *token |= (uint8_t)match_length;
+            }
+
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+
+    /* The last sequence consists only of literals */
+    token = op++;
+    op = ecrypt_scell_lz_write_literals(op, token, anchor, (size_t)(end - anchor));
+
+    *output_length = (size_t)(op - output);
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_lz_read_length(const uint8_t** ip, const uint8_t* end, size_t* length)
+{
+    uint8_t byte = 0;
+
+    do {
+        if (*ip >= end || *length > SIZE_MAX - 255) {
+            return ECRYPT_FAIL;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_scell_lz_decompress(const uint8_t* input,
+                                           size_t input_length,
+                                           uint8_t* output,
+                                           size_t* output_length)
+{
+    const uint8_t* ip = input;
+    const uint8_t* end = input + input_length;
+    uint8_t* op = output;
+    uint8_t* output_end = NULL;
+
+    ECRYPT_CHECK_PARAM(input != NULL && input_length != 0);
+    ECRYPT_CHECK_PARAM(output != NULL && output_length != NULL);
+
+    output_end = output + *output_length;
+
+    for (;;) {
+        size_t literal_length = 0;
+        size_t match_length = 0;
+        size_t offset = 0;
+        uint8_t token = 0;
+
+        if (ip >= end) {
+            return ECRYPT_FAIL;
+        }
+        token = *ip++;
+
+        literal_length = token >> 4;
+        if (literal_length == 15 && ecrypt_scell_lz_read_length(&ip, end, &literal_length) != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+        if (literal_length > (size_t)(end - ip) || literal_length > (size_t)(output_end - op)) {
+            return ECRYPT_FAIL;
+        }
+        memcpy(op, ip, literal_length);
+        op += literal_length;
+        ip += literal_length;
+
+        /* The last sequence has no match */
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return ECRYPT_FAIL;
+        }
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - output)) {
+            return ECRYPT_FAIL;
+        }
+
+        match_length = token & 15;
+        if (match_length == 15 && ecrypt_scell_lz_read_length(&ip, end, &match_length) != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+        match_length += ECRYPT_SCELL_LZ_MIN_MATCH;
+        if (match_length > (size_t)(output_end - op)) {
+            return ECRYPT_FAIL;
+        }
+
+        if (offset >= match_length) {
+            memcpy(op, op - offset, match_length);
+            op += match_length;
+        } else {
+            /* Overlapping match repeats the last `offset` bytes */
+            const uint8_t* match = op - offset;
+            size_t i = 0;
+            for (i = 0; i < match_length; i++) {
+                op[i] = match[i];
+            }
+            op += match_length;
+        }
+    }
+
+    *output_length = (size_t)(op - output);
+    return ECRYPT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @internal
+ * @file secure_cell_lz.h
+ * @brief Secure Cell message compression
+ *
+ * @warning Structures and functions declared in this file are considered
+ * implementation details and may change without notice.
+ */
+
+#ifndef ECRYPT_SECURE_CELL_LZ_H
+#define ECRYPT_SECURE_CELL_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ecrypt/ecrypt_error.h>
+
+/*
+ * Compressed data uses LZ4 block format: a sequence of literal runs and
+ * back references within the preceding 64 KB, with no framing or checksums.
+ * Integrity is provided by the cell around it.
+ *
+ * A single byte of compressed data never expands to more than this number
+ * of bytes, which bounds the uncompressed length that a cell may declare.
+ */
+#define ECRYPT_SCELL_LZ_MAX_RATIO 255
+
+/* Maximum length of compressed data for input of given length */
+static inline uint64_t ecrypt_scell_lz_bound(uint64_t input_length)
+{
+    return input_length + input_length / 255 + 16;
+}
+
+/*
+ * Compresses `input` into `output`. Output buffer must have space for at least
+ * ecrypt_scell_lz_bound(input_length) bytes, actual length is written into
+ * `output_length`. Buffers must not overlap.
+ */
+ecrypt_status_t ecrypt_scell_lz_compress(const uint8_t* input,
+                                         size_t input_length,
+                                         uint8_t* output,
+                                         size_t* output_length);
+
+/*
+ * Decompresses `input` into `output`, writing no more than `output_length`
+ * bytes there. Returns ECRYPT_FAIL if input is malformed or does not fit.
+ * Actual length of decompressed data is written into `output_length`.
+ */
+ecrypt_status_t ecrypt_scell_lz_decompress(const uint8_t* input,
+                                           size_t input_length,
+                                           uint8_t* output,
+                                           size_t* output_length);
+
+#endif /* ECRYPT_SECURE_CELL_LZ_H */
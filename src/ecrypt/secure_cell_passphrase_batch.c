@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_batch.h"
+#include "ecrypt/secure_cell_seal_passphrase.h"
+
+/*
+ * Cells are processed in groups. PBKDF2 prekeys of a group are derived
+ * together by ecconnect_pbkdf2_sha256_batch() which fills SIMD lanes with
+ * independent chains, then each cell is decrypted with its prekey as usual.
+ * Groups are distributed between threads.
+ */
+#define ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP 8
+
+struct ecrypt_scell_passphrase_batch {
+    const uint8_t* passphrase;
+    size_t passphrase_length;
+    ecrypt_secure_cell_batch_item_t* items;
+    size_t item_count;
+    uint8_t* output;
+};
+
+/* Only cells with default salt length fit into prekey structure */
+static bool ecrypt_scell_passphrase_batch_kdf(const ecrypt_secure_cell_batch_item_t* item,
+                                              struct ecrypt_scell_pbkdf2_context* kdf)
+{
+    struct ecrypt_scell_auth_token_passphrase hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (ecrypt_read_scell_auth_token_passphrase(item->input, item->input_length, &hdr) != ECRYPT_SUCCESS) {
+        return false;
+    }
+    if (ecconnect_alg_kdf(hdr.alg) != ECCONNECT_SYM_PBKDF2) {
+        return false;
+    }
+    if (ecrypt_read_scell_pbkdf2_context(&hdr, kdf) != ECRYPT_SUCCESS) {
+        return false;
+    }
+    return kdf->salt_length == ECRYPT_AUTH_SYM_PBKDF2_SALT_LENGTH && kdf->iteration_count != 0;
+}
+
+static void ecrypt_scell_decrypt_passphrase_batch_group(void* arg, size_t group)
+{
+    struct ecrypt_scell_passphrase_batch* batch = arg;
+    struct ecrypt_scell_pbkdf2_prekey prekeys[ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP];
+    ecconnect_pbkdf2_sha256_job_t jobs[ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP];
+    const struct ecrypt_scell_pbkdf2_prekey* known[ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP] = {NULL};
+    struct ecrypt_scell_pbkdf2_context kdf;
+    size_t begin = group * ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP;
+    size_t end = begin + ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP;
+    size_t job_count = 0;
+    size_t i = 0;
+
+    if (end > batch->item_count) {
+        end = batch->item_count;
+    }
+
+    for (i = begin; i < end; i++) {
+        if (batch->items[i].status != ECRYPT_SUCCESS) {
+            continue;
+        }
+        memset(&kdf, 0, sizeof(kdf));
+        if (!ecrypt_scell_passphrase_batch_kdf(&batch->items[i], &kdf)) {
+            continue;
+        }
+        memcpy(prekeys[job_count].salt, kdf.salt, sizeof(prekeys[job_count].salt));
+        prekeys[job_count].iteration_count = kdf.iteration_count;
+
+        jobs[job_count].passphrase = batch->passphrase;
+        jobs[job_count].passphrase_length = batch->passphrase_length;
+        jobs[job_count].salt = prekeys[job_count].salt;
+        jobs[job_count].salt_length = sizeof(prekeys[job_count].salt);
+        jobs[job_count].iterations = prekeys[job_count].iteration_count;
+        jobs[job_count].key = prekeys[job_count].key;
+        jobs[job_count].key_length = sizeof(prekeys[job_count].key);
+
+        known[i - begin] = &prekeys[job_count];
+        job_count++;
+    }
+
+    /* Cells left without prekey derive it on their own */
+    if (job_count != 0 && ecconnect_pbkdf2_sha256_batch(jobs, job_count) != ECCONNECT_SUCCESS) {
+        memset(known, 0, sizeof(known));
+    }
+
+    for (i = begin; i < end; i++) {
+        ecrypt_secure_cell_batch_item_t* item = &batch->items[i];
+        size_t message_length = item->output_length;
+
+        if (item->status != ECRYPT_SUCCESS) {
+            continue;
+        }
+        item->status = ecrypt_auth_sym_decrypt_message_with_known_prekey(batch->passphrase,
+                                                                         batch->passphrase_length,
+                                                                         known[i - begin],
+                                                                         item->user_context,
+                                                                         item->user_context_length,
+                                                                         item->input,
+                                                                         item->input_length
+                                                                             - item->output_length,
+                                                                         item->input + item->input_length
+                                                                             - item->output_length,
+                                                                         item->output_length,
+                                                                         batch->output + item->output_offset,
+                                                                         &message_length);
+        if (item->status != ECRYPT_SUCCESS) {
+            /* Do not leave unauthenticated plaintext around */
+            ecconnect_wipe(batch->output + item->output_offset, item->output_length);
+        }
+    }
+
+    ecconnect_wipe(prekeys, sizeof(prekeys));
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase_batch(const uint8_t* passphrase,
+                                                                      size_t passphrase_length,
+                                                                      ecrypt_secure_cell_batch_item_t* items,
+                                                                      size_t item_count,
+                                                                      uint8_t* output,
+                                                                      size_t* output_length,
+                                                                      size_t thread_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_passphrase_batch batch;
+    uint32_t message_length = 0;
+    size_t offset = 0;
+    size_t i = 0;
+
+    ECRYPT_CHECK_PARAM(passphrase != NULL && passphrase_length != 0);
+    ECRYPT_CHECK_PARAM(items != NULL && item_count != 0);
+    ECRYPT_CHECK_PARAM(output_length != NULL);
+
+    for (i = 0; i < item_count; i++) {
+        ecrypt_secure_cell_batch_item_t* item = &items[i];
+
+        item->output_offset = offset;
+        item->output_length = 0;
+        if (item->input == NULL || item->input_length == 0) {
+            item->status = ECRYPT_INVALID_PARAMETER;
+            continue;
+        }
+        if (item->user_context == NULL && item->user_context_length != 0) {
+            item->status = ECRYPT_INVALID_PARAMETER;
+            continue;
+        }
+        item->status = ecrypt_scell_auth_token_message_size(item->input, item->input_length, &message_length);
+        if (item->status != ECRYPT_SUCCESS) {
+            continue;
+        }
+        if (message_length == 0 || message_length >= item->input_length) {
+            item->status = ECRYPT_FAIL;
+            continue;
+        }
+        if (message_length > SIZE_MAX - offset) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        item->output_length = message_length;
+        offset += message_length;
+    }
+
+    if (!output || *output_length < offset) {
+        *output_length = offset;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    batch.passphrase = passphrase;
+    batch.passphrase_length = passphrase_length;
+    batch.items = items;
+    batch.item_count = item_count;
+    batch.output = output;
+
+    res = ecrypt_scell_batch_run_each((item_count + ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP - 1)
+                                          / ECRYPT_SCELL_PASSPHRASE_BATCH_GROUP,
+                                      thread_count,
+                                      ecrypt_scell_decrypt_passphrase_batch_group,
+                                      &batch);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    *output_length = offset;
+    for (i = 0; i < item_count; i++) {
+        if (items[i].status != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+    }
+    return ECRYPT_SUCCESS;
+}
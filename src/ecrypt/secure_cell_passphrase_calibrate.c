@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_alg.h"
+
+/* Shorter measurements are dominated by timer resolution and noise */
+#define ECRYPT_PBKDF2_CALIBRATION_MIN_NS (20 * UINT64_C(1000000))
+
+#define ECRYPT_PBKDF2_CALIBRATION_START_ITERATIONS 1024
+
+static uint64_t ecrypt_monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * UINT64_C(1000000000) + (uint64_t)now.tv_nsec;
+}
+
+ecrypt_status_t ecrypt_secure_cell_passphrase_calibrate_iterations(uint32_t target_milliseconds,
+                                                                   uint32_t* iteration_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    static const uint8_t passphrase[] = "calibration";
+    uint8_t salt[ECRYPT_AUTH_SYM_PBKDF2_SALT_LENGTH] = {0};
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    uint64_t probe = ECRYPT_PBKDF2_CALIBRATION_START_ITERATIONS;
+    uint64_t elapsed = 0;
+    uint64_t start = 0;
+    double scaled = 0;
+
+    ECRYPT_CHECK_PARAM(target_milliseconds != 0);
+    ECRYPT_CHECK_PARAM(iteration_count != NULL);
+
+    /* Double the probe until it runs long enough to be measured reliably */
+    for (;;) {
+        start = ecrypt_monotonic_ns();
+        res = ecconnect_pbkdf2_sha256(passphrase,
+                                      sizeof(passphrase) - 1,
+                                      salt,
+                                      sizeof(salt),
+                                      (size_t)probe,
+                                      key,
+                                      sizeof(key));
+        elapsed = ecrypt_monotonic_ns() - start;
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        if (elapsed >= ECRYPT_PBKDF2_CALIBRATION_MIN_NS || probe >= UINT32_MAX / 2) {
+            break;
+        }
+        probe *= 2;
+    }
+    ecconnect_wipe(key, sizeof(key));
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    scaled = (double)probe * ((double)target_milliseconds * 1000000.0) / (double)elapsed;
+    if (scaled >= (double)UINT32_MAX) {
+        *iteration_count = UINT32_MAX;
+    } else if (scaled < 1.0) {
+        *iteration_count = 1;
+    } else {
+        *iteration_count = (uint32_t)scaled;
+    }
+
+    return ECRYPT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_seal_passphrase.h"
+
+/*
+ * Passphrase context derives PBKDF2 prekey once and puts its salt into all
+ * cells it produces. The passphrase itself is kept only to decrypt cells
+ * with other salts.
+ */
+struct ecrypt_secure_cell_passphrase_ctx_type {
+    struct ecrypt_scell_pbkdf2_prekey prekey;
+    uint8_t* passphrase;
+    size_t passphrase_length;
+};
+
+ecrypt_secure_cell_passphrase_ctx_t* ecrypt_secure_cell_passphrase_ctx_create(const uint8_t* passphrase,
+                                                                              size_t passphrase_length)
+{
+    ecrypt_secure_cell_passphrase_ctx_t* ctx = NULL;
+
+    ECRYPT_CHECK_PARAM_(passphrase != NULL && passphrase_length != 0);
+
+    ctx = calloc(1, sizeof(*ctx));
+    ECRYPT_CHECK_MALLOC_(ctx);
+
+    ctx->passphrase = malloc(passphrase_length);
+    if (!ctx->passphrase) {
+        free(ctx);
+        return NULL;
+    }
+    memcpy(ctx->passphrase, passphrase, passphrase_length);
+    ctx->passphrase_length = passphrase_length;
+
+    if (ecrypt_scell_pbkdf2_prekey_derive(passphrase,
+                                          passphrase_length,
+                                          ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS,
+                                          &ctx->prekey)
+        != ECRYPT_SUCCESS) {
+        ecrypt_secure_cell_passphrase_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+ecrypt_status_t ecrypt_secure_cell_passphrase_ctx_destroy(ecrypt_secure_cell_passphrase_ctx_t* ctx)
+{
+    if (!ctx) {
+        return ECRYPT_SUCCESS;
+    }
+    if (ctx->passphrase) {
+        ecconnect_wipe(ctx->passphrase, ctx->passphrase_length);
+        free(ctx->passphrase);
+    }
+    ecconnect_wipe(ctx, sizeof(*ctx));
+    free(ctx);
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ecrypt_secure_cell_passphrase_ctx_t* ctx,
+                                                                    const uint8_t* user_context,
+                                                                    size_t user_context_length,
+                                                                    const uint8_t* message,
+                                                                    size_t message_length,
+                                                                    uint8_t* encrypted_message,
+                                                                    size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = ecrypt_scell_auth_token_passphrase_default_size();
+    size_t ciphertext_length = message_length;
+    size_t total_length = 0;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    total_length = auth_token_length + message_length;
+    if (!encrypted_message || *encrypted_message_length < total_length) {
+        *encrypted_message_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_auth_sym_encrypt_message_with_prekey(&ctx->prekey,
+                                                      message,
+                                                      message_length,
+                                                      user_context,
+                                                      user_context_length,
+                                                      encrypted_message,
+                                                      &auth_token_length,
+                                                      encrypted_message + auth_token_length,
+                                                      &ciphertext_length);
+    if (res == ECRYPT_SUCCESS) {
+        *encrypted_message_length = auth_token_length + ciphertext_length;
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_passphrase_ctx(ecrypt_secure_cell_passphrase_ctx_t* ctx,
+                                                                    const uint8_t* user_context,
+                                                                    size_t user_context_length,
+                                                                    const uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    uint8_t* plain_message,
+                                                                    size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = 0;
+    size_t message_length = 0;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    /* See ecrypt_secure_cell_decrypt_seal_with_passphrase() */
+    res = ecrypt_auth_sym_decrypt_message_with_known_prekey(ctx->passphrase,
+                                                           ctx->passphrase_length,
+                                                           &ctx->prekey,
+                                                           user_context,
+                                                           user_context_length,
+                                                           encrypted_message,
+                                                           encrypted_message_length,
+                                                           NULL,
+                                                           0,
+                                                           NULL,
+                                                           &message_length);
+    if (res != ECRYPT_BUFFER_TOO_SMALL) {
+        return res;
+    }
+
+    /* We should not overflow here. If we do then the message is corrupted. */
+    if (encrypted_message_length < message_length) {
+        return ECRYPT_FAIL;
+    }
+    auth_token_length = encrypted_message_length - message_length;
+
+    return ecrypt_auth_sym_decrypt_message_with_known_prekey(ctx->passphrase,
+                                                             ctx->passphrase_length,
+                                                             &ctx->prekey,
+                                                             user_context,
+                                                             user_context_length,
+                                                             encrypted_message,
+                                                             auth_token_length,
+                                                             encrypted_message + auth_token_length,
+                                                             message_length,
+                                                             plain_message,
+                                                             plain_message_length);
+}
@@ -0,0 +1,1181 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell_seal_context.h"
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * Keyed context produces exactly the same Secure Cells as the one-shot API.
+ * The only difference is that master key HMAC pads are computed once and
+ * cipher contexts are recycled instead of being allocated for each call.
+ */
+
+static ecrypt_status_t ecrypt_scell_ctx_key_id(const ecconnect_kdf_ctx_t* kdf, uint32_t* key_id)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t key_id_bytes[sizeof(uint32_t)] = {0};
+
+    res = ecconnect_kdf_ctx_derive(kdf, ECRYPT_SCELL_KEY_ID_LABEL, NULL, 0, key_id_bytes, sizeof(key_id_bytes));
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    stream_read_uint32LE(key_id_bytes, key_id);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_secure_cell_seal_ctx_t* ecrypt_secure_cell_seal_ctx_create(const uint8_t* master_key,
+                                                                  size_t master_key_length)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = NULL;
+
+    ECRYPT_CHECK_PARAM_(master_key != NULL && master_key_length != 0);
+
+    ctx = calloc(1, sizeof(*ctx));
+    ECRYPT_CHECK_MALLOC_(ctx);
+
+    ctx->kdf = ecconnect_kdf_ctx_create(master_key, master_key_length);
+    if (!ctx->kdf) {
+        free(ctx);
+        return NULL;
+    }
+
+    if (ecrypt_scell_ctx_key_id(ctx->kdf, &ctx->key_id) != ECRYPT_SUCCESS) {
+        ecconnect_kdf_ctx_destroy(ctx->kdf);
+        free(ctx);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&ctx->scratch_lock, NULL) != 0) {
+        ecconnect_kdf_ctx_destroy(ctx->kdf);
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void ecrypt_scell_scratch_destroy(struct ecrypt_scell_scratch* scratch)
+{
+    if (scratch->aead_encrypt) {
+        ecconnect_sym_aead_encrypt_destroy(scratch->aead_encrypt);
+    }
+    if (scratch->aead_decrypt) {
+        ecconnect_sym_aead_decrypt_destroy(scratch->aead_decrypt);
+    }
+    ecconnect_kdf_state_destroy(scratch->kdf_state);
+    free(scratch->plaintext);
+    free(scratch->compressed);
+    free(scratch);
+}
+
+/* Grows scratch buffer to hold at least `length` bytes */
+static ecrypt_status_t ecrypt_scell_scratch_reserve(uint8_t** buffer, size_t* capacity, size_t length)
+{
+    if (*capacity >= length) {
+        return ECRYPT_SUCCESS;
+    }
+    /* Buffer is wiped after each use, no need to wipe it here */
+    free(*buffer);
+    *buffer = malloc(length);
+    if (!*buffer) {
+        *capacity = 0;
+        return ECRYPT_NO_MEMORY;
+    }
+    *capacity = length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_destroy(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    struct ecrypt_scell_scratch* scratch = NULL;
+
+    if (!ctx) {
+        return ECRYPT_SUCCESS;
+    }
+
+    while (ctx->scratch) {
+        scratch = ctx->scratch;
+        ctx->scratch = scratch->next;
+        ecrypt_scell_scratch_destroy(scratch);
+    }
+
+    pthread_mutex_destroy(&ctx->scratch_lock);
+    ecrypt_scell_key_cache_destroy(ctx->key_cache);
+    ecconnect_kdf_ctx_destroy(ctx->kdf);
+    free(ctx);
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_set_flags(ecrypt_secure_cell_seal_ctx_t* ctx, uint32_t flags)
+{
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    ECRYPT_CHECK_PARAM(ecrypt_scell_ctx_flags_valid(flags));
+
+    ctx->flags = flags;
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_set_key_cache(ecrypt_secure_cell_seal_ctx_t* ctx, size_t capacity)
+{
+    struct ecrypt_scell_key_cache* key_cache = NULL;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+
+    if (capacity != 0) {
+        key_cache = ecrypt_scell_key_cache_create(capacity);
+        if (!key_cache) {
+            return ECRYPT_NO_MEMORY;
+        }
+    }
+    ecrypt_scell_key_cache_destroy(ctx->key_cache);
+    ctx->key_cache = key_cache;
+
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_ctx_key_cache_stats(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                            uint64_t* hits,
+                                                            uint64_t* misses)
+{
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    ECRYPT_CHECK_PARAM(hits != NULL && misses != NULL);
+
+    if (ctx->key_cache) {
+        ecrypt_scell_key_cache_stats(ctx->key_cache, hits, misses);
+    } else {
+        *hits = 0;
+        *misses = 0;
+    }
+
+    return ECRYPT_SUCCESS;
+}
+
+struct ecrypt_scell_scratch* ecrypt_scell_scratch_acquire(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    struct ecrypt_scell_scratch* scratch = NULL;
+
+    /*
+     * There are at most as many scratch spaces as there are threads using
+     * the context concurrently, so the free list is expected to be short.
+     */
+    pthread_mutex_lock(&ctx->scratch_lock);
+    scratch = ctx->scratch;
+    if (scratch) {
+        ctx->scratch = scratch->next;
+    }
+    pthread_mutex_unlock(&ctx->scratch_lock);
+
+    if (!scratch) {
+        scratch = calloc(1, sizeof(*scratch));
+        if (!scratch) {
+            return NULL;
+        }
+        scratch->kdf_state = ecconnect_kdf_state_create();
+        if (!scratch->kdf_state) {
+            free(scratch);
+            return NULL;
+        }
+    }
+    scratch->next = NULL;
+
+    return scratch;
+}
+
+void ecrypt_scell_scratch_release(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                  struct ecrypt_scell_scratch* scratch)
+{
+    if (!scratch) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->scratch_lock);
+    scratch->next = ctx->scratch;
+    ctx->scratch = scratch;
+    pthread_mutex_unlock(&ctx->scratch_lock);
+}
+
+ecrypt_status_t ecrypt_scell_ctx_derive_encryption_key(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                       struct ecrypt_scell_scratch* scratch,
+                                                       uint32_t ecconnect_alg,
+                                                       const uint8_t* kdf_context,
+                                                       size_t kdf_context_length,
+                                                       const uint8_t* user_context,
+                                                       size_t user_context_length,
+                                                       uint8_t* derived_key,
+                                                       size_t* derived_key_length)
+{
+    ecconnect_kdf_context_buf_t kdf_ctx[2] = {{kdf_context, kdf_context_length},
+                                              {user_context, user_context_length}};
+    struct ecrypt_scell_key_cache_tuple tuple = {ecconnect_alg,
+                                                 kdf_context,
+                                                 kdf_context_length,
+                                                 user_context,
+                                                 user_context_length};
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t required_length = ecconnect_alg_key_length(ecconnect_alg);
+    switch (required_length) {
+    case ECCONNECT_SYM_256_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_192_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_128_KEY_LENGTH / 8:
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    /* Internal buffer must have suitable size */
+    if (*derived_key_length < required_length) {
+        return ECRYPT_FAIL;
+    }
+    *derived_key_length = required_length;
+
+    ECRYPT_CHECK_PARAM(kdf_context != NULL && kdf_context_length != 0);
+
+    /* See ecrypt_auth_sym_derive_encryption_key() */
+    if (ecconnect_alg_kdf(ecconnect_alg) != ECCONNECT_SYM_NOKDF) {
+        return ECRYPT_FAIL;
+    }
+
+    if (ctx->key_cache
+        && ecrypt_scell_key_cache_get(ctx->key_cache, &tuple, derived_key, *derived_key_length)) {
+        return ECRYPT_SUCCESS;
+    }
+    res = ecconnect_kdf_ctx_derive_with_state(ctx->kdf,
+                                              scratch->kdf_state,
+                                              ECRYPT_SYM_KDF_KEY_LABEL,
+                                              kdf_ctx,
+                                              (user_context == NULL || user_context_length == 0) ? 1 : 2,
+                                              derived_key,
+                                              *derived_key_length);
+    if (res == ECRYPT_SUCCESS && ctx->key_cache) {
+        ecrypt_scell_key_cache_put(ctx->key_cache, &tuple, derived_key, *derived_key_length);
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_scell_scratch_plain_encrypt(struct ecrypt_scell_scratch* scratch,
+                                                   uint32_t alg,
+                                                   const uint8_t* key,
+                                                   size_t key_length,
+                                                   const uint8_t* iv,
+                                                   size_t iv_length,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* message,
+                                                   size_t message_length,
+                                                   uint8_t* encrypted_message,
+                                                   size_t* encrypted_message_length,
+                                                   uint8_t* auth_tag,
+                                                   uint32_t* auth_tag_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_tag_length_ = *auth_tag_length;
+
+    if (scratch->aead_encrypt && scratch->aead_encrypt_alg == alg) {
+        res = ecconnect_sym_aead_encrypt_reset(scratch->aead_encrypt, key, key_length, iv, iv_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    } else {
+        if (scratch->aead_encrypt) {
+            ecconnect_sym_aead_encrypt_destroy(scratch->aead_encrypt);
+        }
+        scratch->aead_encrypt = ecconnect_sym_aead_encrypt_create(alg, key, key_length, NULL, 0, iv, iv_length);
+        scratch->aead_encrypt_alg = alg;
+        ECRYPT_CHECK(scratch->aead_encrypt != NULL);
+    }
+
+    if (aad != NULL || aad_length != 0) {
+        res = ecconnect_sym_aead_encrypt_aad(scratch->aead_encrypt, aad, aad_length);
+        if (res != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+    }
+    res = ecconnect_sym_aead_encrypt_update(scratch->aead_encrypt,
+                                            message,
+                                            message_length,
+                                            encrypted_message,
+                                            encrypted_message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return ECRYPT_FAIL;
+    }
+    res = ecconnect_sym_aead_encrypt_final(scratch->aead_encrypt, auth_tag, &auth_tag_length_);
+    if (res != ECRYPT_SUCCESS) {
+        return ECRYPT_FAIL;
+    }
+    if (auth_tag_length_ > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    *auth_tag_length = (uint32_t)auth_tag_length_;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_scell_scratch_plain_decrypt(struct ecrypt_scell_scratch* scratch,
+                                                   uint32_t alg,
+                                                   const uint8_t* key,
+                                                   size_t key_length,
+                                                   const uint8_t* iv,
+                                                   size_t iv_length,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* encrypted_message,
+                                                   size_t encrypted_message_length,
+                                                   uint8_t* message,
+                                                   size_t* message_length,
+                                                   const uint8_t* auth_tag,
+                                                   size_t auth_tag_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+
+    if (scratch->aead_decrypt && scratch->aead_decrypt_alg == alg) {
+        res = ecconnect_sym_aead_decrypt_reset(scratch->aead_decrypt, key, key_length, iv, iv_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+    } else {
+        if (scratch->aead_decrypt) {
+            ecconnect_sym_aead_decrypt_destroy(scratch->aead_decrypt);
+        }
+        scratch->aead_decrypt = ecconnect_sym_aead_decrypt_create(alg, key, key_length, NULL, 0, iv, iv_length);
+        scratch->aead_decrypt_alg = alg;
+        ECRYPT_CHECK(scratch->aead_decrypt != NULL);
+    }
+
+    if (aad != NULL || aad_length != 0) {
+        res = ecconnect_sym_aead_decrypt_aad(scratch->aead_decrypt, aad, aad_length);
+        if (res != ECRYPT_SUCCESS) {
+            return ECRYPT_FAIL;
+        }
+    }
+    res = ecconnect_sym_aead_decrypt_update(scratch->aead_decrypt,
+                                            encrypted_message,
+                                            encrypted_message_length,
+                                            message,
+                                            message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return ECRYPT_FAIL;
+    }
+    res = ecconnect_sym_aead_decrypt_final(scratch->aead_decrypt, auth_tag, auth_tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+/*
+ * Compresses message into `compressed` which must have space for
+ * ecrypt_scell_lz_bound() bytes. See ecrypt_auth_sym_encrypt_message_()
+ * for the rules: messages which do not get shorter are left uncompressed,
+ * `compressed_length` is set to zero then.
+ */
+static ecrypt_status_t ecrypt_scell_ctx_compress(const uint8_t* message,
+                                                 size_t message_length,
+                                                 uint8_t* compressed,
+                                                 size_t* compressed_length)
+{
+    ecrypt_status_t res = ecrypt_scell_lz_compress(message, message_length, compressed, compressed_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (*compressed_length + sizeof(uint32_t) >= message_length) {
+        ecconnect_wipe(compressed, *compressed_length);
+        *compressed_length = 0;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+/*
+ * Message with non-zero `uncompressed_length` is compressed data produced by
+ * ecrypt_scell_ctx_compress() for a message of that length.
+ */
+static ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_ctx_(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                                 struct ecrypt_scell_scratch* scratch,
+                                                                 const uint8_t* message,
+                                                                 size_t message_length,
+                                                                 const uint8_t* user_context,
+                                                                 size_t user_context_length,
+                                                                 uint8_t* auth_token,
+                                                                 size_t* auth_token_length,
+                                                                 uint8_t* encrypted_message,
+                                                                 size_t* encrypted_message_length,
+                                                                 const uint8_t* random_iv,
+                                                                 size_t uncompressed_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t iv[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t auth_tag[ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+    size_t auth_token_real_length = 0;
+    struct ecrypt_scell_auth_token_key hdr;
+
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.alg = ecrypt_auth_sym_encryption_alg(ctx->flags);
+    hdr.iv = iv;
+    hdr.iv_length = sizeof(iv);
+    hdr.auth_tag = auth_tag;
+    hdr.auth_tag_length = sizeof(auth_tag);
+    hdr.compact = (ctx->flags & ECRYPT_SCELL_FLAG_COMPACT) != 0;
+
+    hdr.uncompressed_length = (uint32_t)uncompressed_length;
+    hdr.message_length = (uint32_t)message_length;
+    if (ctx->flags & ECRYPT_SCELL_FLAG_MARK_KDF) {
+        hdr.marks |= ECRYPT_AUTH_SYM_ALG_KDF_CURRENT;
+    }
+    if (ctx->flags & ECRYPT_SCELL_FLAG_KEY_ID) {
+        hdr.marks |= ECRYPT_AUTH_SYM_ALG_KEY_ID;
+        hdr.key_id = ctx->key_id;
+    }
+    if (uncompressed_length != 0) {
+        hdr.marks |= ECRYPT_AUTH_SYM_ALG_COMPRESSED;
+    }
+
+    res = ecrypt_auth_sym_kdf_context_key(&hdr, kdf_context, &kdf_context_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_scell_ctx_derive_encryption_key(ctx,
+                                                 scratch,
+                                                 hdr.alg,
+                                                 kdf_context,
+                                                 kdf_context_length,
+                                                 user_context,
+                                                 user_context_length,
+                                                 derived_key,
+                                                 &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Callers encrypting many messages may pull randomness in bulk */
+    if (random_iv) {
+        memcpy(iv, random_iv, sizeof(iv));
+    } else {
+        res = ecconnect_rand(iv, sizeof(iv));
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+    }
+
+    res = ecrypt_scell_scratch_plain_encrypt(scratch,
+                                             hdr.alg,
+                                             derived_key,
+                                             derived_key_length,
+                                             hdr.iv,
+                                             hdr.iv_length,
+                                             user_context,
+                                             user_context_length,
+                                             message,
+                                             message_length,
+                                             encrypted_message,
+                                             encrypted_message_length,
+                                             &auth_tag[0],
+                                             &hdr.auth_tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    hdr.alg |= hdr.marks;
+
+    /* In valid Secure Cells auth token length always fits into uint32_t. */
+    auth_token_real_length = (uint32_t)ecrypt_scell_auth_token_key_size(&hdr);
+
+    if (*auth_token_length < auth_token_real_length) {
+        *auth_token_length = auth_token_real_length;
+        res = ECRYPT_BUFFER_TOO_SMALL;
+        goto error;
+    }
+    res = ecrypt_write_scell_auth_token_key(&hdr, auth_token, *auth_token_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    *auth_token_length = auth_token_real_length;
+    *encrypted_message_length = message_length;
+
+error:
+    ecconnect_wipe(iv, sizeof(iv));
+    ecconnect_wipe(auth_tag, sizeof(auth_tag));
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_scell_seal_parse(const uint8_t* encrypted_message,
+                                       size_t encrypted_message_length,
+                                       struct ecrypt_scell_auth_token_key* hdr,
+                                       const uint8_t** ciphertext,
+                                       uint32_t* flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t auth_token_length = 0;
+
+    res = ecrypt_scell_seal_auth_token_size(encrypted_message, encrypted_message_length, &auth_token_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ECRYPT_CHECK_PARAM(auth_token_length != encrypted_message_length);
+
+    memset(hdr, 0, sizeof(*hdr));
+    res = ecrypt_read_scell_auth_token_key(encrypted_message, auth_token_length, hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    *flags = ecrypt_scell_auth_token_key_strip_marks(hdr);
+
+    /* Check that message header is consistent with our expectations */
+    if (!ecconnect_alg_reserved_bits_valid(hdr->alg)) {
+        return ECRYPT_FAIL;
+    }
+
+    *ciphertext = encrypted_message + auth_token_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_scell_ctx_decrypt_parsed(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                struct ecrypt_scell_scratch* scratch,
+                                                const struct ecrypt_scell_auth_token_key* hdr,
+                                                bool compat,
+                                                const uint8_t* user_context,
+                                                size_t user_context_length,
+                                                const uint8_t* ciphertext,
+                                                uint8_t* message,
+                                                size_t* message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    /* Use maximum possible length, not the default one */
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+    uint8_t* compressed = NULL;
+    uint8_t* plain = message;
+    size_t plain_length = *message_length;
+
+    /* See ecrypt_auth_sym_decrypt_message_(), temporary buffer is reused here */
+    if (hdr->uncompressed_length != 0) {
+        if (*message_length < hdr->uncompressed_length) {
+            *message_length = hdr->uncompressed_length;
+            return ECRYPT_BUFFER_TOO_SMALL;
+        }
+        res = ecrypt_scell_scratch_reserve(&scratch->compressed, &scratch->compressed_capacity, hdr->message_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        compressed = scratch->compressed;
+        plain = compressed;
+        plain_length = hdr->message_length;
+    }
+
+    if (compat) {
+#ifdef SCELL_COMPAT
+        res = ecrypt_auth_sym_kdf_context_compat(hdr->message_length, kdf_context, &kdf_context_length);
+#else
+        res = ECRYPT_FAIL;
+#endif
+    } else {
+        res = ecrypt_auth_sym_kdf_context_key(hdr, kdf_context, &kdf_context_length);
+    }
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_scell_ctx_derive_encryption_key(ctx,
+                                                 scratch,
+                                                 hdr->alg,
+                                                 kdf_context,
+                                                 kdf_context_length,
+                                                 user_context,
+                                                 user_context_length,
+                                                 derived_key,
+                                                 &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Keep ciphertext intact for other keys if it is decrypted in place */
+    if (message == ciphertext) {
+        res = ecrypt_auth_sym_plain_verify(hdr->alg,
+                                           derived_key,
+                                           derived_key_length,
+                                           hdr->iv,
+                                           hdr->iv_length,
+                                           user_context,
+                                           user_context_length,
+                                           ciphertext,
+                                           hdr->message_length,
+                                           hdr->auth_tag,
+                                           hdr->auth_tag_length);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+    }
+
+    res = ecrypt_scell_scratch_plain_decrypt(scratch,
+                                             hdr->alg,
+                                             derived_key,
+                                             derived_key_length,
+                                             hdr->iv,
+                                             hdr->iv_length,
+                                             user_context,
+                                             user_context_length,
+                                             ciphertext,
+                                             hdr->message_length,
+                                             plain,
+                                             &plain_length,
+                                             hdr->auth_tag,
+                                             hdr->auth_tag_length);
+    if (!compressed) {
+        *message_length = plain_length;
+    }
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Sanity check of resulting message length */
+    if (plain_length != hdr->message_length) {
+        res = ECRYPT_FAIL;
+        goto error;
+    }
+
+    if (compressed) {
+        *message_length = hdr->uncompressed_length;
+        res = ecrypt_scell_lz_decompress(compressed, plain_length, message, message_length);
+        if (res == ECRYPT_SUCCESS && *message_length != hdr->uncompressed_length) {
+            res = ECRYPT_FAIL;
+        }
+    }
+
+error:
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+    if (compressed) {
+        ecconnect_wipe(compressed, hdr->message_length);
+    }
+
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_ctx_decrypt_parsed_any(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                           struct ecrypt_scell_scratch* scratch,
+                                                           const struct ecrypt_scell_auth_token_key* hdr,
+                                                           uint32_t flags,
+                                                           const uint8_t* user_context,
+                                                           size_t user_context_length,
+                                                           const uint8_t* ciphertext,
+                                                           uint8_t* message,
+                                                           size_t* message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+
+    res = ecrypt_scell_ctx_decrypt_parsed(ctx,
+                                          scratch,
+                                          hdr,
+                                          false,
+                                          user_context,
+                                          user_context_length,
+                                          ciphertext,
+                                          message,
+                                          message_length);
+    /* See ecrypt_auth_sym_decrypt_message_() */
+#ifdef SCELL_COMPAT
+    if (res != ECRYPT_SUCCESS && res != ECRYPT_BUFFER_TOO_SMALL && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
+        res = ecrypt_scell_ctx_decrypt_parsed(ctx,
+                                              scratch,
+                                              hdr,
+                                              true,
+                                              user_context,
+                                              user_context_length,
+                                              ciphertext,
+                                              message,
+                                              message_length);
+    }
+#else
+    UNUSED(flags);
+#endif
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_scell_ctx_encrypt_detached(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                 struct ecrypt_scell_scratch* scratch,
+                                                 const uint8_t* user_context,
+                                                 size_t user_context_length,
+                                                 const uint8_t* message,
+                                                 size_t message_length,
+                                                 uint8_t* auth_token,
+                                                 size_t* auth_token_length,
+                                                 uint8_t* encrypted_message,
+                                                 const uint8_t* random_iv)
+{
+    size_t ciphertext_length = message_length;
+
+    return ecrypt_auth_sym_encrypt_message_with_ctx_(ctx,
+                                                     scratch,
+                                                     message,
+                                                     message_length,
+                                                     user_context,
+                                                     user_context_length,
+                                                     auth_token,
+                                                     auth_token_length,
+                                                     encrypted_message,
+                                                     &ciphertext_length,
+                                                     random_iv,
+                                                     0);
+}
+
+ecrypt_status_t ecrypt_scell_ctx_decrypt_detached(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                 struct ecrypt_scell_scratch* scratch,
+                                                 const uint8_t* user_context,
+                                                 size_t user_context_length,
+                                                 const uint8_t* auth_token,
+                                                 size_t auth_token_length,
+                                                 const uint8_t* encrypted_message,
+                                                 size_t encrypted_message_length,
+                                                 uint8_t* message)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_key hdr;
+    size_t message_length = encrypted_message_length;
+    uint32_t flags = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    res = ecrypt_read_scell_auth_token_key(auth_token, auth_token_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    flags = ecrypt_scell_auth_token_key_strip_marks(&hdr) | ctx->flags;
+
+    /* Check that message header is consistent with our expectations */
+    if (hdr.message_length != encrypted_message_length || hdr.uncompressed_length != 0) {
+        return ECRYPT_FAIL;
+    }
+    if (!ecconnect_alg_reserved_bits_valid(hdr.alg)) {
+        return ECRYPT_FAIL;
+    }
+
+    return ecrypt_scell_ctx_decrypt_parsed_any(ctx,
+                                               scratch,
+                                               &hdr,
+                                               flags,
+                                               user_context,
+                                               user_context_length,
+                                               encrypted_message,
+                                               message,
+                                               &message_length);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* message,
+                                                         size_t message_length,
+                                                         uint8_t* encrypted_message,
+                                                         size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    size_t auth_token_length = 0;
+    size_t reserved_auth_token_length = 0;
+    size_t ciphertext_length = 0;
+    size_t total_length = 0;
+    size_t uncompressed_length = 0;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    auth_token_length = ecrypt_scell_ctx_auth_token_size(ctx->flags, message_length);
+    ciphertext_length = (size_t)ecrypt_scell_ciphertext_max_size(ctx->flags, message_length);
+    total_length = auth_token_length + ciphertext_length;
+    if (!encrypted_message || *encrypted_message_length < total_length) {
+        *encrypted_message_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    /* Compressed message takes place of the plaintext and is encrypted in place */
+    if (ctx->flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        res = ecrypt_scell_ctx_compress(message,
+                                        message_length,
+                                        encrypted_message + auth_token_length,
+                                        &ciphertext_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        if (ciphertext_length != 0) {
+            uncompressed_length = message_length;
+            message = encrypted_message + auth_token_length;
+            message_length = ciphertext_length;
+        }
+        ciphertext_length = message_length;
+    }
+
+    scratch = ecrypt_scell_scratch_acquire(ctx);
+    if (!scratch) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    reserved_auth_token_length = auth_token_length;
+    res = ecrypt_auth_sym_encrypt_message_with_ctx_(ctx,
+                                                    scratch,
+                                                    message,
+                                                    message_length,
+                                                    user_context,
+                                                    user_context_length,
+                                                    encrypted_message,
+                                                    &auth_token_length,
+                                                    encrypted_message + auth_token_length,
+                                                    &ciphertext_length,
+                                                    NULL,
+                                                    uncompressed_length);
+    if (res == ECRYPT_SUCCESS) {
+        ecrypt_scell_seal_pack(encrypted_message, reserved_auth_token_length, auth_token_length, ciphertext_length);
+        *encrypted_message_length = auth_token_length + ciphertext_length;
+    }
+
+    ecrypt_scell_scratch_release(ctx, scratch);
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                         const uint8_t* user_context,
+                                                         size_t user_context_length,
+                                                         const uint8_t* encrypted_message,
+                                                         size_t encrypted_message_length,
+                                                         uint8_t* plain_message,
+                                                         size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    struct ecrypt_scell_auth_token_key hdr;
+    const uint8_t* ciphertext = NULL;
+    uint32_t message_length = 0;
+    uint32_t flags = 0;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    /* Do a quick guess without parsing the message too deeply here */
+    res = ecrypt_scell_auth_token_key_message_size(encrypted_message,
+                                                   encrypted_message_length,
+                                                   &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (!plain_message || *plain_message_length < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_scell_seal_parse(encrypted_message, encrypted_message_length, &hdr, &ciphertext, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    flags |= ctx->flags;
+
+    scratch = ecrypt_scell_scratch_acquire(ctx);
+    if (!scratch) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    res = ecrypt_scell_ctx_decrypt_parsed_any(ctx,
+                                              scratch,
+                                              &hdr,
+                                              flags,
+                                              user_context,
+                                              user_context_length,
+                                              ciphertext,
+                                              plain_message,
+                                              plain_message_length);
+
+    ecrypt_scell_scratch_release(ctx, scratch);
+
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_ctx_verify_parsed(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                      struct ecrypt_scell_scratch* scratch,
+                                                      const struct ecrypt_scell_auth_token_key* hdr,
+                                                      bool compat,
+                                                      const uint8_t* user_context,
+                                                      size_t user_context_length,
+                                                      const uint8_t* ciphertext)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    /* Use maximum possible length, not the default one */
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+
+    if (compat) {
+#ifdef SCELL_COMPAT
+        res = ecrypt_auth_sym_kdf_context_compat(hdr->message_length, kdf_context, &kdf_context_length);
+#else
+        res = ECRYPT_FAIL;
+#endif
+    } else {
+        res = ecrypt_auth_sym_kdf_context_key(hdr, kdf_context, &kdf_context_length);
+    }
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_scell_ctx_derive_encryption_key(ctx,
+                                                 scratch,
+                                                 hdr->alg,
+                                                 kdf_context,
+                                                 kdf_context_length,
+                                                 user_context,
+                                                 user_context_length,
+                                                 derived_key,
+                                                 &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_auth_sym_plain_verify(hdr->alg,
+                                       derived_key,
+                                       derived_key_length,
+                                       hdr->iv,
+                                       hdr->iv_length,
+                                       user_context,
+                                       user_context_length,
+                                       ciphertext,
+                                       hdr->message_length,
+                                       hdr->auth_tag,
+                                       hdr->auth_tag_length);
+
+error:
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_verify_seal_with_ctx(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* encrypted_message,
+                                                        size_t encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    struct ecrypt_scell_auth_token_key hdr;
+    const uint8_t* ciphertext = NULL;
+    uint32_t flags = 0;
+
+    ECRYPT_CHECK_PARAM(ctx != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+
+    res = ecrypt_scell_seal_parse(encrypted_message, encrypted_message_length, &hdr, &ciphertext, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    flags |= ctx->flags;
+
+    scratch = ecrypt_scell_scratch_acquire(ctx);
+    if (!scratch) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    res = ecrypt_scell_ctx_verify_parsed(ctx, scratch, &hdr, false, user_context, user_context_length, ciphertext);
+    /* See ecrypt_auth_sym_decrypt_message_() */
+#ifdef SCELL_COMPAT
+    if (res != ECRYPT_SUCCESS && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
+        res = ecrypt_scell_ctx_verify_parsed(ctx, scratch, &hdr, true, user_context, user_context_length, ciphertext);
+    }
+#endif
+
+    ecrypt_scell_scratch_release(ctx, scratch);
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_reseal_with_ctx(ecrypt_secure_cell_seal_ctx_t* old_ctx,
+                                                   ecrypt_secure_cell_seal_ctx_t* new_ctx,
+                                                   const uint8_t* user_context,
+                                                   size_t user_context_length,
+                                                   const uint8_t* encrypted_message,
+                                                   size_t encrypted_message_length,
+                                                   uint8_t* resealed_message,
+                                                   size_t* resealed_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_scratch* scratch = NULL;
+    struct ecrypt_scell_auth_token_key hdr;
+    const uint8_t* ciphertext = NULL;
+    uint32_t flags = 0;
+    uint32_t new_flags = 0;
+    size_t plain_length = 0;
+    size_t message_length = 0;
+    size_t auth_token_length = 0;
+    size_t reserved_auth_token_length = 0;
+    size_t ciphertext_length = 0;
+    size_t total_length = 0;
+    size_t uncompressed_length = 0;
+    const uint8_t* plaintext = NULL;
+    bool exact_length = true;
+
+    ECRYPT_CHECK_PARAM(old_ctx != NULL && new_ctx != NULL);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(resealed_message_length != NULL);
+
+    res = ecrypt_scell_seal_parse(encrypted_message, encrypted_message_length, &hdr, &ciphertext, &flags);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    flags |= old_ctx->flags;
+
+    /* Compressed cells stay compressed, unless new context uses compact tokens */
+    new_flags = new_ctx->flags;
+    if (hdr.uncompressed_length != 0 && !(new_flags & ECRYPT_SCELL_FLAG_COMPACT)) {
+        new_flags |= ECRYPT_SCELL_FLAG_COMPRESS;
+    }
+
+    plain_length = (hdr.uncompressed_length != 0) ? hdr.uncompressed_length : hdr.message_length;
+    auth_token_length = ecrypt_scell_ctx_auth_token_size(new_flags, plain_length);
+    ciphertext_length = (size_t)ecrypt_scell_ciphertext_max_size(new_flags, plain_length);
+    total_length = auth_token_length + ciphertext_length;
+    /*
+     * Compressed cells compress the same way again, so the cell keeps its
+     * length if the token layout stays the same. Otherwise the length is
+     * known only after compression, query reports the upper bound.
+     */
+    if (new_flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        if (hdr.uncompressed_length != 0 && encrypted_message_length - hdr.message_length == auth_token_length) {
+            total_length = encrypted_message_length;
+        } else {
+            exact_length = false;
+        }
+    }
+    if (!resealed_message || (exact_length && *resealed_message_length < total_length)) {
+        *resealed_message_length = total_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    /*
+     * The same scratch space serves both contexts: cipher contexts are
+     * rekeyed on each use anyway. Plaintext never leaves the scratch.
+     */
+    scratch = ecrypt_scell_scratch_acquire(old_ctx);
+    if (!scratch) {
+        return ECRYPT_NO_MEMORY;
+    }
+    res = ecrypt_scell_scratch_reserve(&scratch->plaintext, &scratch->plaintext_capacity, plain_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    message_length = plain_length;
+    res = ecrypt_scell_ctx_decrypt_parsed_any(old_ctx,
+                                              scratch,
+                                              &hdr,
+                                              flags,
+                                              user_context,
+                                              user_context_length,
+                                              ciphertext,
+                                              scratch->plaintext,
+                                              &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    plaintext = scratch->plaintext;
+    ciphertext_length = message_length;
+    if (new_flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        ciphertext_length = (size_t)ecrypt_scell_lz_bound(message_length);
+        res = ecrypt_scell_scratch_reserve(&scratch->compressed, &scratch->compressed_capacity, ciphertext_length);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        res = ecrypt_scell_ctx_compress(plaintext, message_length, scratch->compressed, &ciphertext_length);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        if (ciphertext_length != 0) {
+            uncompressed_length = message_length;
+            plaintext = scratch->compressed;
+            message_length = ciphertext_length;
+        } else {
+            auth_token_length = ecrypt_scell_ctx_auth_token_size(new_flags & ~ECRYPT_SCELL_FLAG_COMPRESS,
+                                                                 message_length);
+        }
+        ciphertext_length = message_length;
+    }
+    if (*resealed_message_length < auth_token_length + ciphertext_length) {
+        *resealed_message_length = auth_token_length + ciphertext_length;
+        res = ECRYPT_BUFFER_TOO_SMALL;
+        goto error;
+    }
+
+    /* Input has been consumed completely, output may overwrite it now */
+    reserved_auth_token_length = auth_token_length;
+    res = ecrypt_auth_sym_encrypt_message_with_ctx_(new_ctx,
+                                                    scratch,
+                                                    plaintext,
+                                                    message_length,
+                                                    user_context,
+                                                    user_context_length,
+                                                    resealed_message,
+                                                    &auth_token_length,
+                                                    resealed_message + auth_token_length,
+                                                    &ciphertext_length,
+                                                    NULL,
+                                                    uncompressed_length);
+    if (res == ECRYPT_SUCCESS) {
+        ecrypt_scell_seal_pack(resealed_message, reserved_auth_token_length, auth_token_length, ciphertext_length);
+        *resealed_message_length = auth_token_length + ciphertext_length;
+    }
+
+error:
+    ecconnect_wipe(scratch->plaintext, plain_length);
+    if (uncompressed_length != 0) {
+        ecconnect_wipe(scratch->compressed, message_length);
+    }
+    ecrypt_scell_scratch_release(old_ctx, scratch);
+
+    return res;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @internal
+ * @file secure_cell_seal_context.h
+ * @brief Keyed Secure Cell context internals
+ *
+ * @warning Structures and functions declared in this file are considered
+ * implementation details and may change without notice.
+ */
+
+#ifndef ECRYPT_SECURE_CELL_SEAL_CONTEXT_H
+#define ECRYPT_SECURE_CELL_SEAL_CONTEXT_H
+
+#include <pthread.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_sym.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_key_cache.h"
+#include "ecrypt/sym_enc_message.h"
+
+#define ECRYPT_SCELL_KEY_ID_LABEL "Ecrypt secure cell key ID"
+
+/*
+ * Cipher contexts reused between calls. Each one is owned by a single thread
+ * while it is acquired, so the keyed context can be shared between threads.
+ * Contexts are created lazily on first use (they need a key for that).
+ */
+struct ecrypt_scell_scratch {
+    ecconnect_sym_ctx_t* aead_encrypt;
+    uint32_t aead_encrypt_alg;
+    ecconnect_sym_ctx_t* aead_decrypt;
+    uint32_t aead_decrypt_alg;
+    /* Digest state for key derivation, allocated with the scratch space */
+    ecconnect_kdf_state_t* kdf_state;
+    /* Intermediate plaintext of reseal, wiped after each use */
+    uint8_t* plaintext;
+    size_t plaintext_capacity;
+    /* Decrypted data of compressed cells, wiped after each use */
+    uint8_t* compressed;
+    size_t compressed_capacity;
+    struct ecrypt_scell_scratch* next;
+};
+
+struct ecrypt_secure_cell_seal_ctx_type {
+    /* Precomputed HMAC pads of the master key, never modified */
+    ecconnect_kdf_ctx_t* kdf;
+
+    /* Public identifier of the master key, see ECRYPT_SCELL_FLAG_KEY_ID */
+    uint32_t key_id;
+
+    /* ECRYPT_SCELL_FLAG_* applied to all operations */
+    uint32_t flags;
+
+    pthread_mutex_t scratch_lock;
+    struct ecrypt_scell_scratch* scratch;
+
+    /* Recently derived keys, NULL unless enabled */
+    struct ecrypt_scell_key_cache* key_cache;
+};
+
+/* Checks that ECRYPT_SCELL_FLAG_* are known to keyed context and compatible */
+static inline bool ecrypt_scell_ctx_flags_valid(uint32_t flags)
+{
+    static const uint32_t known_flags = ECRYPT_SCELL_FLAG_STRICT | ECRYPT_SCELL_FLAG_MARK_KDF
+                                        | ECRYPT_SCELL_FLAG_KEY_ID | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305
+                                        | ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_COMPRESS;
+    if ((flags & ~known_flags) != 0) {
+        return false;
+    }
+    /* Compact tokens have no room for uncompressed length */
+    if ((flags & ECRYPT_SCELL_FLAG_COMPACT) && (flags & ECRYPT_SCELL_FLAG_COMPRESS)) {
+        return false;
+    }
+    return true;
+}
+
+/* Size of the auth token produced by keyed context with given flags */
+static inline size_t ecrypt_scell_ctx_auth_token_size(uint32_t flags, size_t message_length)
+{
+    size_t size = ecrypt_scell_auth_token_key_flags_size(flags, message_length);
+    if (flags & ECRYPT_SCELL_FLAG_KEY_ID) {
+        size += sizeof(uint32_t);
+    }
+    return size;
+}
+
+struct ecrypt_scell_scratch* ecrypt_scell_scratch_acquire(ecrypt_secure_cell_seal_ctx_t* ctx);
+
+void ecrypt_scell_scratch_release(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                  struct ecrypt_scell_scratch* scratch);
+
+/*
+ * Same as ecrypt_auth_sym_derive_encryption_key(),
+ * but uses precomputed master key state, digest state from the scratch,
+ * and key cache.
+ */
+ecrypt_status_t ecrypt_scell_ctx_derive_encryption_key(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                       struct ecrypt_scell_scratch* scratch,
+                                                       uint32_t ecconnect_alg,
+                                                       const uint8_t* kdf_context,
+                                                       size_t kdf_context_length,
+                                                       const uint8_t* user_context,
+                                                       size_t user_context_length,
+                                                       uint8_t* derived_key,
+                                                       size_t* derived_key_length);
+
+/*
+ * Same as ecrypt_auth_sym_plain_encrypt() and ecrypt_auth_sym_plain_decrypt(),
+ * but reuse cipher context from the scratch space.
+ */
+ecrypt_status_t ecrypt_scell_scratch_plain_encrypt(struct ecrypt_scell_scratch* scratch,
+                                                   uint32_t alg,
+                                                   const uint8_t* key,
+                                                   size_t key_length,
+                                                   const uint8_t* iv,
+                                                   size_t iv_length,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* message,
+                                                   size_t message_length,
+                                                   uint8_t* encrypted_message,
+                                                   size_t* encrypted_message_length,
+                                                   uint8_t* auth_tag,
+                                                   uint32_t* auth_tag_length);
+
+ecrypt_status_t ecrypt_scell_scratch_plain_decrypt(struct ecrypt_scell_scratch* scratch,
+                                                   uint32_t alg,
+                                                   const uint8_t* key,
+                                                   size_t key_length,
+                                                   const uint8_t* iv,
+                                                   size_t iv_length,
+                                                   const uint8_t* aad,
+                                                   size_t aad_length,
+                                                   const uint8_t* encrypted_message,
+                                                   size_t encrypted_message_length,
+                                                   uint8_t* message,
+                                                   size_t* message_length,
+                                                   const uint8_t* auth_tag,
+                                                   size_t auth_tag_length);
+
+/*
+ * Splits master key cell into auth token and ciphertext, and parses the token.
+ * Marks are stripped from the algorithm ID, `flags` receives ECRYPT_SCELL_FLAG_*
+ * values implied by them. Ciphertext length is `hdr->message_length`,
+ * plaintext may be longer if the cell is compressed.
+ */
+ecrypt_status_t ecrypt_scell_seal_parse(const uint8_t* encrypted_message,
+                                       size_t encrypted_message_length,
+                                       struct ecrypt_scell_auth_token_key* hdr,
+                                       const uint8_t** ciphertext,
+                                       uint32_t* flags);
+
+/*
+ * Decrypts parsed master key cell with the key of the context. Set `compat`
+ * to use Ecrypt 0.9.6 KDF context instead of the current one.
+ */
+ecrypt_status_t ecrypt_scell_ctx_decrypt_parsed(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                struct ecrypt_scell_scratch* scratch,
+                                                const struct ecrypt_scell_auth_token_key* hdr,
+                                                bool compat,
+                                                const uint8_t* user_context,
+                                                size_t user_context_length,
+                                                const uint8_t* ciphertext,
+                                                uint8_t* message,
+                                                size_t* message_length);
+
+/*
+ * Token Protect with the key of the context, for callers which hold scratch
+ * space across many records. Ciphertext has the same length as the message.
+ * Auth token may be followed by padding, it is ignored. If `random_iv` is not
+ * NULL it provides ECRYPT_AUTH_SYM_IV_LENGTH fresh random bytes for the IV.
+ */
+ecrypt_status_t ecrypt_scell_ctx_encrypt_detached(ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                 struct ecrypt_scell_scratch* scratch,
+                                                 const uint8_t* user_context,
+                                                 size_t user_context_length,
+                                                 const uint8_t* message,
+                                                 size_t message_length,
+                                                 uint8_t* auth_token,
+                                                 size_t* auth_token_length,
+                                                 uint8_t* encrypted_message,
+                                                 const uint8_t* random_iv);
+
+ecrypt_status_t ecrypt_scell_ctx_decrypt_detached(const ecrypt_secure_cell_seal_ctx_t* ctx,
+                                                 struct ecrypt_scell_scratch* scratch,
+                                                 const uint8_t* user_context,
+                                                 size_t user_context_length,
+                                                 const uint8_t* auth_token,
+                                                 size_t auth_token_length,
+                                                 const uint8_t* encrypted_message,
+                                                 size_t encrypted_message_length,
+                                                 uint8_t* message);
+
+#endif /* ECRYPT_SECURE_CELL_SEAL_CONTEXT_H */
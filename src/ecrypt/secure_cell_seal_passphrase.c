@@ -47,103 +47,127 @@ static inline size_t ecconnect_alg_kdf_context_length(uint32_t alg)
     }
 }
 
-static inline size_t default_auth_token_size(void)
+size_t ecrypt_scell_auth_token_passphrase_default_size(void)
 {
     return ecrypt_scell_auth_token_passphrase_min_size + ECRYPT_AUTH_SYM_IV_LENGTH
            + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
            + ecconnect_alg_kdf_context_length(ECRYPT_AUTH_SYM_PASSPHRASE_ALG);
 }
 
-static ecrypt_status_t ecrypt_auth_sym_derive_encryption_key_pbkdf2(
-    struct ecrypt_scell_auth_token_passphrase* hdr,
-    const uint8_t* passphrase,
-    size_t passphrase_length,
-    const uint8_t* user_context,
-    size_t user_context_length,
-    size_t message_length,
-    uint8_t* derived_key,
-    size_t* derived_key_length,
-    uint8_t* auth_token,
-    size_t* auth_token_length)
+ecrypt_status_t ecrypt_scell_pbkdf2_prekey_derive(const uint8_t* passphrase,
+                                                 size_t passphrase_length,
+                                                 uint32_t iteration_count,
+                                                 struct ecrypt_scell_pbkdf2_prekey* prekey)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
-    uint8_t salt[ECRYPT_AUTH_SYM_PBKDF2_SALT_LENGTH] = {0};
-    uint8_t prekey[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
-    uint8_t ecconnect_kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
-    size_t ecconnect_kdf_context_length = sizeof(ecconnect_kdf_context);
-    struct ecrypt_scell_pbkdf2_context kdf;
 
-    memset(&kdf, 0, sizeof(kdf));
-    kdf.iteration_count = ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS;
-    kdf.salt = salt;
-    kdf.salt_length = sizeof(salt);
+    prekey->iteration_count = iteration_count;
 
-    if (*auth_token_length < ecrypt_scell_pbkdf2_context_size(&kdf)) {
-        *auth_token_length = ecrypt_scell_pbkdf2_context_size(&kdf);
-        return ECRYPT_BUFFER_TOO_SMALL;
-    }
-
-    res = ecconnect_rand(salt, sizeof(salt));
+    res = ecconnect_rand(prekey->salt, sizeof(prekey->salt));
     if (res != ECRYPT_SUCCESS) {
         goto error;
     }
 
     res = ecconnect_pbkdf2_sha256(passphrase,
                               passphrase_length,
-                              kdf.salt,
-                              kdf.salt_length,
-                              kdf.iteration_count,
-                              prekey,
-                              sizeof(prekey));
+                              prekey->salt,
+                              sizeof(prekey->salt),
+                              prekey->iteration_count,
+                              prekey->key,
+                              sizeof(prekey->key));
     if (res != ECRYPT_SUCCESS) {
         goto error;
     }
 
+    return ECRYPT_SUCCESS;
+
+error:
+    ecconnect_wipe(prekey, sizeof(*prekey));
+
+    return res;
+}
+
+static ecrypt_status_t ecrypt_auth_sym_derive_prekey_subkey(uint32_t alg,
+                                                            const uint8_t* prekey,
+                                                            size_t prekey_length,
+                                                            const uint8_t* user_context,
+                                                            size_t user_context_length,
+                                                            size_t message_length,
+                                                            uint8_t* derived_key,
+                                                            size_t* derived_key_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t ecconnect_kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    size_t ecconnect_kdf_context_length = sizeof(ecconnect_kdf_context);
+
     /*
-     * ecrypt_auth_sym_encrypt_message_with_passphrase_() makes sure that
-     * message_length fits into uint32_t.
+     * Callers make sure that message_length fits into uint32_t.
      */
     res = ecrypt_auth_sym_kdf_context((uint32_t)message_length,
                                       ecconnect_kdf_context,
                                       &ecconnect_kdf_context_length);
     if (res != ECRYPT_SUCCESS) {
-        goto error;
+        return res;
     }
 
     /* Use ecconnect KDF to derive key from prekey */
-    res = ecrypt_auth_sym_derive_encryption_key(ecconnect_alg_without_kdf(hdr->alg),
-                                                prekey,
-                                                sizeof(prekey),
-                                                ecconnect_kdf_context,
-                                                ecconnect_kdf_context_length,
-                                                user_context,
-                                                user_context_length,
-                                                derived_key,
-                                                derived_key_length);
+    return ecrypt_auth_sym_derive_encryption_key(ecconnect_alg_without_kdf(alg),
+                                                 prekey,
+                                                 prekey_length,
+                                                 ecconnect_kdf_context,
+                                                 ecconnect_kdf_context_length,
+                                                 user_context,
+                                                 user_context_length,
+                                                 derived_key,
+                                                 derived_key_length);
+}
+
+static ecrypt_status_t ecrypt_auth_sym_derive_encryption_key_pbkdf2(
+    struct ecrypt_scell_auth_token_passphrase* hdr,
+    const struct ecrypt_scell_pbkdf2_prekey* prekey,
+    const uint8_t* user_context,
+    size_t user_context_length,
+    size_t message_length,
+    uint8_t* derived_key,
+    size_t* derived_key_length,
+    uint8_t* auth_token,
+    size_t* auth_token_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_pbkdf2_context kdf;
+
+    memset(&kdf, 0, sizeof(kdf));
+    kdf.iteration_count = prekey->iteration_count;
+    kdf.salt = prekey->salt;
+    kdf.salt_length = sizeof(prekey->salt);
+
+    if (*auth_token_length < ecrypt_scell_pbkdf2_context_size(&kdf)) {
+        *auth_token_length = ecrypt_scell_pbkdf2_context_size(&kdf);
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_auth_sym_derive_prekey_subkey(hdr->alg,
+                                               prekey->key,
+                                               sizeof(prekey->key),
+                                               user_context,
+                                               user_context_length,
+                                               message_length,
+                                               derived_key,
+                                               derived_key_length);
     if (res != ECRYPT_SUCCESS) {
-        goto error;
+        return res;
     }
 
     /* KDF pointer is ignored but size is important */
     hdr->kdf_context = NULL;
     hdr->kdf_context_length = ecrypt_scell_pbkdf2_context_size(&kdf);
 
-    res = ecrypt_write_scell_pbkdf2_context(hdr, &kdf, auth_token, *auth_token_length);
-    if (res != ECRYPT_SUCCESS) {
-        goto error;
-    }
-
-error:
-    ecconnect_wipe(salt, sizeof(salt));
-    ecconnect_wipe(prekey, sizeof(prekey));
-
-    return res;
+    return ecrypt_write_scell_pbkdf2_context(hdr, &kdf, auth_token, *auth_token_length);
 }
 
 static ecrypt_status_t ecrypt_auth_sym_derive_encryption_key_passphrase(
     struct ecrypt_scell_auth_token_passphrase* hdr,
-    const uint8_t* passphrase,
-    size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* prekey,
     const uint8_t* user_context,
     size_t user_context_length,
     size_t message_length,
@@ -155,8 +179,7 @@ static ecrypt_status_t ecrypt_auth_sym_derive_encryption_key_passphrase(
     switch (ecconnect_alg_kdf(hdr->alg)) {
     case ECCONNECT_SYM_PBKDF2:
         return ecrypt_auth_sym_derive_encryption_key_pbkdf2(hdr,
-                                                            passphrase,
-                                                            passphrase_length,
+                                                            prekey,
                                                             user_context,
                                                             user_context_length,
                                                             message_length,
@@ -171,16 +194,15 @@ static ecrypt_status_t ecrypt_auth_sym_derive_encryption_key_passphrase(
     }
 }
 
-ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase_(const uint8_t* passphrase,
-                                                                 size_t passphrase_length,
-                                                                 const uint8_t* message,
-                                                                 size_t message_length,
-                                                                 const uint8_t* user_context,
-                                                                 size_t user_context_length,
-                                                                 uint8_t* auth_token,
-                                                                 size_t* auth_token_length,
-                                                                 uint8_t* encrypted_message,
-                                                                 size_t* encrypted_message_length)
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_prekey(const struct ecrypt_scell_pbkdf2_prekey* prekey,
+                                                            const uint8_t* message,
+                                                            size_t message_length,
+                                                            const uint8_t* user_context,
+                                                            size_t user_context_length,
+                                                            uint8_t* auth_token,
+                                                            size_t* auth_token_length,
+                                                            uint8_t* encrypted_message,
+                                                            size_t* encrypted_message_length)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint8_t iv[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
@@ -204,8 +226,7 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase_(const uint8_t*
     hdr.message_length = (uint32_t)message_length;
 
     res = ecrypt_auth_sym_derive_encryption_key_passphrase(&hdr,
-                                                           passphrase,
-                                                           passphrase_length,
+                                                           prekey,
                                                            user_context,
                                                            user_context_length,
                                                            message_length,
@@ -263,18 +284,23 @@ error:
     return res;
 }
 
-ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase(const uint8_t* passphrase,
-                                                                size_t passphrase_length,
-                                                                const uint8_t* message,
-                                                                size_t message_length,
-                                                                const uint8_t* user_context,
-                                                                size_t user_context_length,
-                                                                uint8_t* auth_token,
-                                                                size_t* auth_token_length,
-                                                                uint8_t* encrypted_message,
-                                                                size_t* encrypted_message_length)
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase_ex(const uint8_t* passphrase,
+                                                                   size_t passphrase_length,
+                                                                   const uint8_t* message,
+                                                                   size_t message_length,
+                                                                   const uint8_t* user_context,
+                                                                   size_t user_context_length,
+                                                                   uint8_t* auth_token,
+                                                                   size_t* auth_token_length,
+                                                                   uint8_t* encrypted_message,
+                                                                   size_t* encrypted_message_length,
+                                                                   uint32_t iteration_count)
 {
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_pbkdf2_prekey prekey;
+
     ECRYPT_CHECK_PARAM(passphrase != NULL && passphrase_length != 0);
+    ECRYPT_CHECK_PARAM(iteration_count != 0);
     ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
     if (user_context_length != 0) {
         ECRYPT_CHECK_PARAM(user_context != NULL);
@@ -282,29 +308,76 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase(const uint8_t* p
     ECRYPT_CHECK_PARAM(auth_token_length != NULL);
     ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
 
-    if (!auth_token_length || !encrypted_message || *auth_token_length < default_auth_token_size()
+    if (!auth_token_length || !encrypted_message
+        || *auth_token_length < ecrypt_scell_auth_token_passphrase_default_size()
         || *encrypted_message_length < message_length) {
-        *auth_token_length = default_auth_token_size();
+        *auth_token_length = ecrypt_scell_auth_token_passphrase_default_size();
         *encrypted_message_length = message_length;
         return ECRYPT_BUFFER_TOO_SMALL;
     }
 
-    return ecrypt_auth_sym_encrypt_message_with_passphrase_(passphrase,
-                                                            passphrase_length,
-                                                            message,
-                                                            message_length,
-                                                            user_context,
-                                                            user_context_length,
-                                                            auth_token,
-                                                            auth_token_length,
-                                                            encrypted_message,
-                                                            encrypted_message_length);
+    /* Message length is currently stored as 32-bit integer, sorry */
+    if (message_length > UINT32_MAX) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    res = ecrypt_scell_pbkdf2_prekey_derive(passphrase, passphrase_length, iteration_count, &prekey);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    res = ecrypt_auth_sym_encrypt_message_with_prekey(&prekey,
+                                                      message,
+                                                      message_length,
+                                                      user_context,
+                                                      user_context_length,
+                                                      auth_token,
+                                                      auth_token_length,
+                                                      encrypted_message,
+                                                      encrypted_message_length);
+
+    ecconnect_wipe(&prekey, sizeof(prekey));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase(const uint8_t* passphrase,
+                                                                size_t passphrase_length,
+                                                                const uint8_t* message,
+                                                                size_t message_length,
+                                                                const uint8_t* user_context,
+                                                                size_t user_context_length,
+                                                                uint8_t* auth_token,
+                                                                size_t* auth_token_length,
+                                                                uint8_t* encrypted_message,
+                                                                size_t* encrypted_message_length)
+{
+    return ecrypt_auth_sym_encrypt_message_with_passphrase_ex(passphrase,
+                                                              passphrase_length,
+                                                              message,
+                                                              message_length,
+                                                              user_context,
+                                                              user_context_length,
+                                                              auth_token,
+                                                              auth_token_length,
+                                                              encrypted_message,
+                                                              encrypted_message_length,
+                                                              ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS);
+}
+
+static bool ecrypt_scell_pbkdf2_prekey_matches(const struct ecrypt_scell_pbkdf2_prekey* prekey,
+                                               const struct ecrypt_scell_pbkdf2_context* kdf)
+{
+    return prekey && prekey->iteration_count == kdf->iteration_count
+           && kdf->salt_length == sizeof(prekey->salt)
+           && memcmp(prekey->salt, kdf->salt, sizeof(prekey->salt)) == 0;
 }
 
 static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_pbkdf2(
     const struct ecrypt_scell_auth_token_passphrase* hdr,
     const uint8_t* passphrase,
     size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* known_prekey,
     const uint8_t* user_context,
     size_t user_context_length,
     size_t message_length,
@@ -313,8 +386,6 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_pbkdf2(
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint8_t prekey[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
-    uint8_t ecconnect_kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
-    size_t ecconnect_kdf_context_length = sizeof(ecconnect_kdf_context);
     struct ecrypt_scell_pbkdf2_context kdf;
 
     memset(&kdf, 0, sizeof(kdf));
@@ -323,6 +394,18 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_pbkdf2(
         return res;
     }
 
+    /* Cells sharing salt and iteration count share the prekey as well */
+    if (ecrypt_scell_pbkdf2_prekey_matches(known_prekey, &kdf)) {
+        return ecrypt_auth_sym_derive_prekey_subkey(hdr->alg,
+                                                    known_prekey->key,
+                                                    sizeof(known_prekey->key),
+                                                    user_context,
+                                                    user_context_length,
+                                                    message_length,
+                                                    derived_key,
+                                                    derived_key_length);
+    }
+
     res = ecconnect_pbkdf2_sha256(passphrase,
                               passphrase_length,
                               kdf.salt,
@@ -334,30 +417,14 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_pbkdf2(
         goto error;
     }
 
-    /*
-     * ecrypt_auth_sym_decrypt_message_with_passphrase_() makes sure that
-     * message_length fits into uint32_t.
-     */
-    res = ecrypt_auth_sym_kdf_context((uint32_t)message_length,
-                                      ecconnect_kdf_context,
-                                      &ecconnect_kdf_context_length);
-    if (res != ECRYPT_SUCCESS) {
-        goto error;
-    }
-
-    /* Use ecconnect KDF to derive key from prekey */
-    res = ecrypt_auth_sym_derive_encryption_key(ecconnect_alg_without_kdf(hdr->alg),
-                                                prekey,
-                                                sizeof(prekey),
-                                                ecconnect_kdf_context,
-                                                ecconnect_kdf_context_length,
-                                                user_context,
-                                                user_context_length,
-                                                derived_key,
-                                                derived_key_length);
-    if (res != ECRYPT_SUCCESS) {
-        goto error;
-    }
+    res = ecrypt_auth_sym_derive_prekey_subkey(hdr->alg,
+                                               prekey,
+                                               sizeof(prekey),
+                                               user_context,
+                                               user_context_length,
+                                               message_length,
+                                               derived_key,
+                                               derived_key_length);
 
 error:
     ecconnect_wipe(prekey, sizeof(prekey));
@@ -369,6 +436,7 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_passphrase(
     const struct ecrypt_scell_auth_token_passphrase* hdr,
     const uint8_t* passphrase,
     size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* known_prekey,
     const uint8_t* user_context,
     size_t user_context_length,
     size_t message_length,
@@ -380,6 +448,7 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_passphrase(
         return ecrypt_auth_sym_derive_decryption_key_pbkdf2(hdr,
                                                             passphrase,
                                                             passphrase_length,
+                                                            known_prekey,
                                                             user_context,
                                                             user_context_length,
                                                             message_length,
@@ -392,16 +461,18 @@ static ecrypt_status_t ecrypt_auth_sym_derive_decryption_key_passphrase(
     }
 }
 
-ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase_(const uint8_t* passphrase,
-                                                                 size_t passphrase_length,
-                                                                 const uint8_t* user_context,
-                                                                 size_t user_context_length,
-                                                                 const uint8_t* auth_token,
-                                                                 size_t auth_token_length,
-                                                                 const uint8_t* encrypted_message,
-                                                                 size_t encrypted_message_length,
-                                                                 uint8_t* message,
-                                                                 size_t* message_length)
+static ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase_(
+    const uint8_t* passphrase,
+    size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* known_prekey,
+    const uint8_t* user_context,
+    size_t user_context_length,
+    const uint8_t* auth_token,
+    size_t auth_token_length,
+    const uint8_t* encrypted_message,
+    size_t encrypted_message_length,
+    uint8_t* message,
+    size_t* message_length)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     struct ecrypt_scell_auth_token_passphrase hdr;
@@ -427,6 +498,7 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase_(const uint8_t*
     res = ecrypt_auth_sym_derive_decryption_key_passphrase(&hdr,
                                                            passphrase,
                                                            passphrase_length,
+                                                           known_prekey,
                                                            user_context,
                                                            user_context_length,
                                                            encrypted_message_length,
@@ -462,16 +534,18 @@ error:
     return res;
 }
 
-ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* passphrase,
-                                                                size_t passphrase_length,
-                                                                const uint8_t* user_context,
-                                                                size_t user_context_length,
-                                                                const uint8_t* auth_token,
-                                                                size_t auth_token_length,
-                                                                const uint8_t* encrypted_message,
-                                                                size_t encrypted_message_length,
-                                                                uint8_t* message,
-                                                                size_t* message_length)
+ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_known_prekey(
+    const uint8_t* passphrase,
+    size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* known_prekey,
+    const uint8_t* user_context,
+    size_t user_context_length,
+    const uint8_t* auth_token,
+    size_t auth_token_length,
+    const uint8_t* encrypted_message,
+    size_t encrypted_message_length,
+    uint8_t* message,
+    size_t* message_length)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint32_t expected_message_length = 0;
@@ -498,6 +572,7 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* p
 
     return ecrypt_auth_sym_decrypt_message_with_passphrase_(passphrase,
                                                             passphrase_length,
+                                                            known_prekey,
                                                             user_context,
                                                             user_context_length,
                                                             auth_token,
@@ -507,3 +582,27 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* p
                                                             message,
                                                             message_length);
 }
+
+ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* passphrase,
+                                                                size_t passphrase_length,
+                                                                const uint8_t* user_context,
+                                                                size_t user_context_length,
+                                                                const uint8_t* auth_token,
+                                                                size_t auth_token_length,
+                                                                const uint8_t* encrypted_message,
+                                                                size_t encrypted_message_length,
+                                                                uint8_t* message,
+                                                                size_t* message_length)
+{
+    return ecrypt_auth_sym_decrypt_message_with_known_prekey(passphrase,
+                                                             passphrase_length,
+                                                             NULL,
+                                                             user_context,
+                                                             user_context_length,
+                                                             auth_token,
+                                                             auth_token_length,
+                                                             encrypted_message,
+                                                             encrypted_message_length,
+                                                             message,
+                                                             message_length);
+}
@@ -30,6 +30,8 @@
 #include <ecrypt/ecrypt_error.h>
 #include <ecrypt/ecrypt_portable_endian.h>
 
+#include "ecrypt/secure_cell_alg.h"
+
 /**
  * @internal
  * @page secure-cell-data-formats
@@ -278,6 +280,37 @@ static inline ecrypt_status_t ecrypt_read_scell_pbkdf2_context(
     return ECRYPT_SUCCESS;
 }
 
+/*
+ * PBKDF2 output with the parameters it has been derived with.
+ * Per-message keys are derived from it with ecconnect KDF.
+ */
+struct ecrypt_scell_pbkdf2_prekey {
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8];
+    uint8_t salt[ECRYPT_AUTH_SYM_PBKDF2_SALT_LENGTH];
+    uint32_t iteration_count;
+};
+
+/* Runs PBKDF2 over the passphrase with fresh random salt */
+ecrypt_status_t ecrypt_scell_pbkdf2_prekey_derive(const uint8_t* passphrase,
+                                                 size_t passphrase_length,
+                                                 uint32_t iteration_count,
+                                                 struct ecrypt_scell_pbkdf2_prekey* prekey);
+
+/* Size of the token produced with the default algorithm and parameters */
+size_t ecrypt_scell_auth_token_passphrase_default_size(void);
+
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase_ex(const uint8_t* passphrase,
+                                                                   size_t passphrase_length,
+                                                                   const uint8_t* message,
+                                                                   size_t message_length,
+                                                                   const uint8_t* user_context,
+                                                                   size_t user_context_length,
+                                                                   uint8_t* auth_token,
+                                                                   size_t* auth_token_length,
+                                                                   uint8_t* encrypted_message,
+                                                                   size_t* encrypted_message_length,
+                                                                   uint32_t iteration_count);
+
 ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase(const uint8_t* passphrase,
                                                                 size_t passphrase_length,
                                                                 const uint8_t* message,
@@ -289,6 +322,20 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_passphrase(const uint8_t* p
                                                                 uint8_t* encrypted_message,
                                                                 size_t* encrypted_message_length);
 
+/*
+ * Encrypts with already derived prekey. Output is the same as with the
+ * passphrase, salt and iteration count of the prekey are put into the token.
+ */
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_with_prekey(const struct ecrypt_scell_pbkdf2_prekey* prekey,
+                                                            const uint8_t* message,
+                                                            size_t message_length,
+                                                            const uint8_t* user_context,
+                                                            size_t user_context_length,
+                                                            uint8_t* auth_token,
+                                                            size_t* auth_token_length,
+                                                            uint8_t* encrypted_message,
+                                                            size_t* encrypted_message_length);
+
 ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* passphrase,
                                                                 size_t passphrase_length,
                                                                 const uint8_t* user_context,
@@ -300,4 +347,21 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_passphrase(const uint8_t* p
                                                                 uint8_t* message,
                                                                 size_t* message_length);
 
+/*
+ * PBKDF2 is skipped if the token has the same salt and iteration count
+ * as `known_prekey`, which may be NULL.
+ */
+ecrypt_status_t ecrypt_auth_sym_decrypt_message_with_known_prekey(
+    const uint8_t* passphrase,
+    size_t passphrase_length,
+    const struct ecrypt_scell_pbkdf2_prekey* known_prekey,
+    const uint8_t* user_context,
+    size_t user_context_length,
+    const uint8_t* auth_token,
+    size_t auth_token_length,
+    const uint8_t* encrypted_message,
+    size_t encrypted_message_length,
+    uint8_t* message,
+    size_t* message_length);
+
 #endif /* ECRYPT_SECURE_CELL_SEAL_PASSPHRASE_H */
@@ -0,0 +1,906 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/secure_cell_seal_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell_alg.h"
+
+struct ecrypt_secure_cell_stream_type {
+    bool encrypt;
+    bool failed;
+    bool finished;
+
+    /* Used by decryption until the header is received, NULL afterwards */
+    ecconnect_kdf_ctx_t* kdf;
+    uint8_t* user_context;
+    size_t user_context_length;
+
+    uint8_t header[ECRYPT_SCELL_STREAM_HEADER_LENGTH];
+    size_t header_length;
+    struct ecrypt_scell_stream_header hdr;
+
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8];
+    size_t key_length;
+
+    uint64_t segment_index;
+    uint64_t processed_length;
+
+    /*
+     * Encryption keeps up to one segment of plaintext here.
+     * Decryption keeps up to one encrypted segment and the trailer.
+     */
+    uint8_t* buffer;
+    size_t buffer_length;
+    size_t buffer_capacity;
+
+    struct ecrypt_scell_scratch scratch;
+};
+
+ecrypt_status_t ecrypt_scell_stream_derive_key(const ecconnect_kdf_ctx_t* kdf,
+                                               const uint8_t* header,
+                                               const uint8_t* user_context,
+                                               size_t user_context_length,
+                                               uint32_t alg,
+                                               uint8_t* key,
+                                               size_t* key_length)
+{
+    ecconnect_kdf_context_buf_t kdf_ctx[2] = {{header, ECRYPT_SCELL_STREAM_HEADER_LENGTH},
+                                              {user_context, user_context_length}};
+    size_t required_length = ecconnect_alg_key_length(alg);
+    switch (required_length) {
+    case ECCONNECT_SYM_256_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_192_KEY_LENGTH / 8:
+    case ECCONNECT_SYM_128_KEY_LENGTH / 8:
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    if (*key_length < required_length) {
+        return ECRYPT_FAIL;
+    }
+    *key_length = required_length;
+
+    return ecconnect_kdf_ctx_derive(kdf,
+                                    ECRYPT_SCELL_STREAM_KDF_KEY_LABEL,
+                                    kdf_ctx,
+                                    (user_context == NULL || user_context_length == 0) ? 1 : 2,
+                                    key,
+                                    *key_length);
+}
+
+static void ecrypt_scell_stream_scratch_cleanup(struct ecrypt_scell_scratch* scratch)
+{
+    if (scratch->aead_encrypt) {
+        ecconnect_sym_aead_encrypt_destroy(scratch->aead_encrypt);
+        scratch->aead_encrypt = NULL;
+    }
+    if (scratch->aead_decrypt) {
+        ecconnect_sym_aead_decrypt_destroy(scratch->aead_decrypt);
+        scratch->aead_decrypt = NULL;
+    }
+}
+
+static ecrypt_status_t ecrypt_scell_stream_seal_segment(struct ecrypt_scell_scratch* scratch,
+                                                        const struct ecrypt_scell_stream_header* hdr,
+                                                        const uint8_t* key,
+                                                        size_t key_length,
+                                                        uint64_t index,
+                                                        bool last,
+                                                        uint64_t total_length,
+                                                        const uint8_t* segment,
+                                                        size_t segment_length,
+                                                        uint8_t* output)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t nonce[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t trailer[ECRYPT_SCELL_STREAM_TRAILER_LENGTH] = {0};
+    uint32_t auth_tag_length = ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+    size_t encrypted_length = segment_length;
+    /* Empty last segment still needs a valid pointer */
+    static const uint8_t empty = 0;
+
+    ecrypt_scell_stream_segment_nonce(hdr->iv, index, last, nonce);
+    if (last) {
+        stream_write_uint64LE(trailer, total_length);
+    }
+
+    res = ecrypt_scell_scratch_plain_encrypt(scratch,
+                                             hdr->alg,
+                                             key,
+                                             key_length,
+                                             nonce,
+                                             sizeof(nonce),
+                                             last ? trailer : NULL,
+                                             last ? sizeof(trailer) : 0,
+                                             segment_length ? segment : &empty,
+                                             segment_length,
+                                             output,
+                                             &encrypted_length,
+                                             output + segment_length,
+                                             &auth_tag_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (encrypted_length != segment_length || auth_tag_length != ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    if (last) {
+        memcpy(output + segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH, trailer, sizeof(trailer));
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_stream_open_segment(struct ecrypt_scell_scratch* scratch,
+                                                        const struct ecrypt_scell_stream_header* hdr,
+                                                        const uint8_t* key,
+                                                        size_t key_length,
+                                                        uint64_t index,
+                                                        const uint8_t* trailer,
+                                                        const uint8_t* segment,
+                                                        size_t segment_length,
+                                                        uint8_t* output)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t nonce[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+    uint8_t empty = 0;
+    size_t decrypted_length = segment_length;
+
+    /* Only the last segment carries the trailer */
+    ecrypt_scell_stream_segment_nonce(hdr->iv, index, trailer != NULL, nonce);
+
+    res = ecrypt_scell_scratch_plain_decrypt(scratch,
+                                             hdr->alg,
+                                             key,
+                                             key_length,
+                                             nonce,
+                                             sizeof(nonce),
+                                             trailer,
+                                             trailer ? ECRYPT_SCELL_STREAM_TRAILER_LENGTH : 0,
+                                             segment_length ? segment : &empty,
+                                             segment_length,
+                                             segment_length ? output : &empty,
+                                             &decrypted_length,
+                                             segment + segment_length,
+                                             ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH);
+    if (res != ECRYPT_SUCCESS || decrypted_length != segment_length) {
+        if (segment_length != 0) {
+            ecconnect_wipe(output, segment_length);
+        }
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_secure_cell_stream_t* ecrypt_scell_stream_create(const uint8_t* master_key,
+                                                               size_t master_key_length,
+                                                               const uint8_t* user_context,
+                                                               size_t user_context_length)
+{
+    ecrypt_secure_cell_stream_t* stream = NULL;
+
+    ECRYPT_CHECK_PARAM_(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM_(user_context != NULL);
+    }
+
+    stream = calloc(1, sizeof(*stream));
+    ECRYPT_CHECK_MALLOC_(stream);
+
+    stream->kdf = ecconnect_kdf_ctx_create(master_key, master_key_length);
+    if (!stream->kdf) {
+        goto error;
+    }
+    if (user_context_length != 0) {
+        stream->user_context = malloc(user_context_length);
+        if (!stream->user_context) {
+            goto error;
+        }
+        memcpy(stream->user_context, user_context, user_context_length);
+        stream->user_context_length = user_context_length;
+    }
+    return stream;
+
+error:
+    ecrypt_secure_cell_seal_stream_destroy(stream);
+    return NULL;
+}
+
+/* Key is derived, master key and user context are no longer needed */
+static void ecrypt_scell_stream_drop_master_key(ecrypt_secure_cell_stream_t* stream)
+{
+    ecconnect_kdf_ctx_destroy(stream->kdf);
+    stream->kdf = NULL;
+    if (stream->user_context) {
+        ecconnect_wipe(stream->user_context, stream->user_context_length);
+        free(stream->user_context);
+        stream->user_context = NULL;
+        stream->user_context_length = 0;
+    }
+}
+
+ecrypt_secure_cell_stream_t* ecrypt_secure_cell_encrypt_seal_stream_create(const uint8_t* master_key,
+                                                                           size_t master_key_length,
+                                                                           const uint8_t* user_context,
+                                                                           size_t user_context_length,
+                                                                           size_t segment_length)
+{
+    ecrypt_secure_cell_stream_t* stream = NULL;
+    uint8_t iv[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
+
+    if (segment_length == 0) {
+        segment_length = ECRYPT_SCELL_STREAM_DEFAULT_SEGMENT_LENGTH;
+    }
+    ECRYPT_CHECK_PARAM_(segment_length <= ECRYPT_SCELL_STREAM_MAX_SEGMENT_LENGTH);
+
+    stream = ecrypt_scell_stream_create(master_key, master_key_length, user_context, user_context_length);
+    if (!stream) {
+        return NULL;
+    }
+    stream->encrypt = true;
+
+    if (ecconnect_rand(iv, sizeof(iv)) != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    stream->hdr.alg = ECRYPT_AUTH_SYM_ALG;
+    stream->hdr.segment_length = (uint32_t)segment_length;
+    stream->hdr.iv = iv;
+    ecrypt_write_scell_stream_header(&stream->hdr, stream->header);
+    /* Point into the stream, not at the stack */
+    stream->hdr.iv = stream->header + 2 * sizeof(uint32_t);
+
+    stream->key_length = sizeof(stream->key);
+    if (ecrypt_scell_stream_derive_key(stream->kdf,
+                                       stream->header,
+                                       stream->user_context,
+                                       stream->user_context_length,
+                                       stream->hdr.alg,
+                                       stream->key,
+                                       &stream->key_length)
+        != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    ecrypt_scell_stream_drop_master_key(stream);
+
+    stream->buffer_capacity = segment_length;
+    stream->buffer = malloc(stream->buffer_capacity);
+    if (!stream->buffer) {
+        goto error;
+    }
+
+    ecconnect_wipe(iv, sizeof(iv));
+    return stream;
+
+error:
+    ecconnect_wipe(iv, sizeof(iv));
+    ecrypt_secure_cell_seal_stream_destroy(stream);
+    return NULL;
+}
+
+ecrypt_secure_cell_stream_t* ecrypt_secure_cell_decrypt_seal_stream_create(const uint8_t* master_key,
+                                                                           size_t master_key_length,
+                                                                           const uint8_t* user_context,
+                                                                           size_t user_context_length)
+{
+    ecrypt_secure_cell_stream_t* stream = NULL;
+
+    stream = ecrypt_scell_stream_create(master_key, master_key_length, user_context, user_context_length);
+    if (!stream) {
+        return NULL;
+    }
+    stream->encrypt = false;
+    /* Buffer is allocated once segment length is known from the header */
+    return stream;
+}
+
+ecrypt_status_t ecrypt_secure_cell_seal_stream_destroy(ecrypt_secure_cell_stream_t* stream)
+{
+    if (!stream) {
+        return ECRYPT_SUCCESS;
+    }
+    ecrypt_scell_stream_drop_master_key(stream);
+    ecrypt_scell_stream_scratch_cleanup(&stream->scratch);
+    if (stream->buffer) {
+        ecconnect_wipe(stream->buffer, stream->buffer_capacity);
+        free(stream->buffer);
+    }
+    ecconnect_wipe(stream, sizeof(*stream));
+    free(stream);
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_stream_update(ecrypt_secure_cell_stream_t* stream,
+                                                              const uint8_t* message,
+                                                              size_t message_length,
+                                                              uint8_t* encrypted_message,
+                                                              size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t segment_length = 0;
+    size_t encrypted_segment_length = 0;
+    size_t total_length = 0;
+    size_t segments = 0;
+    size_t output_length = 0;
+    size_t chunk = 0;
+    uint8_t* output = encrypted_message;
+
+    ECRYPT_CHECK_PARAM(stream != NULL && stream->encrypt);
+    if (message_length != 0) {
+        ECRYPT_CHECK_PARAM(message != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+    if (stream->failed || stream->finished) {
+        return ECRYPT_FAIL;
+    }
+
+    segment_length = stream->hdr.segment_length;
+    encrypted_segment_length = segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+
+    /*
+     * A full segment is written out only when more data follows it,
+     * the last segment is always emitted by the final call.
+     */
+    if (message_length > SIZE_MAX - stream->buffer_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    total_length = stream->buffer_length + message_length;
+    segments = (total_length != 0) ? (total_length - 1) / segment_length : 0;
+    if (segments > (SIZE_MAX - ECRYPT_SCELL_STREAM_HEADER_LENGTH) / encrypted_segment_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    output_length = segments * encrypted_segment_length;
+    if (stream->header_length == 0) {
+        output_length += ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+    }
+
+    if (!encrypted_message || *encrypted_message_length < output_length) {
+        *encrypted_message_length = output_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    if (stream->header_length == 0) {
+        memcpy(output, stream->header, ECRYPT_SCELL_STREAM_HEADER_LENGTH);
+        output += ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+        stream->header_length = ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+    }
+
+    /* Complete the buffered segment first */
+    if (stream->buffer_length != 0 && segments != 0) {
+        chunk = segment_length - stream->buffer_length;
+        memcpy(stream->buffer + stream->buffer_length, message, chunk);
+        message += chunk;
+        message_length -= chunk;
+        res = ecrypt_scell_stream_seal_segment(&stream->scratch,
+                                               &stream->hdr,
+                                               stream->key,
+                                               stream->key_length,
+                                               stream->segment_index,
+                                               false,
+                                               0,
+                                               stream->buffer,
+                                               segment_length,
+                                               output);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        output += encrypted_segment_length;
+        stream->segment_index++;
+        stream->processed_length += segment_length;
+        stream->buffer_length = 0;
+        segments--;
+    }
+
+    /* Encrypt the rest directly from input, without copying */
+    while (segments != 0) {
+        res = ecrypt_scell_stream_seal_segment(&stream->scratch,
+                                               &stream->hdr,
+                                               stream->key,
+                                               stream->key_length,
+                                               stream->segment_index,
+                                               false,
+                                               0,
+                                               message,
+                                               segment_length,
+                                               output);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        message += segment_length;
+        message_length -= segment_length;
+        output += encrypted_segment_length;
+        stream->segment_index++;
+        stream->processed_length += segment_length;
+        segments--;
+    }
+
+    if (message_length != 0) {
+        memcpy(stream->buffer + stream->buffer_length, message, message_length);
+        stream->buffer_length += message_length;
+    }
+
+    *encrypted_message_length = output_length;
+    return ECRYPT_SUCCESS;
+
+error:
+    stream->failed = true;
+    ecconnect_wipe(encrypted_message, output_length);
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_stream_final(ecrypt_secure_cell_stream_t* stream,
+                                                             uint8_t* encrypted_message,
+                                                             size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t output_length = 0;
+    uint8_t* output = encrypted_message;
+
+    ECRYPT_CHECK_PARAM(stream != NULL && stream->encrypt);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+    if (stream->failed || stream->finished) {
+        return ECRYPT_FAIL;
+    }
+
+    output_length = stream->buffer_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
+                    + ECRYPT_SCELL_STREAM_TRAILER_LENGTH;
+    if (stream->header_length == 0) {
+        output_length += ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+    }
+
+    if (!encrypted_message || *encrypted_message_length < output_length) {
+        *encrypted_message_length = output_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    if (stream->header_length == 0) {
+        memcpy(output, stream->header, ECRYPT_SCELL_STREAM_HEADER_LENGTH);
+        output += ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+        stream->header_length = ECRYPT_SCELL_STREAM_HEADER_LENGTH;
+    }
+
+    res = ecrypt_scell_stream_seal_segment(&stream->scratch,
+                                           &stream->hdr,
+                                           stream->key,
+                                           stream->key_length,
+                                           stream->segment_index,
+                                           true,
+                                           stream->processed_length + stream->buffer_length,
+                                           stream->buffer,
+                                           stream->buffer_length,
+                                           output);
+    if (res != ECRYPT_SUCCESS) {
+        stream->failed = true;
+        ecconnect_wipe(encrypted_message, output_length);
+        return res;
+    }
+
+    stream->processed_length += stream->buffer_length;
+    ecconnect_wipe(stream->buffer, stream->buffer_length);
+    stream->buffer_length = 0;
+    stream->finished = true;
+
+    *encrypted_message_length = output_length;
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_stream_read_header(ecrypt_secure_cell_stream_t* stream,
+                                                       const uint8_t** data,
+                                                       size_t* data_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t chunk = ECRYPT_SCELL_STREAM_HEADER_LENGTH - stream->header_length;
+
+    if (chunk > *data_length) {
+        chunk = *data_length;
+    }
+    memcpy(stream->header + stream->header_length, *data, chunk);
+    stream->header_length += chunk;
+    *data += chunk;
+    *data_length -= chunk;
+
+    if (stream->header_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH) {
+        return ECRYPT_SUCCESS;
+    }
+
+    res = ecrypt_read_scell_stream_header(stream->header, stream->header_length, &stream->hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    stream->key_length = sizeof(stream->key);
+    res = ecrypt_scell_stream_derive_key(stream->kdf,
+                                         stream->header,
+                                         stream->user_context,
+                                         stream->user_context_length,
+                                         stream->hdr.alg,
+                                         stream->key,
+                                         &stream->key_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    ecrypt_scell_stream_drop_master_key(stream);
+
+    /* One more byte to tell the last segment apart from the others */
+    stream->buffer_capacity = stream->hdr.segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
+                              + ECRYPT_SCELL_STREAM_TRAILER_LENGTH + 1;
+    stream->buffer = malloc(stream->buffer_capacity);
+    if (!stream->buffer) {
+        return ECRYPT_NO_MEMORY;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+/* Number of non-last segments which can be decrypted once `length` more bytes arrive */
+static size_t ecrypt_scell_stream_decryptable_segments(const ecrypt_secure_cell_stream_t* stream,
+                                                       size_t length)
+{
+    size_t encrypted_segment_length = stream->hdr.segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+    size_t header_remaining = ECRYPT_SCELL_STREAM_HEADER_LENGTH - stream->header_length;
+    size_t total_length = 0;
+
+    if (length <= header_remaining) {
+        return 0;
+    }
+    length -= header_remaining;
+    if (length > SIZE_MAX - stream->buffer_length) {
+        return SIZE_MAX;
+    }
+    total_length = stream->buffer_length + length;
+    /* Segment is not the last one if there is more than the trailer after it */
+    if (total_length <= encrypted_segment_length + ECRYPT_SCELL_STREAM_TRAILER_LENGTH) {
+        return 0;
+    }
+    return (total_length - ECRYPT_SCELL_STREAM_TRAILER_LENGTH - 1) / encrypted_segment_length;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_update(ecrypt_secure_cell_stream_t* stream,
+                                                              const uint8_t* encrypted_message,
+                                                              size_t encrypted_message_length,
+                                                              uint8_t* plain_message,
+                                                              size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t segment_length = 0;
+    size_t encrypted_segment_length = 0;
+    size_t segments = 0;
+    size_t output_length = 0;
+    size_t chunk = 0;
+    uint8_t* output = plain_message;
+
+    ECRYPT_CHECK_PARAM(stream != NULL && !stream->encrypt);
+    if (encrypted_message_length != 0) {
+        ECRYPT_CHECK_PARAM(encrypted_message != NULL);
+    }
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+    if (stream->failed || stream->finished) {
+        return ECRYPT_FAIL;
+    }
+
+    /* Output size is not known until we see the header, so consume it first */
+    if (stream->header_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH) {
+        size_t header_remaining = ECRYPT_SCELL_STREAM_HEADER_LENGTH - stream->header_length;
+        if (encrypted_message_length < header_remaining) {
+            res = ecrypt_scell_stream_read_header(stream, &encrypted_message, &encrypted_message_length);
+            if (res != ECRYPT_SUCCESS) {
+                stream->failed = true;
+                return res;
+            }
+            *plain_message_length = 0;
+            return ECRYPT_SUCCESS;
+        }
+        /* Peek at the segment length, the header is validated when consumed */
+        memcpy(stream->header + stream->header_length, encrypted_message, header_remaining);
+        stream_read_uint32LE(stream->header + sizeof(uint32_t), &stream->hdr.segment_length);
+        if (stream->hdr.segment_length == 0
+            || stream->hdr.segment_length > ECRYPT_SCELL_STREAM_MAX_SEGMENT_LENGTH) {
+            stream->failed = true;
+            return ECRYPT_FAIL;
+        }
+    }
+
+    segment_length = stream->hdr.segment_length;
+    encrypted_segment_length = segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+    segments = ecrypt_scell_stream_decryptable_segments(stream, encrypted_message_length);
+    if (segments > SIZE_MAX / segment_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    output_length = segments * segment_length;
+
+    if (output_length != 0 && (!plain_message || *plain_message_length < output_length)) {
+        *plain_message_length = output_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    if (stream->header_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH) {
+        res = ecrypt_scell_stream_read_header(stream, &encrypted_message, &encrypted_message_length);
+        if (res != ECRYPT_SUCCESS) {
+            stream->failed = true;
+            return res;
+        }
+    }
+
+    while (encrypted_message_length != 0) {
+        chunk = stream->buffer_capacity - stream->buffer_length;
+        if (chunk > encrypted_message_length) {
+            chunk = encrypted_message_length;
+        }
+        memcpy(stream->buffer + stream->buffer_length, encrypted_message, chunk);
+        stream->buffer_length += chunk;
+        encrypted_message += chunk;
+        encrypted_message_length -= chunk;
+
+        if (stream->buffer_length < stream->buffer_capacity) {
+            break;
+        }
+
+        /* Buffer is full so its first segment is certainly not the last one */
+        res = ecrypt_scell_stream_open_segment(&stream->scratch,
+                                               &stream->hdr,
+                                               stream->key,
+                                               stream->key_length,
+                                               stream->segment_index,
+                                               NULL,
+                                               stream->buffer,
+                                               segment_length,
+                                               output);
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        output += segment_length;
+        stream->segment_index++;
+        stream->processed_length += segment_length;
+        stream->buffer_length -= encrypted_segment_length;
+        memmove(stream->buffer, stream->buffer + encrypted_segment_length, stream->buffer_length);
+    }
+
+    *plain_message_length = output_length;
+    return ECRYPT_SUCCESS;
+
+error:
+    stream->failed = true;
+    if (plain_message) {
+        ecconnect_wipe(plain_message, output_length);
+    }
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_final(ecrypt_secure_cell_stream_t* stream,
+                                                             uint8_t* plain_message,
+                                                             size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t segment_length = 0;
+    const uint8_t* trailer = NULL;
+    uint64_t total_length = 0;
+
+    ECRYPT_CHECK_PARAM(stream != NULL && !stream->encrypt);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+    if (stream->failed || stream->finished) {
+        return ECRYPT_FAIL;
+    }
+
+    /* Truncated stream */
+    if (stream->header_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH
+        || stream->buffer_length < ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH + ECRYPT_SCELL_STREAM_TRAILER_LENGTH) {
+        stream->failed = true;
+        return ECRYPT_FAIL;
+    }
+    segment_length = stream->buffer_length - ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
+                     - ECRYPT_SCELL_STREAM_TRAILER_LENGTH;
+    /* Only an empty stream may end with an empty segment */
+    if (segment_length == 0 && stream->segment_index != 0) {
+        stream->failed = true;
+        return ECRYPT_FAIL;
+    }
+    trailer = stream->buffer + segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+    stream_read_uint64LE(trailer, &total_length);
+    if (total_length != stream->processed_length + segment_length) {
+        stream->failed = true;
+        return ECRYPT_FAIL;
+    }
+
+    if (segment_length != 0 && (!plain_message || *plain_message_length < segment_length)) {
+        *plain_message_length = segment_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_scell_stream_open_segment(&stream->scratch,
+                                           &stream->hdr,
+                                           stream->key,
+                                           stream->key_length,
+                                           stream->segment_index,
+                                           trailer,
+                                           stream->buffer,
+                                           segment_length,
+                                           plain_message);
+    if (res != ECRYPT_SUCCESS) {
+        stream->failed = true;
+        return res;
+    }
+
+    stream->processed_length += segment_length;
+    stream->buffer_length = 0;
+    stream->finished = true;
+
+    *plain_message_length = segment_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_stream_range(const uint8_t* master_key,
+                                                             size_t master_key_length,
+                                                             const uint8_t* user_context,
+                                                             size_t user_context_length,
+                                                             const uint8_t* encrypted_stream,
+                                                             size_t encrypted_stream_length,
+                                                             uint64_t offset,
+                                                             size_t length,
+                                                             uint8_t* plain_message,
+                                                             size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_stream_header hdr;
+    struct ecrypt_scell_scratch scratch;
+    ecconnect_kdf_ctx_t* kdf = NULL;
+    uint8_t key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t key_length = sizeof(key);
+    uint8_t* segment_buffer = NULL;
+    const uint8_t* trailer = NULL;
+    uint64_t total_length = 0;
+    uint64_t segment_count = 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t index = 0;
+    uint64_t expected_length = 0;
+    uint64_t encrypted_segment_length = 0;
+    uint8_t* output = plain_message;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_stream != NULL && encrypted_stream_length != 0);
+    ECRYPT_CHECK_PARAM(length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&scratch, 0, sizeof(scratch));
+
+    res = ecrypt_read_scell_stream_header(encrypted_stream, encrypted_stream_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (encrypted_stream_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
+                                      + ECRYPT_SCELL_STREAM_TRAILER_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+
+    /* Check that stream length is consistent with the trailer before touching anything */
+    trailer = encrypted_stream + encrypted_stream_length - ECRYPT_SCELL_STREAM_TRAILER_LENGTH;
+    stream_read_uint64LE(trailer, &total_length);
+    if (total_length > encrypted_stream_length) {
+        return ECRYPT_FAIL;
+    }
+    segment_count = ecrypt_scell_stream_segment_count(total_length, hdr.segment_length);
+    expected_length = ECRYPT_SCELL_STREAM_HEADER_LENGTH + total_length
+                      + segment_count * ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH
+                      + ECRYPT_SCELL_STREAM_TRAILER_LENGTH;
+    if (expected_length != encrypted_stream_length) {
+        return ECRYPT_FAIL;
+    }
+
+    if (offset >= total_length || length > total_length - offset) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    if (!plain_message || *plain_message_length < length) {
+        *plain_message_length = length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    kdf = ecconnect_kdf_ctx_create(master_key, master_key_length);
+    if (!kdf) {
+        return ECRYPT_NO_MEMORY;
+    }
+    res = ecrypt_scell_stream_derive_key(kdf,
+                                         encrypted_stream,
+                                         user_context,
+                                         user_context_length,
+                                         hdr.alg,
+                                         key,
+                                         &key_length);
+    ecconnect_kdf_ctx_destroy(kdf);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    encrypted_segment_length = (uint64_t)hdr.segment_length + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+    first = offset / hdr.segment_length;
+    last = (offset + length - 1) / hdr.segment_length;
+
+    for (index = first; index <= last; index++) {
+        uint64_t segment_start = index * hdr.segment_length;
+        size_t segment_length = hdr.segment_length;
+        const uint8_t* segment = encrypted_stream + ECRYPT_SCELL_STREAM_HEADER_LENGTH
+                                 + index * encrypted_segment_length;
+        bool is_last = (index == segment_count - 1);
+        size_t skip = 0;
+        size_t take = 0;
+
+        if (is_last) {
+            segment_length = (size_t)(total_length - segment_start);
+        }
+        skip = (offset > segment_start) ? (size_t)(offset - segment_start) : 0;
+        take = segment_length - skip;
+        if (take > length - (size_t)(output - plain_message)) {
+            take = length - (size_t)(output - plain_message);
+        }
+
+        if (skip == 0 && take == segment_length) {
+            /* Fully covered segments are decrypted straight into the output */
+            res = ecrypt_scell_stream_open_segment(&scratch,
+                                                   &hdr,
+                                                   key,
+                                                   key_length,
+                                                   index,
+                                                   is_last ? trailer : NULL,
+                                                   segment,
+                                                   segment_length,
+                                                   output);
+        } else {
+            if (!segment_buffer) {
+                segment_buffer = malloc(hdr.segment_length);
+                if (!segment_buffer) {
+                    res = ECRYPT_NO_MEMORY;
+                    goto error;
+                }
+            }
+            res = ecrypt_scell_stream_open_segment(&scratch,
+                                                   &hdr,
+                                                   key,
+                                                   key_length,
+                                                   index,
+                                                   is_last ? trailer : NULL,
+                                                   segment,
+                                                   segment_length,
+                                                   segment_buffer);
+            if (res == ECRYPT_SUCCESS) {
+                memcpy(output, segment_buffer + skip, take);
+            }
+        }
+        if (res != ECRYPT_SUCCESS) {
+            goto error;
+        }
+        output += take;
+    }
+
+    *plain_message_length = length;
+
+error:
+    if (res != ECRYPT_SUCCESS) {
+        ecconnect_wipe(plain_message, length);
+    }
+    if (segment_buffer) {
+        ecconnect_wipe(segment_buffer, hdr.segment_length);
+        free(segment_buffer);
+    }
+    ecrypt_scell_stream_scratch_cleanup(&scratch);
+    ecconnect_wipe(key, sizeof(key));
+
+    return res;
+}
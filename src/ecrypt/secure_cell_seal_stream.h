@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @internal
+ * @file secure_cell_seal_stream.h
+ * @brief Secure Cell chunked stream data layout
+ *
+ * @warning Structures and functions declared in this file are considered
+ * implementation details and may change without notice.
+ */
+
+#ifndef ECRYPT_SECURE_CELL_SEAL_STREAM_H
+#define ECRYPT_SECURE_CELL_SEAL_STREAM_H
+
+#include <ecconnect/ecconnect_kdf.h>
+
+#include <ecrypt/ecrypt_error.h>
+#include <ecrypt/ecrypt_portable_endian.h>
+
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/secure_cell_seal_context.h"
+
+#define ECRYPT_SCELL_STREAM_KDF_KEY_LABEL "Ecrypt secure cell stream key"
+
+/**
+ * @internal
+ * @page secure-cell-data-formats
+ * @ingroup ECRYPT_SECURE_CELL
+ * @subsection seal-stream Chunked stream for master keys
+ *
+ * Streams are split into segments of fixed plaintext length, each segment
+ * is encrypted and authenticated separately. This allows to process data
+ * of any length with constant memory, and to decrypt any range of a stream
+ * by touching only the segments covering it.
+ *
+ * ```
+ *     0        1        2        3        4        5        6        7
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ * |           algorithm ID            |          segment length           |
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ * |                   Initialization Vector (12 bytes)                    |
+ * + - - - -+ - - - -+ - - - -+ - - - -+--------+--------+--------+--------+
+ * |                                   |
+ * +--------+--------+--------+--------+
+ *
+ *  Segments (repeated)
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ * |            encrypted data (segment length bytes, last may be less)    |
+ * + - - - -+ - - - -+ - - - -+ - - - -+ - - - -+ - - - -+ - - - -+ - - - -+
+ * |                   Authentication Tag (16 bytes)                       |
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ *
+ *  Trailer
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ * |                        total plaintext length                         |
+ * +--------+--------+--------+--------+--------+--------+--------+--------+
+ * ```
+ *
+ * All numerical fields are unsigned integers encoded in little-endian format.
+ *
+ * The stream key is derived with ecconnect KDF from the master key, using
+ * the header and the user context as KDF context, so it is unique per stream
+ * and the header is authenticated implicitly.
+ *
+ * Segment nonces are chained from the header IV: segment index is XORed
+ * into the last 8 bytes of the IV (little-endian), and the last segment
+ * also has its 4th byte XORed with 1. This prevents reordering, truncation
+ * and extension of the stream. Trailer is authenticated as associated data
+ * of the last segment. The last segment is never empty unless the whole
+ * stream is empty.
+ */
+
+#define ECRYPT_SCELL_STREAM_HEADER_LENGTH (2 * sizeof(uint32_t) + ECRYPT_AUTH_SYM_IV_LENGTH)
+#define ECRYPT_SCELL_STREAM_TRAILER_LENGTH sizeof(uint64_t)
+
+#define ECRYPT_SCELL_STREAM_DEFAULT_SEGMENT_LENGTH (64 * 1024)
+/* Limits memory allocated by stream decryption for untrusted headers */
+#define ECRYPT_SCELL_STREAM_MAX_SEGMENT_LENGTH (16 * 1024 * 1024)
+
+struct ecrypt_scell_stream_header {
+    uint32_t alg;
+    uint32_t segment_length;
+    const uint8_t* iv;
+};
+
+static inline void ecrypt_write_scell_stream_header(const struct ecrypt_scell_stream_header* hdr,
+                                                    uint8_t* buffer)
+{
+    buffer = stream_write_uint32LE(buffer, hdr->alg);
+    buffer = stream_write_uint32LE(buffer, hdr->segment_length);
+    buffer = stream_write_bytes(buffer, hdr->iv, ECRYPT_AUTH_SYM_IV_LENGTH);
+}
+
+static inline ecrypt_status_t ecrypt_read_scell_stream_header(const uint8_t* buffer,
+                                                              size_t buffer_length,
+                                                              struct ecrypt_scell_stream_header* hdr)
+{
+    if (buffer_length < ECRYPT_SCELL_STREAM_HEADER_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    buffer = stream_read_uint32LE(buffer, &hdr->alg);
+    buffer = stream_read_uint32LE(buffer, &hdr->segment_length);
+    buffer = stream_read_bytes(buffer, &hdr->iv, ECRYPT_AUTH_SYM_IV_LENGTH);
+    if (!ecconnect_alg_reserved_bits_valid(hdr->alg)) {
+        return ECRYPT_FAIL;
+    }
+    switch (hdr->alg & (ECCONNECT_SYM_ALG_MASK | ECCONNECT_SYM_PADDING_MASK)) {
+    case ECCONNECT_SYM_AES_GCM:
+    case ECCONNECT_SYM_CHACHA20_POLY1305:
+        break;
+    default:
+        return ECRYPT_FAIL;
+    }
+    if (ecconnect_alg_kdf(hdr->alg) != ECCONNECT_SYM_NOKDF) {
+        return ECRYPT_FAIL;
+    }
+    if (hdr->segment_length == 0 || hdr->segment_length > ECRYPT_SCELL_STREAM_MAX_SEGMENT_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static inline void ecrypt_scell_stream_segment_nonce(const uint8_t* iv,
+                                                     uint64_t index,
+                                                     bool last,
+                                                     uint8_t* nonce)
+{
+    uint8_t encoded_index[sizeof(uint64_t)];
+    size_t i;
+    memcpy(nonce, iv, ECRYPT_AUTH_SYM_IV_LENGTH);
+    stream_write_uint64LE(encoded_index, index);
+    for (i = 0; i < sizeof(encoded_index); i++) {
+        nonce[ECRYPT_AUTH_SYM_IV_LENGTH - sizeof(encoded_index) + i] ^= encoded_index[i];
+    }
+    if (last) {
+        nonce[3] ^= 1;
+    }
+}
+
+/* Number of segments in a stream with given plaintext length, at least one */
+static inline uint64_t ecrypt_scell_stream_segment_count(uint64_t total_length, uint32_t segment_length)
+{
+    if (total_length == 0) {
+        return 1;
+    }
+    return total_length / segment_length + (total_length % segment_length != 0 ? 1 : 0);
+}
+
+ecrypt_status_t ecrypt_scell_stream_derive_key(const ecconnect_kdf_ctx_t* kdf,
+                                               const uint8_t* header,
+                                               const uint8_t* user_context,
+                                               size_t user_context_length,
+                                               uint32_t alg,
+                                               uint8_t* key,
+                                               size_t* key_length);
+
+#endif /* ECRYPT_SECURE_CELL_SEAL_STREAM_H */
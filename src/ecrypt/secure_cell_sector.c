@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+#include <ecconnect/ecconnect_sym.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_batch.h"
+
+#define ECRYPT_SCELL_SECTOR_ALG (ECCONNECT_SYM_AES_XTS | ECCONNECT_SYM_NOKDF | ECCONNECT_SYM_256_KEY_LENGTH)
+
+/*
+ * AES-256-XTS takes a pair of AES-256 keys: one for data and one for tweak.
+ * ecconnect KDF output is limited to 32 bytes so they are derived separately.
+ */
+#define ECRYPT_SCELL_SECTOR_DATA_KEY_LABEL "Ecrypt secure cell sector data key"
+#define ECRYPT_SCELL_SECTOR_TWEAK_KEY_LABEL "Ecrypt secure cell sector tweak key"
+
+#define ECRYPT_SCELL_SECTOR_HALF_KEY_LENGTH 32
+#define ECRYPT_SCELL_SECTOR_KEY_LENGTH (2 * ECRYPT_SCELL_SECTOR_HALF_KEY_LENGTH)
+#define ECRYPT_SCELL_SECTOR_TWEAK_LENGTH 16
+
+/* Sectors are handed out to threads in blocks of this size */
+#define ECRYPT_SCELL_SECTOR_BLOCK_ITEMS 64
+
+static ecrypt_status_t ecrypt_scell_sector_derive_key(const uint8_t* master_key,
+                                                      size_t master_key_length,
+                                                      const uint8_t* context,
+                                                      size_t context_length,
+                                                      uint8_t* key)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_kdf_context_buf_t kdf_context = {context, context_length};
+
+    res = ecconnect_kdf(master_key,
+                        master_key_length,
+                        ECRYPT_SCELL_SECTOR_DATA_KEY_LABEL,
+                        &kdf_context,
+                        1,
+                        key,
+                        ECRYPT_SCELL_SECTOR_HALF_KEY_LENGTH);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+
+    return ecconnect_kdf(master_key,
+                         master_key_length,
+                         ECRYPT_SCELL_SECTOR_TWEAK_KEY_LABEL,
+                         &kdf_context,
+                         1,
+                         key + ECRYPT_SCELL_SECTOR_HALF_KEY_LENGTH,
+                         ECRYPT_SCELL_SECTOR_HALF_KEY_LENGTH);
+}
+
+/* Sector number is the tweak, as 128-bit little-endian integer (IEEE 1619) */
+static void ecrypt_scell_sector_tweak(uint64_t sector_number, uint8_t* tweak)
+{
+    size_t i = 0;
+
+    for (i = 0; i < ECRYPT_SCELL_SECTOR_TWEAK_LENGTH; i++) {
+        tweak[i] = (i < sizeof(sector_number)) ? (uint8_t)(sector_number >> (8 * i)) : 0;
+    }
+}
+
+struct ecrypt_scell_sector_batch {
+    const uint8_t* key;
+    uint64_t first_sector_number;
+    const uint8_t* input;
+    size_t sector_length;
+    size_t sector_count;
+    uint8_t* output;
+    bool encrypt;
+    /* One per block */
+    ecrypt_status_t* status;
+};
+
+static ecrypt_status_t ecrypt_scell_sector_run(const struct ecrypt_scell_sector_batch* batch,
+                                               size_t begin,
+                                               size_t end)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecconnect_sym_ctx_t* ctx = NULL;
+    uint8_t tweak[ECRYPT_SCELL_SECTOR_TWEAK_LENGTH] = {0};
+    size_t length = 0;
+    size_t i = 0;
+
+    /* Key schedule is computed once, then only the tweak changes */
+    ecrypt_scell_sector_tweak(batch->first_sector_number + begin, tweak);
+    if (batch->encrypt) {
+        ctx = ecconnect_sym_encrypt_create(ECRYPT_SCELL_SECTOR_ALG,
+                                           batch->key,
+                                           ECRYPT_SCELL_SECTOR_KEY_LENGTH,
+                                           NULL,
+                                           0,
+                                           tweak,
+                                           sizeof(tweak));
+    } else {
+        ctx = ecconnect_sym_decrypt_create(ECRYPT_SCELL_SECTOR_ALG,
+                                           batch->key,
+                                           ECRYPT_SCELL_SECTOR_KEY_LENGTH,
+                                           NULL,
+                                           0,
+                                           tweak,
+                                           sizeof(tweak));
+    }
+    if (!ctx) {
+        return ECRYPT_NO_MEMORY;
+    }
+
+    for (i = begin; i < end; i++) {
+        if (i != begin) {
+            ecrypt_scell_sector_tweak(batch->first_sector_number + i, tweak);
+            if (batch->encrypt) {
+                res = ecconnect_sym_encrypt_reset(ctx, tweak, sizeof(tweak));
+            } else {
+                res = ecconnect_sym_decrypt_reset(ctx, tweak, sizeof(tweak));
+            }
+            if (res != ECRYPT_SUCCESS) {
+                goto error;
+            }
+        }
+
+        /* XTS processes the whole data unit in one update, nothing is buffered */
+        length = batch->sector_length;
+        if (batch->encrypt) {
+            res = ecconnect_sym_encrypt_update(ctx,
+                                               batch->input + i * batch->sector_length,
+                                               batch->sector_length,
+                                               batch->output + i * batch->sector_length,
+                                               &length);
+        } else {
+            res = ecconnect_sym_decrypt_update(ctx,
+                                               batch->input + i * batch->sector_length,
+                                               batch->sector_length,
+                                               batch->output + i * batch->sector_length,
+                                               &length);
+        }
+        if (res != ECRYPT_SUCCESS || length != batch->sector_length) {
+            res = ECRYPT_FAIL;
+            goto error;
+        }
+    }
+
+    res = ECRYPT_SUCCESS;
+
+error:
+    if (batch->encrypt) {
+        ecconnect_sym_encrypt_destroy(ctx);
+    } else {
+        ecconnect_sym_decrypt_destroy(ctx);
+    }
+    ecconnect_wipe(tweak, sizeof(tweak));
+
+    return res;
+}
+
+static void ecrypt_scell_sector_block(void* arg, size_t block)
+{
+    struct ecrypt_scell_sector_batch* batch = arg;
+    size_t begin = block * ECRYPT_SCELL_SECTOR_BLOCK_ITEMS;
+    size_t end = begin + ECRYPT_SCELL_SECTOR_BLOCK_ITEMS;
+
+    if (end > batch->sector_count) {
+        end = batch->sector_count;
+    }
+
+    batch->status[block] = ecrypt_scell_sector_run(batch, begin, end);
+}
+
+static ecrypt_status_t ecrypt_scell_sectors(const uint8_t* master_key,
+                                            size_t master_key_length,
+                                            const uint8_t* context,
+                                            size_t context_length,
+                                            uint64_t first_sector_number,
+                                            const uint8_t* input,
+                                            size_t sector_length,
+                                            size_t sector_count,
+                                            uint8_t* output,
+                                            size_t thread_count,
+                                            bool encrypt)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_sector_batch batch;
+    uint8_t key[ECRYPT_SCELL_SECTOR_KEY_LENGTH] = {0};
+    size_t block_count = 0;
+    size_t i = 0;
+
+    ECRYPT_CHECK_PARAM(master_key != NULL && master_key_length != 0);
+    if (context_length != 0) {
+        ECRYPT_CHECK_PARAM(context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(sector_length >= ECRYPT_SCELL_SECTOR_MIN_LENGTH
+                       && sector_length <= ECRYPT_SCELL_SECTOR_MAX_LENGTH);
+    ECRYPT_CHECK_PARAM(sector_count != 0 && sector_count <= SIZE_MAX / sector_length);
+    ECRYPT_CHECK_PARAM(sector_count - 1 <= UINT64_MAX - first_sector_number);
+    ECRYPT_CHECK_PARAM(input != NULL && output != NULL);
+
+    batch.status = NULL;
+
+    res = ecrypt_scell_sector_derive_key(master_key, master_key_length, context, context_length, key);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    batch.key = key;
+    batch.first_sector_number = first_sector_number;
+    batch.input = input;
+    batch.sector_length = sector_length;
+    batch.sector_count = sector_count;
+    batch.output = output;
+    batch.encrypt = encrypt;
+
+    /* Do not bother with threads for a single block */
+    if (sector_count <= ECRYPT_SCELL_SECTOR_BLOCK_ITEMS) {
+        res = ecrypt_scell_sector_run(&batch, 0, sector_count);
+        goto error;
+    }
+
+    block_count = (sector_count + ECRYPT_SCELL_SECTOR_BLOCK_ITEMS - 1) / ECRYPT_SCELL_SECTOR_BLOCK_ITEMS;
+    batch.status = calloc(block_count, sizeof(*batch.status));
+    if (!batch.status) {
+        res = ECRYPT_NO_MEMORY;
+        goto error;
+    }
+
+    res = ecrypt_scell_batch_run_each(block_count, thread_count, ecrypt_scell_sector_block, &batch);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    for (i = 0; i < block_count; i++) {
+        if (batch.status[i] != ECRYPT_SUCCESS) {
+            res = batch.status[i];
+            break;
+        }
+    }
+
+error:
+    ecconnect_wipe(key, sizeof(key));
+    free(batch.status);
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_sector(const uint8_t* master_key,
+                                                  size_t master_key_length,
+                                                  const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint64_t sector_number,
+                                                  const uint8_t* plain_sector,
+                                                  size_t sector_length,
+                                                  uint8_t* encrypted_sector)
+{
+    return ecrypt_scell_sectors(master_key,
+                                master_key_length,
+                                context,
+                                context_length,
+                                sector_number,
+                                plain_sector,
+                                sector_length,
+                                1,
+                                encrypted_sector,
+                                1,
+                                true);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_sector(const uint8_t* master_key,
+                                                  size_t master_key_length,
+                                                  const uint8_t* context,
+                                                  size_t context_length,
+                                                  uint64_t sector_number,
+                                                  const uint8_t* encrypted_sector,
+                                                  size_t sector_length,
+                                                  uint8_t* plain_sector)
+{
+    return ecrypt_scell_sectors(master_key,
+                                master_key_length,
+                                context,
+                                context_length,
+                                sector_number,
+                                encrypted_sector,
+                                sector_length,
+                                1,
+                                plain_sector,
+                                1,
+                                false);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_sectors(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* context,
+                                                   size_t context_length,
+                                                   uint64_t first_sector_number,
+                                                   const uint8_t* plain_sectors,
+                                                   size_t sector_length,
+                                                   size_t sector_count,
+                                                   uint8_t* encrypted_sectors,
+                                                   size_t thread_count)
+{
+    return ecrypt_scell_sectors(master_key,
+                                master_key_length,
+                                context,
+                                context_length,
+                                first_sector_number,
+                                plain_sectors,
+                                sector_length,
+                                sector_count,
+                                encrypted_sectors,
+                                thread_count,
+                                true);
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_sectors(const uint8_t* master_key,
+                                                   size_t master_key_length,
+                                                   const uint8_t* context,
+                                                   size_t context_length,
+                                                   uint64_t first_sector_number,
+                                                   const uint8_t* encrypted_sectors,
+                                                   size_t sector_length,
+                                                   size_t sector_count,
+                                                   uint8_t* plain_sectors,
+                                                   size_t thread_count)
+{
+    return ecrypt_scell_sectors(master_key,
+                                master_key_length,
+                                context,
+                                context_length,
+                                first_sector_number,
+                                encrypted_sectors,
+                                sector_length,
+                                sector_count,
+                                plain_sectors,
+                                thread_count,
+                                false);
+}
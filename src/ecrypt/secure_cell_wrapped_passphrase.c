@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ecconnect/ecconnect_rand.h>
+#include <ecconnect/ecconnect_wipe.h>
+
+#include "ecrypt/secure_cell.h"
+#include "ecrypt/secure_cell_seal_passphrase.h"
+#include "ecrypt/sym_enc_message.h"
+
+/*
+ * Key-wrapped passphrase cell is a concatenation of two cells:
+ *
+ *   - the header, a passphrase sealed cell with random data key as payload,
+ *   - the body, a master key sealed cell with the data key as master key.
+ *
+ * Both use the same associated context. Changing the passphrase rewrites
+ * only the header, the body stays the same.
+ */
+#define ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH (ECRYPT_AUTH_SYM_KEY_LENGTH / 8)
+
+/* Default header takes 102 bytes */
+#define ECRYPT_SCELL_WRAPPED_MAX_HEADER_LENGTH 128
+
+/* Only the fixed part of the passphrase token is needed to find its length */
+static ecrypt_status_t ecrypt_scell_wrapped_header_length(const uint8_t* encrypted_message,
+                                                          size_t encrypted_message_length,
+                                                          struct ecrypt_scell_auth_token_passphrase* hdr,
+                                                          size_t* header_length)
+{
+    uint64_t length = 0;
+
+    memset(hdr, 0, sizeof(*hdr));
+    if (encrypted_message_length < ecrypt_scell_auth_token_passphrase_min_size) {
+        return ECRYPT_FAIL;
+    }
+    stream_read_uint32LE(encrypted_message + 1 * sizeof(uint32_t), &hdr->iv_length);
+    stream_read_uint32LE(encrypted_message + 2 * sizeof(uint32_t), &hdr->auth_tag_length);
+    stream_read_uint32LE(encrypted_message + 3 * sizeof(uint32_t), &hdr->message_length);
+    stream_read_uint32LE(encrypted_message + 4 * sizeof(uint32_t), &hdr->kdf_context_length);
+
+    if (hdr->message_length != ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    length = ecrypt_scell_auth_token_passphrase_size(hdr) + hdr->message_length;
+    if (length > SIZE_MAX) {
+        return ECRYPT_FAIL;
+    }
+    *header_length = (size_t)length;
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_scell_wrapped_unwrap(const uint8_t* passphrase,
+                                                   size_t passphrase_length,
+                                                   const uint8_t* user_context,
+                                                   size_t user_context_length,
+                                                   const uint8_t* header,
+                                                   size_t header_length,
+                                                   uint8_t* data_key,
+                                                   uint32_t* iteration_count)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_passphrase hdr;
+    struct ecrypt_scell_pbkdf2_context kdf;
+    size_t data_key_length = ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH;
+    size_t token_length = header_length - ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&kdf, 0, sizeof(kdf));
+    res = ecrypt_read_scell_auth_token_passphrase(header, token_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (ecconnect_alg_kdf(hdr.alg) != ECCONNECT_SYM_PBKDF2) {
+        return ECRYPT_FAIL;
+    }
+    res = ecrypt_read_scell_pbkdf2_context(&hdr, &kdf);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (iteration_count) {
+        *iteration_count = kdf.iteration_count;
+    }
+
+    res = ecrypt_auth_sym_decrypt_message_with_passphrase(passphrase,
+                                                          passphrase_length,
+                                                          user_context,
+                                                          user_context_length,
+                                                          header,
+                                                          token_length,
+                                                          header + token_length,
+                                                          ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH,
+                                                          data_key,
+                                                          &data_key_length);
+    if (res == ECRYPT_SUCCESS && data_key_length != ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH) {
+        res = ECRYPT_FAIL;
+    }
+    return res;
+}
+
+static ecrypt_status_t ecrypt_scell_wrapped_wrap(const uint8_t* passphrase,
+                                                 size_t passphrase_length,
+                                                 const uint8_t* user_context,
+                                                 size_t user_context_length,
+                                                 const uint8_t* data_key,
+                                                 uint32_t iteration_count,
+                                                 uint8_t* header,
+                                                 size_t header_length)
+{
+    size_t token_length = ecrypt_scell_auth_token_passphrase_default_size();
+    size_t wrapped_key_length = ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH;
+
+    if (header_length != token_length + wrapped_key_length) {
+        return ECRYPT_FAIL;
+    }
+
+    return ecrypt_auth_sym_encrypt_message_with_passphrase_ex(passphrase,
+                                                              passphrase_length,
+                                                              data_key,
+                                                              ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH,
+                                                              user_context,
+                                                              user_context_length,
+                                                              header,
+                                                              &token_length,
+                                                              header + token_length,
+                                                              &wrapped_key_length,
+                                                              iteration_count);
+}
+
+ecrypt_status_t ecrypt_secure_cell_encrypt_seal_with_wrapped_passphrase(const uint8_t* passphrase,
+                                                                        size_t passphrase_length,
+                                                                        const uint8_t* user_context,
+                                                                        size_t user_context_length,
+                                                                        const uint8_t* message,
+                                                                        size_t message_length,
+                                                                        uint8_t* encrypted_message,
+                                                                        size_t* encrypted_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t data_key[ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH] = {0};
+    size_t header_length = ecrypt_scell_auth_token_passphrase_default_size()
+                           + ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH;
+    size_t body_length = 0;
+
+    ECRYPT_CHECK_PARAM(passphrase != NULL && passphrase_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    /* Body length does not depend on the key, any non-empty one will do */
+    res = ecrypt_secure_cell_encrypt_seal(data_key,
+                                          sizeof(data_key),
+                                          user_context,
+                                          user_context_length,
+                                          message,
+                                          message_length,
+                                          NULL,
+                                          &body_length);
+    if (res != ECRYPT_BUFFER_TOO_SMALL) {
+        return res;
+    }
+    if (body_length > SIZE_MAX - header_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    if (!encrypted_message || *encrypted_message_length < header_length + body_length) {
+        *encrypted_message_length = header_length + body_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecconnect_rand(data_key, sizeof(data_key));
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_scell_wrapped_wrap(passphrase,
+                                    passphrase_length,
+                                    user_context,
+                                    user_context_length,
+                                    data_key,
+                                    ECRYPT_AUTH_SYM_PBKDF2_ITERATIONS,
+                                    encrypted_message,
+                                    header_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_secure_cell_encrypt_seal(data_key,
+                                          sizeof(data_key),
+                                          user_context,
+                                          user_context_length,
+                                          message,
+                                          message_length,
+                                          encrypted_message + header_length,
+                                          &body_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    *encrypted_message_length = header_length + body_length;
+
+error:
+    ecconnect_wipe(data_key, sizeof(data_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase(const uint8_t* passphrase,
+                                                                        size_t passphrase_length,
+                                                                        const uint8_t* user_context,
+                                                                        size_t user_context_length,
+                                                                        const uint8_t* encrypted_message,
+                                                                        size_t encrypted_message_length,
+                                                                        uint8_t* plain_message,
+                                                                        size_t* plain_message_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_passphrase hdr;
+    uint8_t data_key[ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH] = {0};
+    size_t header_length = 0;
+    uint32_t message_length = 0;
+
+    ECRYPT_CHECK_PARAM(passphrase != NULL && passphrase_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+    ECRYPT_CHECK_PARAM(plain_message_length != NULL);
+
+    res = ecrypt_scell_wrapped_header_length(encrypted_message, encrypted_message_length, &hdr, &header_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (encrypted_message_length <= header_length) {
+        return ECRYPT_FAIL;
+    }
+
+    /* Answer size queries without running PBKDF2 */
+    res = ecrypt_scell_auth_token_key_message_size(encrypted_message + header_length,
+                                                   encrypted_message_length - header_length,
+                                                   &message_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (!plain_message || *plain_message_length < message_length) {
+        *plain_message_length = message_length;
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+
+    res = ecrypt_scell_wrapped_unwrap(passphrase,
+                                      passphrase_length,
+                                      user_context,
+                                      user_context_length,
+                                      encrypted_message,
+                                      header_length,
+                                      data_key,
+                                      NULL);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_secure_cell_decrypt_seal(data_key,
+                                          sizeof(data_key),
+                                          user_context,
+                                          user_context_length,
+                                          encrypted_message + header_length,
+                                          encrypted_message_length - header_length,
+                                          plain_message,
+                                          plain_message_length);
+
+error:
+    ecconnect_wipe(data_key, sizeof(data_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_secure_cell_wrapped_passphrase_header_length(const uint8_t* encrypted_message,
+                                                                    size_t encrypted_message_length,
+                                                                    size_t* header_length)
+{
+    struct ecrypt_scell_auth_token_passphrase hdr;
+
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL);
+    ECRYPT_CHECK_PARAM(header_length != NULL);
+
+    return ecrypt_scell_wrapped_header_length(encrypted_message, encrypted_message_length, &hdr, header_length);
+}
+
+ecrypt_status_t ecrypt_secure_cell_rewrap_passphrase(const uint8_t* old_passphrase,
+                                                     size_t old_passphrase_length,
+                                                     const uint8_t* new_passphrase,
+                                                     size_t new_passphrase_length,
+                                                     const uint8_t* user_context,
+                                                     size_t user_context_length,
+                                                     uint8_t* header,
+                                                     size_t header_length)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_passphrase hdr;
+    uint8_t data_key[ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH] = {0};
+    uint8_t new_header[ECRYPT_SCELL_WRAPPED_MAX_HEADER_LENGTH] = {0};
+    size_t expected_length = 0;
+    uint32_t iteration_count = 0;
+
+    ECRYPT_CHECK_PARAM(old_passphrase != NULL && old_passphrase_length != 0);
+    ECRYPT_CHECK_PARAM(new_passphrase != NULL && new_passphrase_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(header != NULL && header_length != 0);
+
+    res = ecrypt_scell_wrapped_header_length(header, header_length, &hdr, &expected_length);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    if (header_length != expected_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    /* The header is rewritten in place, so its length must not change */
+    if (header_length != ecrypt_scell_auth_token_passphrase_default_size() + ECRYPT_SCELL_WRAPPED_DATA_KEY_LENGTH
+        || header_length > sizeof(new_header)) {
+        return ECRYPT_FAIL;
+    }
+
+    res = ecrypt_scell_wrapped_unwrap(old_passphrase,
+                                      old_passphrase_length,
+                                      user_context,
+                                      user_context_length,
+                                      header,
+                                      header_length,
+                                      data_key,
+                                      &iteration_count);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Keep the work factor chosen when the cell was created */
+    res = ecrypt_scell_wrapped_wrap(new_passphrase,
+                                    new_passphrase_length,
+                                    user_context,
+                                    user_context_length,
+                                    data_key,
+                                    iteration_count,
+                                    new_header,
+                                    header_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    /* Old header stays intact if anything fails */
+    memcpy(header, new_header, header_length);
+
+error:
+    ecconnect_wipe(data_key, sizeof(data_key));
+    ecconnect_wipe(new_header, sizeof(new_header));
+
+    return res;
+}
@@ -16,6 +16,8 @@
 
 #include "ecrypt/secure_message.h"
 
+#include <string.h>
+
 #include "ecrypt/secure_keygen.h"
 #include "ecrypt/secure_message_wrapper.h"
 
@@ -181,6 +183,126 @@ ecrypt_status_t ecrypt_secure_message_verify(const uint8_t* public_key,
     return status;
 }
 
+ecrypt_status_t ecrypt_secure_message_encrypt_output_size(const uint8_t* public_key,
+                                                          size_t public_key_length,
+                                                          size_t message_length,
+                                                          size_t* encrypted_message_length)
+{
+    ECRYPT_CHECK_PARAM(public_key != NULL && public_key_length != 0);
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+
+    return ecrypt_secure_message_encrypted_size(public_key,
+                                                public_key_length,
+                                                message_length,
+                                                encrypted_message_length);
+}
+
+ecrypt_status_t ecrypt_secure_message_sign_output_size(const uint8_t* private_key,
+                                                       size_t private_key_length,
+                                                       size_t message_length,
+                                                       size_t* signed_message_length)
+{
+    ECRYPT_CHECK_PARAM(private_key != NULL && private_key_length != 0);
+    ECRYPT_CHECK_PARAM(message_length != 0);
+    ECRYPT_CHECK_PARAM(signed_message_length != NULL);
+
+    return ecrypt_secure_message_signed_size(private_key,
+                                             private_key_length,
+                                             message_length,
+                                             signed_message_length);
+}
+
+static ecrypt_status_t ecrypt_secure_message_inspect_signed(const uint8_t* message,
+                                                            size_t message_length,
+                                                            ecrypt_secure_message_info_t* info)
+{
+    ecrypt_secure_signed_message_hdr_t hdr;
+    uint64_t total_length = sizeof(hdr);
+
+    if (message_length < sizeof(hdr)) {
+        return ECRYPT_FAIL;
+    }
+    memcpy(&hdr, message, sizeof(hdr));
+    /* Add separately to avoid overflows in intermediate calculations */
+    total_length += hdr.message_hdr.message_length;
+    total_length += hdr.signature_length;
+    if (message_length < total_length) {
+        return ECRYPT_FAIL;
+    }
+    info->message_length = hdr.message_hdr.message_length;
+    info->signature_length = hdr.signature_length;
+    return ECRYPT_SUCCESS;
+}
+
+static ecrypt_status_t ecrypt_secure_message_inspect_encrypted(const uint8_t* message,
+                                                               size_t message_length,
+                                                               size_t cell_offset,
+                                                               ecrypt_secure_message_info_t* info)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    ecrypt_secure_encrypted_message_hdr_t hdr;
+
+    memcpy(&hdr, message, sizeof(hdr));
+    if (hdr.message_hdr.message_length != message_length || cell_offset >= message_length) {
+        return ECRYPT_FAIL;
+    }
+    res = ecrypt_secure_cell_inspect(message + cell_offset, message_length - cell_offset, &info->cell);
+    if (res != ECRYPT_SUCCESS) {
+        return ECRYPT_FAIL;
+    }
+    info->message_length = info->cell.message_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_message_inspect(const uint8_t* message,
+                                              size_t message_length,
+                                              ecrypt_secure_message_info_t* info)
+{
+    ecrypt_secure_message_hdr_t hdr;
+    ecrypt_secure_rsa_encrypted_message_hdr_t rsa_hdr;
+
+    ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
+    ECRYPT_CHECK_PARAM(info != NULL);
+
+    memset(info, 0, sizeof(*info));
+    if (message_length < sizeof(hdr)) {
+        return ECRYPT_FAIL;
+    }
+    memcpy(&hdr, message, sizeof(hdr));
+
+    switch (hdr.message_type) {
+    case ECRYPT_SECURE_MESSAGE_EC_SIGNED:
+        info->kind = ECRYPT_SECURE_MESSAGE_KIND_EC_SIGNED;
+        return ecrypt_secure_message_inspect_signed(message, message_length, info);
+    case ECRYPT_SECURE_MESSAGE_RSA_SIGNED:
+        info->kind = ECRYPT_SECURE_MESSAGE_KIND_RSA_SIGNED;
+        return ecrypt_secure_message_inspect_signed(message, message_length, info);
+    case ECRYPT_SECURE_MESSAGE_EC_ENCRYPTED:
+        info->kind = ECRYPT_SECURE_MESSAGE_KIND_EC_ENCRYPTED;
+        return ecrypt_secure_message_inspect_encrypted(message,
+                                                       message_length,
+                                                       sizeof(ecrypt_secure_encrypted_message_hdr_t),
+                                                       info);
+    case ECRYPT_SECURE_MESSAGE_RSA_ENCRYPTED:
+        info->kind = ECRYPT_SECURE_MESSAGE_KIND_RSA_ENCRYPTED;
+        if (message_length < sizeof(rsa_hdr)) {
+            return ECRYPT_FAIL;
+        }
+        memcpy(&rsa_hdr, message, sizeof(rsa_hdr));
+        /* Encrypted symmetric key precedes the cell */
+        if (rsa_hdr.encrypted_passwd_length > message_length - sizeof(rsa_hdr)) {
+            return ECRYPT_FAIL;
+        }
+        return ecrypt_secure_message_inspect_encrypted(message,
+                                                       message_length,
+                                                       sizeof(rsa_hdr) + rsa_hdr.encrypted_passwd_length,
+                                                       info);
+    default:
+        return ECRYPT_FAIL;
+    }
+}
+
 /*
  * ecrypt_secure_message_wrap() and ecrypt_secure_message_unwrap() functions
  * are deprecated in favor of more specific ecrypt_secure_message_encrypt()
@@ -242,11 +242,6 @@ ecrypt_secure_message_rsa_encrypter_t* ecrypt_secure_message_rsa_encrypter_init(
     return ctx;
 }
 
-typedef struct ecrypt_secure_rsa_encrypted_message_hdr_type {
-    ecrypt_secure_encrypted_message_hdr_t msg;
-    uint32_t encrypted_passwd_length;
-} ecrypt_secure_rsa_encrypted_message_hdr_t;
-
 ecrypt_status_t ecrypt_secure_message_rsa_encrypter_proceed(ecrypt_secure_message_rsa_encrypter_t* ctx,
                                                             const uint8_t* message,
                                                             const size_t message_length,
@@ -257,9 +252,8 @@ ecrypt_status_t ecrypt_secure_message_rsa_encrypter_proceed(ecrypt_secure_messag
     size_t seal_message_length = 0;
     ECRYPT_CHECK(ecconnect_asym_cipher_encrypt(ctx->asym_cipher, (const uint8_t*)"123", 3, NULL, &symm_passwd_length)
                  == ECRYPT_BUFFER_TOO_SMALL);
-    ECRYPT_CHECK(
-        ecrypt_secure_cell_encrypt_seal((const uint8_t*)"123", 3, NULL, 0, message, message_length, NULL, &seal_message_length)
-        == ECRYPT_BUFFER_TOO_SMALL);
+    ECRYPT_CHECK(ecrypt_secure_cell_seal_output_size(message_length, 0, &seal_message_length)
+                 == ECRYPT_SUCCESS);
     if (wrapped_message == NULL
         || (*wrapped_message_length) < (sizeof(ecrypt_secure_rsa_encrypted_message_hdr_t)
                                         + symm_passwd_length + seal_message_length)) {
@@ -445,16 +439,8 @@ ecrypt_status_t ecrypt_secure_message_ec_encrypter_proceed(ecrypt_secure_message
 {
     ECRYPT_CHECK_PARAM(ctx != NULL);
     size_t encrypted_message_length = 0;
-    ECRYPT_CHECK(ecrypt_secure_cell_encrypt_seal(ctx->shared_secret,
-                                                 ctx->shared_secret_length,
-                                                 NULL,
-                                                 0,
-                                                 message,
-                                                 message_length,
-                                                 NULL,
-                                                 &encrypted_message_length)
-                     == ECRYPT_BUFFER_TOO_SMALL
-                 && encrypted_message_length != 0);
+    ECRYPT_CHECK(ecrypt_secure_cell_seal_output_size(message_length, 0, &encrypted_message_length)
+                 == ECRYPT_SUCCESS);
     if (wrapped_message == NULL
         || (*wrapped_message_length)
                < (sizeof(ecrypt_secure_encrypted_message_hdr_t) + encrypted_message_length)) {
@@ -706,3 +692,107 @@ ecrypt_status_t ecrypt_secure_message_decrypter_destroy(ecrypt_secure_message_de
     }
     return res;
 }
+
+/* Length of RSA modulus or EC group order in bits, zero for unknown keys */
+static size_t ecrypt_secure_message_key_bits(const uint8_t* key, size_t key_length, ecconnect_sign_alg_t alg)
+{
+    const ecconnect_container_hdr_t* hdr = (const ecconnect_container_hdr_t*)key;
+
+    if (key_length < sizeof(ecconnect_container_hdr_t)) {
+        return 0;
+    }
+    switch (alg) {
+    case ECCONNECT_SIGN_ecdsa_none_pkcs8:
+        switch (hdr->tag[3]) {
+        case EC_SIZE_TAG_256:
+            return 256;
+        case EC_SIZE_TAG_384:
+            return 384;
+        case EC_SIZE_TAG_521:
+            return 521;
+        default:
+            return 0;
+        }
+    case ECCONNECT_SIGN_rsa_pss_pkcs8:
+        switch (hdr->tag[3]) {
+        case RSA_SIZE_TAG_1024:
+            return 1024;
+        case RSA_SIZE_TAG_2048:
+            return 2048;
+        case RSA_SIZE_TAG_4096:
+            return 4096;
+        case RSA_SIZE_TAG_8192:
+            return 8192;
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+/* Maximum length of DER-encoded ECDSA signature: SEQUENCE of two INTEGERs */
+static size_t ecrypt_secure_message_ecdsa_max_size(size_t key_bits)
+{
+    /* INTEGER needs a leading zero byte if its highest bit may be set */
+    size_t integer_size = 2 + EC_BYTE_SIZE(key_bits) + ((key_bits % 8 == 0) ? 1 : 0);
+    size_t content_size = 2 * integer_size;
+    return content_size + ((content_size < 128) ? 2 : 3);
+}
+
+ecrypt_status_t ecrypt_secure_message_signed_size(const uint8_t* private_key,
+                                                  size_t private_key_length,
+                                                  size_t message_length,
+                                                  size_t* wrapped_message_length)
+{
+    ecconnect_sign_alg_t alg = get_alg_id(private_key, private_key_length);
+    size_t key_bits = ecrypt_secure_message_key_bits(private_key, private_key_length, alg);
+    size_t signature_length = 0;
+
+    if (key_bits == 0) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    switch (alg) {
+    case ECCONNECT_SIGN_ecdsa_none_pkcs8:
+        signature_length = ecrypt_secure_message_ecdsa_max_size(key_bits);
+        break;
+    case ECCONNECT_SIGN_rsa_pss_pkcs8:
+        signature_length = RSA_BYTE_SIZE(key_bits);
+        break;
+    default:
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    *wrapped_message_length = sizeof(ecrypt_secure_signed_message_hdr_t) + message_length
+                              + signature_length;
+    return ECRYPT_SUCCESS;
+}
+
+ecrypt_status_t ecrypt_secure_message_encrypted_size(const uint8_t* peer_public_key,
+                                                     size_t peer_public_key_length,
+                                                     size_t message_length,
+                                                     size_t* wrapped_message_length)
+{
+    ecconnect_sign_alg_t alg = get_alg_id(peer_public_key, peer_public_key_length);
+    size_t key_bits = ecrypt_secure_message_key_bits(peer_public_key, peer_public_key_length, alg);
+    size_t seal_message_length = 0;
+
+    if (key_bits == 0) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    ECRYPT_STATUS_CHECK(ecrypt_secure_cell_seal_output_size(message_length, 0, &seal_message_length),
+                        ECRYPT_SUCCESS);
+
+    switch (alg) {
+    case ECCONNECT_SIGN_ecdsa_none_pkcs8:
+        *wrapped_message_length = sizeof(ecrypt_secure_encrypted_message_hdr_t) + seal_message_length;
+        return ECRYPT_SUCCESS;
+    case ECCONNECT_SIGN_rsa_pss_pkcs8:
+        /* OAEP ciphertext is as long as RSA modulus */
+        *wrapped_message_length = sizeof(ecrypt_secure_rsa_encrypted_message_hdr_t)
+                                  + RSA_BYTE_SIZE(key_bits) + seal_message_length;
+        return ECRYPT_SUCCESS;
+    default:
+        return ECRYPT_INVALID_PARAMETER;
+    }
+}
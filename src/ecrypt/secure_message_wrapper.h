@@ -54,6 +54,11 @@ typedef struct ecrypt_secure_encrypted_message_hdr_type {
     ecrypt_secure_message_hdr_t message_hdr;
 } ecrypt_secure_encrypted_message_hdr_t;
 
+typedef struct ecrypt_secure_rsa_encrypted_message_hdr_type {
+    ecrypt_secure_encrypted_message_hdr_t msg;
+    uint32_t encrypted_passwd_length;
+} ecrypt_secure_rsa_encrypted_message_hdr_t;
+
 struct ecrypt_secure_message_sign_worker_type {
     ecconnect_sign_ctx_t* sign_ctx;
 };
@@ -110,4 +115,17 @@ ecrypt_status_t ecrypt_secure_message_decrypter_proceed(ecrypt_secure_message_de
                                                         size_t* wrapped_message_length);
 ecrypt_status_t ecrypt_secure_message_decrypter_destroy(ecrypt_secure_message_decrypter_t* ctx);
 
+/*
+ * Lengths of messages produced with given keys, computed from key container
+ * tags alone. Signature length of ECDSA varies, maximum length is returned.
+ */
+ecrypt_status_t ecrypt_secure_message_signed_size(const uint8_t* private_key,
+                                                  size_t private_key_length,
+                                                  size_t message_length,
+                                                  size_t* wrapped_message_length);
+ecrypt_status_t ecrypt_secure_message_encrypted_size(const uint8_t* peer_public_key,
+                                                     size_t peer_public_key_length,
+                                                     size_t message_length,
+                                                     size_t* wrapped_message_length);
+
 #endif /* ECRYPT_SECURE_MESSAGE_WRAPPER_H */
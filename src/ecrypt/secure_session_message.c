@@ -95,6 +95,16 @@ ecrypt_status_t secure_session_wrap(secure_session_t* session_ctx,
     return ECRYPT_SUCCESS;
 }
 
+ecrypt_status_t secure_session_wrap_output_size(size_t message_length, size_t* wrapped_message_length)
+{
+    if ((0 == message_length) || (NULL == wrapped_message_length)) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+
+    *wrapped_message_length = WRAPPED_SIZE(message_length);
+    return ECRYPT_SUCCESS;
+}
+
 ecrypt_status_t secure_session_unwrap(secure_session_t* session_ctx,
                                       const void* wrapped_message,
                                       size_t wrapped_message_length,
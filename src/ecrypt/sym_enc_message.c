@@ -16,6 +16,7 @@
 
 #include "ecrypt/sym_enc_message.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <ecconnect/ecconnect.h>
@@ -23,9 +24,6 @@
 #include "ecrypt/secure_cell_alg.h"
 #include "ecrypt/ecrypt_portable_endian.h"
 
-#define ECRYPT_SYM_KDF_KEY_LABEL "Ecrypt secure cell message key"
-#define ECRYPT_SYM_KDF_IV_LABEL "Ecrypt secure cell message iv"
-
 ecrypt_status_t ecrypt_sym_kdf(const uint8_t* master_key,
                                const size_t master_key_length,
                                const char* label,
@@ -119,6 +117,32 @@ ecrypt_status_t ecrypt_auth_sym_plain_decrypt(uint32_t alg,
     return ECRYPT_SUCCESS;
 }
 
+ecrypt_status_t ecrypt_auth_sym_plain_verify(uint32_t alg,
+                                             const uint8_t* key,
+                                             const size_t key_length,
+                                             const uint8_t* iv,
+                                             const size_t iv_length,
+                                             const uint8_t* aad,
+                                             const size_t aad_length,
+                                             const uint8_t* encrypted_message,
+                                             const size_t encrypted_message_length,
+                                             const uint8_t* auth_tag,
+                                             const size_t auth_tag_length)
+{
+    ecconnect_status_t res = ecconnect_sym_aead_verify(alg,
+                                                       key,
+                                                       key_length,
+                                                       iv,
+                                                       iv_length,
+                                                       aad,
+                                                       aad_length,
+                                                       encrypted_message,
+                                                       encrypted_message_length,
+                                                       auth_tag,
+                                                       auth_tag_length);
+    return (res == ECCONNECT_SUCCESS) ? ECRYPT_SUCCESS : ECRYPT_FAIL;
+}
+
 ecrypt_status_t ecrypt_sym_plain_encrypt(uint32_t alg,
                                          const uint8_t* key,
                                          const size_t key_length,
@@ -177,12 +201,6 @@ ecrypt_status_t ecrypt_sym_plain_decrypt(uint32_t alg,
     return ECRYPT_SUCCESS;
 }
 
-static inline size_t default_auth_token_size(void)
-{
-    return ecrypt_scell_auth_token_key_min_size + ECRYPT_AUTH_SYM_IV_LENGTH
-           + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
-}
-
 ecrypt_status_t ecrypt_auth_sym_kdf_context(uint32_t message_length,
                                             uint8_t* kdf_context,
                                             size_t* kdf_context_length)
@@ -196,11 +214,35 @@ ecrypt_status_t ecrypt_auth_sym_kdf_context(uint32_t message_length,
     return ECRYPT_SUCCESS;
 }
 
+/*
+ * Compressed cells carry the marks and uncompressed length outside of AEAD
+ * input, so the whole algorithm ID and uncompressed length are added to KDF
+ * context. Stripping or adding any mark changes the key. Other cells use
+ * message length only, as before.
+ */
+ecrypt_status_t ecrypt_auth_sym_kdf_context_key(const struct ecrypt_scell_auth_token_key* hdr,
+                                                uint8_t* kdf_context,
+                                                size_t* kdf_context_length)
+{
+    if (!(hdr->marks & ECRYPT_AUTH_SYM_ALG_COMPRESSED)) {
+        return ecrypt_auth_sym_kdf_context(hdr->message_length, kdf_context, kdf_context_length);
+    }
+    if (*kdf_context_length < 3 * sizeof(uint32_t)) {
+        *kdf_context_length = 3 * sizeof(uint32_t);
+        return ECRYPT_BUFFER_TOO_SMALL;
+    }
+    kdf_context = stream_write_uint32LE(kdf_context, hdr->message_length);
+    kdf_context = stream_write_uint32LE(kdf_context, hdr->alg | hdr->marks);
+    stream_write_uint32LE(kdf_context, hdr->uncompressed_length);
+    *kdf_context_length = 3 * sizeof(uint32_t);
+    return ECRYPT_SUCCESS;
+}
+
 #ifdef SCELL_COMPAT
 /*
  * Ecrypt 0.9.6 incorrectly used 64-bit message length for this field.
  */
-static ecrypt_status_t ecrypt_auth_sym_kdf_context_compat(uint32_t message_length,
+ecrypt_status_t ecrypt_auth_sym_kdf_context_compat(uint32_t message_length,
                                                           uint8_t* kdf_context,
                                                           size_t* kdf_context_length)
 {
@@ -259,22 +301,25 @@ ecrypt_status_t ecrypt_auth_sym_derive_encryption_key(uint32_t ecconnect_alg,
     }
 }
 
-ecrypt_status_t ecrypt_auth_sym_encrypt_message_(const uint8_t* key,
-                                                 size_t key_length,
-                                                 const uint8_t* message,
-                                                 size_t message_length,
-                                                 const uint8_t* user_context,
-                                                 size_t user_context_length,
-                                                 uint8_t* auth_token,
-                                                 size_t* auth_token_length,
-                                                 uint8_t* encrypted_message,
-                                                 size_t* encrypted_message_length)
+static ecrypt_status_t ecrypt_auth_sym_encrypt_message_(const uint8_t* key,
+                                                        size_t key_length,
+                                                        const uint8_t* message,
+                                                        size_t message_length,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* aad,
+                                                        size_t aad_length,
+                                                        uint8_t* auth_token,
+                                                        size_t* auth_token_length,
+                                                        uint8_t* encrypted_message,
+                                                        size_t* encrypted_message_length,
+                                                        uint32_t flags)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
     uint8_t iv[ECRYPT_AUTH_SYM_IV_LENGTH] = {0};
     uint8_t auth_tag[ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH] = {0};
-    uint8_t derived_key[ECRYPT_AUTH_SYM_KEY_LENGTH / 8] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
     size_t kdf_context_length = sizeof(kdf_context);
     size_t derived_key_length = sizeof(derived_key);
     size_t auth_token_real_length = 0;
@@ -286,14 +331,42 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_(const uint8_t* key,
     }
 
     memset(&hdr, 0, sizeof(hdr));
-    hdr.alg = ECRYPT_AUTH_SYM_ALG;
+    hdr.alg = ecrypt_auth_sym_encryption_alg(flags);
     hdr.iv = iv;
     hdr.iv_length = sizeof(iv);
     hdr.auth_tag = auth_tag;
     hdr.auth_tag_length = sizeof(auth_tag);
+    hdr.compact = (flags & ECRYPT_SCELL_FLAG_COMPACT) != 0;
+
+    /*
+     * Compressed message takes place of the plaintext and is encrypted in place.
+     * Messages which do not get shorter than the length field are stored as is,
+     * without compression mark.
+     */
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        size_t compressed_length = *encrypted_message_length;
+        res = ecrypt_scell_lz_compress(message, message_length, encrypted_message, &compressed_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        if (compressed_length + sizeof(uint32_t) >= message_length) {
+            ecconnect_wipe(encrypted_message, compressed_length);
+            flags &= ~ECRYPT_SCELL_FLAG_COMPRESS;
+        } else {
+            hdr.uncompressed_length = (uint32_t)message_length;
+            message = encrypted_message;
+            message_length = compressed_length;
+        }
+    }
     hdr.message_length = (uint32_t)message_length;
+    if (flags & ECRYPT_SCELL_FLAG_MARK_KDF) {
+        hdr.marks |= ECRYPT_AUTH_SYM_ALG_KDF_CURRENT;
+    }
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        hdr.marks |= ECRYPT_AUTH_SYM_ALG_COMPRESSED;
+    }
 
-    res = ecrypt_auth_sym_kdf_context(hdr.message_length, kdf_context, &kdf_context_length);
+    res = ecrypt_auth_sym_kdf_context_key(&hdr, kdf_context, &kdf_context_length);
     if (res != ECRYPT_SUCCESS) {
         goto error;
     }
@@ -320,8 +393,8 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_(const uint8_t* key,
                                         derived_key_length,
                                         hdr.iv,
                                         hdr.iv_length,
-                                        user_context,
-                                        user_context_length,
+                                        aad,
+                                        aad_length,
                                         message,
                                         message_length,
                                         encrypted_message,
@@ -332,6 +405,8 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message_(const uint8_t* key,
         goto error;
     }
 
+    hdr.alg |= hdr.marks;
+
     /* In valid Secure Cells auth token length always fits into uint32_t. */
     auth_token_real_length = (uint32_t)ecrypt_scell_auth_token_key_size(&hdr);
 
@@ -355,31 +430,49 @@ error:
     return res;
 }
 
-ecrypt_status_t ecrypt_auth_sym_encrypt_message(const uint8_t* key,
-                                                size_t key_length,
-                                                const uint8_t* message,
-                                                size_t message_length,
-                                                const uint8_t* user_context,
-                                                size_t user_context_length,
-                                                uint8_t* auth_token,
-                                                size_t* auth_token_length,
-                                                uint8_t* encrypted_message,
-                                                size_t* encrypted_message_length)
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_aad(const uint8_t* key,
+                                                    size_t key_length,
+                                                    const uint8_t* message,
+                                                    size_t message_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    uint8_t* auth_token,
+                                                    size_t* auth_token_length,
+                                                    uint8_t* encrypted_message,
+                                                    size_t* encrypted_message_length,
+                                                    uint32_t flags)
 {
     ECRYPT_CHECK_PARAM(key != NULL && key_length != 0);
     ECRYPT_CHECK_PARAM(message != NULL && message_length != 0);
     if (user_context_length != 0) {
         ECRYPT_CHECK_PARAM(user_context != NULL);
     }
+    if (aad_length != 0) {
+        ECRYPT_CHECK_PARAM(aad != NULL);
+    }
     ECRYPT_CHECK_PARAM(auth_token_length != NULL);
     ECRYPT_CHECK_PARAM(encrypted_message_length != NULL);
+    /* Key ID is computed by keyed contexts, raw keys have none */
+    ECRYPT_CHECK_PARAM(!(flags & ECRYPT_SCELL_FLAG_KEY_ID));
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        /* Compact tokens have no room for uncompressed length */
+        ECRYPT_CHECK_PARAM(!(flags & ECRYPT_SCELL_FLAG_COMPACT));
+    }
 
-    if (!auth_token_length || !encrypted_message || *auth_token_length < default_auth_token_size()
-        || *encrypted_message_length < message_length) {
-        *auth_token_length = default_auth_token_size();
-        *encrypted_message_length = message_length;
+    if (!auth_token_length || !encrypted_message
+        || *auth_token_length < ecrypt_scell_auth_token_key_flags_size(flags, message_length)
+        || *encrypted_message_length < ecrypt_scell_ciphertext_max_size(flags, message_length)) {
+        *auth_token_length = ecrypt_scell_auth_token_key_flags_size(flags, message_length);
+        *encrypted_message_length = (size_t)ecrypt_scell_ciphertext_max_size(flags, message_length);
         return ECRYPT_BUFFER_TOO_SMALL;
     }
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        /* Compression writes into the output before encryption */
+        ECRYPT_CHECK_PARAM(encrypted_message + *encrypted_message_length <= message
+                           || message + message_length <= encrypted_message);
+    }
 
     return ecrypt_auth_sym_encrypt_message_(key,
                                             key_length,
@@ -387,22 +480,56 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message(const uint8_t* key,
                                             message_length,
                                             user_context,
                                             user_context_length,
+                                            aad,
+                                            aad_length,
                                             auth_token,
                                             auth_token_length,
                                             encrypted_message,
-                                            encrypted_message_length);
+                                            encrypted_message_length,
+                                            flags);
 }
 
-ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
-                                                 size_t key_length,
-                                                 const uint8_t* user_context,
-                                                 size_t user_context_length,
-                                                 const uint8_t* auth_token,
-                                                 size_t auth_token_length,
-                                                 const uint8_t* encrypted_message,
-                                                 const size_t encrypted_message_length,
-                                                 uint8_t* message,
-                                                 size_t* message_length)
+ecrypt_status_t ecrypt_auth_sym_encrypt_message(const uint8_t* key,
+                                                size_t key_length,
+                                                const uint8_t* message,
+                                                size_t message_length,
+                                                const uint8_t* user_context,
+                                                size_t user_context_length,
+                                                uint8_t* auth_token,
+                                                size_t* auth_token_length,
+                                                uint8_t* encrypted_message,
+                                                size_t* encrypted_message_length,
+                                                uint32_t flags)
+{
+    /* User context is used both for key derivation and as associated data */
+    return ecrypt_auth_sym_encrypt_message_aad(key,
+                                               key_length,
+                                               message,
+                                               message_length,
+                                               user_context,
+                                               user_context_length,
+                                               user_context,
+                                               user_context_length,
+                                               auth_token,
+                                               auth_token_length,
+                                               encrypted_message,
+                                               encrypted_message_length,
+                                               flags);
+}
+
+static ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
+                                                        size_t key_length,
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* aad,
+                                                        size_t aad_length,
+                                                        const uint8_t* auth_token,
+                                                        size_t auth_token_length,
+                                                        const uint8_t* encrypted_message,
+                                                        const size_t encrypted_message_length,
+                                                        uint8_t* message,
+                                                        size_t* message_length,
+                                                        uint32_t flags)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     struct ecrypt_scell_auth_token_key hdr;
@@ -411,6 +538,9 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
     uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
     size_t kdf_context_length = sizeof(kdf_context);
     size_t derived_key_length = sizeof(derived_key);
+    uint8_t* compressed = NULL;
+    uint8_t* plain = message;
+    size_t plain_length = *message_length;
 
     memset(&hdr, 0, sizeof(hdr));
     res = ecrypt_read_scell_auth_token_key(auth_token, auth_token_length, &hdr);
@@ -418,6 +548,9 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
         return res;
     }
 
+    /* Marked cells are known to use current KDF, no need for trial decryption */
+    flags |= ecrypt_scell_auth_token_key_strip_marks(&hdr);
+
     /* Check that message header is consistent with our expectations */
     if (hdr.message_length != encrypted_message_length) {
         return ECRYPT_FAIL;
@@ -426,7 +559,21 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
         return ECRYPT_FAIL;
     }
 
-    res = ecrypt_auth_sym_kdf_context(hdr.message_length, kdf_context, &kdf_context_length);
+    /* Compressed message is decrypted into temporary buffer first */
+    if (hdr.uncompressed_length != 0) {
+        if (*message_length < hdr.uncompressed_length) {
+            *message_length = hdr.uncompressed_length;
+            return ECRYPT_BUFFER_TOO_SMALL;
+        }
+        compressed = malloc(hdr.message_length);
+        if (!compressed) {
+            return ECRYPT_NO_MEMORY;
+        }
+        plain = compressed;
+        plain_length = hdr.message_length;
+    }
+
+    res = ecrypt_auth_sym_kdf_context_key(&hdr, kdf_context, &kdf_context_length);
     if (res != ECRYPT_SUCCESS) {
         goto error;
     }
@@ -443,25 +590,45 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
         goto error;
     }
 
-    res = ecrypt_auth_sym_plain_decrypt(hdr.alg,
-                                        derived_key,
-                                        derived_key_length,
-                                        hdr.iv,
-                                        hdr.iv_length,
-                                        user_context,
-                                        user_context_length,
-                                        encrypted_message,
-                                        encrypted_message_length,
-                                        message,
-                                        message_length,
-                                        hdr.auth_tag,
-                                        hdr.auth_tag_length);
+    /*
+     * In-place decryption overwrites the ciphertext before the tag is checked.
+     * Verify the tag first so that failed attempts (with a wrong key, context,
+     * or KDF) leave the caller's data intact.
+     */
+    if (plain == encrypted_message) {
+        res = ecrypt_auth_sym_plain_verify(hdr.alg,
+                                           derived_key,
+                                           derived_key_length,
+                                           hdr.iv,
+                                           hdr.iv_length,
+                                           aad,
+                                           aad_length,
+                                           encrypted_message,
+                                           encrypted_message_length,
+                                           hdr.auth_tag,
+                                           hdr.auth_tag_length);
+    }
+    if (res == ECRYPT_SUCCESS) {
+        res = ecrypt_auth_sym_plain_decrypt(hdr.alg,
+                                            derived_key,
+                                            derived_key_length,
+                                            hdr.iv,
+                                            hdr.iv_length,
+                                            aad,
+                                            aad_length,
+                                            encrypted_message,
+                                            encrypted_message_length,
+                                            plain,
+                                            &plain_length,
+                                            hdr.auth_tag,
+                                            hdr.auth_tag_length);
+    }
     /*
      * Ecrypt 0.9.6 used slightly different KDF. If decryption fails,
      * maybe it was encrypted with that incorrect key. Try it out.
      */
 #ifdef SCELL_COMPAT
-    if (res != ECRYPT_SUCCESS && res != ECRYPT_BUFFER_TOO_SMALL) {
+    if (res != ECRYPT_SUCCESS && res != ECRYPT_BUFFER_TOO_SMALL && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
         kdf_context_length = sizeof(kdf_context);
         res = ecrypt_auth_sym_kdf_context_compat(hdr.message_length, kdf_context, &kdf_context_length);
         if (res != ECRYPT_SUCCESS) {
@@ -479,44 +646,81 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message_(const uint8_t* key,
         if (res != ECRYPT_SUCCESS) {
             goto error;
         }
-        res = ecrypt_auth_sym_plain_decrypt(hdr.alg,
-                                            derived_key,
-                                            derived_key_length,
-                                            hdr.iv,
-                                            hdr.iv_length,
-                                            user_context,
-                                            user_context_length,
-                                            encrypted_message,
-                                            encrypted_message_length,
-                                            message,
-                                            message_length,
-                                            hdr.auth_tag,
-                                            hdr.auth_tag_length);
+        if (plain == encrypted_message) {
+            res = ecrypt_auth_sym_plain_verify(hdr.alg,
+                                               derived_key,
+                                               derived_key_length,
+                                               hdr.iv,
+                                               hdr.iv_length,
+                                               aad,
+                                               aad_length,
+                                               encrypted_message,
+                                               encrypted_message_length,
+                                               hdr.auth_tag,
+                                               hdr.auth_tag_length);
+        }
+        if (res == ECRYPT_SUCCESS) {
+            res = ecrypt_auth_sym_plain_decrypt(hdr.alg,
+                                                derived_key,
+                                                derived_key_length,
+                                                hdr.iv,
+                                                hdr.iv_length,
+                                                aad,
+                                                aad_length,
+                                                encrypted_message,
+                                                encrypted_message_length,
+                                                plain,
+                                                &plain_length,
+                                                hdr.auth_tag,
+                                                hdr.auth_tag_length);
+        }
     }
+#else
+    UNUSED(flags);
 #endif
 
+    if (!compressed) {
+        *message_length = plain_length;
+    }
+
     /* Sanity check of resulting message length */
-    if (*message_length != encrypted_message_length) {
+    if (plain_length != encrypted_message_length) {
         res = ECRYPT_FAIL;
         goto error;
     }
 
+    if (compressed && res == ECRYPT_SUCCESS) {
+        /* Message must decompress to exactly the declared length */
+        *message_length = hdr.uncompressed_length;
+        res = ecrypt_scell_lz_decompress(compressed, plain_length, message, message_length);
+        if (res == ECRYPT_SUCCESS && *message_length != hdr.uncompressed_length) {
+            res = ECRYPT_FAIL;
+        }
+    }
+
 error:
     ecconnect_wipe(derived_key, sizeof(derived_key));
+    if (compressed) {
+        ecconnect_wipe(compressed, hdr.message_length);
+        free(compressed);
+    }
 
     return res;
 }
 
-ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
-                                                size_t key_length,
-                                                const uint8_t* user_context,
-                                                size_t user_context_length,
-                                                const uint8_t* auth_token,
-                                                size_t auth_token_length,
-                                                const uint8_t* encrypted_message,
-                                                size_t encrypted_message_length,
-                                                uint8_t* message,
-                                                size_t* message_length)
+ecrypt_status_t ecrypt_auth_sym_decrypt_message_aad(const uint8_t* key,
+                                                    size_t key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    const uint8_t* auth_token,
+                                                    size_t auth_token_length,
+                                                    const uint8_t* encrypted_message,
+                                                    size_t encrypted_message_length,
+                                                    uint8_t* message,
+                                                    size_t* message_length,
+                                                    uint32_t flags)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint32_t expected_message_length = 0;
@@ -525,6 +729,9 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
     if (user_context_length != 0) {
         ECRYPT_CHECK_PARAM(user_context != NULL);
     }
+    if (aad_length != 0) {
+        ECRYPT_CHECK_PARAM(aad != NULL);
+    }
     ECRYPT_CHECK_PARAM(auth_token != NULL && auth_token_length != 0);
     ECRYPT_CHECK_PARAM(message_length != NULL);
 
@@ -545,19 +752,159 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
                                             key_length,
                                             user_context,
                                             user_context_length,
+                                            aad,
+                                            aad_length,
                                             auth_token,
                                             auth_token_length,
                                             encrypted_message,
                                             encrypted_message_length,
                                             message,
-                                            message_length);
+                                            message_length,
+                                            flags);
 }
 
-static ecrypt_status_t ecrypt_sym_derive_encryption_key(const uint8_t* key,
+ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
+                                                size_t key_length,
+                                                const uint8_t* user_context,
+                                                size_t user_context_length,
+                                                const uint8_t* auth_token,
+                                                size_t auth_token_length,
+                                                const uint8_t* encrypted_message,
+                                                size_t encrypted_message_length,
+                                                uint8_t* message,
+                                                size_t* message_length,
+                                                uint32_t flags)
+{
+    return ecrypt_auth_sym_decrypt_message_aad(key,
+                                               key_length,
+                                               user_context,
+                                               user_context_length,
+                                               user_context,
+                                               user_context_length,
+                                               auth_token,
+                                               auth_token_length,
+                                               encrypted_message,
+                                               encrypted_message_length,
+                                               message,
+                                               message_length,
+                                               flags);
+}
+
+static ecrypt_status_t ecrypt_auth_sym_verify_message_(const struct ecrypt_scell_auth_token_key* hdr,
+                                                        const uint8_t* key,
                                                         size_t key_length,
-                                                        size_t message_length,
-                                                        uint8_t* derived_key,
-                                                        size_t derived_key_length)
+                                                        const uint8_t* user_context,
+                                                        size_t user_context_length,
+                                                        const uint8_t* encrypted_message,
+                                                        bool compat)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint8_t kdf_context[ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH] = {0};
+    uint8_t derived_key[ECRYPT_AUTH_SYM_MAX_KEY_LENGTH / 8] = {0};
+    size_t kdf_context_length = sizeof(kdf_context);
+    size_t derived_key_length = sizeof(derived_key);
+
+    if (compat) {
+#ifdef SCELL_COMPAT
+        res = ecrypt_auth_sym_kdf_context_compat(hdr->message_length, kdf_context, &kdf_context_length);
+#else
+        res = ECRYPT_FAIL;
+#endif
+    } else {
+        res = ecrypt_auth_sym_kdf_context_key(hdr, kdf_context, &kdf_context_length);
+    }
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+    res = ecrypt_auth_sym_derive_encryption_key(hdr->alg,
+                                                key,
+                                                key_length,
+                                                kdf_context,
+                                                kdf_context_length,
+                                                user_context,
+                                                user_context_length,
+                                                derived_key,
+                                                &derived_key_length);
+    if (res != ECRYPT_SUCCESS) {
+        goto error;
+    }
+
+    res = ecrypt_auth_sym_plain_verify(hdr->alg,
+                                       derived_key,
+                                       derived_key_length,
+                                       hdr->iv,
+                                       hdr->iv_length,
+                                       user_context,
+                                       user_context_length,
+                                       encrypted_message,
+                                       hdr->message_length,
+                                       hdr->auth_tag,
+                                       hdr->auth_tag_length);
+
+error:
+    ecconnect_wipe(derived_key, sizeof(derived_key));
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_auth_sym_verify_message(const uint8_t* key,
+                                               size_t key_length,
+                                               const uint8_t* user_context,
+                                               size_t user_context_length,
+                                               const uint8_t* auth_token,
+                                               size_t auth_token_length,
+                                               const uint8_t* encrypted_message,
+                                               size_t encrypted_message_length,
+                                               uint32_t flags)
+{
+    ecrypt_status_t res = ECRYPT_FAIL;
+    struct ecrypt_scell_auth_token_key hdr;
+
+    ECRYPT_CHECK_PARAM(key != NULL && key_length != 0);
+    if (user_context_length != 0) {
+        ECRYPT_CHECK_PARAM(user_context != NULL);
+    }
+    ECRYPT_CHECK_PARAM(auth_token != NULL && auth_token_length != 0);
+    ECRYPT_CHECK_PARAM(encrypted_message != NULL && encrypted_message_length != 0);
+
+    memset(&hdr, 0, sizeof(hdr));
+    res = ecrypt_read_scell_auth_token_key(auth_token, auth_token_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    flags |= ecrypt_scell_auth_token_key_strip_marks(&hdr);
+
+    if (hdr.message_length != encrypted_message_length) {
+        return ECRYPT_FAIL;
+    }
+    if (!ecconnect_alg_reserved_bits_valid(hdr.alg)) {
+        return ECRYPT_FAIL;
+    }
+
+    res = ecrypt_auth_sym_verify_message_(&hdr, key, key_length, user_context, user_context_length, encrypted_message, false);
+    /* See ecrypt_auth_sym_decrypt_message_() */
+#ifdef SCELL_COMPAT
+    if (res != ECRYPT_SUCCESS && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
+        res = ecrypt_auth_sym_verify_message_(&hdr,
+                                              key,
+                                              key_length,
+                                              user_context,
+                                              user_context_length,
+                                              encrypted_message,
+                                              true);
+    }
+#else
+    UNUSED(flags);
+#endif
+
+    return res;
+}
+
+ecrypt_status_t ecrypt_sym_derive_encryption_key(const uint8_t* key,
+                                                 size_t key_length,
+                                                 size_t message_length,
+                                                 uint8_t* derived_key,
+                                                 size_t derived_key_length)
 {
     uint8_t kdf_context[sizeof(uint32_t)];
     /*
@@ -601,12 +948,12 @@ static ecrypt_status_t ecrypt_sym_derive_encryption_key_compat(const uint8_t* ke
 }
 #endif
 
-static ecrypt_status_t ecrypt_sym_derive_encryption_iv(const uint8_t* key,
-                                                       size_t key_length,
-                                                       const uint8_t* context,
-                                                       size_t context_length,
-                                                       uint8_t* iv,
-                                                       size_t iv_length)
+ecrypt_status_t ecrypt_sym_derive_encryption_iv(const uint8_t* key,
+                                                size_t key_length,
+                                                const uint8_t* context,
+                                                size_t context_length,
+                                                uint8_t* iv,
+                                                size_t iv_length)
 {
     /*
      * Yes, you are reading it correct. We do derive IV with a KDF.
@@ -732,7 +1079,8 @@ ecrypt_status_t ecrypt_sym_decrypt_message_u(const uint8_t* key,
                                              const uint8_t* encrypted_message,
                                              const size_t encrypted_message_length,
                                              uint8_t* message,
-                                             size_t* message_length)
+                                             size_t* message_length,
+                                             uint32_t flags)
 {
     ecrypt_status_t res = ECRYPT_FAIL;
     uint8_t derived_key[ECRYPT_SYM_KEY_LENGTH / 8];
@@ -759,7 +1107,7 @@ ecrypt_status_t ecrypt_sym_decrypt_message_u(const uint8_t* key,
      * maybe it was encrypted with that incorrect key. Try it out.
      */
 #ifdef SCELL_COMPAT
-    if (res != ECRYPT_SUCCESS && res != ECRYPT_BUFFER_TOO_SMALL) {
+    if (res != ECRYPT_SUCCESS && res != ECRYPT_BUFFER_TOO_SMALL && !(flags & ECRYPT_SCELL_FLAG_STRICT)) {
         res = ecrypt_sym_derive_encryption_key_compat(key,
                                                       key_length,
                                                       encrypted_message_length,
@@ -779,6 +1127,8 @@ ecrypt_status_t ecrypt_sym_decrypt_message_u(const uint8_t* key,
     }
 
 error:
+#else
+    UNUSED(flags);
 #endif
     ecconnect_wipe(derived_key, sizeof(derived_key));
 
@@ -26,8 +26,17 @@
  * implementation details and may change without notice.
  */
 
+#include <string.h>
+
 #include <ecrypt/ecrypt_error.h>
 #include <ecrypt/ecrypt_portable_endian.h>
+#include <ecrypt/secure_cell.h>
+
+#include "ecrypt/secure_cell_alg.h"
+#include "ecrypt/secure_cell_lz.h"
+
+#define ECRYPT_SYM_KDF_KEY_LABEL "Ecrypt secure cell message key"
+#define ECRYPT_SYM_KDF_IV_LABEL "Ecrypt secure cell message iv"
 
 /**
  * @internal
@@ -101,13 +110,111 @@ struct ecrypt_scell_auth_token_key {
     const uint8_t* auth_tag;
     uint32_t auth_tag_length;
     uint32_t message_length;
+    /* Present only with ECRYPT_AUTH_SYM_ALG_KEY_ID */
+    uint32_t key_id;
+    /* Present only with ECRYPT_AUTH_SYM_ALG_COMPRESSED, zero otherwise */
+    uint32_t uncompressed_length;
+    /* Marks removed from `alg` by ecrypt_scell_auth_token_key_strip_marks() */
+    uint32_t marks;
+    /* Encoded in compact format, see below */
+    bool compact;
 };
 
+/*
+ * Compact auth token (ECRYPT_SCELL_FLAG_COMPACT) has the following layout:
+ *
+ *     format tag       1 byte, see below
+ *     message length   LEB128 varint, 1-5 bytes
+ *     IV               12 bytes
+ *     auth tag         16 bytes
+ *     key ID           4 bytes, only with ECRYPT_SCELL_COMPACT_KEY_ID
+ *
+ * Format tag always has the lowest bit set, while regular tokens start with
+ * the lowest byte of key length in bits, which is always even. That is how
+ * decoders tell them apart. Compact cells always use current KDF context.
+ */
+#define ECRYPT_SCELL_COMPACT_MARKER 0x01
+#define ECRYPT_SCELL_COMPACT_ALG_MASK 0x06
+#define ECRYPT_SCELL_COMPACT_KEY_ID 0x08
+#define ECRYPT_SCELL_COMPACT_VERSION_MASK 0xF0
+#define ECRYPT_SCELL_COMPACT_VERSION_1 0x10
+
+#define ECRYPT_SCELL_COMPACT_IV_LENGTH 12
+#define ECRYPT_SCELL_COMPACT_AUTH_TAG_LENGTH 16
+#define ECRYPT_SCELL_COMPACT_MAX_VARINT_LENGTH 5
+
+/* Algorithms which can be encoded, indexed by ECRYPT_SCELL_COMPACT_ALG_MASK bits */
+static const uint32_t ecrypt_scell_compact_algs[] = {
+    ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_256_KEY_LENGTH,
+    ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_128_KEY_LENGTH,
+    ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_192_KEY_LENGTH,
+    ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_256_KEY_LENGTH,
+};
+
+static inline bool ecrypt_scell_auth_token_key_is_compact(const uint8_t* buffer, size_t buffer_length)
+{
+    return buffer_length != 0 && (buffer[0] & ECRYPT_SCELL_COMPACT_MARKER) != 0;
+}
+
+static inline size_t ecrypt_scell_varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static inline uint8_t* stream_write_varint32(uint8_t* buffer, uint32_t value)
+{
+    while (value >= 0x80) {
+        *buffer++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *buffer++ = (uint8_t)value;
+    return buffer;
+}
+
+/* Returns NULL if the varint is truncated, overlong, or does not fit */
+static inline const uint8_t* stream_read_varint32(const uint8_t* buffer, size_t buffer_length, uint32_t* value)
+{
+    uint64_t result = 0;
+    size_t i = 0;
+
+    for (i = 0; i < buffer_length && i < ECRYPT_SCELL_COMPACT_MAX_VARINT_LENGTH; i++) {
+        result |= (uint64_t)(buffer[i] & 0x7F) << (7 * i);
+        if ((buffer[i] & 0x80) == 0) {
+            /* Only canonical encoding is accepted */
+            if (result > UINT32_MAX || (i != 0 && buffer[i] == 0)) {
+                return NULL;
+            }
+            *value = (uint32_t)result;
+            return buffer + i + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Size of compact token for a message of given length */
+static inline uint64_t ecrypt_scell_auth_token_key_compact_size(uint64_t message_length)
+{
+    return 1 + ecrypt_scell_varint_size(message_length) + ECRYPT_SCELL_COMPACT_IV_LENGTH
+           + ECRYPT_SCELL_COMPACT_AUTH_TAG_LENGTH;
+}
+
 static const uint64_t ecrypt_scell_auth_token_key_min_size = 4 * sizeof(uint32_t);
 
 static inline uint64_t ecrypt_scell_auth_token_key_size(const struct ecrypt_scell_auth_token_key* hdr)
 {
     uint64_t total_size = 0;
+    if (hdr->compact) {
+        total_size += ecrypt_scell_auth_token_key_compact_size(hdr->message_length);
+        if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+            total_size += sizeof(hdr->key_id);
+        }
+        return total_size;
+    }
     /* Add separately to avoid overflows in intermediade calculations */
     total_size += sizeof(hdr->alg);
     total_size += sizeof(hdr->iv_length);
@@ -115,21 +222,152 @@ static inline uint64_t ecrypt_scell_auth_token_key_size(const struct ecrypt_scel
     total_size += sizeof(hdr->auth_tag_length);
     total_size += hdr->auth_tag_length;
     total_size += sizeof(hdr->message_length);
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        total_size += sizeof(hdr->key_id);
+    }
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_COMPRESSED) {
+        total_size += sizeof(hdr->uncompressed_length);
+    }
     return total_size;
 }
 
+/* Size of the token produced with the default algorithm and parameters */
+static inline size_t ecrypt_scell_auth_token_key_default_size(void)
+{
+    return ecrypt_scell_auth_token_key_min_size + ECRYPT_AUTH_SYM_IV_LENGTH
+           + ECRYPT_AUTH_SYM_AUTH_TAG_LENGTH;
+}
+
+/* Size of the token produced for a message with given ECRYPT_SCELL_FLAG_* */
+static inline size_t ecrypt_scell_auth_token_key_flags_size(uint32_t flags, size_t message_length)
+{
+    if (flags & ECRYPT_SCELL_FLAG_COMPACT) {
+        return (size_t)ecrypt_scell_auth_token_key_compact_size(message_length);
+    }
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        return ecrypt_scell_auth_token_key_default_size() + sizeof(uint32_t);
+    }
+    return ecrypt_scell_auth_token_key_default_size();
+}
+
+/* Maximum length of ciphertext produced for a message with given ECRYPT_SCELL_FLAG_* */
+static inline uint64_t ecrypt_scell_ciphertext_max_size(uint32_t flags, size_t message_length)
+{
+    if (flags & ECRYPT_SCELL_FLAG_COMPRESS) {
+        return ecrypt_scell_lz_bound(message_length);
+    }
+    return message_length;
+}
+
+/*
+ * Messages which do not compress well are sealed without compression and get
+ * shorter auth token than reserved with ECRYPT_SCELL_FLAG_COMPRESS. Moves
+ * ciphertext from reserved position to follow the actual token.
+ */
+static inline void ecrypt_scell_seal_pack(uint8_t* cell,
+                                          size_t reserved_auth_token_length,
+                                          size_t auth_token_length,
+                                          size_t ciphertext_length)
+{
+    if (auth_token_length < reserved_auth_token_length) {
+        memmove(cell + auth_token_length, cell + reserved_auth_token_length, ciphertext_length);
+    }
+}
+
+static inline ecrypt_status_t ecrypt_write_scell_auth_token_key_compact(
+    const struct ecrypt_scell_auth_token_key* hdr, uint8_t* buffer)
+{
+    uint32_t alg = hdr->alg & ~(ECRYPT_AUTH_SYM_ALG_KDF_CURRENT | ECRYPT_AUTH_SYM_ALG_KEY_ID);
+    uint8_t format = ECRYPT_SCELL_COMPACT_VERSION_1 | ECRYPT_SCELL_COMPACT_MARKER;
+    size_t i = 0;
+
+    if (hdr->iv_length != ECRYPT_SCELL_COMPACT_IV_LENGTH
+        || hdr->auth_tag_length != ECRYPT_SCELL_COMPACT_AUTH_TAG_LENGTH) {
+        return ECRYPT_FAIL;
+    }
+    for (i = 0; i < sizeof(ecrypt_scell_compact_algs) / sizeof(ecrypt_scell_compact_algs[0]); i++) {
+        if (ecrypt_scell_compact_algs[i] == alg) {
+            break;
+        }
+    }
+    if (i == sizeof(ecrypt_scell_compact_algs) / sizeof(ecrypt_scell_compact_algs[0])) {
+        return ECRYPT_FAIL;
+    }
+    format |= (uint8_t)(i << 1);
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        format |= ECRYPT_SCELL_COMPACT_KEY_ID;
+    }
+
+    *buffer++ = format;
+    buffer = stream_write_varint32(buffer, hdr->message_length);
+    buffer = stream_write_bytes(buffer, hdr->iv, hdr->iv_length);
+    buffer = stream_write_bytes(buffer, hdr->auth_tag, hdr->auth_tag_length);
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        buffer = stream_write_uint32LE(buffer, hdr->key_id);
+    }
+    return ECRYPT_SUCCESS;
+}
+
 static inline ecrypt_status_t ecrypt_write_scell_auth_token_key(
     const struct ecrypt_scell_auth_token_key* hdr, uint8_t* buffer, size_t buffer_length)
 {
     if (buffer_length < ecrypt_scell_auth_token_key_size(hdr)) {
         return ECRYPT_BUFFER_TOO_SMALL;
     }
+    if (hdr->compact) {
+        return ecrypt_write_scell_auth_token_key_compact(hdr, buffer);
+    }
     buffer = stream_write_uint32LE(buffer, hdr->alg);
     buffer = stream_write_uint32LE(buffer, hdr->iv_length);
     buffer = stream_write_uint32LE(buffer, hdr->auth_tag_length);
     buffer = stream_write_uint32LE(buffer, hdr->message_length);
     buffer = stream_write_bytes(buffer, hdr->iv, hdr->iv_length);
     buffer = stream_write_bytes(buffer, hdr->auth_tag, hdr->auth_tag_length);
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        buffer = stream_write_uint32LE(buffer, hdr->key_id);
+    }
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_COMPRESSED) {
+        buffer = stream_write_uint32LE(buffer, hdr->uncompressed_length);
+    }
+    return ECRYPT_SUCCESS;
+}
+
+static inline ecrypt_status_t ecrypt_read_scell_auth_token_key_compact(const uint8_t* buffer,
+                                                                       size_t buffer_length,
+                                                                       struct ecrypt_scell_auth_token_key* hdr)
+{
+    const uint8_t* end = buffer + buffer_length;
+    uint8_t format = buffer[0];
+
+    if ((format & ECRYPT_SCELL_COMPACT_VERSION_MASK) != ECRYPT_SCELL_COMPACT_VERSION_1) {
+        return ECRYPT_FAIL;
+    }
+    hdr->alg = ecrypt_scell_compact_algs[(format & ECRYPT_SCELL_COMPACT_ALG_MASK) >> 1];
+    /* Synthesize marks so that callers treat compact cells as usual */
+    hdr->alg |= ECRYPT_AUTH_SYM_ALG_KDF_CURRENT;
+    if (format & ECRYPT_SCELL_COMPACT_KEY_ID) {
+        hdr->alg |= ECRYPT_AUTH_SYM_ALG_KEY_ID;
+    }
+    hdr->compact = true;
+    hdr->uncompressed_length = 0;
+
+    buffer = stream_read_varint32(buffer + 1, buffer_length - 1, &hdr->message_length);
+    if (!buffer) {
+        return ECRYPT_FAIL;
+    }
+    hdr->iv_length = ECRYPT_SCELL_COMPACT_IV_LENGTH;
+    hdr->auth_tag_length = ECRYPT_SCELL_COMPACT_AUTH_TAG_LENGTH;
+    if ((size_t)(end - buffer) < hdr->iv_length + hdr->auth_tag_length) {
+        return ECRYPT_FAIL;
+    }
+    buffer = stream_read_bytes(buffer, &hdr->iv, hdr->iv_length);
+    buffer = stream_read_bytes(buffer, &hdr->auth_tag, hdr->auth_tag_length);
+    if (format & ECRYPT_SCELL_COMPACT_KEY_ID) {
+        if ((size_t)(end - buffer) < sizeof(hdr->key_id)) {
+            return ECRYPT_FAIL;
+        }
+        buffer = stream_read_uint32LE(buffer, &hdr->key_id);
+    }
     return ECRYPT_SUCCESS;
 }
 
@@ -138,6 +376,9 @@ static inline ecrypt_status_t ecrypt_read_scell_auth_token_key(const uint8_t* bu
                                                                struct ecrypt_scell_auth_token_key* hdr)
 {
     uint64_t need_length = ecrypt_scell_auth_token_key_min_size;
+    if (ecrypt_scell_auth_token_key_is_compact(buffer, buffer_length)) {
+        return ecrypt_read_scell_auth_token_key_compact(buffer, buffer_length, hdr);
+    }
     if (buffer_length < need_length) {
         return ECRYPT_FAIL;
     }
@@ -153,22 +394,136 @@ static inline ecrypt_status_t ecrypt_read_scell_auth_token_key(const uint8_t* bu
     }
     buffer = stream_read_bytes(buffer, &hdr->iv, hdr->iv_length);
     buffer = stream_read_bytes(buffer, &hdr->auth_tag, hdr->auth_tag_length);
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        need_length += sizeof(hdr->key_id);
+        if (buffer_length < need_length) {
+            return ECRYPT_FAIL;
+        }
+        buffer = stream_read_uint32LE(buffer, &hdr->key_id);
+    }
+    hdr->uncompressed_length = 0;
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_COMPRESSED) {
+        need_length += sizeof(hdr->uncompressed_length);
+        if (buffer_length < need_length) {
+            return ECRYPT_FAIL;
+        }
+        buffer = stream_read_uint32LE(buffer, &hdr->uncompressed_length);
+        /* Do not let corrupted cells request unreasonable amounts of memory */
+        if (hdr->uncompressed_length == 0
+            || hdr->uncompressed_length > (uint64_t)hdr->message_length * ECRYPT_SCELL_LZ_MAX_RATIO) {
+            return ECRYPT_FAIL;
+        }
+    }
     return ECRYPT_SUCCESS;
 }
 
+/* Algorithm ID for new master key cells */
+static inline uint32_t ecrypt_auth_sym_encryption_alg(uint32_t flags)
+{
+    if (flags & ECRYPT_SCELL_FLAG_CHACHA20_POLY1305) {
+        return ECRYPT_AUTH_SYM_ALG_CHACHA20_POLY1305_256;
+    }
+    return ECRYPT_AUTH_SYM_ALG;
+}
+
+/*
+ * Strips Ecrypt-specific marks from the algorithm ID so that only ecconnect
+ * bits remain. Returns ECRYPT_SCELL_FLAG_* values implied by the marks.
+ */
+static inline uint32_t ecrypt_scell_auth_token_key_strip_marks(struct ecrypt_scell_auth_token_key* hdr)
+{
+    uint32_t flags = 0;
+    if (hdr->alg & ECRYPT_AUTH_SYM_ALG_KEY_ID) {
+        flags |= ECRYPT_SCELL_FLAG_KEY_ID | ECRYPT_SCELL_FLAG_STRICT;
+    }
+    if (hdr->alg & (ECRYPT_AUTH_SYM_ALG_KDF_CURRENT | ECRYPT_AUTH_SYM_ALG_COMPRESSED)) {
+        flags |= ECRYPT_SCELL_FLAG_STRICT;
+    }
+    hdr->marks = hdr->alg & (ECRYPT_AUTH_SYM_ALG_KDF_CURRENT | ECRYPT_AUTH_SYM_ALG_KEY_ID | ECRYPT_AUTH_SYM_ALG_COMPRESSED);
+    hdr->alg &= ~hdr->marks;
+    return flags;
+}
+
+static inline bool ecrypt_scell_auth_token_key_is_compressed(const uint8_t* buffer, size_t buffer_length)
+{
+    uint32_t alg = 0;
+    if (ecrypt_scell_auth_token_key_is_compact(buffer, buffer_length) || buffer_length < sizeof(alg)) {
+        return false;
+    }
+    stream_read_uint32LE(buffer, &alg);
+    return (alg & ECRYPT_AUTH_SYM_ALG_COMPRESSED) != 0;
+}
+
 static inline ecrypt_status_t ecrypt_scell_auth_token_key_message_size(const uint8_t* auth_token,
                                                                        size_t auth_token_length,
                                                                        uint32_t* message_length)
 {
     ECRYPT_CHECK_PARAM(message_length != NULL);
+    if (ecrypt_scell_auth_token_key_is_compact(auth_token, auth_token_length)) {
+        if (!stream_read_varint32(auth_token + 1, auth_token_length - 1, message_length)) {
+            return ECRYPT_FAIL;
+        }
+        return ECRYPT_SUCCESS;
+    }
     if (auth_token_length < ecrypt_scell_auth_token_key_min_size) {
         return ECRYPT_FAIL;
     }
+    /* Compressed cells declare plaintext length separately, after the tag */
+    if (ecrypt_scell_auth_token_key_is_compressed(auth_token, auth_token_length)) {
+        struct ecrypt_scell_auth_token_key hdr;
+        ecrypt_status_t res = ECRYPT_FAIL;
+        memset(&hdr, 0, sizeof(hdr));
+        res = ecrypt_read_scell_auth_token_key(auth_token, auth_token_length, &hdr);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        *message_length = hdr.uncompressed_length;
+        return ECRYPT_SUCCESS;
+    }
     const uint8_t* message_length_ptr = auth_token + 3 * sizeof(uint32_t);
     stream_read_uint32LE(message_length_ptr, message_length);
     return ECRYPT_SUCCESS;
 }
 
+/*
+ * Returns length of the auth token at the start of a sealed cell. Usually
+ * ciphertext takes the rest of the cell and has the same length as plaintext,
+ * but compressed cells have shorter ciphertext so their token is parsed.
+ */
+static inline ecrypt_status_t ecrypt_scell_seal_auth_token_size(const uint8_t* cell,
+                                                                size_t cell_length,
+                                                                size_t* auth_token_length)
+{
+    struct ecrypt_scell_auth_token_key hdr;
+    ecrypt_status_t res = ECRYPT_FAIL;
+    uint32_t message_length = 0;
+
+    if (!ecrypt_scell_auth_token_key_is_compressed(cell, cell_length)) {
+        res = ecrypt_scell_auth_token_key_message_size(cell, cell_length, &message_length);
+        if (res != ECRYPT_SUCCESS) {
+            return res;
+        }
+        /* We should not overflow here. If we do then the message is corrupted. */
+        if (cell_length < message_length) {
+            return ECRYPT_INVALID_PARAMETER;
+        }
+        *auth_token_length = cell_length - message_length;
+        return ECRYPT_SUCCESS;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    res = ecrypt_read_scell_auth_token_key(cell, cell_length, &hdr);
+    if (res != ECRYPT_SUCCESS) {
+        return res;
+    }
+    /* Token has been read from the cell so it fits there */
+    *auth_token_length = (size_t)ecrypt_scell_auth_token_key_size(&hdr);
+    if (cell_length - *auth_token_length != hdr.message_length) {
+        return ECRYPT_INVALID_PARAMETER;
+    }
+    return ECRYPT_SUCCESS;
+}
+
 ecrypt_status_t ecrypt_auth_sym_plain_encrypt(uint32_t alg,
                                               const uint8_t* key,
                                               size_t key_length,
@@ -197,6 +552,19 @@ ecrypt_status_t ecrypt_auth_sym_plain_decrypt(uint32_t alg,
                                               const uint8_t* auth_tag,
                                               size_t auth_tag_length);
 
+/* Checks auth tag of the message without decrypting it */
+ecrypt_status_t ecrypt_auth_sym_plain_verify(uint32_t alg,
+                                             const uint8_t* key,
+                                             size_t key_length,
+                                             const uint8_t* iv,
+                                             size_t iv_length,
+                                             const uint8_t* aad,
+                                             size_t aad_length,
+                                             const uint8_t* encrypted_message,
+                                             size_t encrypted_message_length,
+                                             const uint8_t* auth_tag,
+                                             size_t auth_tag_length);
+
 ecrypt_status_t ecrypt_auth_sym_encrypt_message(const uint8_t* key,
                                                 size_t key_length,
                                                 const uint8_t* message,
@@ -206,7 +574,8 @@ ecrypt_status_t ecrypt_auth_sym_encrypt_message(const uint8_t* key,
                                                 uint8_t* auth_token,
                                                 size_t* auth_token_length,
                                                 uint8_t* encrypted_message,
-                                                size_t* encrypted_message_length);
+                                                size_t* encrypted_message_length,
+                                                uint32_t flags);
 
 ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
                                                 size_t key_length,
@@ -217,7 +586,51 @@ ecrypt_status_t ecrypt_auth_sym_decrypt_message(const uint8_t* key,
                                                 const uint8_t* encrypted_message,
                                                 size_t encrypted_message_length,
                                                 uint8_t* message,
-                                                size_t* message_length);
+                                                size_t* message_length,
+                                                uint32_t flags);
+
+/*
+ * Same as above, but key derivation and authentication use separate data:
+ * `user_context` is passed to KDF while `aad` is only authenticated by AEAD.
+ * The functions above are equivalent to passing user context as both.
+ */
+ecrypt_status_t ecrypt_auth_sym_encrypt_message_aad(const uint8_t* key,
+                                                    size_t key_length,
+                                                    const uint8_t* message,
+                                                    size_t message_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    uint8_t* auth_token,
+                                                    size_t* auth_token_length,
+                                                    uint8_t* encrypted_message,
+                                                    size_t* encrypted_message_length,
+                                                    uint32_t flags);
+
+ecrypt_status_t ecrypt_auth_sym_decrypt_message_aad(const uint8_t* key,
+                                                    size_t key_length,
+                                                    const uint8_t* user_context,
+                                                    size_t user_context_length,
+                                                    const uint8_t* aad,
+                                                    size_t aad_length,
+                                                    const uint8_t* auth_token,
+                                                    size_t auth_token_length,
+                                                    const uint8_t* encrypted_message,
+                                                    size_t encrypted_message_length,
+                                                    uint8_t* message,
+                                                    size_t* message_length,
+                                                    uint32_t flags);
+
+ecrypt_status_t ecrypt_auth_sym_verify_message(const uint8_t* key,
+                                               size_t key_length,
+                                               const uint8_t* user_context,
+                                               size_t user_context_length,
+                                               const uint8_t* auth_token,
+                                               size_t auth_token_length,
+                                               const uint8_t* encrypted_message,
+                                               size_t encrypted_message_length,
+                                               uint32_t flags);
 
 ecrypt_status_t ecrypt_sym_encrypt_message_u(const uint8_t* key,
                                              size_t key_length,
@@ -235,14 +648,44 @@ ecrypt_status_t ecrypt_sym_decrypt_message_u(const uint8_t* key,
                                              const uint8_t* encrypted_message,
                                              size_t encrypted_message_length,
                                              uint8_t* message,
-                                             size_t* message_length);
+                                             size_t* message_length,
+                                             uint32_t flags);
+
+/* Context Imprint key and IV derivation, IV is derived from the message key */
+ecrypt_status_t ecrypt_sym_derive_encryption_key(const uint8_t* key,
+                                                 size_t key_length,
+                                                 size_t message_length,
+                                                 uint8_t* derived_key,
+                                                 size_t derived_key_length);
+
+ecrypt_status_t ecrypt_sym_derive_encryption_iv(const uint8_t* key,
+                                                size_t key_length,
+                                                const uint8_t* context,
+                                                size_t context_length,
+                                                uint8_t* iv,
+                                                size_t iv_length);
 
-#define ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH sizeof(uint64_t)
+/* Compressed cells use the longest context, see ecrypt_auth_sym_kdf_context_key() */
+#define ECRYPT_AUTH_SYM_MAX_KDF_CONTEXT_LENGTH (3 * sizeof(uint32_t))
 
 ecrypt_status_t ecrypt_auth_sym_kdf_context(uint32_t message_length,
                                             uint8_t* kdf_context,
                                             size_t* kdf_context_length);
 
+/*
+ * KDF context for master key cell with given auth token. Algorithm ID
+ * must include the marks in `hdr->marks`, not in `hdr->alg` itself.
+ */
+ecrypt_status_t ecrypt_auth_sym_kdf_context_key(const struct ecrypt_scell_auth_token_key* hdr,
+                                                uint8_t* kdf_context,
+                                                size_t* kdf_context_length);
+
+#ifdef SCELL_COMPAT
+ecrypt_status_t ecrypt_auth_sym_kdf_context_compat(uint32_t message_length,
+                                                   uint8_t* kdf_context,
+                                                   size_t* kdf_context_length);
+#endif
+
 ecrypt_status_t ecrypt_auth_sym_derive_encryption_key(uint32_t ecconnect_alg,
                                                       const uint8_t* key,
                                                       size_t key_length,
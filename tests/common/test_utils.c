@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/test_utils.h"
+
+#include <stdio.h>
+
+static int checks_run = 0;
+static int checks_failed = 0;
+
+void testsuite_enter_suite(const char* suite_name)
+{
+    printf("# %s\n", suite_name);
+}
+
+void testsuite_check(int passed, const char* name, const char* file, int line)
+{
+    checks_run++;
+    if (passed) {
+        printf("ok %d - %s\n", checks_run, name);
+        return;
+    }
+    checks_failed++;
+    printf("not ok %d - %s\n", checks_run, name);
+    printf("#   at %s:%d\n", file, line);
+}
+
+int testsuite_finish_testing(void)
+{
+    printf("1..%d\n", checks_run);
+    if (checks_failed) {
+        printf("# failed %d of %d checks\n", checks_failed, checks_run);
+        return 1;
+    }
+    return 0;
+}
+
+void testsuite_fill_random(uint8_t* buffer, size_t length, uint32_t seed)
+{
+    size_t i;
+    uint32_t state = seed ? seed : 1;
+
+    for (i = 0; i < length; i++) {
+        /* xorshift32 */
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        buffer[i] = (uint8_t)state;
+    }
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+size_t testsuite_from_hex(const char* hex, uint8_t* buffer, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length && hex[2 * i] && hex[2 * i + 1]; i++) {
+        int high = hex_digit(hex[2 * i]);
+        int low = hex_digit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            break;
+        }
+        buffer[i] = (uint8_t)((high << 4) | low);
+    }
+    return i;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal test harness. Every check prints a TAP line, failed checks
+ * are counted and turn into a non-zero exit status of the test binary.
+ */
+
+#define testsuite_fail_unless(condition, name) \
+    testsuite_check(!!(condition), (name), __FILE__, __LINE__)
+
+#define testsuite_fail_if(condition, name) testsuite_fail_unless(!(condition), name)
+
+void testsuite_enter_suite(const char* suite_name);
+void testsuite_check(int passed, const char* name, const char* file, int line);
+int testsuite_finish_testing(void);
+
+/* Fills the buffer with deterministic pseudo-random bytes. */
+void testsuite_fill_random(uint8_t* buffer, size_t length, uint32_t seed);
+
+/* Decodes hexadecimal string into the buffer, returns decoded length. */
+size_t testsuite_from_hex(const char* hex, uint8_t* buffer, size_t length);
+
+#endif /* TEST_UTILS_H */
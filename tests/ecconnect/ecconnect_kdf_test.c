@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+
+#include "ecconnect/test.h"
+
+static bool derive_matches(const uint8_t* key, size_t key_length, const char* label, size_t output_length)
+{
+    static const uint8_t first_context[] = "first context";
+    static const uint8_t second_context[] = "second";
+    ecconnect_kdf_context_buf_t context[3] = {
+        {first_context, sizeof(first_context)},
+        {NULL, 0},
+        {second_context, sizeof(second_context)},
+    };
+    ecconnect_kdf_ctx_t* ctx = NULL;
+    ecconnect_kdf_state_t* state = NULL;
+    uint8_t expected[32];
+    uint8_t derived[32];
+    uint8_t derived_with_state[32];
+    bool matches = false;
+    size_t count;
+
+    ctx = ecconnect_kdf_ctx_create(key, key_length);
+    state = ecconnect_kdf_state_create();
+    if (!ctx || !state) {
+        goto out;
+    }
+
+    for (count = 0; count <= 3; count++) {
+        memset(derived, 0, sizeof(derived));
+        memset(derived_with_state, 0, sizeof(derived_with_state));
+        if (ecconnect_kdf(key, key_length, label, context, count, expected, output_length) != ECCONNECT_SUCCESS
+            || ecconnect_kdf_ctx_derive(ctx, label, context, count, derived, output_length) != ECCONNECT_SUCCESS
+            || ecconnect_kdf_ctx_derive_with_state(ctx, state, label, context, count, derived_with_state, output_length)
+                   != ECCONNECT_SUCCESS) {
+            goto out;
+        }
+        if (memcmp(expected, derived, output_length) != 0
+            || memcmp(expected, derived_with_state, output_length) != 0) {
+            goto out;
+        }
+    }
+    matches = true;
+
+out:
+    ecconnect_kdf_state_destroy(state);
+    ecconnect_kdf_ctx_destroy(ctx);
+    return matches;
+}
+
+static void kdf_ctx_matches_one_shot(void)
+{
+    uint8_t key[100];
+
+    testsuite_fill_random(key, sizeof(key), 0xcafe);
+
+    testsuite_fail_unless(derive_matches(key, 32, "Ecrypt secure cell message key", 32),
+                          "KDF context: 32-byte key");
+    testsuite_fail_unless(derive_matches(key, 1, "label", 16), "KDF context: short key");
+    testsuite_fail_unless(derive_matches(key, 64, "", 24), "KDF context: block-sized key, empty label");
+    testsuite_fail_unless(derive_matches(key, sizeof(key), "label", 32), "KDF context: key longer than block");
+    testsuite_fail_unless(derive_matches(key, 32, "label", 1), "KDF context: 1-byte output");
+}
+
+static void kdf_state_is_reusable(void)
+{
+    static const uint8_t other_key[32] = "another KDF context key 01234567";
+    ecconnect_kdf_ctx_t* ctx = ecconnect_kdf_ctx_create("first KDF context key", 21);
+    ecconnect_kdf_ctx_t* other_ctx = ecconnect_kdf_ctx_create(other_key, sizeof(other_key));
+    ecconnect_kdf_state_t* state = ecconnect_kdf_state_create();
+    uint8_t expected[32];
+    uint8_t derived[32];
+    bool matches = true;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        ecconnect_kdf_ctx_t* current = (i % 2) ? other_ctx : ctx;
+        ecconnect_kdf_ctx_derive(current, "label", NULL, 0, expected, sizeof(expected));
+        ecconnect_kdf_ctx_derive_with_state(current, state, "label", NULL, 0, derived, sizeof(derived));
+        if (memcmp(expected, derived, sizeof(derived)) != 0) {
+            matches = false;
+        }
+    }
+    testsuite_fail_unless(matches, "KDF state: reused with different contexts");
+
+    testsuite_fail_unless(ecconnect_kdf_ctx_derive_with_state(ctx, NULL, "label", NULL, 0, derived, sizeof(derived))
+                              == ECCONNECT_INVALID_PARAMETER,
+                          "KDF state: state is required");
+    testsuite_fail_unless(ecconnect_kdf_ctx_derive_with_state(ctx, state, "label", NULL, 0, derived, 33)
+                              == ECCONNECT_INVALID_PARAMETER,
+                          "KDF state: output length is limited");
+    testsuite_fail_unless(ecconnect_kdf_ctx_create(NULL, 32) == NULL, "KDF context: key is required");
+
+    ecconnect_kdf_state_destroy(state);
+    ecconnect_kdf_ctx_destroy(other_ctx);
+    ecconnect_kdf_ctx_destroy(ctx);
+}
+
+void run_ecconnect_kdf_test(void)
+{
+    kdf_ctx_matches_one_shot();
+    kdf_state_is_reusable();
+}
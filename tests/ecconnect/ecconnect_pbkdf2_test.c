@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_kdf.h>
+
+#include "ecconnect/test.h"
+
+#define MAX_JOB_COUNT 9
+
+static void pbkdf2_batch_known_answers(void)
+{
+    static const uint8_t password[] = {'p', 'a', 's', 's', 'w', 'o', 'r', 'd'};
+    static const uint8_t salt[] = {'s', 'a', 'l', 't'};
+    uint8_t expected[2][32];
+    uint8_t keys[2][32];
+    ecconnect_pbkdf2_sha256_job_t jobs[2] = {
+        {password, sizeof(password), salt, sizeof(salt), 1, keys[0], sizeof(keys[0])},
+        {password, sizeof(password), salt, sizeof(salt), 4096, keys[1], sizeof(keys[1])},
+    };
+
+    testsuite_from_hex("120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b", expected[0], sizeof(expected[0]));
+    testsuite_from_hex("c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a", expected[1], sizeof(expected[1]));
+
+    testsuite_fail_unless(ecconnect_pbkdf2_sha256_batch(jobs, 2) == ECCONNECT_SUCCESS
+                              && !memcmp(keys[0], expected[0], sizeof(expected[0]))
+                              && !memcmp(keys[1], expected[1], sizeof(expected[1])),
+                          "PBKDF2 batch: known answers with mixed iterations");
+}
+
+static void pbkdf2_batch_matches_scalar(void)
+{
+    uint8_t passphrases[MAX_JOB_COUNT][80];
+    uint8_t salts[MAX_JOB_COUNT][16];
+    uint8_t keys[MAX_JOB_COUNT][40];
+    uint8_t expected[40];
+    ecconnect_pbkdf2_sha256_job_t jobs[MAX_JOB_COUNT];
+    bool all_match = true;
+    size_t count, i;
+
+    for (count = 1; count <= MAX_JOB_COUNT; count++) {
+        for (i = 0; i < count; i++) {
+            testsuite_fill_random(passphrases[i], sizeof(passphrases[i]), (uint32_t)(count * 100 + i));
+            testsuite_fill_random(salts[i], sizeof(salts[i]), (uint32_t)(count * 200 + i));
+            /* Passphrases longer than SHA-256 block are hashed first */
+            jobs[i].passphrase = passphrases[i];
+            jobs[i].passphrase_length = 1 + (i * 17) % sizeof(passphrases[i]);
+            jobs[i].salt = salts[i];
+            jobs[i].salt_length = 1 + i % sizeof(salts[i]);
+            jobs[i].iterations = 100;
+            jobs[i].key = keys[i];
+            /* Key longer than SHA-256 output takes two blocks */
+            jobs[i].key_length = i % 2 ? sizeof(keys[i]) : 32;
+        }
+        if (ecconnect_pbkdf2_sha256_batch(jobs, count) != ECCONNECT_SUCCESS) {
+            all_match = false;
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            ecconnect_pbkdf2_sha256(jobs[i].passphrase,
+                                    jobs[i].passphrase_length,
+                                    jobs[i].salt,
+                                    jobs[i].salt_length,
+                                    jobs[i].iterations,
+                                    expected,
+                                    jobs[i].key_length);
+            if (memcmp(keys[i], expected, jobs[i].key_length) != 0) {
+                all_match = false;
+            }
+        }
+    }
+    testsuite_fail_unless(all_match, "PBKDF2 batch: same keys as scalar for 1 to 9 lanes");
+}
+
+static void pbkdf2_batch_params(void)
+{
+    uint8_t key[32];
+    ecconnect_pbkdf2_sha256_job_t job = {NULL, 0, NULL, 0, 1, key, sizeof(key)};
+
+    testsuite_fail_unless(ecconnect_pbkdf2_sha256_batch(NULL, 1) == ECCONNECT_INVALID_PARAMETER,
+                          "PBKDF2 batch: jobs are required");
+    testsuite_fail_unless(ecconnect_pbkdf2_sha256_batch(&job, 1) == ECCONNECT_INVALID_PARAMETER,
+                          "PBKDF2 batch: invalid job is rejected");
+}
+
+void run_ecconnect_pbkdf2_test(void)
+{
+    pbkdf2_batch_known_answers();
+    pbkdf2_batch_matches_scalar();
+    pbkdf2_batch_params();
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <ecconnect/ecconnect_sym.h>
+
+#include "ecconnect/test.h"
+
+#define CHACHA20_POLY1305_ALG (ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_NOKDF | ECCONNECT_SYM_256_KEY_LENGTH)
+#define AES_GCM_128_ALG (ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_NOKDF | ECCONNECT_SYM_128_KEY_LENGTH)
+#define AES_GCM_256_ALG (ECCONNECT_SYM_AES_GCM | ECCONNECT_SYM_NOKDF | ECCONNECT_SYM_256_KEY_LENGTH)
+#define AES_XTS_256_ALG (ECCONNECT_SYM_AES_XTS | ECCONNECT_SYM_NOKDF | ECCONNECT_SYM_256_KEY_LENGTH)
+#define VERIFY_MAX_LENGTH 300
+#define XTS_UNIT_LENGTH 512
+
+/* RFC 8439, section 2.8.2 */
+static const char rfc8439_key[] = "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f";
+static const char rfc8439_nonce[] = "070000004041424344454647";
+static const char rfc8439_aad[] = "50515253c0c1c2c3c4c5c6c7";
+static const char rfc8439_plaintext[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, "
+    "sunscreen would be it.";
+static const char rfc8439_ciphertext[] =
+    "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b"
+    "1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+    "3ff4def08e4b7a9de576d26586cec64b6116";
+static const char rfc8439_tag[] = "1ae10b594f09e26a7e902ecbd0600691";
+
+static uint8_t key[32];
+static uint8_t nonce[12];
+static uint8_t aad[12];
+static uint8_t ciphertext[114];
+static uint8_t tag[16];
+
+/* Feeds the data in pieces to exercise keystream carry-over between updates */
+static bool chacha20_poly1305_encrypt(const uint8_t* plain, size_t length, size_t piece, uint8_t* out, uint8_t* out_tag)
+{
+    ecconnect_sym_ctx_t* ctx = NULL;
+    size_t offset = 0;
+    size_t out_length = 0;
+    size_t tag_length = 16;
+    bool ok = false;
+
+    ctx = ecconnect_sym_aead_encrypt_create(CHACHA20_POLY1305_ALG, key, sizeof(key), NULL, 0, nonce, sizeof(nonce));
+    if (!ctx || ecconnect_sym_aead_encrypt_aad(ctx, aad, sizeof(aad)) != ECCONNECT_SUCCESS) {
+        goto out;
+    }
+    while (offset < length) {
+        size_t part = (piece < length - offset) ? piece : length - offset;
+        out_length = part;
+        if (ecconnect_sym_aead_encrypt_update(ctx, plain + offset, part, out + offset, &out_length)
+                != ECCONNECT_SUCCESS
+            || out_length != part) {
+            goto out;
+        }
+        offset += part;
+    }
+    ok = ecconnect_sym_aead_encrypt_final(ctx, out_tag, &tag_length) == ECCONNECT_SUCCESS && tag_length == 16;
+
+out:
+    ecconnect_sym_aead_encrypt_destroy(ctx);
+    return ok;
+}
+
+static bool chacha20_poly1305_decrypt(const uint8_t* in, size_t length, const uint8_t* in_tag, uint8_t* out)
+{
+    ecconnect_sym_ctx_t* ctx = NULL;
+    size_t out_length = length;
+    bool ok = false;
+
+    ctx = ecconnect_sym_aead_decrypt_create(CHACHA20_POLY1305_ALG, key, sizeof(key), NULL, 0, nonce, sizeof(nonce));
+    if (!ctx) {
+        return false;
+    }
+    ok = ecconnect_sym_aead_decrypt_aad(ctx, aad, sizeof(aad)) == ECCONNECT_SUCCESS
+         && ecconnect_sym_aead_decrypt_update(ctx, in, length, out, &out_length) == ECCONNECT_SUCCESS
+         && out_length == length && ecconnect_sym_aead_decrypt_final(ctx, in_tag, 16) == ECCONNECT_SUCCESS;
+    ecconnect_sym_aead_decrypt_destroy(ctx);
+    return ok;
+}
+
+static void chacha20_poly1305_known_answer(void)
+{
+    const uint8_t* plain = (const uint8_t*)rfc8439_plaintext;
+    size_t plain_length = sizeof(rfc8439_plaintext) - 1;
+    static const size_t pieces[] = {1, 13, 64, 200};
+    uint8_t out[sizeof(ciphertext)];
+    uint8_t out_tag[sizeof(tag)];
+    bool all_match = true;
+    size_t i;
+
+    testsuite_from_hex(rfc8439_key, key, sizeof(key));
+    testsuite_from_hex(rfc8439_nonce, nonce, sizeof(nonce));
+    testsuite_from_hex(rfc8439_aad, aad, sizeof(aad));
+    testsuite_from_hex(rfc8439_ciphertext, ciphertext, sizeof(ciphertext));
+    testsuite_from_hex(rfc8439_tag, tag, sizeof(tag));
+
+    for (i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+        memset(out, 0, sizeof(out));
+        memset(out_tag, 0, sizeof(out_tag));
+        if (!chacha20_poly1305_encrypt(plain, plain_length, pieces[i], out, out_tag)
+            || memcmp(out, ciphertext, plain_length) != 0 || memcmp(out_tag, tag, sizeof(tag)) != 0) {
+            all_match = false;
+        }
+    }
+    testsuite_fail_unless(all_match, "ChaCha20-Poly1305: RFC 8439 encryption");
+
+    memset(out, 0, sizeof(out));
+    testsuite_fail_unless(chacha20_poly1305_decrypt(ciphertext, plain_length, tag, out)
+                              && !memcmp(out, plain, plain_length),
+                          "ChaCha20-Poly1305: RFC 8439 decryption");
+
+    tag[0] ^= 0x01;
+    testsuite_fail_if(chacha20_poly1305_decrypt(ciphertext, plain_length, tag, out),
+                      "ChaCha20-Poly1305: corrupted tag is rejected");
+    tag[0] ^= 0x01;
+
+    ciphertext[50] ^= 0x01;
+    testsuite_fail_if(chacha20_poly1305_decrypt(ciphertext, plain_length, tag, out),
+                      "ChaCha20-Poly1305: corrupted ciphertext is rejected");
+    ciphertext[50] ^= 0x01;
+
+    testsuite_fail_unless(ecconnect_sym_aead_encrypt_create(ECCONNECT_SYM_CHACHA20_POLY1305 | ECCONNECT_SYM_NOKDF
+                                                                | ECCONNECT_SYM_128_KEY_LENGTH,
+                                                            key,
+                                                            16,
+                                                            NULL,
+                                                            0,
+                                                            nonce,
+                                                            sizeof(nonce))
+                              == NULL,
+                          "ChaCha20-Poly1305: only 256-bit keys");
+}
+
+/* Encrypts random data and checks that verification agrees with decryption */
+static bool aead_verify_agrees(uint32_t alg, size_t aad_length, size_t data_length)
+{
+    static uint8_t verify_key[32];
+    static uint8_t verify_iv[12];
+    uint8_t verify_aad[VERIFY_MAX_LENGTH];
+    uint8_t data[VERIFY_MAX_LENGTH];
+    uint8_t encrypted[VERIFY_MAX_LENGTH];
+    uint8_t verify_tag[16];
+    size_t key_length = (alg & ECCONNECT_SYM_KEY_LENGTH_MASK) / 8;
+    size_t encrypted_length = data_length;
+    size_t tag_length = sizeof(verify_tag);
+    ecconnect_sym_ctx_t* ctx = NULL;
+    bool ok = false;
+
+    testsuite_fill_random(verify_key, sizeof(verify_key), (uint32_t)(aad_length * 1000 + data_length));
+    testsuite_fill_random(verify_iv, sizeof(verify_iv), (uint32_t)data_length);
+    testsuite_fill_random(verify_aad, sizeof(verify_aad), (uint32_t)aad_length);
+    testsuite_fill_random(data, sizeof(data), 0xda7a);
+
+    ctx = ecconnect_sym_aead_encrypt_create(alg, verify_key, key_length, NULL, 0, verify_iv, sizeof(verify_iv));
+    if (!ctx || (aad_length && ecconnect_sym_aead_encrypt_aad(ctx, verify_aad, aad_length) != ECCONNECT_SUCCESS)
+        || (data_length
+            && ecconnect_sym_aead_encrypt_update(ctx, data, data_length, encrypted, &encrypted_length)
+                   != ECCONNECT_SUCCESS)
+        || ecconnect_sym_aead_encrypt_final(ctx, verify_tag, &tag_length) != ECCONNECT_SUCCESS) {
+        goto out;
+    }
+
+    if (ecconnect_sym_aead_verify(alg,
+                                  verify_key,
+                                  key_length,
+                                  verify_iv,
+                                  sizeof(verify_iv),
+                                  verify_aad,
+                                  aad_length,
+                                  encrypted,
+                                  data_length,
+                                  verify_tag,
+                                  tag_length)
+        != ECCONNECT_SUCCESS) {
+        goto out;
+    }
+    verify_tag[tag_length - 1] ^= 0x01;
+    if (ecconnect_sym_aead_verify(alg,
+                                  verify_key,
+                                  key_length,
+                                  verify_iv,
+                                  sizeof(verify_iv),
+                                  verify_aad,
+                                  aad_length,
+                                  encrypted,
+                                  data_length,
+                                  verify_tag,
+                                  tag_length)
+        == ECCONNECT_SUCCESS) {
+        goto out;
+    }
+    verify_tag[tag_length - 1] ^= 0x01;
+    if (data_length) {
+        encrypted[data_length / 2] ^= 0x01;
+        if (ecconnect_sym_aead_verify(alg,
+                                      verify_key,
+                                      key_length,
+                                      verify_iv,
+                                      sizeof(verify_iv),
+                                      verify_aad,
+                                      aad_length,
+                                      encrypted,
+                                      data_length,
+                                      verify_tag,
+                                      tag_length)
+            == ECCONNECT_SUCCESS) {
+            goto out;
+        }
+    }
+    ok = true;
+
+out:
+    ecconnect_sym_aead_encrypt_destroy(ctx);
+    return ok;
+}
+
+static void aead_verify(void)
+{
+    static const size_t lengths[] = {0, 1, 15, 16, 17, 100, VERIFY_MAX_LENGTH};
+    static const uint32_t algs[] = {AES_GCM_128_ALG, AES_GCM_256_ALG, CHACHA20_POLY1305_ALG};
+    static const char* names[] = {"AEAD verify: AES-128-GCM", "AEAD verify: AES-256-GCM", "AEAD verify: ChaCha20-Poly1305"};
+    size_t alg;
+    size_t i;
+    size_t j;
+
+    for (alg = 0; alg < sizeof(algs) / sizeof(algs[0]); alg++) {
+        bool all_agree = true;
+        for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            for (j = 1; j < sizeof(lengths) / sizeof(lengths[0]); j++) {
+                if (!aead_verify_agrees(algs[alg], lengths[i], lengths[j])) {
+                    all_agree = false;
+                }
+            }
+        }
+        testsuite_fail_unless(all_agree, names[alg]);
+    }
+}
+
+static bool xts_process(ecconnect_sym_ctx_t* ctx, bool encrypt, const uint8_t* in, uint8_t* out)
+{
+    size_t out_length = XTS_UNIT_LENGTH;
+
+    if (encrypt) {
+        return ecconnect_sym_encrypt_update(ctx, in, XTS_UNIT_LENGTH, out, &out_length) == ECCONNECT_SUCCESS
+               && out_length == XTS_UNIT_LENGTH;
+    }
+    return ecconnect_sym_decrypt_update(ctx, in, XTS_UNIT_LENGTH, out, &out_length) == ECCONNECT_SUCCESS
+           && out_length == XTS_UNIT_LENGTH;
+}
+
+/* Reset context must produce the same output as a fresh one with the new IV */
+static void reset_matches_fresh_context(void)
+{
+    uint8_t xts_key[64];
+    uint8_t tweaks[2][16];
+    uint8_t plain[2][XTS_UNIT_LENGTH];
+    uint8_t expected[XTS_UNIT_LENGTH];
+    uint8_t encrypted[2][XTS_UNIT_LENGTH];
+    uint8_t decrypted[XTS_UNIT_LENGTH];
+    ecconnect_sym_ctx_t* reused = NULL;
+    ecconnect_sym_ctx_t* fresh = NULL;
+
+    testsuite_fill_random(xts_key, sizeof(xts_key), 0x7e5);
+    testsuite_fill_random(tweaks[0], sizeof(tweaks[0]), 0x7e6);
+    testsuite_fill_random(tweaks[1], sizeof(tweaks[1]), 0x7e7);
+    testsuite_fill_random(plain[0], sizeof(plain[0]), 0x7e8);
+    testsuite_fill_random(plain[1], sizeof(plain[1]), 0x7e9);
+
+    reused = ecconnect_sym_encrypt_create(AES_XTS_256_ALG, xts_key, sizeof(xts_key), NULL, 0, tweaks[0], sizeof(tweaks[0]));
+    fresh = ecconnect_sym_encrypt_create(AES_XTS_256_ALG, xts_key, sizeof(xts_key), NULL, 0, tweaks[1], sizeof(tweaks[1]));
+    testsuite_fail_unless(xts_process(reused, true, plain[0], encrypted[0])
+                              && ecconnect_sym_encrypt_reset(reused, tweaks[1], sizeof(tweaks[1])) == ECCONNECT_SUCCESS
+                              && xts_process(reused, true, plain[1], encrypted[1])
+                              && xts_process(fresh, true, plain[1], expected)
+                              && !memcmp(encrypted[1], expected, sizeof(expected)),
+                          "XTS: reset encryption context");
+    testsuite_fail_unless(ecconnect_sym_encrypt_reset(reused, tweaks[1], 15) == ECCONNECT_INVALID_PARAMETER,
+                          "XTS: reset with wrong IV length");
+    ecconnect_sym_encrypt_destroy(fresh);
+    ecconnect_sym_encrypt_destroy(reused);
+
+    reused = ecconnect_sym_decrypt_create(AES_XTS_256_ALG, xts_key, sizeof(xts_key), NULL, 0, tweaks[1], sizeof(tweaks[1]));
+    testsuite_fail_unless(xts_process(reused, false, encrypted[1], decrypted)
+                              && !memcmp(decrypted, plain[1], sizeof(decrypted))
+                              && ecconnect_sym_decrypt_reset(reused, tweaks[0], sizeof(tweaks[0])) == ECCONNECT_SUCCESS
+                              && xts_process(reused, false, encrypted[0], decrypted)
+                              && !memcmp(decrypted, plain[0], sizeof(decrypted)),
+                          "XTS: reset decryption context");
+    ecconnect_sym_decrypt_destroy(reused);
+}
+
+static ecconnect_status_t decrypt_truncated(const uint8_t* in_tag, size_t tag_length)
+{
+    uint8_t out[sizeof(ciphertext)];
+    size_t out_length = sizeof(out);
+    ecconnect_sym_ctx_t* ctx = NULL;
+    ecconnect_status_t res = ECCONNECT_FAIL;
+
+    ctx = ecconnect_sym_aead_decrypt_create(CHACHA20_POLY1305_ALG, key, sizeof(key), NULL, 0, nonce, sizeof(nonce));
+    if (ctx && ecconnect_sym_aead_decrypt_aad(ctx, aad, sizeof(aad)) == ECCONNECT_SUCCESS
+        && ecconnect_sym_aead_decrypt_update(ctx, ciphertext, sizeof(ciphertext), out, &out_length) == ECCONNECT_SUCCESS) {
+        res = ecconnect_sym_aead_decrypt_final_truncated(ctx, in_tag, tag_length);
+    }
+    ecconnect_sym_aead_decrypt_destroy(ctx);
+    return res;
+}
+
+/* Uses RFC 8439 data loaded by chacha20_poly1305_known_answer() */
+static void truncated_tag(void)
+{
+    uint8_t corrupted_tag[sizeof(tag)];
+    bool prefixes_accepted = true;
+    size_t length;
+
+    for (length = ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH; length <= sizeof(tag); length++) {
+        if (decrypt_truncated(tag, length) != ECCONNECT_SUCCESS) {
+            prefixes_accepted = false;
+        }
+    }
+    testsuite_fail_unless(prefixes_accepted, "truncated tag: tag prefixes accepted");
+
+    memcpy(corrupted_tag, tag, sizeof(tag));
+    corrupted_tag[ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH - 1] ^= 0x01;
+    testsuite_fail_if(decrypt_truncated(corrupted_tag, ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH) == ECCONNECT_SUCCESS,
+                      "truncated tag: corrupted prefix rejected");
+    testsuite_fail_unless(decrypt_truncated(tag, ECCONNECT_SYM_AEAD_MIN_TRUNCATED_TAG_LENGTH - 1)
+                              == ECCONNECT_INVALID_PARAMETER,
+                          "truncated tag: too short");
+    testsuite_fail_unless(decrypt_truncated(tag, sizeof(tag) + 1) == ECCONNECT_INVALID_PARAMETER,
+                          "truncated tag: too long");
+}
+
+void run_ecconnect_sym_test(void)
+{
+    chacha20_poly1305_known_answer();
+    aead_verify();
+    reset_matches_fresh_context();
+    truncated_tag();
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecconnect/test.h"
+
+int main(void)
+{
+    testsuite_enter_suite("ecconnect: KDF contexts");
+    run_ecconnect_kdf_test();
+
+    testsuite_enter_suite("ecconnect: symmetric ciphers");
+    run_ecconnect_sym_test();
+
+    testsuite_enter_suite("ecconnect: PBKDF2 batch");
+    run_ecconnect_pbkdf2_test();
+
+    return testsuite_finish_testing();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define KEY_ID_LENGTH 4
+#define MESSAGE_LENGTH 500
+
+static const uint8_t master_key[32] = "inspect test master key 01234567";
+static const uint8_t passphrase[] = "inspect test passphrase";
+static const uint8_t user_context[] = "inspect test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t output[MESSAGE_LENGTH + 1024];
+
+static size_t seal_ex(size_t message_length, uint32_t flags)
+{
+    size_t output_length = sizeof(output);
+
+    if (ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                           sizeof(master_key),
+                                           user_context,
+                                           sizeof(user_context),
+                                           message,
+                                           message_length,
+                                           output,
+                                           &output_length,
+                                           flags)
+        != ECRYPT_SUCCESS) {
+        return 0;
+    }
+    return output_length;
+}
+
+static void cell_output_sizes(void)
+{
+    static const uint32_t flags[] = {0,
+                                     ECRYPT_SCELL_FLAG_CHACHA20_POLY1305,
+                                     ECRYPT_SCELL_FLAG_COMPACT,
+                                     ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305};
+    static const size_t lengths[] = {1, 127, 128, MESSAGE_LENGTH};
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    size_t token_length = 0;
+    size_t output_length = 0;
+    bool seal_matches = true;
+    bool token_matches = true;
+    size_t i, j;
+
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        for (j = 0; j < sizeof(lengths) / sizeof(lengths[0]); j++) {
+            size_t encrypted_length = sizeof(output);
+
+            if (ecrypt_secure_cell_seal_output_size(lengths[j], flags[i], &output_length) != ECRYPT_SUCCESS
+                || output_length != seal_ex(lengths[j], flags[i])) {
+                seal_matches = false;
+            }
+            token_length = sizeof(token);
+            if (ecrypt_secure_cell_token_protect_output_size(lengths[j], flags[i], &output_length) != ECRYPT_SUCCESS
+                || ecrypt_secure_cell_encrypt_token_protect_ex(master_key,
+                                                               sizeof(master_key),
+                                                               user_context,
+                                                               sizeof(user_context),
+                                                               message,
+                                                               lengths[j],
+                                                               token,
+                                                               &token_length,
+                                                               output,
+                                                               &encrypted_length,
+                                                               flags[i])
+                       != ECRYPT_SUCCESS
+                || output_length != token_length) {
+                token_matches = false;
+            }
+        }
+    }
+    testsuite_fail_unless(seal_matches, "output size: seal");
+    testsuite_fail_unless(token_matches, "output size: token protect");
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_output_size(MESSAGE_LENGTH, ECRYPT_SCELL_FLAG_KEY_ID, &output_length)
+                                  == ECRYPT_SUCCESS
+                              && output_length == DEFAULT_AUTH_TOKEN_LENGTH + KEY_ID_LENGTH + MESSAGE_LENGTH,
+                          "output size: seal with key ID");
+    testsuite_fail_unless(ecrypt_secure_cell_context_imprint_output_size(MESSAGE_LENGTH, &output_length) == ECRYPT_SUCCESS
+                              && output_length == MESSAGE_LENGTH,
+                          "output size: context imprint");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_output_size(0, 0, &output_length) == ECRYPT_INVALID_PARAMETER,
+                          "output size: empty message");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_output_size(MESSAGE_LENGTH, 0, NULL) == ECRYPT_INVALID_PARAMETER,
+                          "output size: output length is required");
+}
+
+static void cell_inspection(void)
+{
+    ecrypt_secure_cell_info_t info;
+    size_t output_length = seal_ex(MESSAGE_LENGTH, 0);
+    size_t expected_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, output_length, &info) == ECRYPT_SUCCESS
+                              && info.cipher == ECRYPT_SCELL_CIPHER_AES_GCM && info.key_bits == 256
+                              && info.kdf == ECRYPT_SCELL_KDF_MASTER_KEY && !info.has_key_id && !info.compact
+                              && info.auth_token_length == DEFAULT_AUTH_TOKEN_LENGTH
+                              && info.message_length == MESSAGE_LENGTH,
+                          "inspect: default cell");
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, DEFAULT_AUTH_TOKEN_LENGTH, &info) == ECRYPT_SUCCESS
+                              && info.message_length == MESSAGE_LENGTH,
+                          "inspect: auth token alone");
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, DEFAULT_AUTH_TOKEN_LENGTH - 1, &info) == ECRYPT_FAIL,
+                          "inspect: truncated header");
+
+    output_length = seal_ex(MESSAGE_LENGTH, ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305);
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, output_length, &info) == ECRYPT_SUCCESS
+                              && info.cipher == ECRYPT_SCELL_CIPHER_CHACHA20_POLY1305 && info.compact
+                              && info.auth_token_length + info.message_length == output_length
+                              && info.message_length == MESSAGE_LENGTH,
+                          "inspect: compact ChaCha20-Poly1305 cell");
+
+    output_length = sizeof(output);
+    ecrypt_secure_cell_encrypt_seal_with_passphrase(passphrase,
+                                                    sizeof(passphrase),
+                                                    user_context,
+                                                    sizeof(user_context),
+                                                    message,
+                                                    MESSAGE_LENGTH,
+                                                    output,
+                                                    &output_length);
+    testsuite_fail_unless(ecrypt_secure_cell_seal_passphrase_output_size(MESSAGE_LENGTH, &expected_length) == ECRYPT_SUCCESS
+                              && expected_length == output_length,
+                          "output size: seal with passphrase");
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, output_length, &info) == ECRYPT_SUCCESS
+                              && info.kdf == ECRYPT_SCELL_KDF_PBKDF2_HMAC_SHA256 && info.pbkdf2_iterations != 0
+                              && info.auth_token_length + info.message_length == output_length,
+                          "inspect: passphrase cell");
+
+    output[0] ^= 0xFF;
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(output, output_length, &info) == ECRYPT_FAIL,
+                          "inspect: unknown algorithm");
+}
+
+static void secure_message_sizes(void)
+{
+    uint8_t private_key[1024];
+    uint8_t public_key[1024];
+    size_t private_key_length = sizeof(private_key);
+    size_t public_key_length = sizeof(public_key);
+    size_t expected_length = 0;
+    size_t output_length = sizeof(output);
+    ecrypt_secure_message_info_t info;
+
+    ecrypt_gen_ec_key_pair(private_key, &private_key_length, public_key, &public_key_length);
+
+    ecrypt_secure_message_encrypt(private_key,
+                                  private_key_length,
+                                  public_key,
+                                  public_key_length,
+                                  message,
+                                  MESSAGE_LENGTH,
+                                  output,
+                                  &output_length);
+    testsuite_fail_unless(ecrypt_secure_message_encrypt_output_size(public_key, public_key_length, MESSAGE_LENGTH, &expected_length)
+                                  == ECRYPT_SUCCESS
+                              && expected_length == output_length,
+                          "secure message: encrypted output size");
+    testsuite_fail_unless(ecrypt_secure_message_inspect(output, output_length, &info) == ECRYPT_SUCCESS
+                              && info.kind == ECRYPT_SECURE_MESSAGE_KIND_EC_ENCRYPTED
+                              && info.message_length == MESSAGE_LENGTH && info.cell.message_length == MESSAGE_LENGTH,
+                          "secure message: inspect encrypted");
+    testsuite_fail_unless(ecrypt_secure_message_inspect(output, output_length - 1, &info) == ECRYPT_FAIL,
+                          "secure message: truncated encrypted message");
+
+    output_length = 0;
+    ecrypt_secure_message_sign(private_key, private_key_length, message, MESSAGE_LENGTH, NULL, &output_length);
+    testsuite_fail_unless(ecrypt_secure_message_sign_output_size(private_key, private_key_length, MESSAGE_LENGTH, &expected_length)
+                                  == ECRYPT_SUCCESS
+                              && expected_length == output_length,
+                          "secure message: signed output size");
+    ecrypt_secure_message_sign(private_key, private_key_length, message, MESSAGE_LENGTH, output, &output_length);
+    testsuite_fail_unless(ecrypt_secure_message_inspect(output, output_length, &info) == ECRYPT_SUCCESS
+                              && info.kind == ECRYPT_SECURE_MESSAGE_KIND_EC_SIGNED
+                              && info.message_length == MESSAGE_LENGTH && info.signature_length != 0,
+                          "secure message: inspect signed");
+    testsuite_fail_unless(ecrypt_secure_message_encrypt_output_size(message, MESSAGE_LENGTH, MESSAGE_LENGTH, &expected_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "secure message: invalid key");
+
+    testsuite_fail_unless(secure_session_wrap_output_size(MESSAGE_LENGTH, &expected_length) == ECRYPT_SUCCESS
+                              && expected_length > MESSAGE_LENGTH,
+                          "secure session: wrapped output size");
+}
+
+void run_inspect_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x15bec7);
+
+    cell_output_sizes();
+    cell_inspection();
+    secure_message_sizes();
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 200
+#define AAD_LENGTH 4000
+
+static const uint8_t master_key[32] = "aad test master key 012345678901";
+static const uint8_t kdf_context[] = "record 42";
+static const uint8_t other_kdf_context[] = "record 43";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t aad[AAD_LENGTH];
+
+static ecrypt_status_t decrypt(const uint8_t* context,
+                               size_t context_length,
+                               const uint8_t* associated_data,
+                               size_t associated_data_length,
+                               const uint8_t* cell,
+                               size_t cell_length,
+                               uint8_t* plain,
+                               size_t* plain_length)
+{
+    return ecrypt_secure_cell_decrypt_seal_with_aad(master_key,
+                                                    sizeof(master_key),
+                                                    context,
+                                                    context_length,
+                                                    associated_data,
+                                                    associated_data_length,
+                                                    cell,
+                                                    cell_length,
+                                                    plain,
+                                                    plain_length,
+                                                    0);
+}
+
+static void aad_round_trip(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = 0;
+    size_t plain_length = sizeof(plain);
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_aad(master_key,
+                                                                   sizeof(master_key),
+                                                                   kdf_context,
+                                                                   sizeof(kdf_context),
+                                                                   aad,
+                                                                   sizeof(aad),
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   NULL,
+                                                                   &cell_length,
+                                                                   0)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(cell),
+                          "aad: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_aad(master_key,
+                                                                   sizeof(master_key),
+                                                                   kdf_context,
+                                                                   sizeof(kdf_context),
+                                                                   aad,
+                                                                   sizeof(aad),
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   cell,
+                                                                   &cell_length,
+                                                                   0)
+                              == ECRYPT_SUCCESS,
+                          "aad: encryption");
+    testsuite_fail_unless(decrypt(kdf_context, sizeof(kdf_context), aad, sizeof(aad), cell, cell_length, plain, &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message)),
+                          "aad: decryption");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(decrypt(other_kdf_context, sizeof(other_kdf_context), aad, sizeof(aad), cell, cell_length, plain, &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "aad: wrong KDF context");
+    plain_length = sizeof(plain);
+    testsuite_fail_if(decrypt(kdf_context, sizeof(kdf_context), aad, sizeof(aad) - 1, cell, cell_length, plain, &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "aad: truncated associated data");
+    plain_length = sizeof(plain);
+    testsuite_fail_if(decrypt(kdf_context, sizeof(kdf_context), NULL, 0, cell, cell_length, plain, &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "aad: missing associated data");
+
+    for (i = 0; i < cell_length; i += 7) {
+        cell[i] ^= 0x01;
+        plain_length = sizeof(plain);
+        if (decrypt(kdf_context, sizeof(kdf_context), aad, sizeof(aad), cell, cell_length, plain, &plain_length)
+            == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x01;
+    }
+    testsuite_fail_unless(all_rejected, "aad: corrupted cell");
+}
+
+static void aad_regular_cell_compatibility(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = sizeof(plain);
+
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    kdf_context,
+                                    sizeof(kdf_context),
+                                    message,
+                                    sizeof(message),
+                                    cell,
+                                    &cell_length);
+    testsuite_fail_unless(decrypt(kdf_context, sizeof(kdf_context), kdf_context, sizeof(kdf_context), cell, cell_length, plain, &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message)),
+                          "aad: regular cell uses context as both");
+
+    cell_length = sizeof(cell);
+    ecrypt_secure_cell_encrypt_seal_with_aad(master_key,
+                                             sizeof(master_key),
+                                             kdf_context,
+                                             sizeof(kdf_context),
+                                             kdf_context,
+                                             sizeof(kdf_context),
+                                             message,
+                                             sizeof(message),
+                                             cell,
+                                             &cell_length,
+                                             0);
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          kdf_context,
+                                                          sizeof(kdf_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message)),
+                          "aad: same contexts produce regular cell");
+}
+
+static void context_digest(void)
+{
+    static const uint8_t abc[] = {'a', 'b', 'c'};
+    uint8_t expected[ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH];
+    uint8_t digest[ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH];
+    size_t digest_length = 0;
+
+    testsuite_from_hex("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", expected, sizeof(expected));
+    testsuite_fail_unless(ecrypt_secure_cell_context_digest(abc, sizeof(abc), NULL, &digest_length) == ECRYPT_BUFFER_TOO_SMALL
+                              && digest_length == ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH,
+                          "context digest: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_context_digest(abc, sizeof(abc), digest, &digest_length) == ECRYPT_SUCCESS
+                              && digest_length == ECRYPT_SCELL_CONTEXT_DIGEST_LENGTH
+                              && !memcmp(digest, expected, sizeof(expected)),
+                          "context digest: SHA-256 known answer");
+    testsuite_fail_unless(ecrypt_secure_cell_context_digest(NULL, 0, digest, &digest_length) == ECRYPT_INVALID_PARAMETER,
+                          "context digest: context is required");
+}
+
+void run_secure_cell_aad_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xaad1);
+    testsuite_fill_random(aad, sizeof(aad), 0xaad2);
+
+    aad_round_trip();
+    aad_regular_cell_compatibility();
+    context_digest();
+}
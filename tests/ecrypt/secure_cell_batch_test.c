@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define ITEM_COUNT 100
+#define MAX_MESSAGE_LENGTH 200
+
+static const uint8_t master_key[32] = "batch test master key 0123456789";
+static const uint8_t wrong_master_key[32] = "batch test wrong key 01234567890";
+static const uint8_t user_context[] = "batch test context";
+
+static uint8_t messages[ITEM_COUNT][MAX_MESSAGE_LENGTH];
+static uint8_t cells[ITEM_COUNT * (DEFAULT_AUTH_TOKEN_LENGTH + MAX_MESSAGE_LENGTH)];
+static uint8_t plain[ITEM_COUNT * MAX_MESSAGE_LENGTH];
+static ecrypt_secure_cell_batch_item_t items[ITEM_COUNT];
+static ecrypt_secure_cell_batch_item_t decrypt_items[ITEM_COUNT];
+
+static size_t message_length(size_t index)
+{
+    return 1 + (index * 37) % MAX_MESSAGE_LENGTH;
+}
+
+static void fill_items(void)
+{
+    size_t i;
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        memset(&items[i], 0, sizeof(items[i]));
+        items[i].input = messages[i];
+        items[i].input_length = message_length(i);
+        /* Every other record has its own context */
+        if (i % 2) {
+            items[i].user_context = user_context;
+            items[i].user_context_length = sizeof(user_context);
+        }
+    }
+}
+
+static void fill_decrypt_items(void)
+{
+    size_t i;
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        memset(&decrypt_items[i], 0, sizeof(decrypt_items[i]));
+        decrypt_items[i].input = cells + items[i].output_offset;
+        decrypt_items[i].input_length = items[i].output_length;
+        decrypt_items[i].user_context = items[i].user_context;
+        decrypt_items[i].user_context_length = items[i].user_context_length;
+    }
+}
+
+static bool batch_round_trip(size_t thread_count)
+{
+    size_t cells_length = sizeof(cells);
+    size_t plain_length = sizeof(plain);
+    size_t i;
+
+    fill_items();
+    if (ecrypt_secure_cell_encrypt_seal_batch(master_key,
+                                              sizeof(master_key),
+                                              items,
+                                              ITEM_COUNT,
+                                              cells,
+                                              &cells_length,
+                                              thread_count)
+        != ECRYPT_SUCCESS) {
+        return false;
+    }
+
+    fill_decrypt_items();
+    if (ecrypt_secure_cell_decrypt_seal_batch(master_key,
+                                              sizeof(master_key),
+                                              decrypt_items,
+                                              ITEM_COUNT,
+                                              plain,
+                                              &plain_length,
+                                              thread_count)
+        != ECRYPT_SUCCESS) {
+        return false;
+    }
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        if (decrypt_items[i].status != ECRYPT_SUCCESS || decrypt_items[i].output_length != message_length(i)
+            || memcmp(plain + decrypt_items[i].output_offset, messages[i], message_length(i)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void batch_sizes(void)
+{
+    size_t cells_length = 0;
+    size_t expected = 0;
+    size_t i;
+
+    fill_items();
+    for (i = 0; i < ITEM_COUNT; i++) {
+        expected += DEFAULT_AUTH_TOKEN_LENGTH + message_length(i);
+    }
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_batch(master_key,
+                                                                sizeof(master_key),
+                                                                items,
+                                                                ITEM_COUNT,
+                                                                NULL,
+                                                                &cells_length,
+                                                                0)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cells_length == expected,
+                          "batch: arena size query");
+    testsuite_fail_unless(items[1].output_offset == items[0].output_length
+                              && items[1].output_length == DEFAULT_AUTH_TOKEN_LENGTH + message_length(1),
+                          "batch: record offsets are filled in");
+
+    cells_length = expected - 1;
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_batch(master_key,
+                                                                sizeof(master_key),
+                                                                items,
+                                                                ITEM_COUNT,
+                                                                cells,
+                                                                &cells_length,
+                                                                0)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cells_length == expected,
+                          "batch: short arena is rejected");
+}
+
+static void batch_compatible_with_single_records(void)
+{
+    size_t cells_length = sizeof(cells);
+    uint8_t single[MAX_MESSAGE_LENGTH];
+    size_t single_length = sizeof(single);
+    const size_t index = 7;
+
+    fill_items();
+    ecrypt_secure_cell_encrypt_seal_batch(master_key, sizeof(master_key), items, ITEM_COUNT, cells, &cells_length, 4);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          items[index].user_context,
+                                                          items[index].user_context_length,
+                                                          cells + items[index].output_offset,
+                                                          items[index].output_length,
+                                                          single,
+                                                          &single_length)
+                                  == ECRYPT_SUCCESS
+                              && single_length == message_length(index)
+                              && !memcmp(single, messages[index], single_length),
+                          "batch: records are regular sealed cells");
+}
+
+static void batch_rejects_tampering(void)
+{
+    size_t cells_length = sizeof(cells);
+    size_t plain_length = sizeof(plain);
+    bool others_intact = true;
+    size_t i;
+
+    fill_items();
+    ecrypt_secure_cell_encrypt_seal_batch(master_key, sizeof(master_key), items, ITEM_COUNT, cells, &cells_length, 4);
+    cells[items[3].output_offset + items[3].output_length - 1] ^= 0x01;
+    items[5].user_context = NULL;
+    items[5].user_context_length = 0;
+
+    fill_decrypt_items();
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_batch(master_key,
+                                                                sizeof(master_key),
+                                                                decrypt_items,
+                                                                ITEM_COUNT,
+                                                                plain,
+                                                                &plain_length,
+                                                                4)
+                              == ECRYPT_FAIL,
+                          "batch: failures are reported");
+    testsuite_fail_unless(decrypt_items[3].status == ECRYPT_FAIL, "batch: corrupted record is detected");
+    testsuite_fail_unless(decrypt_items[5].status == ECRYPT_FAIL, "batch: wrong context is detected");
+    for (i = 0; i < ITEM_COUNT; i++) {
+        if (i != 3 && i != 5 && decrypt_items[i].status != ECRYPT_SUCCESS) {
+            others_intact = false;
+        }
+    }
+    testsuite_fail_unless(others_intact, "batch: other records are decrypted");
+
+    fill_decrypt_items();
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_batch(wrong_master_key,
+                                                                sizeof(wrong_master_key),
+                                                                decrypt_items,
+                                                                ITEM_COUNT,
+                                                                plain,
+                                                                &plain_length,
+                                                                4)
+                                  == ECRYPT_FAIL
+                              && decrypt_items[0].status == ECRYPT_FAIL,
+                          "batch: wrong key is rejected");
+}
+
+void run_secure_cell_batch_test(void)
+{
+    size_t i;
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        testsuite_fill_random(messages[i], sizeof(messages[i]), (uint32_t)(0xba7c + i));
+    }
+
+    testsuite_fail_unless(batch_round_trip(1), "batch: single thread");
+    testsuite_fail_unless(batch_round_trip(4), "batch: four threads");
+    testsuite_fail_unless(batch_round_trip(0), "batch: one thread per CPU");
+    batch_sizes();
+    batch_compatible_with_single_records();
+    batch_rejects_tampering();
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define ITEM_COUNT 200
+#define MAX_VALUE_LENGTH 30
+
+static const uint8_t master_key[32] = "blind index test master key 0123";
+static const uint8_t other_master_key[32] = "blind index test other key 01234";
+static const uint8_t column_context[] = "users.email";
+static const uint8_t other_column_context[] = "users.phone";
+static const uint8_t value[] = "alice@example.com";
+static const uint8_t other_value[] = "alice@example.con";
+
+static uint8_t values[ITEM_COUNT * MAX_VALUE_LENGTH];
+static size_t offsets[ITEM_COUNT + 1];
+static uint8_t tags[ITEM_COUNT * ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH];
+
+static void blind_index(const uint8_t* key,
+                        const uint8_t* context,
+                        size_t context_length,
+                        const uint8_t* data,
+                        size_t data_length,
+                        uint8_t* tag,
+                        size_t tag_length)
+{
+    memset(tag, 0, tag_length);
+    ecrypt_secure_cell_blind_index(key, 32, context, context_length, data, data_length, tag, tag_length);
+}
+
+static void blind_index_tags(void)
+{
+    uint8_t tag[ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH];
+    uint8_t other_tag[ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH];
+    uint8_t short_tag[8];
+
+    blind_index(master_key, column_context, sizeof(column_context), value, sizeof(value), tag, sizeof(tag));
+    blind_index(master_key, column_context, sizeof(column_context), value, sizeof(value), other_tag, sizeof(other_tag));
+    testsuite_fail_unless(!memcmp(tag, other_tag, sizeof(tag)), "blind index: equal values have equal tags");
+
+    blind_index(master_key, column_context, sizeof(column_context), other_value, sizeof(other_value), other_tag, sizeof(other_tag));
+    testsuite_fail_if(!memcmp(tag, other_tag, sizeof(tag)), "blind index: different values");
+    blind_index(other_master_key, column_context, sizeof(column_context), value, sizeof(value), other_tag, sizeof(other_tag));
+    testsuite_fail_if(!memcmp(tag, other_tag, sizeof(tag)), "blind index: different keys");
+    blind_index(master_key, other_column_context, sizeof(other_column_context), value, sizeof(value), other_tag, sizeof(other_tag));
+    testsuite_fail_if(!memcmp(tag, other_tag, sizeof(tag)), "blind index: different columns");
+
+    blind_index(master_key, column_context, sizeof(column_context), value, sizeof(value), short_tag, sizeof(short_tag));
+    testsuite_fail_unless(!memcmp(tag, short_tag, sizeof(short_tag)), "blind index: short tags are prefixes");
+
+    blind_index(master_key, NULL, 0, NULL, 0, other_tag, sizeof(other_tag));
+    blind_index(master_key, NULL, 0, value, 1, tag, sizeof(tag));
+    testsuite_fail_if(!memcmp(tag, other_tag, sizeof(tag)), "blind index: empty value");
+
+    testsuite_fail_unless(ecrypt_secure_cell_blind_index(master_key, sizeof(master_key), NULL, 0, value, sizeof(value), tag, 0)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "blind index: empty tag");
+    testsuite_fail_unless(ecrypt_secure_cell_blind_index(master_key,
+                                                         sizeof(master_key),
+                                                         NULL,
+                                                         0,
+                                                         value,
+                                                         sizeof(value),
+                                                         tag,
+                                                         ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH + 1)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "blind index: too long tag");
+}
+
+static void blind_index_batch(size_t tag_length, size_t thread_count)
+{
+    uint8_t expected[ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH];
+    bool all_match = true;
+    size_t i;
+
+    if (ecrypt_secure_cell_blind_index_batch(master_key,
+                                             sizeof(master_key),
+                                             column_context,
+                                             sizeof(column_context),
+                                             values,
+                                             offsets,
+                                             ITEM_COUNT,
+                                             tags,
+                                             tag_length,
+                                             thread_count)
+        != ECRYPT_SUCCESS) {
+        all_match = false;
+    }
+    for (i = 0; i < ITEM_COUNT && all_match; i++) {
+        blind_index(master_key,
+                    column_context,
+                    sizeof(column_context),
+                    values + offsets[i],
+                    offsets[i + 1] - offsets[i],
+                    expected,
+                    tag_length);
+        if (memcmp(tags + i * tag_length, expected, tag_length) != 0) {
+            all_match = false;
+        }
+    }
+    testsuite_fail_unless(all_match, "blind index batch: same tags as one by one");
+}
+
+void run_secure_cell_blind_index_test(void)
+{
+    size_t i;
+
+    offsets[0] = 0;
+    for (i = 0; i < ITEM_COUNT; i++) {
+        /* Includes empty values */
+        offsets[i + 1] = offsets[i] + i % MAX_VALUE_LENGTH;
+    }
+    testsuite_fill_random(values, sizeof(values), 0xb11d);
+
+    blind_index_tags();
+    blind_index_batch(ECRYPT_SCELL_BLIND_INDEX_MAX_LENGTH, 1);
+    blind_index_batch(8, 4);
+    blind_index_batch(3, 0);
+
+    offsets[5] = offsets[4] - 1;
+    testsuite_fail_unless(ecrypt_secure_cell_blind_index_batch(master_key,
+                                                               sizeof(master_key),
+                                                               NULL,
+                                                               0,
+                                                               values,
+                                                               offsets,
+                                                               ITEM_COUNT,
+                                                               tags,
+                                                               8,
+                                                               1)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "blind index batch: decreasing offsets");
+}
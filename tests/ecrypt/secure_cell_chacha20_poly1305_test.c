@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 150
+
+static const uint8_t master_key[32] = "chacha test master key 012345678";
+static const uint8_t wrong_master_key[32] = "chacha test wrong key 0123456789";
+static const uint8_t user_context[] = "chacha test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static bool decrypts(const uint8_t* key, const uint8_t* cell, size_t cell_length)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal(key,
+                                           32,
+                                           user_context,
+                                           sizeof(user_context),
+                                           cell,
+                                           cell_length,
+                                           plain,
+                                           &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static void seal_chacha20_poly1305(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t aes_cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t aes_cell_length = sizeof(aes_cell);
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                                             sizeof(master_key),
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             message,
+                                                             sizeof(message),
+                                                             cell,
+                                                             &cell_length,
+                                                             ECRYPT_SCELL_FLAG_CHACHA20_POLY1305)
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(cell),
+                          "ChaCha20-Poly1305 seal: same size as AES-GCM");
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    aes_cell,
+                                    &aes_cell_length);
+    testsuite_fail_unless(memcmp(cell, aes_cell, sizeof(uint32_t)) != 0,
+                          "ChaCha20-Poly1305 seal: algorithm is recorded");
+    testsuite_fail_unless(decrypts(master_key, cell, cell_length), "ChaCha20-Poly1305 seal: decrypts without flags");
+    testsuite_fail_if(decrypts(wrong_master_key, cell, cell_length), "ChaCha20-Poly1305 seal: wrong key is rejected");
+
+    for (i = 0; i < cell_length; i++) {
+        cell[i] ^= 0x20;
+        if (decrypts(master_key, cell, cell_length)) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x20;
+    }
+    testsuite_fail_unless(all_rejected, "ChaCha20-Poly1305 seal: every corrupted byte is detected");
+}
+
+static void seal_ctx_chacha20_poly1305(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t other[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t other_length = sizeof(other);
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(ctx, ECRYPT_SCELL_FLAG_CHACHA20_POLY1305)
+                              == ECRYPT_SUCCESS,
+                          "ChaCha20-Poly1305 context: set flags");
+    ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                             user_context,
+                                             sizeof(user_context),
+                                             message,
+                                             sizeof(message),
+                                             cell,
+                                             &cell_length);
+    testsuite_fail_unless(decrypts(master_key, cell, cell_length),
+                          "ChaCha20-Poly1305 context: compatible with regular decryption");
+
+    ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                       sizeof(master_key),
+                                       user_context,
+                                       sizeof(user_context),
+                                       message,
+                                       sizeof(message),
+                                       other,
+                                       &other_length,
+                                       ECRYPT_SCELL_FLAG_CHACHA20_POLY1305);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   other,
+                                                                   other_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "ChaCha20-Poly1305 context: decrypts one-shot cells");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+static void token_protect_chacha20_poly1305(void)
+{
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    uint8_t encrypted[MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t token_length = sizeof(token);
+    size_t encrypted_length = sizeof(encrypted);
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_ex(master_key,
+                                                                      sizeof(master_key),
+                                                                      user_context,
+                                                                      sizeof(user_context),
+                                                                      message,
+                                                                      sizeof(message),
+                                                                      token,
+                                                                      &token_length,
+                                                                      encrypted,
+                                                                      &encrypted_length,
+                                                                      ECRYPT_SCELL_FLAG_CHACHA20_POLY1305)
+                                  == ECRYPT_SUCCESS
+                              && token_length == sizeof(token) && encrypted_length == sizeof(message),
+                          "ChaCha20-Poly1305 token protect: encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   encrypted,
+                                                                   encrypted_length,
+                                                                   token,
+                                                                   token_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "ChaCha20-Poly1305 token protect: decryption");
+
+    encrypted[0] ^= 0x01;
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                               sizeof(master_key),
+                                                               user_context,
+                                                               sizeof(user_context),
+                                                               encrypted,
+                                                               encrypted_length,
+                                                               token,
+                                                               token_length,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "ChaCha20-Poly1305 token protect: corrupted data is rejected");
+}
+
+void run_secure_cell_chacha20_poly1305_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xc4a);
+
+    seal_chacha20_poly1305();
+    seal_ctx_chacha20_poly1305();
+    token_protect_chacha20_poly1305();
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define COLUMN_TOKEN_STRIDE 48
+#define ITEM_COUNT 150
+#define MAX_VALUE_LENGTH 40
+#define CONTEXT_LENGTH 8
+
+static const uint8_t master_key[32] = "column test master key 012345678";
+
+static uint8_t values[ITEM_COUNT * MAX_VALUE_LENGTH];
+static uint8_t encrypted[ITEM_COUNT * MAX_VALUE_LENGTH];
+static uint8_t decrypted[ITEM_COUNT * MAX_VALUE_LENGTH];
+static uint8_t contexts[ITEM_COUNT * CONTEXT_LENGTH];
+static uint8_t tokens[ITEM_COUNT * COLUMN_TOKEN_STRIDE];
+static size_t offsets[ITEM_COUNT + 1];
+static size_t context_offsets[ITEM_COUNT + 1];
+
+static void fill_column(void)
+{
+    size_t i;
+
+    offsets[0] = 0;
+    context_offsets[0] = 0;
+    for (i = 0; i < ITEM_COUNT; i++) {
+        /* Many values have the same length to exercise shared keys */
+        offsets[i + 1] = offsets[i] + 1 + i % MAX_VALUE_LENGTH;
+        context_offsets[i + 1] = context_offsets[i] + i % (CONTEXT_LENGTH + 1);
+    }
+    testsuite_fill_random(values, offsets[ITEM_COUNT], 0xc01);
+    testsuite_fill_random(contexts, context_offsets[ITEM_COUNT], 0xc02);
+}
+
+static ecrypt_status_t encrypt_column(const uint8_t* input, uint8_t* output, bool with_contexts, size_t thread_count)
+{
+    size_t tokens_length = sizeof(tokens);
+
+    return ecrypt_secure_cell_encrypt_token_protect_column(master_key,
+                                                           sizeof(master_key),
+                                                           input,
+                                                           offsets,
+                                                           ITEM_COUNT,
+                                                           with_contexts ? contexts : NULL,
+                                                           with_contexts ? context_offsets : NULL,
+                                                           output,
+                                                           tokens,
+                                                           &tokens_length,
+                                                           thread_count);
+}
+
+static ecrypt_status_t decrypt_column(const uint8_t* input, uint8_t* output, bool with_contexts, size_t thread_count)
+{
+    return ecrypt_secure_cell_decrypt_token_protect_column(master_key,
+                                                           sizeof(master_key),
+                                                           input,
+                                                           offsets,
+                                                           ITEM_COUNT,
+                                                           with_contexts ? contexts : NULL,
+                                                           with_contexts ? context_offsets : NULL,
+                                                           tokens,
+                                                           sizeof(tokens),
+                                                           output,
+                                                           thread_count);
+}
+
+static bool matches_token_protect(bool with_contexts)
+{
+    uint8_t plain[MAX_VALUE_LENGTH];
+    size_t i;
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        size_t length = offsets[i + 1] - offsets[i];
+        size_t plain_length = sizeof(plain);
+
+        if (ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                     sizeof(master_key),
+                                                     with_contexts ? contexts + context_offsets[i] : NULL,
+                                                     with_contexts ? context_offsets[i + 1] - context_offsets[i] : 0,
+                                                     encrypted + offsets[i],
+                                                     length,
+                                                     tokens + i * COLUMN_TOKEN_STRIDE,
+                                                     DEFAULT_AUTH_TOKEN_LENGTH,
+                                                     plain,
+                                                     &plain_length)
+                != ECRYPT_SUCCESS
+            || plain_length != length || memcmp(plain, values + offsets[i], length) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void column_round_trip(bool with_contexts)
+{
+    static const size_t thread_counts[] = {1, 4, 0};
+    size_t tokens_length = 0;
+    bool round_trips = true;
+    bool compatible = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_column(master_key,
+                                                                          sizeof(master_key),
+                                                                          values,
+                                                                          offsets,
+                                                                          ITEM_COUNT,
+                                                                          NULL,
+                                                                          NULL,
+                                                                          encrypted,
+                                                                          NULL,
+                                                                          &tokens_length,
+                                                                          1)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && tokens_length == sizeof(tokens),
+                          "column: size query");
+
+    for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        if (encrypt_column(values, encrypted, with_contexts, thread_counts[i]) != ECRYPT_SUCCESS
+            || decrypt_column(encrypted, decrypted, with_contexts, thread_counts[i]) != ECRYPT_SUCCESS
+            || memcmp(decrypted, values, offsets[ITEM_COUNT]) != 0) {
+            round_trips = false;
+        }
+        if (!matches_token_protect(with_contexts)) {
+            compatible = false;
+        }
+    }
+    testsuite_fail_unless(round_trips, with_contexts ? "column with contexts: round trip" : "column: round trip");
+    testsuite_fail_unless(compatible,
+                          with_contexts ? "column with contexts: compatible with Token Protect"
+                                        : "column: compatible with Token Protect");
+}
+
+static void column_in_place_and_tamper(void)
+{
+    bool padded = true;
+    size_t i;
+
+    memcpy(decrypted, values, offsets[ITEM_COUNT]);
+    testsuite_fail_unless(encrypt_column(decrypted, decrypted, true, 2) == ECRYPT_SUCCESS
+                              && decrypt_column(decrypted, decrypted, true, 2) == ECRYPT_SUCCESS
+                              && !memcmp(decrypted, values, offsets[ITEM_COUNT]),
+                          "column: in place");
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        size_t j;
+
+        for (j = DEFAULT_AUTH_TOKEN_LENGTH; j < COLUMN_TOKEN_STRIDE; j++) {
+            if (tokens[i * COLUMN_TOKEN_STRIDE + j] != 0) {
+                padded = false;
+            }
+        }
+    }
+    testsuite_fail_unless(padded, "column: tokens are padded with zeros");
+
+    encrypt_column(values, encrypted, true, 2);
+    encrypted[offsets[ITEM_COUNT / 2]] ^= 0x01;
+    memset(decrypted, 0xAA, sizeof(decrypted));
+    testsuite_fail_unless(decrypt_column(encrypted, decrypted, true, 2) == ECRYPT_FAIL, "column: corrupted value");
+    for (i = 0; i < offsets[ITEM_COUNT]; i++) {
+        if (decrypted[i] != 0) {
+            break;
+        }
+    }
+    testsuite_fail_unless(i == offsets[ITEM_COUNT], "column: output is wiped on failure");
+    encrypted[offsets[ITEM_COUNT / 2]] ^= 0x01;
+
+    testsuite_fail_unless(decrypt_column(encrypted, decrypted, false, 2) == ECRYPT_FAIL, "column: missing contexts");
+}
+
+static void column_params(void)
+{
+    size_t stride = 0;
+    size_t saved_offset = offsets[10];
+
+    testsuite_fail_unless(ecrypt_secure_cell_token_protect_column_stride(&stride) == ECRYPT_SUCCESS
+                              && stride == COLUMN_TOKEN_STRIDE
+                              && stride % ECRYPT_SCELL_COLUMN_TOKEN_ALIGNMENT == 0,
+                          "column: token stride");
+
+    offsets[10] = offsets[9];
+    testsuite_fail_unless(encrypt_column(values, encrypted, false, 1) == ECRYPT_INVALID_PARAMETER,
+                          "column: empty value is rejected");
+    offsets[10] = saved_offset;
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_column(master_key,
+                                                                          sizeof(master_key),
+                                                                          encrypted,
+                                                                          offsets,
+                                                                          ITEM_COUNT,
+                                                                          NULL,
+                                                                          NULL,
+                                                                          tokens,
+                                                                          sizeof(tokens) - 1,
+                                                                          decrypted,
+                                                                          1)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "column: tokens length must match item count");
+}
+
+void run_secure_cell_column_test(void)
+{
+    fill_column();
+
+    column_round_trip(false);
+    column_round_trip(true);
+    column_in_place_and_tamper();
+    column_params();
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MAX_MESSAGE_LENGTH 20000
+
+static const uint8_t master_key[32] = "compact token test master key 01";
+static const uint8_t user_context[] = "compact token test context";
+
+static uint8_t message[MAX_MESSAGE_LENGTH];
+static uint8_t cell[MAX_MESSAGE_LENGTH + 64];
+static uint8_t other_cell[MAX_MESSAGE_LENGTH + 64];
+static uint8_t plain[MAX_MESSAGE_LENGTH + 64];
+
+static size_t compact_token_length(size_t message_length)
+{
+    /* algorithm byte, varint length, IV, tag */
+    size_t varint_length = message_length < 128 ? 1 : message_length < 16384 ? 2 : 3;
+    return 1 + varint_length + 12 + 16;
+}
+
+static bool cell_rejected(const uint8_t* input, size_t input_length)
+{
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal(master_key,
+                                           sizeof(master_key),
+                                           user_context,
+                                           sizeof(user_context),
+                                           input,
+                                           input_length,
+                                           plain,
+                                           &plain_length)
+           != ECRYPT_SUCCESS;
+}
+
+static void compact_seal_round_trip(uint32_t flags)
+{
+    static const size_t lengths[] = {1, 127, 128, 16383, 16384, MAX_MESSAGE_LENGTH};
+    bool sizes_match = true;
+    bool round_trips = true;
+    size_t i;
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        size_t query_length = 0;
+        size_t cell_length = sizeof(cell);
+        size_t plain_length = sizeof(plain);
+
+        ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                           sizeof(master_key),
+                                           user_context,
+                                           sizeof(user_context),
+                                           message,
+                                           lengths[i],
+                                           NULL,
+                                           &query_length,
+                                           flags);
+        if (ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                               sizeof(master_key),
+                                               user_context,
+                                               sizeof(user_context),
+                                               message,
+                                               lengths[i],
+                                               cell,
+                                               &cell_length,
+                                               flags)
+            != ECRYPT_SUCCESS) {
+            round_trips = false;
+            continue;
+        }
+        if (query_length != cell_length
+            || cell_length != compact_token_length(lengths[i]) + lengths[i]) {
+            sizes_match = false;
+        }
+        if (ecrypt_secure_cell_decrypt_seal(master_key,
+                                            sizeof(master_key),
+                                            user_context,
+                                            sizeof(user_context),
+                                            cell,
+                                            cell_length,
+                                            plain,
+                                            &plain_length)
+                != ECRYPT_SUCCESS
+            || plain_length != lengths[i] || memcmp(plain, message, lengths[i]) != 0) {
+            round_trips = false;
+        }
+    }
+
+    testsuite_fail_unless(sizes_match, "compact cell: token length");
+    testsuite_fail_unless(round_trips, "compact cell: round trip");
+}
+
+static void compact_seal_tamper(uint32_t flags)
+{
+    size_t cell_length = sizeof(cell);
+    size_t message_length = 200;
+    bool all_rejected = true;
+    size_t i;
+
+    ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                       sizeof(master_key),
+                                       user_context,
+                                       sizeof(user_context),
+                                       message,
+                                       message_length,
+                                       cell,
+                                       &cell_length,
+                                       flags);
+
+    for (i = 0; i < cell_length; i++) {
+        memcpy(other_cell, cell, cell_length);
+        other_cell[i] ^= 0x01;
+        if (!cell_rejected(other_cell, cell_length)) {
+            all_rejected = false;
+        }
+    }
+    testsuite_fail_unless(all_rejected, "compact cell: every corrupted byte is detected");
+    testsuite_fail_unless(cell_rejected(cell, cell_length - 1), "compact cell: truncation");
+
+    memcpy(other_cell, cell, cell_length);
+    other_cell[cell_length] = 0;
+    testsuite_fail_unless(cell_rejected(other_cell, cell_length + 1), "compact cell: extension");
+}
+
+static void compact_token_protect(uint32_t flags)
+{
+    uint8_t token[64];
+    size_t token_length = sizeof(token);
+    size_t message_length = 1000;
+    size_t encrypted_length = sizeof(cell);
+    size_t plain_length = sizeof(plain);
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_ex(master_key,
+                                                                      sizeof(master_key),
+                                                                      user_context,
+                                                                      sizeof(user_context),
+                                                                      message,
+                                                                      message_length,
+                                                                      token,
+                                                                      &token_length,
+                                                                      cell,
+                                                                      &encrypted_length,
+                                                                      flags)
+                                  == ECRYPT_SUCCESS
+                              && token_length == compact_token_length(message_length)
+                              && token_length < DEFAULT_AUTH_TOKEN_LENGTH,
+                          "compact token: encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   cell,
+                                                                   encrypted_length,
+                                                                   token,
+                                                                   token_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == message_length
+                              && !memcmp(plain, message, message_length),
+                          "compact token: decryption");
+
+    for (i = 0; i < token_length; i++) {
+        token[i] ^= 0x01;
+        plain_length = sizeof(plain);
+        if (ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                     sizeof(master_key),
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     cell,
+                                                     encrypted_length,
+                                                     token,
+                                                     token_length,
+                                                     plain,
+                                                     &plain_length)
+            == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        token[i] ^= 0x01;
+    }
+    testsuite_fail_unless(all_rejected, "compact token: every corrupted byte is detected");
+}
+
+static void compact_seal_with_ctx(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    size_t message_length = 300;
+    size_t cell_length = 0;
+    size_t plain_length = sizeof(plain);
+
+    ecrypt_secure_cell_seal_ctx_set_flags(ctx, ECRYPT_SCELL_FLAG_COMPACT);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   message,
+                                                                   message_length,
+                                                                   NULL,
+                                                                   &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == compact_token_length(message_length) + message_length,
+                          "compact context: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   message,
+                                                                   message_length,
+                                                                   cell,
+                                                                   &cell_length)
+                                  == ECRYPT_SUCCESS
+                              && ecrypt_secure_cell_decrypt_seal(master_key,
+                                                                 sizeof(master_key),
+                                                                 user_context,
+                                                                 sizeof(user_context),
+                                                                 cell,
+                                                                 cell_length,
+                                                                 plain,
+                                                                 &plain_length)
+                                     == ECRYPT_SUCCESS
+                              && plain_length == message_length && !memcmp(plain, message, message_length),
+                          "compact context: compatible with regular decryption");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+void run_secure_cell_compact_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xc0ffee);
+
+    compact_seal_round_trip(ECRYPT_SCELL_FLAG_COMPACT);
+    compact_seal_tamper(ECRYPT_SCELL_FLAG_COMPACT);
+    compact_token_protect(ECRYPT_SCELL_FLAG_COMPACT);
+
+    compact_seal_round_trip(ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305);
+    compact_seal_tamper(ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305);
+    compact_token_protect(ECRYPT_SCELL_FLAG_COMPACT | ECRYPT_SCELL_FLAG_CHACHA20_POLY1305);
+
+    compact_seal_with_ctx();
+}
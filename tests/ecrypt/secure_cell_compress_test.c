@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define COMPRESSED_AUTH_TOKEN_LENGTH (DEFAULT_AUTH_TOKEN_LENGTH + 4)
+#define MESSAGE_LENGTH 4096
+#define BATCH_ITEM_COUNT 8
+
+static const uint8_t master_key[32] = "compression test master key 0123";
+static const uint8_t user_context[] = "compression test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t cell[MESSAGE_LENGTH + 256];
+static uint8_t other_cell[MESSAGE_LENGTH + 256];
+static uint8_t plain[MESSAGE_LENGTH + 256];
+static uint8_t batch_arena[BATCH_ITEM_COUNT * (MESSAGE_LENGTH + 256)];
+static uint8_t reseal_arena[BATCH_ITEM_COUNT * (MESSAGE_LENGTH + 256)];
+
+static void fill_compressible(uint8_t* buffer, size_t length)
+{
+    static const char record[] = "{\"user\":\"alice\",\"role\":\"admin\",\"active\":true}\n";
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        buffer[i] = (uint8_t)record[i % (sizeof(record) - 1)];
+    }
+}
+
+static ecrypt_status_t seal_compressed(uint8_t* output, size_t* output_length)
+{
+    return ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                              sizeof(master_key),
+                                              user_context,
+                                              sizeof(user_context),
+                                              message,
+                                              sizeof(message),
+                                              output,
+                                              output_length,
+                                              ECRYPT_SCELL_FLAG_COMPRESS);
+}
+
+static ecrypt_status_t open_cell(const uint8_t* input, size_t input_length, size_t* plain_length)
+{
+    *plain_length = sizeof(plain);
+    return ecrypt_secure_cell_decrypt_seal(master_key,
+                                           sizeof(master_key),
+                                           user_context,
+                                           sizeof(user_context),
+                                           input,
+                                           input_length,
+                                           plain,
+                                           plain_length);
+}
+
+static bool cell_rejected(const uint8_t* input, size_t input_length)
+{
+    size_t plain_length = 0;
+
+    if (open_cell(input, input_length, &plain_length) == ECRYPT_SUCCESS) {
+        return false;
+    }
+    return ecrypt_secure_cell_verify_seal(master_key,
+                                          sizeof(master_key),
+                                          user_context,
+                                          sizeof(user_context),
+                                          input,
+                                          input_length)
+           != ECRYPT_SUCCESS;
+}
+
+static void compressed_round_trip(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = NULL;
+    ecrypt_secure_cell_info_t info;
+    size_t cell_length = 0;
+    size_t plain_length = 0;
+
+    fill_compressible(message, sizeof(message));
+
+    testsuite_fail_unless(seal_compressed(NULL, &cell_length) == ECRYPT_BUFFER_TOO_SMALL,
+                          "compressed cell: size query");
+    testsuite_fail_unless(cell_length >= COMPRESSED_AUTH_TOKEN_LENGTH + sizeof(message),
+                          "compressed cell: size query is an upper bound");
+
+    cell_length = sizeof(cell);
+    testsuite_fail_unless(seal_compressed(cell, &cell_length) == ECRYPT_SUCCESS,
+                          "compressed cell: encryption");
+    testsuite_fail_unless(cell_length < sizeof(message) / 4, "compressed cell: message shrinks");
+
+    testsuite_fail_unless(open_cell(cell, cell_length, &plain_length) == ECRYPT_SUCCESS,
+                          "compressed cell: decryption");
+    testsuite_fail_unless(plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message)),
+                          "compressed cell: decrypted message matches");
+
+    ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   cell,
+                                                                   cell_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "compressed cell: decryption with keyed context");
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(cell, cell_length, &info) == ECRYPT_SUCCESS,
+                          "compressed cell: inspection");
+    testsuite_fail_unless(info.compressed && !info.compact, "compressed cell: inspected mark");
+    testsuite_fail_unless(info.auth_token_length == COMPRESSED_AUTH_TOKEN_LENGTH,
+                          "compressed cell: inspected token length");
+    testsuite_fail_unless(info.message_length == sizeof(message),
+                          "compressed cell: inspected length is uncompressed");
+}
+
+static void compressed_ctx_round_trip(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key,
+                                                                            sizeof(master_key));
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(ctx,
+                                                                ECRYPT_SCELL_FLAG_COMPRESS
+                                                                    | ECRYPT_SCELL_FLAG_COMPACT)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "keyed context: compression does not combine with compact tokens");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(ctx, ECRYPT_SCELL_FLAG_COMPRESS)
+                              == ECRYPT_SUCCESS,
+                          "keyed context: compression flag");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   cell,
+                                                                   &cell_length)
+                                  == ECRYPT_SUCCESS
+                              && cell_length < sizeof(message) / 4,
+                          "keyed context: compressed encryption");
+    testsuite_fail_unless(open_cell(cell, cell_length, &plain_length) == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "keyed context: compressed cell decrypts with master key");
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+static void incompressible_fallback(void)
+{
+    ecrypt_secure_cell_info_t info;
+    size_t lengths[] = {1, 16, 100, sizeof(message)};
+    size_t i;
+
+    testsuite_fill_random(message, sizeof(message), 0x5eed);
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        size_t cell_length = sizeof(cell);
+        size_t plain_length = 0;
+        ecrypt_status_t res = ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                                                 sizeof(master_key),
+                                                                 user_context,
+                                                                 sizeof(user_context),
+                                                                 message,
+                                                                 lengths[i],
+                                                                 cell,
+                                                                 &cell_length,
+                                                                 ECRYPT_SCELL_FLAG_COMPRESS);
+        testsuite_fail_unless(res == ECRYPT_SUCCESS
+                                  && cell_length == DEFAULT_AUTH_TOKEN_LENGTH + lengths[i],
+                              "incompressible message: sealed uncompressed");
+        testsuite_fail_unless(ecrypt_secure_cell_inspect(cell, cell_length, &info) == ECRYPT_SUCCESS
+                                  && !info.compressed,
+                              "incompressible message: no compression mark");
+        testsuite_fail_unless(open_cell(cell, cell_length, &plain_length) == ECRYPT_SUCCESS
+                                  && plain_length == lengths[i]
+                                  && !memcmp(plain, message, lengths[i]),
+                              "incompressible message: decryption");
+    }
+}
+
+static void compressed_tamper(void)
+{
+    size_t cell_length = sizeof(cell);
+    size_t i;
+    bool all_rejected = true;
+
+    fill_compressible(message, sizeof(message));
+    seal_compressed(cell, &cell_length);
+
+    for (i = 0; i < cell_length; i++) {
+        memcpy(other_cell, cell, cell_length);
+        other_cell[i] ^= 0x01;
+        if (!cell_rejected(other_cell, cell_length)) {
+            all_rejected = false;
+        }
+    }
+    testsuite_fail_unless(all_rejected, "compressed cell: every corrupted byte is detected");
+
+    testsuite_fail_unless(cell_rejected(cell, cell_length - 1), "compressed cell: truncation");
+    testsuite_fail_unless(cell_rejected(cell, DEFAULT_AUTH_TOKEN_LENGTH + 2),
+                          "compressed cell: truncated length field");
+}
+
+static void compression_mark_forgery(void)
+{
+    size_t cell_length = sizeof(cell);
+    size_t other_length = 0;
+    uint32_t length_field = 0;
+
+    fill_compressible(message, sizeof(message));
+    seal_compressed(cell, &cell_length);
+
+    /* Strip the mark along with uncompressed length */
+    memcpy(other_cell, cell, DEFAULT_AUTH_TOKEN_LENGTH);
+    memcpy(other_cell + DEFAULT_AUTH_TOKEN_LENGTH,
+           cell + COMPRESSED_AUTH_TOKEN_LENGTH,
+           cell_length - COMPRESSED_AUTH_TOKEN_LENGTH);
+    other_cell[1] &= ~0x40;
+    other_length = cell_length - sizeof(uint32_t);
+    testsuite_fail_unless(cell_rejected(other_cell, other_length),
+                          "compressed cell: stripped compression mark");
+
+    /* Inflate the recorded uncompressed length */
+    memcpy(other_cell, cell, cell_length);
+    memcpy(&length_field, other_cell + DEFAULT_AUTH_TOKEN_LENGTH, sizeof(length_field));
+    length_field += 1;
+    memcpy(other_cell + DEFAULT_AUTH_TOKEN_LENGTH, &length_field, sizeof(length_field));
+    testsuite_fail_unless(cell_rejected(other_cell, cell_length),
+                          "compressed cell: modified uncompressed length");
+
+    /* Add the mark to an uncompressed cell */
+    testsuite_fill_random(message, sizeof(message), 0xfeed);
+    cell_length = sizeof(cell);
+    seal_compressed(cell, &cell_length);
+    memcpy(other_cell, cell, DEFAULT_AUTH_TOKEN_LENGTH);
+    length_field = (uint32_t)sizeof(message);
+    memcpy(other_cell + DEFAULT_AUTH_TOKEN_LENGTH, &length_field, sizeof(length_field));
+    memcpy(other_cell + COMPRESSED_AUTH_TOKEN_LENGTH,
+           cell + DEFAULT_AUTH_TOKEN_LENGTH,
+           cell_length - DEFAULT_AUTH_TOKEN_LENGTH);
+    other_cell[1] |= 0x40;
+    other_length = cell_length + sizeof(uint32_t);
+    testsuite_fail_unless(cell_rejected(other_cell, other_length),
+                          "uncompressed cell: added compression mark");
+}
+
+static void compressed_unsupported_apis(void)
+{
+    ecrypt_secure_cell_iovec_t input;
+    ecrypt_secure_cell_iovec_t output;
+    uint8_t* in_place_message = NULL;
+    size_t in_place_length = 0;
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = 0;
+
+    fill_compressible(message, sizeof(message));
+    seal_compressed(cell, &cell_length);
+    memcpy(other_cell, cell, cell_length);
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   other_cell,
+                                                                   cell_length,
+                                                                   &in_place_message,
+                                                                   &in_place_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "compressed cell: in-place decryption rejected");
+    testsuite_fail_unless(!memcmp(other_cell, cell, cell_length),
+                          "compressed cell: left intact by in-place decryption");
+
+    input.base = cell;
+    input.length = cell_length;
+    output.base = plain;
+    output.length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              &input,
+                                                              1,
+                                                              &output,
+                                                              1,
+                                                              &plain_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "compressed cell: scatter/gather decryption rejected");
+}
+
+static void compressed_reseal(void)
+{
+    static const uint8_t new_master_key[32] = "compression test rotated key 456";
+    ecrypt_secure_cell_seal_ctx_t* old_ctx = NULL;
+    ecrypt_secure_cell_seal_ctx_t* new_ctx = NULL;
+    ecrypt_secure_cell_info_t info;
+    size_t cell_length = sizeof(cell);
+    size_t resealed_length = sizeof(other_cell);
+    size_t plain_length = sizeof(plain);
+
+    fill_compressible(message, sizeof(message));
+    seal_compressed(cell, &cell_length);
+
+    testsuite_fail_unless(ecrypt_secure_cell_reseal(master_key,
+                                                    sizeof(master_key),
+                                                    new_master_key,
+                                                    sizeof(new_master_key),
+                                                    user_context,
+                                                    sizeof(user_context),
+                                                    cell,
+                                                    cell_length,
+                                                    other_cell,
+                                                    &resealed_length)
+                              == ECRYPT_SUCCESS,
+                          "compressed cell: reseal");
+    testsuite_fail_unless(resealed_length == cell_length
+                              && ecrypt_secure_cell_inspect(other_cell, resealed_length, &info)
+                                     == ECRYPT_SUCCESS
+                              && info.compressed,
+                          "compressed cell: reseal keeps compression");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(new_master_key,
+                                                          sizeof(new_master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          other_cell,
+                                                          resealed_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "compressed cell: resealed cell decrypts with new key");
+
+    old_ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    new_ctx = ecrypt_secure_cell_seal_ctx_create(new_master_key, sizeof(new_master_key));
+    resealed_length = sizeof(other_cell);
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(old_ctx,
+                                                             new_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             other_cell,
+                                                             &resealed_length)
+                                  == ECRYPT_SUCCESS
+                              && resealed_length == cell_length,
+                          "compressed cell: reseal with keyed contexts keeps compression");
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_ctx(new_ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   other_cell,
+                                                                   resealed_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "compressed cell: resealed cell decrypts with new context");
+    ecrypt_secure_cell_seal_ctx_destroy(old_ctx);
+    ecrypt_secure_cell_seal_ctx_destroy(new_ctx);
+}
+
+static bool ctx_decrypts(ecrypt_secure_cell_seal_ctx_t* ctx, const uint8_t* input, size_t input_length)
+{
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                    user_context,
+                                                    sizeof(user_context),
+                                                    input,
+                                                    input_length,
+                                                    plain,
+                                                    &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static void compressed_reseal_in_place(void)
+{
+    static const uint8_t new_master_key[32] = "compression test rotated key 456";
+    ecrypt_secure_cell_seal_ctx_t* old_ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    ecrypt_secure_cell_seal_ctx_t* new_ctx = ecrypt_secure_cell_seal_ctx_create(new_master_key,
+                                                                                sizeof(new_master_key));
+    ecrypt_secure_cell_info_t info;
+    size_t cell_length = sizeof(cell);
+    size_t resealed_length = 0;
+
+    fill_compressible(message, sizeof(message));
+    seal_compressed(cell, &cell_length);
+
+    /* Same token layout: the cell keeps its length and fits its own buffer */
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(old_ctx,
+                                                             new_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             NULL,
+                                                             &resealed_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length == cell_length,
+                          "compressed reseal: size query reports exact length");
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(old_ctx,
+                                                             new_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             cell,
+                                                             &resealed_length)
+                                  == ECRYPT_SUCCESS
+                              && resealed_length == cell_length && ctx_decrypts(new_ctx, cell, resealed_length),
+                          "compressed reseal: in place into exact-length buffer");
+
+    /* Key ID grows the token, compressed length is known only after compression */
+    ecrypt_secure_cell_seal_ctx_set_flags(old_ctx, ECRYPT_SCELL_FLAG_KEY_ID);
+    resealed_length = 0;
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(new_ctx,
+                                                             old_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             NULL,
+                                                             &resealed_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length > cell_length + 4,
+                          "compressed reseal: size query reports upper bound for new layout");
+    resealed_length = cell_length;
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(new_ctx,
+                                                             old_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             cell,
+                                                             &resealed_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length == cell_length + 4 && ctx_decrypts(new_ctx, cell, cell_length),
+                          "compressed reseal: short buffer reports real length, input intact");
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(new_ctx,
+                                                             old_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             cell,
+                                                             &resealed_length)
+                                  == ECRYPT_SUCCESS
+                              && resealed_length == cell_length + 4 && ctx_decrypts(old_ctx, cell, resealed_length),
+                          "compressed reseal: buffer below upper bound is enough");
+
+    /* Uncompressed cell gets compressed by new context, below upper bound too */
+    cell_length = sizeof(cell);
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    cell,
+                                    &cell_length);
+    ecrypt_secure_cell_seal_ctx_set_flags(old_ctx, 0);
+    ecrypt_secure_cell_seal_ctx_set_flags(new_ctx, ECRYPT_SCELL_FLAG_COMPRESS);
+    resealed_length = cell_length;
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(old_ctx,
+                                                             new_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             cell,
+                                                             &resealed_length)
+                                  == ECRYPT_SUCCESS
+                              && resealed_length < cell_length && ctx_decrypts(new_ctx, cell, resealed_length)
+                              && ecrypt_secure_cell_inspect(cell, resealed_length, &info) == ECRYPT_SUCCESS
+                              && info.compressed,
+                          "compressed reseal: new context compresses in place");
+
+    ecrypt_secure_cell_seal_ctx_destroy(old_ctx);
+    ecrypt_secure_cell_seal_ctx_destroy(new_ctx);
+}
+
+static void compressed_batch(void)
+{
+    static const uint8_t new_master_key[32] = "compression test rotated key 456";
+    ecrypt_secure_cell_batch_item_t reseal_items[BATCH_ITEM_COUNT];
+    size_t reseal_length = 0;
+    size_t cells_length = 0;
+    ecrypt_secure_cell_batch_item_t items[BATCH_ITEM_COUNT];
+    size_t arena_length = 0;
+    size_t i;
+    bool all_compressed = true;
+    bool all_decrypted = true;
+
+    fill_compressible(message, sizeof(message));
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < BATCH_ITEM_COUNT; i++) {
+        items[i].input = message + i;
+        items[i].input_length = sizeof(message) / 2 + i * 100;
+        items[i].user_context = user_context;
+        items[i].user_context_length = sizeof(user_context);
+    }
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_batch_ex(master_key,
+                                                                   sizeof(master_key),
+                                                                   items,
+                                                                   BATCH_ITEM_COUNT,
+                                                                   NULL,
+                                                                   &arena_length,
+                                                                   1,
+                                                                   ECRYPT_SCELL_FLAG_COMPRESS)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && arena_length <= sizeof(batch_arena),
+                          "compressed batch: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_batch_ex(master_key,
+                                                                   sizeof(master_key),
+                                                                   items,
+                                                                   BATCH_ITEM_COUNT,
+                                                                   batch_arena,
+                                                                   &arena_length,
+                                                                   4,
+                                                                   ECRYPT_SCELL_FLAG_COMPRESS)
+                              == ECRYPT_SUCCESS,
+                          "compressed batch: encryption");
+
+    for (i = 0; i < BATCH_ITEM_COUNT; i++) {
+        size_t plain_length = 0;
+
+        if (items[i].status != ECRYPT_SUCCESS || items[i].output_length >= items[i].input_length / 4) {
+            all_compressed = false;
+        }
+        if (open_cell(batch_arena + items[i].output_offset, items[i].output_length, &plain_length) != ECRYPT_SUCCESS
+            || plain_length != items[i].input_length || memcmp(plain, items[i].input, plain_length) != 0) {
+            all_decrypted = false;
+        }
+    }
+    testsuite_fail_unless(all_compressed, "compressed batch: records shrink");
+    testsuite_fail_unless(all_decrypted, "compressed batch: records decrypt");
+
+    memset(reseal_items, 0, sizeof(reseal_items));
+    for (i = 0; i < BATCH_ITEM_COUNT; i++) {
+        reseal_items[i].input = batch_arena + items[i].output_offset;
+        reseal_items[i].input_length = items[i].output_length;
+        reseal_items[i].user_context = user_context;
+        reseal_items[i].user_context_length = sizeof(user_context);
+        cells_length += items[i].output_length;
+    }
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_batch(master_key,
+                                                          sizeof(master_key),
+                                                          new_master_key,
+                                                          sizeof(new_master_key),
+                                                          reseal_items,
+                                                          BATCH_ITEM_COUNT,
+                                                          NULL,
+                                                          &reseal_length,
+                                                          1)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && reseal_length == cells_length,
+                          "compressed batch: reseal keeps record lengths");
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_batch(master_key,
+                                                          sizeof(master_key),
+                                                          new_master_key,
+                                                          sizeof(new_master_key),
+                                                          reseal_items,
+                                                          BATCH_ITEM_COUNT,
+                                                          reseal_arena,
+                                                          &reseal_length,
+                                                          4)
+                              == ECRYPT_SUCCESS,
+                          "compressed batch: reseal");
+    all_decrypted = true;
+    for (i = 0; i < BATCH_ITEM_COUNT; i++) {
+        size_t plain_length = sizeof(plain);
+
+        if (reseal_items[i].status != ECRYPT_SUCCESS || reseal_items[i].output_length != items[i].output_length
+            || ecrypt_secure_cell_decrypt_seal(new_master_key,
+                                               sizeof(new_master_key),
+                                               user_context,
+                                               sizeof(user_context),
+                                               reseal_arena + reseal_items[i].output_offset,
+                                               reseal_items[i].output_length,
+                                               plain,
+                                               &plain_length)
+                   != ECRYPT_SUCCESS
+            || plain_length != items[i].input_length || memcmp(plain, items[i].input, plain_length) != 0) {
+            all_decrypted = false;
+        }
+    }
+    testsuite_fail_unless(all_decrypted, "compressed batch: resealed records decrypt with new key");
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_batch_ex(master_key,
+                                                                   sizeof(master_key),
+                                                                   items,
+                                                                   BATCH_ITEM_COUNT,
+                                                                   batch_arena,
+                                                                   &arena_length,
+                                                                   1,
+                                                                   ECRYPT_SCELL_FLAG_COMPRESS | ECRYPT_SCELL_FLAG_COMPACT)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "compressed batch: compact tokens cannot carry compression");
+}
+
+void run_secure_cell_compress_test(void)
+{
+    compressed_round_trip();
+    compressed_ctx_round_trip();
+    incompressible_fallback();
+    compressed_tamper();
+    compression_mark_forgery();
+    compressed_unsupported_apis();
+    compressed_reseal();
+    compressed_reseal_in_place();
+    compressed_batch();
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define RECORD_COUNT 10
+#define RECORD_CAPACITY 512
+
+static const uint8_t key_encryption_key[32] = "envelope test key encryption key";
+static const uint8_t user_context[] = "envelope test context";
+static const uint8_t wrong_user_context[] = "envelope test other context";
+static const uint8_t message[] = "envelope test message";
+
+static uint8_t records[RECORD_COUNT][RECORD_CAPACITY];
+static size_t record_lengths[RECORD_COUNT];
+
+/* Key service stand-in: data keys are sealed with the key-encryption key */
+static ecrypt_status_t wrap_key(const uint8_t* key_id,
+                                size_t key_id_length,
+                                const uint8_t* data_key,
+                                size_t data_key_length,
+                                uint8_t* wrapped_key,
+                                size_t* wrapped_key_length,
+                                void* user_data)
+{
+    (void)user_data;
+    return ecrypt_secure_cell_encrypt_seal(key_encryption_key,
+                                           sizeof(key_encryption_key),
+                                           key_id,
+                                           key_id_length,
+                                           data_key,
+                                           data_key_length,
+                                           wrapped_key,
+                                           wrapped_key_length);
+}
+
+static ecrypt_status_t unwrap_key(const uint8_t* key_id,
+                                  size_t key_id_length,
+                                  const uint8_t* wrapped_key,
+                                  size_t wrapped_key_length,
+                                  uint8_t* data_key,
+                                  size_t* data_key_length,
+                                  void* user_data)
+{
+    (void)user_data;
+    return ecrypt_secure_cell_decrypt_seal(key_encryption_key,
+                                           sizeof(key_encryption_key),
+                                           key_id,
+                                           key_id_length,
+                                           wrapped_key,
+                                           wrapped_key_length,
+                                           data_key,
+                                           data_key_length);
+}
+
+static ecrypt_status_t open_record(ecrypt_secure_cell_envelope_t* envelope,
+                                   const uint8_t* context,
+                                   size_t context_length,
+                                   const uint8_t* record,
+                                   size_t record_length)
+{
+    uint8_t plain[RECORD_CAPACITY];
+    size_t plain_length = sizeof(plain);
+    ecrypt_status_t res = ecrypt_secure_cell_decrypt_envelope(envelope,
+                                                              context,
+                                                              context_length,
+                                                              record,
+                                                              record_length,
+                                                              plain,
+                                                              &plain_length);
+    if (res == ECRYPT_SUCCESS
+        && (plain_length != sizeof(message) || memcmp(plain, message, sizeof(message)) != 0)) {
+        return ECRYPT_FAIL;
+    }
+    return res;
+}
+
+static void envelope_round_trip(void)
+{
+    ecrypt_secure_cell_envelope_t* writer = ecrypt_secure_cell_envelope_create(wrap_key, unwrap_key, NULL);
+    ecrypt_secure_cell_envelope_t* reader = ecrypt_secure_cell_envelope_create(wrap_key, unwrap_key, NULL);
+    uint64_t wrap_count = 0;
+    uint64_t unwrap_count = 0;
+    uint64_t cache_hits = 0;
+    size_t query_length = 0;
+    bool encrypted = true;
+    bool decrypted = true;
+    int i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_envelope_create(NULL, unwrap_key, NULL) == NULL,
+                          "envelope: wrap callback is required");
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_envelope(writer,
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              message,
+                                                              sizeof(message),
+                                                              NULL,
+                                                              &query_length)
+                              == ECRYPT_BUFFER_TOO_SMALL,
+                          "envelope: size query");
+
+    for (i = 0; i < RECORD_COUNT; i++) {
+        record_lengths[i] = sizeof(records[i]);
+        if (ecrypt_secure_cell_encrypt_envelope(writer,
+                                                user_context,
+                                                sizeof(user_context),
+                                                message,
+                                                sizeof(message),
+                                                records[i],
+                                                &record_lengths[i])
+                != ECRYPT_SUCCESS
+            || record_lengths[i] > query_length) {
+            encrypted = false;
+        }
+    }
+    testsuite_fail_unless(encrypted, "envelope: encryption");
+    ecrypt_secure_cell_envelope_stats(writer, &wrap_count, NULL, NULL);
+    testsuite_fail_unless(wrap_count == 1, "envelope: data key is wrapped once");
+
+    for (i = 0; i < RECORD_COUNT; i++) {
+        if (open_record(reader, user_context, sizeof(user_context), records[i], record_lengths[i])
+            != ECRYPT_SUCCESS) {
+            decrypted = false;
+        }
+    }
+    testsuite_fail_unless(decrypted, "envelope: decryption");
+    ecrypt_secure_cell_envelope_stats(reader, NULL, &unwrap_count, &cache_hits);
+    testsuite_fail_unless(unwrap_count == 1 && cache_hits == RECORD_COUNT - 1,
+                          "envelope: data key is unwrapped once");
+
+    ecrypt_secure_cell_envelope_destroy(writer);
+    ecrypt_secure_cell_envelope_destroy(reader);
+}
+
+static void envelope_tamper(void)
+{
+    ecrypt_secure_cell_envelope_t* reader = ecrypt_secure_cell_envelope_create(wrap_key, unwrap_key, NULL);
+    uint8_t corrupted[RECORD_CAPACITY];
+    size_t record_length = record_lengths[0];
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(open_record(reader,
+                                      wrong_user_context,
+                                      sizeof(wrong_user_context),
+                                      records[0],
+                                      record_length)
+                              != ECRYPT_SUCCESS,
+                          "envelope: wrong context");
+
+    for (i = 0; i < record_length; i++) {
+        memcpy(corrupted, records[0], record_length);
+        corrupted[i] ^= 0x01;
+        if (open_record(reader, user_context, sizeof(user_context), corrupted, record_length)
+            == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+    }
+    testsuite_fail_unless(all_rejected, "envelope: every corrupted byte is detected");
+
+    testsuite_fail_unless(open_record(reader, user_context, sizeof(user_context), records[0], record_length - 1)
+                              != ECRYPT_SUCCESS,
+                          "envelope: truncation");
+
+    testsuite_fail_unless(open_record(reader, user_context, sizeof(user_context), records[0], record_length)
+                              == ECRYPT_SUCCESS,
+                          "envelope: intact record still decrypts");
+
+    ecrypt_secure_cell_envelope_destroy(reader);
+}
+
+static void envelope_rotation(void)
+{
+    ecrypt_secure_cell_envelope_t* writer = ecrypt_secure_cell_envelope_create(wrap_key, unwrap_key, NULL);
+    ecrypt_secure_cell_envelope_t* reader = ecrypt_secure_cell_envelope_create(wrap_key, unwrap_key, NULL);
+    uint64_t wrap_count = 0;
+    bool decrypted = true;
+    int i;
+
+    ecrypt_secure_cell_envelope_set_limits(writer, 4, 0, 3);
+    for (i = 0; i < RECORD_COUNT; i++) {
+        record_lengths[i] = sizeof(records[i]);
+        ecrypt_secure_cell_encrypt_envelope(writer,
+                                            user_context,
+                                            sizeof(user_context),
+                                            message,
+                                            sizeof(message),
+                                            records[i],
+                                            &record_lengths[i]);
+    }
+    ecrypt_secure_cell_envelope_stats(writer, &wrap_count, NULL, NULL);
+    testsuite_fail_unless(wrap_count == (RECORD_COUNT + 2) / 3, "envelope: data keys rotate by usage");
+
+    for (i = 0; i < RECORD_COUNT; i++) {
+        if (open_record(reader, user_context, sizeof(user_context), records[i], record_lengths[i])
+            != ECRYPT_SUCCESS) {
+            decrypted = false;
+        }
+    }
+    testsuite_fail_unless(decrypted, "envelope: records with rotated keys decrypt");
+
+    ecrypt_secure_cell_envelope_destroy(writer);
+    ecrypt_secure_cell_envelope_destroy(reader);
+}
+
+void run_secure_cell_envelope_test(void)
+{
+    envelope_round_trip();
+    envelope_tamper();
+    envelope_rotation();
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 64
+/* ECRYPT_AUTH_SYM_ALG_KDF_CURRENT in the second byte of little-endian algorithm ID */
+#define KDF_MARK_BYTE 1
+#define KDF_MARK_BIT 0x10
+
+static const uint8_t master_key[32] = "flags test master key 0123456789";
+static const uint8_t wrong_master_key[32] = "flags test wrong key 01234567890";
+static const uint8_t user_context[] = "flags test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static void seal_kdf_marking(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t unmarked[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t unmarked_length = sizeof(unmarked);
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                                             sizeof(master_key),
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             message,
+                                                             sizeof(message),
+                                                             cell,
+                                                             &cell_length,
+                                                             ECRYPT_SCELL_FLAG_MARK_KDF)
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(cell),
+                          "KDF mark: marked cell has the same size");
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    unmarked,
+                                    &unmarked_length);
+    testsuite_fail_unless((cell[KDF_MARK_BYTE] & KDF_MARK_BIT) && !(unmarked[KDF_MARK_BYTE] & KDF_MARK_BIT),
+                          "KDF mark: only marked cells carry the bit");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "KDF mark: marked cell decrypts without flags");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_ex(master_key,
+                                                             sizeof(master_key),
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             unmarked,
+                                                             unmarked_length,
+                                                             plain,
+                                                             &plain_length,
+                                                             ECRYPT_SCELL_FLAG_STRICT)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "strict mode: current cells decrypt");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_ex(wrong_master_key,
+                                                         sizeof(wrong_master_key),
+                                                         user_context,
+                                                         sizeof(user_context),
+                                                         cell,
+                                                         cell_length,
+                                                         plain,
+                                                         &plain_length,
+                                                         ECRYPT_SCELL_FLAG_STRICT)
+                          == ECRYPT_SUCCESS,
+                      "strict mode: wrong key is rejected");
+
+    cell[cell_length - 1] ^= 0x01;
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                      sizeof(master_key),
+                                                      user_context,
+                                                      sizeof(user_context),
+                                                      cell,
+                                                      cell_length,
+                                                      plain,
+                                                      &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "KDF mark: corrupted marked cell is rejected");
+}
+
+static void seal_ctx_flags(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(ctx, 0x80000000) == ECRYPT_INVALID_PARAMETER,
+                          "seal context flags: unknown flags are rejected");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(NULL, 0) == ECRYPT_INVALID_PARAMETER,
+                          "seal context flags: context is required");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_flags(ctx,
+                                                                ECRYPT_SCELL_FLAG_STRICT
+                                                                    | ECRYPT_SCELL_FLAG_MARK_KDF)
+                              == ECRYPT_SUCCESS,
+                          "seal context flags: set");
+
+    ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                             user_context,
+                                             sizeof(user_context),
+                                             message,
+                                             sizeof(message),
+                                             cell,
+                                             &cell_length);
+    testsuite_fail_unless(cell[KDF_MARK_BYTE] & KDF_MARK_BIT, "seal context flags: cells are marked");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal context flags: marked cells decrypt with one-shot API");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+static void token_protect_kdf_marking(void)
+{
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    uint8_t encrypted[MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t token_length = sizeof(token);
+    size_t encrypted_length = sizeof(encrypted);
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_ex(master_key,
+                                                                      sizeof(master_key),
+                                                                      user_context,
+                                                                      sizeof(user_context),
+                                                                      message,
+                                                                      sizeof(message),
+                                                                      token,
+                                                                      &token_length,
+                                                                      encrypted,
+                                                                      &encrypted_length,
+                                                                      ECRYPT_SCELL_FLAG_MARK_KDF)
+                                  == ECRYPT_SUCCESS
+                              && token_length == sizeof(token) && encrypted_length == sizeof(message)
+                              && (token[KDF_MARK_BYTE] & KDF_MARK_BIT),
+                          "token protect: marked token");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_ex(master_key,
+                                                                      sizeof(master_key),
+                                                                      user_context,
+                                                                      sizeof(user_context),
+                                                                      encrypted,
+                                                                      encrypted_length,
+                                                                      token,
+                                                                      token_length,
+                                                                      plain,
+                                                                      &plain_length,
+                                                                      ECRYPT_SCELL_FLAG_STRICT)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "token protect: marked token decrypts");
+
+    token[token_length - 1] ^= 0x01;
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_token_protect_ex(master_key,
+                                                                  sizeof(master_key),
+                                                                  user_context,
+                                                                  sizeof(user_context),
+                                                                  encrypted,
+                                                                  encrypted_length,
+                                                                  token,
+                                                                  token_length,
+                                                                  plain,
+                                                                  &plain_length,
+                                                                  0)
+                          == ECRYPT_SUCCESS,
+                      "token protect: corrupted token is rejected");
+}
+
+static void context_imprint_strict(void)
+{
+    uint8_t encrypted[MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t encrypted_length = sizeof(encrypted);
+    size_t plain_length = sizeof(plain);
+
+    ecrypt_secure_cell_encrypt_context_imprint(master_key,
+                                               sizeof(master_key),
+                                               message,
+                                               sizeof(message),
+                                               user_context,
+                                               sizeof(user_context),
+                                               encrypted,
+                                               &encrypted_length);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_context_imprint_ex(master_key,
+                                                                        sizeof(master_key),
+                                                                        encrypted,
+                                                                        encrypted_length,
+                                                                        user_context,
+                                                                        sizeof(user_context),
+                                                                        plain,
+                                                                        &plain_length,
+                                                                        ECRYPT_SCELL_FLAG_STRICT)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "context imprint: strict decryption");
+}
+
+void run_secure_cell_flags_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xf1a9);
+
+    seal_kdf_marking();
+    seal_ctx_flags();
+    token_protect_kdf_marking();
+    context_imprint_strict();
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define MESSAGE_LENGTH 1000
+
+static const uint8_t master_key[32] = "imprint range test master key 01";
+static const uint8_t context[] = "imprint range test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t imprint[MESSAGE_LENGTH];
+static uint8_t range[MESSAGE_LENGTH];
+
+static ecrypt_status_t encrypt_range(const uint8_t* data, size_t length, size_t offset, size_t message_length)
+{
+    size_t range_length = sizeof(range);
+
+    return ecrypt_secure_cell_encrypt_context_imprint_range(master_key,
+                                                            sizeof(master_key),
+                                                            data,
+                                                            length,
+                                                            offset,
+                                                            message_length,
+                                                            context,
+                                                            sizeof(context),
+                                                            range,
+                                                            &range_length);
+}
+
+static ecrypt_status_t decrypt_range(const uint8_t* data, size_t length, size_t offset, size_t message_length)
+{
+    size_t range_length = sizeof(range);
+
+    return ecrypt_secure_cell_decrypt_context_imprint_range(master_key,
+                                                            sizeof(master_key),
+                                                            data,
+                                                            length,
+                                                            offset,
+                                                            message_length,
+                                                            context,
+                                                            sizeof(context),
+                                                            range,
+                                                            &range_length);
+}
+
+static void imprint_ranges(void)
+{
+    static const size_t offsets[] = {0, 1, 15, 16, 17, 500, MESSAGE_LENGTH - 1};
+    static const size_t lengths[] = {1, 15, 16, 33, 300};
+    size_t imprint_length = sizeof(imprint);
+    size_t range_length = 0;
+    bool encrypted_match = true;
+    bool decrypted_match = true;
+    size_t i, j;
+
+    ecrypt_secure_cell_encrypt_context_imprint(master_key,
+                                               sizeof(master_key),
+                                               message,
+                                               sizeof(message),
+                                               context,
+                                               sizeof(context),
+                                               imprint,
+                                               &imprint_length);
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        for (j = 0; j < sizeof(lengths) / sizeof(lengths[0]); j++) {
+            size_t length = lengths[j];
+
+            if (offsets[i] + length > MESSAGE_LENGTH) {
+                length = MESSAGE_LENGTH - offsets[i];
+            }
+            if (encrypt_range(message + offsets[i], length, offsets[i], MESSAGE_LENGTH) != ECRYPT_SUCCESS
+                || memcmp(range, imprint + offsets[i], length) != 0) {
+                encrypted_match = false;
+            }
+            if (decrypt_range(imprint + offsets[i], length, offsets[i], MESSAGE_LENGTH) != ECRYPT_SUCCESS
+                || memcmp(range, message + offsets[i], length) != 0) {
+                decrypted_match = false;
+            }
+        }
+    }
+    testsuite_fail_unless(encrypted_match, "imprint range: encryption matches whole message");
+    testsuite_fail_unless(decrypted_match, "imprint range: decryption matches whole message");
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_context_imprint_range(master_key,
+                                                                           sizeof(master_key),
+                                                                           message,
+                                                                           10,
+                                                                           20,
+                                                                           MESSAGE_LENGTH,
+                                                                           context,
+                                                                           sizeof(context),
+                                                                           NULL,
+                                                                           &range_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && range_length == 10,
+                          "imprint range: size query");
+
+    testsuite_fail_unless(decrypt_range(imprint + 100, 50, 100, MESSAGE_LENGTH - 1) == ECRYPT_SUCCESS
+                              && memcmp(range, message + 100, 50) != 0,
+                          "imprint range: key depends on message length");
+}
+
+static void imprint_range_update(void)
+{
+    uint8_t patch[40];
+    uint8_t decrypted[MESSAGE_LENGTH];
+    size_t decrypted_length = sizeof(decrypted);
+
+    testsuite_fill_random(patch, sizeof(patch), 0x9a7c);
+    encrypt_range(patch, sizeof(patch), 333, MESSAGE_LENGTH);
+    memcpy(imprint + 333, range, sizeof(patch));
+    memcpy(message + 333, patch, sizeof(patch));
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_context_imprint(master_key,
+                                                                     sizeof(master_key),
+                                                                     imprint,
+                                                                     sizeof(imprint),
+                                                                     context,
+                                                                     sizeof(context),
+                                                                     decrypted,
+                                                                     &decrypted_length)
+                                  == ECRYPT_SUCCESS
+                              && !memcmp(decrypted, message, sizeof(message)),
+                          "imprint range: updated range decrypts with the whole message");
+}
+
+static void imprint_range_params(void)
+{
+    testsuite_fail_unless(encrypt_range(message, 10, MESSAGE_LENGTH - 9, MESSAGE_LENGTH) == ECRYPT_INVALID_PARAMETER,
+                          "imprint range: range past the end");
+    testsuite_fail_unless(encrypt_range(message, 10, (size_t)-5, MESSAGE_LENGTH) == ECRYPT_INVALID_PARAMETER,
+                          "imprint range: overflowing offset");
+    testsuite_fail_unless(decrypt_range(imprint, 0, 0, MESSAGE_LENGTH) == ECRYPT_INVALID_PARAMETER,
+                          "imprint range: empty range");
+}
+
+void run_secure_cell_imprint_range_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x1a9e);
+
+    imprint_ranges();
+    imprint_range_update();
+    imprint_range_params();
+}
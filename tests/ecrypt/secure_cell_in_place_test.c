@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 1000
+
+static const uint8_t master_key[32] = "in-place test master key 0123456";
+static const uint8_t wrong_master_key[32] = "in-place test wrong key 01234567";
+static const uint8_t user_context[] = "in-place test context";
+static const uint8_t wrong_user_context[] = "in-place test other context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t buffer[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+static uint8_t saved[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+
+static void seal_in_place_round_trip(void)
+{
+    uint8_t* plain = NULL;
+    size_t plain_length = 0;
+    size_t cell_length = 0;
+    size_t plain_copy_length = sizeof(saved);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   NULL,
+                                                                   &cell_length,
+                                                                   sizeof(message))
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(buffer),
+                          "seal in place: size query");
+
+    memcpy(buffer + DEFAULT_AUTH_TOKEN_LENGTH, message, sizeof(message));
+    cell_length = sizeof(buffer);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   buffer,
+                                                                   &cell_length,
+                                                                   sizeof(message))
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(buffer),
+                          "seal in place: encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          buffer,
+                                                          cell_length,
+                                                          saved,
+                                                          &plain_copy_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_copy_length == sizeof(message)
+                              && !memcmp(saved, message, sizeof(message)),
+                          "seal in place: compatible with regular decryption");
+
+    memcpy(saved, buffer, cell_length);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_in_place(wrong_master_key,
+                                                                   sizeof(wrong_master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   buffer,
+                                                                   cell_length,
+                                                                   &plain,
+                                                                   &plain_length)
+                              == ECRYPT_FAIL,
+                          "seal in place: wrong key");
+    testsuite_fail_unless(!memcmp(saved, buffer, cell_length), "seal in place: intact after wrong key");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   wrong_user_context,
+                                                                   sizeof(wrong_user_context),
+                                                                   buffer,
+                                                                   cell_length,
+                                                                   &plain,
+                                                                   &plain_length)
+                              == ECRYPT_FAIL,
+                          "seal in place: wrong context");
+    testsuite_fail_unless(!memcmp(saved, buffer, cell_length),
+                          "seal in place: intact after wrong context");
+
+    buffer[cell_length - 1] ^= 0x01;
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   buffer,
+                                                                   cell_length,
+                                                                   &plain,
+                                                                   &plain_length)
+                              == ECRYPT_FAIL,
+                          "seal in place: corrupted cell");
+    buffer[cell_length - 1] ^= 0x01;
+    testsuite_fail_unless(!memcmp(saved, buffer, cell_length),
+                          "seal in place: intact after corruption");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_in_place(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   buffer,
+                                                                   cell_length,
+                                                                   &plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain == buffer + DEFAULT_AUTH_TOKEN_LENGTH
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal in place: decryption");
+}
+
+static void token_protect_in_place_round_trip(void)
+{
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    size_t token_length = sizeof(token);
+
+    memcpy(buffer, message, sizeof(message));
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_in_place(master_key,
+                                                                            sizeof(master_key),
+                                                                            user_context,
+                                                                            sizeof(user_context),
+                                                                            buffer,
+                                                                            sizeof(message),
+                                                                            token,
+                                                                            &token_length)
+                                  == ECRYPT_SUCCESS
+                              && memcmp(buffer, message, sizeof(message)) != 0,
+                          "token protect in place: encryption");
+
+    memcpy(saved, buffer, sizeof(message));
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_in_place(wrong_master_key,
+                                                                            sizeof(wrong_master_key),
+                                                                            user_context,
+                                                                            sizeof(user_context),
+                                                                            buffer,
+                                                                            sizeof(message),
+                                                                            token,
+                                                                            token_length)
+                              == ECRYPT_FAIL,
+                          "token protect in place: wrong key");
+    testsuite_fail_unless(!memcmp(saved, buffer, sizeof(message)),
+                          "token protect in place: intact after wrong key");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_in_place(master_key,
+                                                                            sizeof(master_key),
+                                                                            user_context,
+                                                                            sizeof(user_context),
+                                                                            buffer,
+                                                                            sizeof(message) - 1,
+                                                                            token,
+                                                                            token_length)
+                              == ECRYPT_FAIL,
+                          "token protect in place: length mismatch");
+    testsuite_fail_unless(!memcmp(saved, buffer, sizeof(message)),
+                          "token protect in place: intact after length mismatch");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_in_place(master_key,
+                                                                            sizeof(master_key),
+                                                                            user_context,
+                                                                            sizeof(user_context),
+                                                                            buffer,
+                                                                            sizeof(message),
+                                                                            token,
+                                                                            token_length)
+                                  == ECRYPT_SUCCESS
+                              && !memcmp(buffer, message, sizeof(message)),
+                          "token protect in place: decryption");
+}
+
+static void context_imprint_in_place_round_trip(void)
+{
+    uint8_t imprint[MESSAGE_LENGTH];
+    size_t imprint_length = sizeof(imprint);
+
+    ecrypt_secure_cell_encrypt_context_imprint(master_key,
+                                               sizeof(master_key),
+                                               message,
+                                               sizeof(message),
+                                               user_context,
+                                               sizeof(user_context),
+                                               imprint,
+                                               &imprint_length);
+
+    memcpy(buffer, message, sizeof(message));
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_context_imprint_in_place(master_key,
+                                                                              sizeof(master_key),
+                                                                              buffer,
+                                                                              sizeof(message),
+                                                                              user_context,
+                                                                              sizeof(user_context))
+                                  == ECRYPT_SUCCESS
+                              && !memcmp(buffer, imprint, sizeof(imprint)),
+                          "context imprint in place: same as regular encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_context_imprint_in_place(master_key,
+                                                                              sizeof(master_key),
+                                                                              buffer,
+                                                                              sizeof(message),
+                                                                              user_context,
+                                                                              sizeof(user_context))
+                                  == ECRYPT_SUCCESS
+                              && !memcmp(buffer, message, sizeof(message)),
+                          "context imprint in place: decryption");
+}
+
+static void key_ring_in_place(void)
+{
+    const uint8_t* keys[2] = {wrong_master_key, master_key};
+    size_t key_lengths[2] = {sizeof(wrong_master_key), sizeof(master_key)};
+    ecrypt_secure_cell_key_ring_t* ring = ecrypt_secure_cell_key_ring_create(keys, key_lengths, 2);
+    size_t cell_length = sizeof(buffer);
+    size_t plain_length = sizeof(message);
+    size_t key_index = 0;
+
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    buffer,
+                                    &cell_length);
+
+    /* The first key of the ring fails, the cell must survive for the second one */
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_key_ring(ring,
+                                                                        user_context,
+                                                                        sizeof(user_context),
+                                                                        buffer,
+                                                                        cell_length,
+                                                                        buffer + DEFAULT_AUTH_TOKEN_LENGTH,
+                                                                        &plain_length,
+                                                                        &key_index)
+                                  == ECRYPT_SUCCESS
+                              && key_index == 1 && plain_length == sizeof(message)
+                              && !memcmp(buffer + DEFAULT_AUTH_TOKEN_LENGTH, message, sizeof(message)),
+                          "key ring in place: trial decryption");
+
+    ecrypt_secure_cell_key_ring_destroy(ring);
+}
+
+void run_secure_cell_in_place_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x1dea);
+
+    seal_in_place_round_trip();
+    token_protect_in_place_round_trip();
+    context_imprint_in_place_round_trip();
+    key_ring_in_place();
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 300
+#define MAX_FRAGMENTS 16
+
+static const uint8_t master_key[32] = "iov test master key 012345678901";
+static const uint8_t user_context[] = "iov test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+/* Splits buffer into fragments of growing length, with an empty one in between */
+static size_t split(uint8_t* buffer, size_t length, ecrypt_secure_cell_iovec_t* iov)
+{
+    size_t count = 0;
+    size_t offset = 0;
+    size_t fragment = 1;
+
+    while (offset < length && count < MAX_FRAGMENTS - 2) {
+        if (fragment > length - offset) {
+            fragment = length - offset;
+        }
+        iov[count].base = buffer + offset;
+        iov[count].length = fragment;
+        count++;
+        if (count == 2) {
+            iov[count].base = NULL;
+            iov[count].length = 0;
+            count++;
+        }
+        offset += fragment;
+        fragment = fragment * 2 + 3;
+    }
+    if (offset < length) {
+        iov[count].base = buffer + offset;
+        iov[count].length = length - offset;
+        count++;
+    }
+    return count;
+}
+
+static void seal_iov(void)
+{
+    uint8_t input[MESSAGE_LENGTH];
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    ecrypt_secure_cell_iovec_t message_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t cell_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t plain_iov[MAX_FRAGMENTS];
+    size_t message_count = 0;
+    size_t cell_count = 0;
+    size_t plain_count = 0;
+    size_t cell_length = 0;
+    size_t plain_length = 0;
+    bool wiped = true;
+    size_t i;
+
+    memcpy(input, message, sizeof(message));
+    message_count = split(input, sizeof(input), message_iov);
+    cell_count = split(cell, sizeof(cell), cell_iov);
+    plain_count = split(plain, sizeof(plain), plain_iov);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              message_iov,
+                                                              message_count,
+                                                              NULL,
+                                                              0,
+                                                              &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(cell),
+                          "seal iov: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              message_iov,
+                                                              message_count,
+                                                              cell_iov,
+                                                              cell_count - 1,
+                                                              &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(cell),
+                          "seal iov: short output fragments");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              message_iov,
+                                                              message_count,
+                                                              cell_iov,
+                                                              cell_count,
+                                                              &cell_length)
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(cell),
+                          "seal iov: encryption");
+    testsuite_fail_unless(!memcmp(input, message, sizeof(message)), "seal iov: input is not modified");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal iov: compatible with regular decryption");
+
+    memset(plain, 0, sizeof(plain));
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              cell_iov,
+                                                              cell_count,
+                                                              plain_iov,
+                                                              plain_count,
+                                                              &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal iov: decryption");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_iov(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              cell_iov,
+                                                              cell_count,
+                                                              NULL,
+                                                              0,
+                                                              &plain_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && plain_length == sizeof(message),
+                          "seal iov: decrypted size query");
+
+    cell[DEFAULT_AUTH_TOKEN_LENGTH + 100] ^= 0x01;
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_iov(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell_iov,
+                                                          cell_count,
+                                                          plain_iov,
+                                                          plain_count,
+                                                          &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "seal iov: corrupted cell is rejected");
+    for (i = 0; i < sizeof(plain); i++) {
+        if (plain[i] != 0) {
+            wiped = false;
+        }
+    }
+    testsuite_fail_unless(wiped, "seal iov: output is wiped on failure");
+}
+
+static void token_protect_iov(void)
+{
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    uint8_t encrypted[MESSAGE_LENGTH];
+    uint8_t contiguous[MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    ecrypt_secure_cell_iovec_t message_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t encrypted_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t plain_iov[MAX_FRAGMENTS];
+    size_t message_count = split(message, sizeof(message), message_iov);
+    size_t encrypted_count = split(encrypted, sizeof(encrypted), encrypted_iov);
+    size_t plain_count = split(plain, sizeof(plain), plain_iov);
+    size_t token_length = sizeof(token);
+    size_t encrypted_length = 0;
+    size_t plain_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_token_protect_iov(master_key,
+                                                                       sizeof(master_key),
+                                                                       user_context,
+                                                                       sizeof(user_context),
+                                                                       message_iov,
+                                                                       message_count,
+                                                                       token,
+                                                                       &token_length,
+                                                                       encrypted_iov,
+                                                                       encrypted_count,
+                                                                       &encrypted_length)
+                                  == ECRYPT_SUCCESS
+                              && token_length == sizeof(token) && encrypted_length == sizeof(message),
+                          "token protect iov: encryption");
+
+    plain_length = sizeof(contiguous);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   encrypted,
+                                                                   encrypted_length,
+                                                                   token,
+                                                                   token_length,
+                                                                   contiguous,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(contiguous, message, sizeof(message)),
+                          "token protect iov: compatible with regular decryption");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_token_protect_iov(master_key,
+                                                                       sizeof(master_key),
+                                                                       user_context,
+                                                                       sizeof(user_context),
+                                                                       encrypted_iov,
+                                                                       encrypted_count,
+                                                                       token,
+                                                                       token_length,
+                                                                       plain_iov,
+                                                                       plain_count,
+                                                                       &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "token protect iov: decryption");
+
+    token[token_length - 1] ^= 0x01;
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_token_protect_iov(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   encrypted_iov,
+                                                                   encrypted_count,
+                                                                   token,
+                                                                   token_length,
+                                                                   plain_iov,
+                                                                   plain_count,
+                                                                   &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "token protect iov: corrupted token is rejected");
+}
+
+static void context_imprint_iov(void)
+{
+    uint8_t encrypted[MESSAGE_LENGTH];
+    uint8_t contiguous[MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    ecrypt_secure_cell_iovec_t message_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t encrypted_iov[MAX_FRAGMENTS];
+    ecrypt_secure_cell_iovec_t plain_iov[MAX_FRAGMENTS];
+    size_t message_count = split(message, sizeof(message), message_iov);
+    size_t encrypted_count = split(encrypted, sizeof(encrypted), encrypted_iov);
+    size_t plain_count = split(plain, sizeof(plain), plain_iov);
+    size_t encrypted_length = 0;
+    size_t contiguous_length = sizeof(contiguous);
+    size_t plain_length = 0;
+
+    ecrypt_secure_cell_encrypt_context_imprint(master_key,
+                                               sizeof(master_key),
+                                               message,
+                                               sizeof(message),
+                                               user_context,
+                                               sizeof(user_context),
+                                               contiguous,
+                                               &contiguous_length);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_context_imprint_iov(master_key,
+                                                                         sizeof(master_key),
+                                                                         message_iov,
+                                                                         message_count,
+                                                                         user_context,
+                                                                         sizeof(user_context),
+                                                                         encrypted_iov,
+                                                                         encrypted_count,
+                                                                         &encrypted_length)
+                                  == ECRYPT_SUCCESS
+                              && encrypted_length == contiguous_length
+                              && !memcmp(encrypted, contiguous, contiguous_length),
+                          "context imprint iov: same output as contiguous version");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_context_imprint_iov(master_key,
+                                                                         sizeof(master_key),
+                                                                         encrypted_iov,
+                                                                         encrypted_count,
+                                                                         user_context,
+                                                                         sizeof(user_context),
+                                                                         plain_iov,
+                                                                         plain_count,
+                                                                         &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "context imprint iov: decryption");
+}
+
+void run_secure_cell_iov_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x10f);
+
+    seal_iov();
+    token_protect_iov();
+    context_imprint_iov();
+}
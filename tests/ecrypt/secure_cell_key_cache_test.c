@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 48
+
+static const uint8_t master_key[32] = "key cache test master key 012345";
+static const uint8_t context_a[] = "key cache test context A";
+static const uint8_t context_b[] = "key cache test context B";
+static const uint8_t context_c[] = "key cache test context C";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t long_context[200];
+
+static bool round_trip(ecrypt_secure_cell_seal_ctx_t* ctx, const uint8_t* context, size_t context_length)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = sizeof(plain);
+
+    if (ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                 context,
+                                                 context_length,
+                                                 message,
+                                                 sizeof(message),
+                                                 cell,
+                                                 &cell_length)
+        != ECRYPT_SUCCESS) {
+        return false;
+    }
+    /* Cached keys must be the same as derived ones */
+    if (ecrypt_secure_cell_decrypt_seal(master_key,
+                                        sizeof(master_key),
+                                        context,
+                                        context_length,
+                                        cell,
+                                        cell_length,
+                                        plain,
+                                        &plain_length)
+            != ECRYPT_SUCCESS
+        || plain_length != sizeof(message) || memcmp(plain, message, sizeof(message)) != 0) {
+        return false;
+    }
+    plain_length = sizeof(plain);
+    return ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                    context,
+                                                    context_length,
+                                                    cell,
+                                                    cell_length,
+                                                    plain,
+                                                    &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static bool stats_are(ecrypt_secure_cell_seal_ctx_t* ctx, uint64_t expected_hits, uint64_t expected_misses)
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    return ecrypt_secure_cell_seal_ctx_key_cache_stats(ctx, &hits, &misses) == ECRYPT_SUCCESS
+           && hits == expected_hits && misses == expected_misses;
+}
+
+static void key_cache_hits_and_misses(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+
+    testsuite_fail_unless(stats_are(ctx, 0, 0), "key cache: disabled by default");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_key_cache(ctx, 2) == ECRYPT_SUCCESS,
+                          "key cache: enable");
+
+    testsuite_fail_unless(round_trip(ctx, context_a, sizeof(context_a)), "key cache: first message");
+    testsuite_fail_unless(stats_are(ctx, 1, 1), "key cache: decryption reuses the key");
+    testsuite_fail_unless(round_trip(ctx, context_a, sizeof(context_a)), "key cache: repeated message");
+    testsuite_fail_unless(stats_are(ctx, 3, 1), "key cache: repeated message is a hit");
+
+    testsuite_fail_unless(round_trip(ctx, NULL, 0), "key cache: empty context");
+    testsuite_fail_unless(round_trip(ctx, context_b, sizeof(context_b)), "key cache: second context");
+    testsuite_fail_unless(stats_are(ctx, 5, 3), "key cache: new contexts are misses");
+
+    /* Capacity is 2, the first context has been evicted by now */
+    testsuite_fail_unless(round_trip(ctx, context_a, sizeof(context_a)), "key cache: evicted context");
+    testsuite_fail_unless(stats_are(ctx, 6, 4), "key cache: least recently used key is evicted");
+
+    testsuite_fail_unless(round_trip(ctx, long_context, sizeof(long_context)), "key cache: long context");
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_key_cache(ctx, 0) == ECRYPT_SUCCESS
+                              && stats_are(ctx, 0, 0),
+                          "key cache: disabling resets statistics");
+    testsuite_fail_unless(round_trip(ctx, context_c, sizeof(context_c)), "key cache: works when disabled");
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_set_key_cache(NULL, 1) == ECRYPT_INVALID_PARAMETER,
+                          "key cache: context is required");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+static void key_cache_rejects_tampering(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = sizeof(plain);
+
+    ecrypt_secure_cell_seal_ctx_set_key_cache(ctx, 8);
+    ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                             context_a,
+                                             sizeof(context_a),
+                                             message,
+                                             sizeof(message),
+                                             cell,
+                                             &cell_length);
+
+    cell[cell_length - 1] ^= 0x01;
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                               context_a,
+                                                               sizeof(context_a),
+                                                               cell,
+                                                               cell_length,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "key cache: corrupted cell is rejected with cached key");
+    cell[cell_length - 1] ^= 0x01;
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                               context_b,
+                                                               sizeof(context_b),
+                                                               cell,
+                                                               cell_length,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "key cache: wrong context is rejected");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+void run_secure_cell_key_cache_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xcac4e);
+    testsuite_fill_random(long_context, sizeof(long_context), 0x10c);
+
+    key_cache_hits_and_misses();
+    key_cache_rejects_tampering();
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define KEY_ID_LENGTH 4
+#define MESSAGE_LENGTH 80
+
+static const uint8_t current_key[32] = "key ring test current key 012345";
+static const uint8_t previous_key[32] = "key ring test previous key 01234";
+static const uint8_t unknown_key[32] = "key ring test unknown key 012345";
+static const uint8_t user_context[] = "key ring test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static ecrypt_secure_cell_key_ring_t* create_ring(const uint8_t* first, const uint8_t* second)
+{
+    const uint8_t* keys[2] = {first, second};
+    size_t key_lengths[2] = {32, 32};
+
+    return ecrypt_secure_cell_key_ring_create(keys, key_lengths, 2);
+}
+
+static bool ring_decrypts(ecrypt_secure_cell_key_ring_t* ring,
+                          const uint8_t* cell,
+                          size_t cell_length,
+                          size_t expected_index)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+    size_t key_index = (size_t)-1;
+
+    return ecrypt_secure_cell_decrypt_seal_with_key_ring(ring,
+                                                         user_context,
+                                                         sizeof(user_context),
+                                                         cell,
+                                                         cell_length,
+                                                         plain,
+                                                         &plain_length,
+                                                         &key_index)
+               == ECRYPT_SUCCESS
+           && key_index == expected_index && plain_length == sizeof(message)
+           && !memcmp(plain, message, sizeof(message));
+}
+
+static size_t seal_with_key(const uint8_t* key, uint8_t* cell, size_t cell_length)
+{
+    ecrypt_secure_cell_encrypt_seal(key,
+                                    32,
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    cell,
+                                    &cell_length);
+    return cell_length;
+}
+
+static void key_ring_trial_decryption(void)
+{
+    ecrypt_secure_cell_key_ring_t* ring = create_ring(current_key, previous_key);
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = 0;
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_key_ring(ring,
+                                                                        user_context,
+                                                                        sizeof(user_context),
+                                                                        message,
+                                                                        sizeof(message),
+                                                                        NULL,
+                                                                        &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(cell),
+                          "key ring: size query");
+    ecrypt_secure_cell_encrypt_seal_with_key_ring(ring,
+                                                  user_context,
+                                                  sizeof(user_context),
+                                                  message,
+                                                  sizeof(message),
+                                                  cell,
+                                                  &cell_length);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(current_key,
+                                                          sizeof(current_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "key ring: encrypts with the current key");
+    testsuite_fail_unless(ring_decrypts(ring, cell, cell_length, 0), "key ring: decrypts with the current key");
+
+    cell_length = seal_with_key(previous_key, cell, sizeof(cell));
+    testsuite_fail_unless(ring_decrypts(ring, cell, cell_length, 1), "key ring: decrypts with the previous key");
+    testsuite_fail_unless(ring_decrypts(ring, cell, cell_length, 1), "key ring: index survives reordering");
+
+    plain_length = 0;
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_key_ring(ring,
+                                                                        user_context,
+                                                                        sizeof(user_context),
+                                                                        cell,
+                                                                        cell_length,
+                                                                        NULL,
+                                                                        &plain_length,
+                                                                        NULL)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && plain_length == sizeof(message),
+                          "key ring: decrypted size query");
+
+    cell_length = seal_with_key(unknown_key, cell, sizeof(cell));
+    testsuite_fail_if(ring_decrypts(ring, cell, cell_length, 0) || ring_decrypts(ring, cell, cell_length, 1),
+                      "key ring: unknown key is rejected");
+
+    ecrypt_secure_cell_key_ring_destroy(ring);
+}
+
+static void key_ring_key_id(void)
+{
+    ecrypt_secure_cell_key_ring_t* ring = create_ring(current_key, previous_key);
+    ecrypt_secure_cell_key_ring_t* reversed = create_ring(previous_key, current_key);
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + KEY_ID_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_key_ring_set_flags(ring, ECRYPT_SCELL_FLAG_KEY_ID) == ECRYPT_SUCCESS
+                              && ecrypt_secure_cell_key_ring_set_flags(reversed, ECRYPT_SCELL_FLAG_KEY_ID)
+                                     == ECRYPT_SUCCESS,
+                          "key ID: set flags");
+    testsuite_fail_unless(ecrypt_secure_cell_key_ring_set_flags(ring, 0x80000000) == ECRYPT_INVALID_PARAMETER,
+                          "key ID: unknown flags are rejected");
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_key_ring(ring,
+                                                                        user_context,
+                                                                        sizeof(user_context),
+                                                                        message,
+                                                                        sizeof(message),
+                                                                        cell,
+                                                                        &cell_length)
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(cell),
+                          "key ID: cell carries key identifier");
+    testsuite_fail_unless(ring_decrypts(ring, cell, cell_length, 0), "key ID: decrypts with the current key");
+    testsuite_fail_unless(ring_decrypts(reversed, cell, cell_length, 1), "key ID: finds the key by identifier");
+
+    for (i = 0; i < cell_length; i++) {
+        cell[i] ^= 0x04;
+        if (ring_decrypts(ring, cell, cell_length, 0) || ring_decrypts(ring, cell, cell_length, 1)) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x04;
+    }
+    testsuite_fail_unless(all_rejected, "key ID: every corrupted byte is detected");
+
+    /* Cells without key identifier still go through trial decryption */
+    cell_length = seal_with_key(previous_key, cell, sizeof(cell));
+    testsuite_fail_unless(ring_decrypts(ring, cell, cell_length, 1), "key ID: legacy cell decrypts with key ID ring");
+    cell_length = seal_with_key(current_key, cell, sizeof(cell));
+    testsuite_fail_unless(ring_decrypts(reversed, cell, cell_length, 1),
+                          "key ID: legacy cell decrypts with any key of the ring");
+
+    ecrypt_secure_cell_key_ring_destroy(reversed);
+    ecrypt_secure_cell_key_ring_destroy(ring);
+}
+
+static void key_ring_parameter_checks(void)
+{
+    const uint8_t* keys[2] = {current_key, NULL};
+    size_t key_lengths[2] = {32, 32};
+
+    testsuite_fail_unless(ecrypt_secure_cell_key_ring_create(keys, key_lengths, 2) == NULL,
+                          "key ring: NULL key is rejected");
+    testsuite_fail_unless(ecrypt_secure_cell_key_ring_create(keys, key_lengths, 0) == NULL,
+                          "key ring: empty ring is rejected");
+}
+
+static void key_id_one_shot_rejected(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + KEY_ID_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+
+    /* One-shot sealing has no key ring to take the identifier from */
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_ex(current_key,
+                                                             sizeof(current_key),
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             message,
+                                                             sizeof(message),
+                                                             cell,
+                                                             &cell_length,
+                                                             ECRYPT_SCELL_FLAG_KEY_ID)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "key ID: one-shot encryption rejects key ID flag");
+}
+
+void run_secure_cell_key_ring_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x4e7);
+
+    key_ring_trial_decryption();
+    key_ring_key_id();
+    key_ring_parameter_checks();
+    key_id_one_shot_rejected();
+}
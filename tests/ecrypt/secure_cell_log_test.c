@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define RECORD_COUNT 20
+#define SEGMENT_CAPACITY 4096
+
+static const uint8_t master_key[32] = "log segment test master key 0123";
+static const uint8_t wrong_master_key[32] = "log segment test wrong key 01234";
+
+static uint8_t segment[SEGMENT_CAPACITY];
+static uint8_t corrupted[SEGMENT_CAPACITY];
+
+static size_t format_record(int index, char* record, size_t record_length)
+{
+    /* Some records are empty, these are valid too */
+    if (index % 7 == 3) {
+        return 0;
+    }
+    return (size_t)snprintf(record, record_length, "audit record %d", index);
+}
+
+static bool write_segment(size_t tag_length, bool seal, size_t* segment_length)
+{
+    ecrypt_secure_cell_log_writer_t* writer = NULL;
+    char record[64];
+    size_t output_length = 0;
+    bool ok = true;
+    int i;
+
+    *segment_length = 0;
+    writer = ecrypt_secure_cell_log_writer_create(master_key, sizeof(master_key), 42, tag_length);
+    if (!writer) {
+        return false;
+    }
+    for (i = 0; i < RECORD_COUNT && ok; i++) {
+        size_t record_length = format_record(i, record, sizeof(record));
+        output_length = SEGMENT_CAPACITY - *segment_length;
+        ok = ecrypt_secure_cell_log_append(writer,
+                                           (const uint8_t*)record,
+                                           record_length,
+                                           segment + *segment_length,
+                                           &output_length)
+             == ECRYPT_SUCCESS;
+        *segment_length += output_length;
+    }
+    if (ok && seal) {
+        output_length = SEGMENT_CAPACITY - *segment_length;
+        ok = ecrypt_secure_cell_log_seal(writer, segment + *segment_length, &output_length)
+             == ECRYPT_SUCCESS;
+        *segment_length += output_length;
+    }
+    ecrypt_secure_cell_log_writer_destroy(writer);
+    return ok;
+}
+
+/* Returns the number of matching records read, or -1 on error */
+static int read_segment(const uint8_t* data, size_t data_length, bool* sealed)
+{
+    ecrypt_secure_cell_log_reader_t* reader = NULL;
+    char expected[64];
+    uint8_t record[64];
+    bool end = false;
+    int count = 0;
+
+    *sealed = false;
+    reader = ecrypt_secure_cell_log_reader_create(master_key, sizeof(master_key), data, data_length);
+    if (!reader) {
+        return -1;
+    }
+    for (;;) {
+        size_t record_length = sizeof(record);
+        size_t expected_length = 0;
+        if (ecrypt_secure_cell_log_reader_next(reader, record, &record_length, &end) != ECRYPT_SUCCESS) {
+            count = -1;
+            break;
+        }
+        if (end) {
+            break;
+        }
+        expected_length = format_record(count, expected, sizeof(expected));
+        if (record_length != expected_length || memcmp(record, expected, expected_length) != 0) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    if (count >= 0) {
+        *sealed = ecrypt_secure_cell_log_reader_final(reader) == ECRYPT_SUCCESS;
+    }
+    ecrypt_secure_cell_log_reader_destroy(reader);
+    return count;
+}
+
+static void log_round_trip(size_t tag_length)
+{
+    size_t segment_length = 0;
+    bool sealed = false;
+
+    testsuite_fail_unless(write_segment(tag_length, false, &segment_length), "log: append records");
+    testsuite_fail_unless(read_segment(segment, segment_length, &sealed) == RECORD_COUNT && !sealed,
+                          "log: open segment reads back");
+    testsuite_fail_unless(ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), segment, segment_length)
+                              == ECRYPT_FAIL,
+                          "log: open segment does not verify");
+
+    testsuite_fail_unless(write_segment(tag_length, true, &segment_length), "log: seal segment");
+    testsuite_fail_unless(read_segment(segment, segment_length, &sealed) == RECORD_COUNT && sealed,
+                          "log: sealed segment reads back");
+    testsuite_fail_unless(ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), segment, segment_length)
+                              == ECRYPT_SUCCESS,
+                          "log: sealed segment verifies");
+}
+
+static void log_tamper(size_t tag_length)
+{
+    size_t segment_length = 0;
+    bool all_rejected = true;
+    bool all_truncations_rejected = true;
+    bool sealed = false;
+    size_t i;
+
+    write_segment(tag_length, true, &segment_length);
+
+    for (i = 0; i < segment_length; i++) {
+        memcpy(corrupted, segment, segment_length);
+        corrupted[i] ^= 0x01;
+        if (ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), corrupted, segment_length)
+                == ECRYPT_SUCCESS
+            || (read_segment(corrupted, segment_length, &sealed) >= 0 && sealed)) {
+            all_rejected = false;
+        }
+    }
+    testsuite_fail_unless(all_rejected, "log: every corrupted byte is detected");
+
+    for (i = 1; i < segment_length; i++) {
+        if (ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), segment, i) == ECRYPT_SUCCESS
+            || (read_segment(segment, i, &sealed) >= 0 && sealed)) {
+            all_truncations_rejected = false;
+        }
+    }
+    testsuite_fail_unless(all_truncations_rejected, "log: every truncation is detected");
+
+    memcpy(corrupted, segment, segment_length);
+    corrupted[segment_length] = 0;
+    testsuite_fail_unless(ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), corrupted, segment_length + 1)
+                              != ECRYPT_SUCCESS,
+                          "log: trailing data is detected");
+
+    testsuite_fail_unless(ecrypt_secure_cell_log_verify(wrong_master_key,
+                                                        sizeof(wrong_master_key),
+                                                        segment,
+                                                        segment_length)
+                              != ECRYPT_SUCCESS,
+                          "log: wrong key");
+}
+
+static void log_sealed_writer(void)
+{
+    ecrypt_secure_cell_log_writer_t* writer = NULL;
+    uint8_t output[128];
+    size_t output_length = sizeof(output);
+
+    writer = ecrypt_secure_cell_log_writer_create(master_key, sizeof(master_key), 7, 0);
+    testsuite_fail_unless(ecrypt_secure_cell_log_seal(writer, output, &output_length) == ECRYPT_SUCCESS,
+                          "log: seal empty segment");
+    testsuite_fail_unless(ecrypt_secure_cell_log_verify(master_key, sizeof(master_key), output, output_length)
+                              == ECRYPT_SUCCESS,
+                          "log: empty sealed segment verifies");
+    output_length = sizeof(output);
+    testsuite_fail_unless(ecrypt_secure_cell_log_append(writer, (const uint8_t*)"late", 4, output, &output_length)
+                              != ECRYPT_SUCCESS,
+                          "log: sealed segment rejects records");
+    ecrypt_secure_cell_log_writer_destroy(writer);
+
+    testsuite_fail_unless(ecrypt_secure_cell_log_writer_create(master_key, sizeof(master_key), 7, 7) == NULL,
+                          "log: invalid tag length");
+}
+
+void run_secure_cell_log_test(void)
+{
+    log_round_trip(0);
+    log_tamper(0);
+    log_round_trip(8);
+    log_tamper(8);
+    log_sealed_writer();
+}
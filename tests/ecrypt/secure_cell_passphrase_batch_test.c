@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define ITEM_COUNT 10
+#define MESSAGE_LENGTH 64
+#define MAX_CELL_LENGTH (MESSAGE_LENGTH + 128)
+
+static const uint8_t passphrase[] = "passphrase batch test secret";
+static const uint8_t user_context[] = "passphrase batch test context";
+
+static uint8_t messages[ITEM_COUNT][MESSAGE_LENGTH];
+static uint8_t cells[ITEM_COUNT][MAX_CELL_LENGTH];
+static uint8_t plain[ITEM_COUNT * MESSAGE_LENGTH];
+
+static void passphrase_batch_decryption(void)
+{
+    ecrypt_secure_cell_passphrase_ctx_t* ctx = ecrypt_secure_cell_passphrase_ctx_create(passphrase, sizeof(passphrase));
+    ecrypt_secure_cell_batch_item_t items[ITEM_COUNT];
+    size_t plain_length = 0;
+    bool all_match = true;
+    size_t i;
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < ITEM_COUNT; i++) {
+        size_t cell_length = sizeof(cells[i]);
+
+        testsuite_fill_random(messages[i], sizeof(messages[i]), (uint32_t)(0xba7c + i));
+        /* Every other cell has its own salt */
+        if (i % 2) {
+            ecrypt_secure_cell_encrypt_seal_with_passphrase(passphrase,
+                                                            sizeof(passphrase),
+                                                            user_context,
+                                                            sizeof(user_context),
+                                                            messages[i],
+                                                            1 + i * 5,
+                                                            cells[i],
+                                                            &cell_length);
+        } else {
+            ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ctx,
+                                                                user_context,
+                                                                sizeof(user_context),
+                                                                messages[i],
+                                                                1 + i * 5,
+                                                                cells[i],
+                                                                &cell_length);
+        }
+        items[i].input = cells[i];
+        items[i].input_length = cell_length;
+        items[i].user_context = user_context;
+        items[i].user_context_length = sizeof(user_context);
+    }
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_passphrase_batch(passphrase,
+                                                                                sizeof(passphrase),
+                                                                                items,
+                                                                                ITEM_COUNT,
+                                                                                NULL,
+                                                                                &plain_length,
+                                                                                0)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && plain_length == ITEM_COUNT + 5 * (ITEM_COUNT - 1) * ITEM_COUNT / 2,
+                          "passphrase batch: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_passphrase_batch(passphrase,
+                                                                                sizeof(passphrase),
+                                                                                items,
+                                                                                ITEM_COUNT,
+                                                                                plain,
+                                                                                &plain_length,
+                                                                                2)
+                              == ECRYPT_SUCCESS,
+                          "passphrase batch: decryption");
+    for (i = 0; i < ITEM_COUNT; i++) {
+        if (items[i].status != ECRYPT_SUCCESS || items[i].output_length != 1 + i * 5
+            || memcmp(plain + items[i].output_offset, messages[i], items[i].output_length) != 0) {
+            all_match = false;
+        }
+    }
+    testsuite_fail_unless(all_match, "passphrase batch: all records match");
+
+    cells[3][items[3].input_length - 1] ^= 0x01;
+    items[6].user_context = NULL;
+    items[6].user_context_length = 0;
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_passphrase_batch(passphrase,
+                                                                                sizeof(passphrase),
+                                                                                items,
+                                                                                ITEM_COUNT,
+                                                                                plain,
+                                                                                &plain_length,
+                                                                                1)
+                                  == ECRYPT_FAIL
+                              && items[3].status == ECRYPT_FAIL && items[6].status == ECRYPT_FAIL
+                              && items[2].status == ECRYPT_SUCCESS && items[7].status == ECRYPT_SUCCESS,
+                          "passphrase batch: failures are reported per record");
+
+    ecrypt_secure_cell_passphrase_ctx_destroy(ctx);
+}
+
+void run_secure_cell_passphrase_batch_test(void)
+{
+    passphrase_batch_decryption();
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define MESSAGE_LENGTH 300
+#define MAX_CELL_LENGTH (MESSAGE_LENGTH + 128)
+
+static const uint8_t passphrase[] = "passphrase context test secret";
+static const uint8_t wrong_passphrase[] = "passphrase context test guess";
+static const uint8_t user_context[] = "passphrase context test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static bool ctx_decrypts(ecrypt_secure_cell_passphrase_ctx_t* ctx, const uint8_t* cell, size_t cell_length)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal_with_passphrase_ctx(ctx,
+                                                               user_context,
+                                                               sizeof(user_context),
+                                                               cell,
+                                                               cell_length,
+                                                               plain,
+                                                               &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static void passphrase_ctx_round_trip(void)
+{
+    ecrypt_secure_cell_passphrase_ctx_t* ctx = ecrypt_secure_cell_passphrase_ctx_create(passphrase, sizeof(passphrase));
+    uint8_t cell[MAX_CELL_LENGTH];
+    uint8_t other_cell[MAX_CELL_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = 0;
+    size_t other_cell_length = sizeof(other_cell);
+    size_t expected_length = 0;
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(ctx != NULL, "passphrase context: creation");
+
+    ecrypt_secure_cell_seal_passphrase_output_size(sizeof(message), &expected_length);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ctx,
+                                                                              user_context,
+                                                                              sizeof(user_context),
+                                                                              message,
+                                                                              sizeof(message),
+                                                                              NULL,
+                                                                              &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == expected_length,
+                          "passphrase context: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ctx,
+                                                                              user_context,
+                                                                              sizeof(user_context),
+                                                                              message,
+                                                                              sizeof(message),
+                                                                              cell,
+                                                                              &cell_length)
+                              == ECRYPT_SUCCESS,
+                          "passphrase context: encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_passphrase(passphrase,
+                                                                          sizeof(passphrase),
+                                                                          user_context,
+                                                                          sizeof(user_context),
+                                                                          cell,
+                                                                          cell_length,
+                                                                          plain,
+                                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message)),
+                          "passphrase context: compatible with regular decryption");
+    testsuite_fail_unless(ctx_decrypts(ctx, cell, cell_length), "passphrase context: decryption");
+
+    ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(ctx,
+                                                        user_context,
+                                                        sizeof(user_context),
+                                                        message,
+                                                        sizeof(message),
+                                                        other_cell,
+                                                        &other_cell_length);
+    testsuite_fail_unless(other_cell_length == cell_length && memcmp(other_cell, cell, cell_length) != 0
+                              && ctx_decrypts(ctx, other_cell, other_cell_length),
+                          "passphrase context: every cell uses fresh IV");
+
+    other_cell_length = sizeof(other_cell);
+    ecrypt_secure_cell_encrypt_seal_with_passphrase(passphrase,
+                                                    sizeof(passphrase),
+                                                    user_context,
+                                                    sizeof(user_context),
+                                                    message,
+                                                    sizeof(message),
+                                                    other_cell,
+                                                    &other_cell_length);
+    testsuite_fail_unless(ctx_decrypts(ctx, other_cell, other_cell_length),
+                          "passphrase context: decrypts cells with other salt");
+
+    cell[cell_length - 1] ^= 0x01;
+    testsuite_fail_if(ctx_decrypts(ctx, cell, cell_length), "passphrase context: corrupted cell");
+    cell[cell_length - 1] ^= 0x01;
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_passphrase_ctx(ctx,
+                                                                          NULL,
+                                                                          0,
+                                                                          cell,
+                                                                          cell_length,
+                                                                          plain,
+                                                                          &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "passphrase context: wrong user context");
+
+    ecrypt_secure_cell_passphrase_ctx_destroy(ctx);
+
+    ctx = ecrypt_secure_cell_passphrase_ctx_create(wrong_passphrase, sizeof(wrong_passphrase));
+    testsuite_fail_if(ctx_decrypts(ctx, cell, cell_length), "passphrase context: wrong passphrase");
+    ecrypt_secure_cell_passphrase_ctx_destroy(ctx);
+}
+
+static void passphrase_ctx_params(void)
+{
+    uint8_t cell[MAX_CELL_LENGTH];
+    size_t cell_length = sizeof(cell);
+
+    testsuite_fail_unless(ecrypt_secure_cell_passphrase_ctx_create(NULL, 0) == NULL,
+                          "passphrase context: passphrase is required");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_passphrase_ctx(NULL,
+                                                                              user_context,
+                                                                              sizeof(user_context),
+                                                                              message,
+                                                                              sizeof(message),
+                                                                              cell,
+                                                                              &cell_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "passphrase context: context is required");
+    testsuite_fail_unless(ecrypt_secure_cell_passphrase_ctx_destroy(NULL) == ECRYPT_SUCCESS,
+                          "passphrase context: destroying NULL");
+}
+
+void run_secure_cell_passphrase_ctx_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0xba55);
+
+    passphrase_ctx_round_trip();
+    passphrase_ctx_params();
+}
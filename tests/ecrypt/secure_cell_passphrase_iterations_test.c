@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define MESSAGE_LENGTH 100
+#define MAX_CELL_LENGTH (MESSAGE_LENGTH + 128)
+#define TEST_ITERATION_COUNT 1000
+
+static const uint8_t passphrase[] = "iteration count test secret";
+static const uint8_t user_context[] = "iteration count test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static ecrypt_status_t decrypt(const uint8_t* cell, size_t cell_length)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+    ecrypt_status_t res;
+
+    res = ecrypt_secure_cell_decrypt_seal_with_passphrase(passphrase,
+                                                          sizeof(passphrase),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length);
+    if (res == ECRYPT_SUCCESS && (plain_length != sizeof(message) || memcmp(plain, message, sizeof(message)) != 0)) {
+        res = ECRYPT_FAIL;
+    }
+    return res;
+}
+
+static void explicit_iteration_count(void)
+{
+    uint8_t cell[MAX_CELL_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t expected_length = 0;
+    ecrypt_secure_cell_info_t info;
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_passphrase_ex(passphrase,
+                                                                             sizeof(passphrase),
+                                                                             user_context,
+                                                                             sizeof(user_context),
+                                                                             message,
+                                                                             sizeof(message),
+                                                                             cell,
+                                                                             &cell_length,
+                                                                             TEST_ITERATION_COUNT)
+                              == ECRYPT_SUCCESS,
+                          "iterations: encryption");
+    ecrypt_secure_cell_seal_passphrase_output_size(sizeof(message), &expected_length);
+    testsuite_fail_unless(cell_length == expected_length, "iterations: cell length does not change");
+    testsuite_fail_unless(ecrypt_secure_cell_inspect(cell, cell_length, &info) == ECRYPT_SUCCESS
+                              && info.pbkdf2_iterations == TEST_ITERATION_COUNT,
+                          "iterations: count is stored in the cell");
+    testsuite_fail_unless(decrypt(cell, cell_length) == ECRYPT_SUCCESS, "iterations: regular decryption");
+
+    /* Covers the stored iteration count as well */
+    for (i = 0; i < info.auth_token_length; i++) {
+        cell[i] ^= 0x01;
+        if (decrypt(cell, cell_length) == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x01;
+    }
+    testsuite_fail_unless(all_rejected, "iterations: corrupted header");
+
+    cell_length = sizeof(cell);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_passphrase_ex(passphrase,
+                                                                             sizeof(passphrase),
+                                                                             user_context,
+                                                                             sizeof(user_context),
+                                                                             message,
+                                                                             sizeof(message),
+                                                                             cell,
+                                                                             &cell_length,
+                                                                             0)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "iterations: zero count");
+}
+
+static void iteration_calibration(void)
+{
+    uint32_t iteration_count = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_passphrase_calibrate_iterations(20, &iteration_count) == ECRYPT_SUCCESS
+                              && iteration_count != 0,
+                          "calibration: estimate");
+    testsuite_fail_unless(ecrypt_secure_cell_passphrase_calibrate_iterations(0, &iteration_count)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "calibration: zero time");
+    testsuite_fail_unless(ecrypt_secure_cell_passphrase_calibrate_iterations(20, NULL) == ECRYPT_INVALID_PARAMETER,
+                          "calibration: output is required");
+}
+
+void run_secure_cell_passphrase_iterations_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x17e7);
+
+    explicit_iteration_count();
+    iteration_calibration();
+}
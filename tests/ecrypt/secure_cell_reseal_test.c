@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define KEY_ID_LENGTH 4
+#define MESSAGE_LENGTH 120
+#define ITEM_COUNT 20
+
+static const uint8_t old_master_key[32] = "reseal test old master key 01234";
+static const uint8_t new_master_key[32] = "reseal test new master key 01234";
+static const uint8_t user_context[] = "reseal test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static size_t seal_with_key(const uint8_t* key, uint8_t* cell, size_t cell_length)
+{
+    ecrypt_secure_cell_encrypt_seal(key,
+                                    32,
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    cell,
+                                    &cell_length);
+    return cell_length;
+}
+
+static bool decrypts(const uint8_t* key, const uint8_t* cell, size_t cell_length)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal(key,
+                                           32,
+                                           user_context,
+                                           sizeof(user_context),
+                                           cell,
+                                           cell_length,
+                                           plain,
+                                           &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static ecrypt_status_t reseal(const uint8_t* old_key,
+                              const uint8_t* cell,
+                              size_t cell_length,
+                              uint8_t* resealed,
+                              size_t* resealed_length)
+{
+    return ecrypt_secure_cell_reseal(old_key,
+                                     32,
+                                     new_master_key,
+                                     sizeof(new_master_key),
+                                     user_context,
+                                     sizeof(user_context),
+                                     cell,
+                                     cell_length,
+                                     resealed,
+                                     resealed_length);
+}
+
+static void reseal_one_shot(void)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t resealed[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = seal_with_key(old_master_key, cell, sizeof(cell));
+    size_t resealed_length = 0;
+
+    testsuite_fail_unless(reseal(old_master_key, cell, cell_length, NULL, &resealed_length) == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length == cell_length,
+                          "reseal: size query");
+    resealed_length = sizeof(resealed);
+    testsuite_fail_unless(reseal(old_master_key, cell, cell_length, resealed, &resealed_length) == ECRYPT_SUCCESS
+                              && resealed_length == cell_length,
+                          "reseal: separate buffers");
+    testsuite_fail_unless(decrypts(new_master_key, resealed, resealed_length)
+                              && !decrypts(old_master_key, resealed, resealed_length),
+                          "reseal: new key decrypts the cell");
+
+    resealed_length = sizeof(cell);
+    testsuite_fail_unless(reseal(old_master_key, cell, cell_length, cell, &resealed_length) == ECRYPT_SUCCESS
+                              && resealed_length == cell_length && decrypts(new_master_key, cell, resealed_length),
+                          "reseal: in place");
+
+    cell_length = seal_with_key(old_master_key, cell, sizeof(cell));
+    resealed_length = sizeof(resealed);
+    testsuite_fail_if(reseal(new_master_key, cell, cell_length, resealed, &resealed_length) == ECRYPT_SUCCESS,
+                      "reseal: wrong old key is rejected");
+
+    cell[cell_length - 1] ^= 0x01;
+    resealed_length = sizeof(resealed);
+    testsuite_fail_if(reseal(old_master_key, cell, cell_length, resealed, &resealed_length) == ECRYPT_SUCCESS,
+                      "reseal: corrupted cell is rejected");
+}
+
+static void reseal_with_ctx(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* old_ctx = ecrypt_secure_cell_seal_ctx_create(old_master_key, sizeof(old_master_key));
+    ecrypt_secure_cell_seal_ctx_t* new_ctx = ecrypt_secure_cell_seal_ctx_create(new_master_key, sizeof(new_master_key));
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + KEY_ID_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = seal_with_key(old_master_key, cell, sizeof(cell));
+    size_t resealed_length = sizeof(cell);
+    bool all_resealed = true;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        resealed_length = sizeof(cell);
+        if (ecrypt_secure_cell_reseal_with_ctx(i % 2 ? new_ctx : old_ctx,
+                                               i % 2 ? old_ctx : new_ctx,
+                                               user_context,
+                                               sizeof(user_context),
+                                               cell,
+                                               cell_length,
+                                               cell,
+                                               &resealed_length)
+                != ECRYPT_SUCCESS
+            || resealed_length != cell_length
+            || !decrypts(i % 2 ? old_master_key : new_master_key, cell, resealed_length)) {
+            all_resealed = false;
+        }
+    }
+    testsuite_fail_unless(all_resealed, "reseal context: repeated in-place rotation");
+
+    /* Cell is encrypted with the new key now */
+    ecrypt_secure_cell_seal_ctx_set_flags(old_ctx, ECRYPT_SCELL_FLAG_KEY_ID);
+    resealed_length = 0;
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(new_ctx,
+                                                             old_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             NULL,
+                                                             &resealed_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length == cell_length + KEY_ID_LENGTH,
+                          "reseal context: size query accounts for new flags");
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(new_ctx,
+                                                             old_ctx,
+                                                             user_context,
+                                                             sizeof(user_context),
+                                                             cell,
+                                                             cell_length,
+                                                             cell,
+                                                             &resealed_length)
+                                  == ECRYPT_SUCCESS
+                              && decrypts(old_master_key, cell, resealed_length),
+                          "reseal context: cell grows in place");
+
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_with_ctx(NULL,
+                                                             new_ctx,
+                                                             NULL,
+                                                             0,
+                                                             cell,
+                                                             resealed_length,
+                                                             NULL,
+                                                             &resealed_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "reseal context: contexts are required");
+
+    ecrypt_secure_cell_seal_ctx_destroy(new_ctx);
+    ecrypt_secure_cell_seal_ctx_destroy(old_ctx);
+}
+
+static void reseal_batch(void)
+{
+    static uint8_t messages[ITEM_COUNT][MESSAGE_LENGTH];
+    static uint8_t arena[ITEM_COUNT * (DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH)];
+    static uint8_t plain[ITEM_COUNT * MESSAGE_LENGTH];
+    ecrypt_secure_cell_batch_item_t items[ITEM_COUNT];
+    size_t arena_length = sizeof(arena);
+    size_t resealed_length = 0;
+    size_t plain_length = sizeof(plain);
+    bool all_match = true;
+    size_t i;
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < ITEM_COUNT; i++) {
+        testsuite_fill_random(messages[i], sizeof(messages[i]), (uint32_t)(0x5ea1 + i));
+        items[i].input = messages[i];
+        items[i].input_length = 1 + i * 5;
+        items[i].user_context = user_context;
+        items[i].user_context_length = sizeof(user_context);
+    }
+    ecrypt_secure_cell_encrypt_seal_batch(old_master_key, sizeof(old_master_key), items, ITEM_COUNT, arena, &arena_length, 4);
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        items[i].input = arena + items[i].output_offset;
+        items[i].input_length = items[i].output_length;
+    }
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_batch(old_master_key,
+                                                          sizeof(old_master_key),
+                                                          new_master_key,
+                                                          sizeof(new_master_key),
+                                                          items,
+                                                          ITEM_COUNT,
+                                                          NULL,
+                                                          &resealed_length,
+                                                          4)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && resealed_length == arena_length,
+                          "reseal batch: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_batch(old_master_key,
+                                                          sizeof(old_master_key),
+                                                          new_master_key,
+                                                          sizeof(new_master_key),
+                                                          items,
+                                                          ITEM_COUNT,
+                                                          arena,
+                                                          &resealed_length,
+                                                          4)
+                                  == ECRYPT_SUCCESS
+                              && resealed_length == arena_length,
+                          "reseal batch: in place");
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        items[i].input = arena + items[i].output_offset;
+        items[i].input_length = items[i].output_length;
+    }
+    ecrypt_secure_cell_decrypt_seal_batch(new_master_key, sizeof(new_master_key), items, ITEM_COUNT, plain, &plain_length, 4);
+    for (i = 0; i < ITEM_COUNT; i++) {
+        if (items[i].status != ECRYPT_SUCCESS || items[i].output_length != 1 + i * 5
+            || memcmp(plain + items[i].output_offset, messages[i], items[i].output_length) != 0) {
+            all_match = false;
+        }
+    }
+    testsuite_fail_unless(all_match, "reseal batch: new key decrypts all records");
+
+    for (i = 0; i < ITEM_COUNT; i++) {
+        items[i].input = arena + items[i].output_offset;
+        items[i].input_length = items[i].output_length;
+    }
+    resealed_length = sizeof(arena);
+    testsuite_fail_unless(ecrypt_secure_cell_reseal_batch(old_master_key,
+                                                          sizeof(old_master_key),
+                                                          new_master_key,
+                                                          sizeof(new_master_key),
+                                                          items,
+                                                          ITEM_COUNT,
+                                                          arena,
+                                                          &resealed_length,
+                                                          4)
+                                  == ECRYPT_FAIL
+                              && items[0].status == ECRYPT_FAIL,
+                          "reseal batch: wrong old key is reported");
+}
+
+void run_secure_cell_reseal_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x4e5ea1);
+
+    reseal_one_shot();
+    reseal_with_ctx();
+    reseal_batch();
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 100
+#define THREAD_COUNT 4
+#define THREAD_ITERATIONS 200
+
+static const uint8_t master_key[32] = "seal context test master key 012";
+static const uint8_t wrong_master_key[32] = "seal context test wrong key 0123";
+static const uint8_t user_context[] = "seal context test context";
+static const uint8_t wrong_user_context[] = "seal context test other context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static void seal_ctx_round_trip(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = 0;
+    size_t plain_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   NULL,
+                                                                   &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length == sizeof(cell),
+                          "seal context: size query");
+
+    cell_length = sizeof(cell);
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   cell,
+                                                                   &cell_length)
+                                  == ECRYPT_SUCCESS
+                              && cell_length == sizeof(cell),
+                          "seal context: encryption");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   cell,
+                                                                   cell_length,
+                                                                   NULL,
+                                                                   &plain_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && plain_length == sizeof(message),
+                          "seal context: decrypted size query");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal(master_key,
+                                                          sizeof(master_key),
+                                                          user_context,
+                                                          sizeof(user_context),
+                                                          cell,
+                                                          cell_length,
+                                                          plain,
+                                                          &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal context: compatible with regular decryption");
+
+    cell_length = sizeof(cell);
+    ecrypt_secure_cell_encrypt_seal(master_key,
+                                    sizeof(master_key),
+                                    user_context,
+                                    sizeof(user_context),
+                                    message,
+                                    sizeof(message),
+                                    cell,
+                                    &cell_length);
+    memset(plain, 0, sizeof(plain));
+    plain_length = sizeof(plain);
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   cell,
+                                                                   cell_length,
+                                                                   plain,
+                                                                   &plain_length)
+                                  == ECRYPT_SUCCESS
+                              && plain_length == sizeof(message)
+                              && !memcmp(plain, message, sizeof(message)),
+                          "seal context: decrypts regular cells");
+}
+
+static void seal_ctx_rejects_tampering(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    size_t plain_length = 0;
+    ecrypt_secure_cell_seal_ctx_t* wrong_ctx = NULL;
+    bool all_rejected = true;
+    size_t i;
+
+    ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                             user_context,
+                                             sizeof(user_context),
+                                             message,
+                                             sizeof(message),
+                                             cell,
+                                             &cell_length);
+
+    for (i = 0; i < cell_length; i++) {
+        cell[i] ^= 0x01;
+        plain_length = sizeof(plain);
+        if (ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     cell,
+                                                     cell_length,
+                                                     plain,
+                                                     &plain_length)
+            == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x01;
+    }
+    testsuite_fail_unless(all_rejected, "seal context: every corrupted byte is detected");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                               wrong_user_context,
+                                                               sizeof(wrong_user_context),
+                                                               cell,
+                                                               cell_length,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "seal context: wrong context is rejected");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                               user_context,
+                                                               sizeof(user_context),
+                                                               cell,
+                                                               cell_length - 1,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "seal context: truncated cell is rejected");
+
+    wrong_ctx = ecrypt_secure_cell_seal_ctx_create(wrong_master_key, sizeof(wrong_master_key));
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_with_ctx(wrong_ctx,
+                                                               user_context,
+                                                               sizeof(user_context),
+                                                               cell,
+                                                               cell_length,
+                                                               plain,
+                                                               &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "seal context: wrong key is rejected");
+    ecrypt_secure_cell_seal_ctx_destroy(wrong_ctx);
+}
+
+static void seal_ctx_parameter_checks(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    size_t cell_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_create(NULL, sizeof(master_key)) == NULL,
+                          "seal context: key is required");
+    testsuite_fail_unless(ecrypt_secure_cell_seal_ctx_create(master_key, 0) == NULL,
+                          "seal context: empty key is rejected");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(NULL,
+                                                                   NULL,
+                                                                   0,
+                                                                   message,
+                                                                   sizeof(message),
+                                                                   NULL,
+                                                                   &cell_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "seal context: context is required");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_ctx(ctx, NULL, 0, message, 0, NULL, &cell_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "seal context: empty message is rejected");
+}
+
+static void* seal_ctx_thread(void* arg)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = arg;
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t cell_length;
+    size_t plain_length;
+    int i;
+
+    for (i = 0; i < THREAD_ITERATIONS; i++) {
+        cell_length = sizeof(cell);
+        plain_length = sizeof(plain);
+        if (ecrypt_secure_cell_encrypt_seal_with_ctx(ctx,
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     message,
+                                                     sizeof(message),
+                                                     cell,
+                                                     &cell_length)
+                != ECRYPT_SUCCESS
+            || ecrypt_secure_cell_decrypt_seal_with_ctx(ctx,
+                                                        user_context,
+                                                        sizeof(user_context),
+                                                        cell,
+                                                        cell_length,
+                                                        plain,
+                                                        &plain_length)
+                   != ECRYPT_SUCCESS
+            || plain_length != sizeof(message) || memcmp(plain, message, sizeof(message)) != 0) {
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+static void seal_ctx_shared_between_threads(ecrypt_secure_cell_seal_ctx_t* ctx)
+{
+    pthread_t threads[THREAD_COUNT];
+    bool all_succeeded = true;
+    void* result = NULL;
+    int i;
+
+    for (i = 0; i < THREAD_COUNT; i++) {
+        if (pthread_create(&threads[i], NULL, seal_ctx_thread, ctx) != 0) {
+            threads[i] = pthread_self();
+            all_succeeded = false;
+        }
+    }
+    for (i = 0; i < THREAD_COUNT; i++) {
+        if (pthread_equal(threads[i], pthread_self())) {
+            continue;
+        }
+        if (pthread_join(threads[i], &result) != 0 || result != NULL) {
+            all_succeeded = false;
+        }
+    }
+    testsuite_fail_unless(all_succeeded, "seal context: shared between threads");
+}
+
+void run_secure_cell_seal_context_test(void)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = NULL;
+
+    testsuite_fill_random(message, sizeof(message), 0x5ea1);
+
+    ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    testsuite_fail_if(ctx == NULL, "seal context: create");
+    if (!ctx) {
+        return;
+    }
+
+    seal_ctx_round_trip(ctx);
+    seal_ctx_rejects_tampering(ctx);
+    seal_ctx_parameter_checks(ctx);
+    seal_ctx_shared_between_threads(ctx);
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define SECTOR_LENGTH 512
+#define SECTOR_COUNT 64
+#define FIRST_SECTOR 1000
+
+static const uint8_t master_key[32] = "sector test master key 012345678";
+static const uint8_t context[] = "sector test volume";
+static const uint8_t other_context[] = "sector test other volume";
+
+static uint8_t plain[SECTOR_COUNT * SECTOR_LENGTH];
+static uint8_t encrypted[SECTOR_COUNT * SECTOR_LENGTH];
+static uint8_t expected[SECTOR_COUNT * SECTOR_LENGTH];
+static uint8_t decrypted[SECTOR_COUNT * SECTOR_LENGTH];
+
+static ecrypt_status_t encrypt_sector(const uint8_t* ctx, size_t ctx_length, uint64_t number, const uint8_t* in, size_t length, uint8_t* out)
+{
+    return ecrypt_secure_cell_encrypt_sector(master_key, sizeof(master_key), ctx, ctx_length, number, in, length, out);
+}
+
+static ecrypt_status_t decrypt_sector(const uint8_t* ctx, size_t ctx_length, uint64_t number, const uint8_t* in, size_t length, uint8_t* out)
+{
+    return ecrypt_secure_cell_decrypt_sector(master_key, sizeof(master_key), ctx, ctx_length, number, in, length, out);
+}
+
+static void sector_round_trip(void)
+{
+    static const size_t lengths[] = {ECRYPT_SCELL_SECTOR_MIN_LENGTH, 17, 31, 4096};
+    uint8_t sector[4096];
+    bool round_trips = true;
+    size_t i;
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        if (encrypt_sector(context, sizeof(context), 7, plain, lengths[i], sector) != ECRYPT_SUCCESS
+            || !memcmp(sector, plain, lengths[i])
+            || decrypt_sector(context, sizeof(context), 7, sector, lengths[i], sector) != ECRYPT_SUCCESS
+            || memcmp(sector, plain, lengths[i]) != 0) {
+            round_trips = false;
+        }
+    }
+    testsuite_fail_unless(round_trips, "sector: round trip with length preserved");
+
+    encrypt_sector(context, sizeof(context), 7, plain, SECTOR_LENGTH, encrypted);
+    encrypt_sector(context, sizeof(context), 8, plain, SECTOR_LENGTH, expected);
+    testsuite_fail_if(!memcmp(encrypted, expected, SECTOR_LENGTH), "sector: sector number is the tweak");
+    encrypt_sector(other_context, sizeof(other_context), 7, plain, SECTOR_LENGTH, expected);
+    testsuite_fail_if(!memcmp(encrypted, expected, SECTOR_LENGTH), "sector: context changes the key");
+    encrypt_sector(context, sizeof(context), 7, plain, SECTOR_LENGTH, expected);
+    testsuite_fail_unless(!memcmp(encrypted, expected, SECTOR_LENGTH), "sector: encryption is deterministic");
+
+    /* No integrity protection: corrupted sector decrypts to garbage without an error */
+    encrypted[100] ^= 0x01;
+    testsuite_fail_unless(decrypt_sector(context, sizeof(context), 7, encrypted, SECTOR_LENGTH, decrypted) == ECRYPT_SUCCESS
+                              && memcmp(decrypted, plain, SECTOR_LENGTH) != 0
+                              && !memcmp(decrypted + 112, plain + 112, SECTOR_LENGTH - 112),
+                          "sector: corruption affects only its block");
+}
+
+static void sectors_match_single(size_t thread_count)
+{
+    bool all_match = true;
+    size_t i;
+
+    for (i = 0; i < SECTOR_COUNT; i++) {
+        encrypt_sector(NULL, 0, FIRST_SECTOR + i, plain + i * SECTOR_LENGTH, SECTOR_LENGTH, expected + i * SECTOR_LENGTH);
+    }
+    if (ecrypt_secure_cell_encrypt_sectors(master_key,
+                                           sizeof(master_key),
+                                           NULL,
+                                           0,
+                                           FIRST_SECTOR,
+                                           plain,
+                                           SECTOR_LENGTH,
+                                           SECTOR_COUNT,
+                                           encrypted,
+                                           thread_count)
+            != ECRYPT_SUCCESS
+        || memcmp(encrypted, expected, sizeof(expected)) != 0) {
+        all_match = false;
+    }
+    memcpy(decrypted, encrypted, sizeof(decrypted));
+    if (ecrypt_secure_cell_decrypt_sectors(master_key,
+                                           sizeof(master_key),
+                                           NULL,
+                                           0,
+                                           FIRST_SECTOR,
+                                           decrypted,
+                                           SECTOR_LENGTH,
+                                           SECTOR_COUNT,
+                                           decrypted,
+                                           thread_count)
+            != ECRYPT_SUCCESS
+        || memcmp(decrypted, plain, sizeof(plain)) != 0) {
+        all_match = false;
+    }
+    testsuite_fail_unless(all_match, "sectors: same as sector by sector");
+}
+
+static void sector_params(void)
+{
+    testsuite_fail_unless(encrypt_sector(context, sizeof(context), 0, plain, ECRYPT_SCELL_SECTOR_MIN_LENGTH - 1, encrypted)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "sector: too short");
+    testsuite_fail_unless(encrypt_sector(context, sizeof(context), 0, plain, ECRYPT_SCELL_SECTOR_MAX_LENGTH + 1, encrypted)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "sector: too long");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_sectors(master_key,
+                                                             sizeof(master_key),
+                                                             NULL,
+                                                             0,
+                                                             UINT64_MAX,
+                                                             plain,
+                                                             SECTOR_LENGTH,
+                                                             2,
+                                                             encrypted,
+                                                             1)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "sectors: sector number overflow");
+}
+
+void run_secure_cell_sector_test(void)
+{
+    testsuite_fill_random(plain, sizeof(plain), 0x5ec7);
+
+    sector_round_trip();
+    sectors_match_single(1);
+    sectors_match_single(4);
+    sector_params();
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define SEGMENT_LENGTH 256
+#define MESSAGE_LENGTH 1000
+#define STREAM_CAPACITY 4096
+
+static const uint8_t master_key[32] = "stream test master key 012345678";
+static const uint8_t wrong_master_key[32] = "stream test wrong key 0123456789";
+static const uint8_t user_context[] = "stream test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t stream_data[STREAM_CAPACITY];
+static size_t stream_length;
+
+/* Encrypts the message feeding it in chunks of varying size */
+static bool encrypt_stream(void)
+{
+    ecrypt_secure_cell_stream_t* stream = NULL;
+    size_t consumed = 0;
+    size_t chunk = 1;
+    size_t output_length = 0;
+    bool ok = false;
+
+    stream = ecrypt_secure_cell_encrypt_seal_stream_create(master_key,
+                                                           sizeof(master_key),
+                                                           user_context,
+                                                           sizeof(user_context),
+                                                           SEGMENT_LENGTH);
+    if (!stream) {
+        return false;
+    }
+
+    stream_length = 0;
+    while (consumed < sizeof(message)) {
+        if (chunk > sizeof(message) - consumed) {
+            chunk = sizeof(message) - consumed;
+        }
+        output_length = sizeof(stream_data) - stream_length;
+        if (ecrypt_secure_cell_encrypt_seal_stream_update(stream,
+                                                          message + consumed,
+                                                          chunk,
+                                                          stream_data + stream_length,
+                                                          &output_length)
+            != ECRYPT_SUCCESS) {
+            goto out;
+        }
+        stream_length += output_length;
+        consumed += chunk;
+        chunk = chunk * 3 + 1;
+    }
+
+    output_length = sizeof(stream_data) - stream_length;
+    if (ecrypt_secure_cell_encrypt_seal_stream_final(stream, stream_data + stream_length, &output_length)
+        != ECRYPT_SUCCESS) {
+        goto out;
+    }
+    stream_length += output_length;
+    ok = true;
+
+out:
+    ecrypt_secure_cell_seal_stream_destroy(stream);
+    return ok;
+}
+
+/* Decrypts the stream feeding it in chunks of a fixed size */
+static ecrypt_status_t decrypt_stream(const uint8_t* key,
+                                      const uint8_t* data,
+                                      size_t data_length,
+                                      size_t chunk,
+                                      uint8_t* plain,
+                                      size_t* plain_length)
+{
+    ecrypt_secure_cell_stream_t* stream = NULL;
+    ecrypt_status_t res = ECRYPT_FAIL;
+    size_t consumed = 0;
+    size_t total = 0;
+    size_t output_length = 0;
+
+    stream = ecrypt_secure_cell_decrypt_seal_stream_create(key, 32, user_context, sizeof(user_context));
+    if (!stream) {
+        return ECRYPT_FAIL;
+    }
+
+    while (consumed < data_length) {
+        size_t part = (chunk < data_length - consumed) ? chunk : data_length - consumed;
+        output_length = *plain_length - total;
+        res = ecrypt_secure_cell_decrypt_seal_stream_update(stream,
+                                                            data + consumed,
+                                                            part,
+                                                            plain + total,
+                                                            &output_length);
+        if (res != ECRYPT_SUCCESS) {
+            goto out;
+        }
+        total += output_length;
+        consumed += part;
+    }
+
+    output_length = *plain_length - total;
+    res = ecrypt_secure_cell_decrypt_seal_stream_final(stream, plain + total, &output_length);
+    if (res == ECRYPT_SUCCESS) {
+        *plain_length = total + output_length;
+    }
+
+out:
+    ecrypt_secure_cell_seal_stream_destroy(stream);
+    return res;
+}
+
+static void stream_round_trip(void)
+{
+    static uint8_t plain[MESSAGE_LENGTH + SEGMENT_LENGTH];
+    static const size_t chunks[] = {1, 7, SEGMENT_LENGTH, STREAM_CAPACITY};
+    bool all_match = true;
+    size_t plain_length = 0;
+    size_t i;
+
+    testsuite_fail_unless(encrypt_stream(), "stream: encryption");
+    testsuite_fail_unless(stream_length > sizeof(message) && stream_length < sizeof(stream_data),
+                          "stream: encrypted size");
+
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        memset(plain, 0, sizeof(plain));
+        plain_length = sizeof(plain);
+        if (decrypt_stream(master_key, stream_data, stream_length, chunks[i], plain, &plain_length)
+                != ECRYPT_SUCCESS
+            || plain_length != sizeof(message) || memcmp(plain, message, sizeof(message)) != 0) {
+            all_match = false;
+        }
+    }
+    testsuite_fail_unless(all_match, "stream: decryption with any chunk size");
+}
+
+static void stream_rejects_tampering(void)
+{
+    static uint8_t plain[MESSAGE_LENGTH + SEGMENT_LENGTH];
+    size_t plain_length = sizeof(plain);
+    bool all_rejected = true;
+    size_t i;
+
+    testsuite_fail_if(decrypt_stream(wrong_master_key, stream_data, stream_length, 64, plain, &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "stream: wrong key is rejected");
+
+    for (i = 0; i < stream_length; i += 13) {
+        stream_data[i] ^= 0x80;
+        plain_length = sizeof(plain);
+        if (decrypt_stream(master_key, stream_data, stream_length, 64, plain, &plain_length)
+            == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        stream_data[i] ^= 0x80;
+    }
+    testsuite_fail_unless(all_rejected, "stream: corrupted bytes are detected");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(decrypt_stream(master_key, stream_data, stream_length - 1, 64, plain, &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "stream: truncated trailer is detected");
+
+    plain_length = sizeof(plain);
+    testsuite_fail_if(decrypt_stream(master_key,
+                                     stream_data,
+                                     stream_length - SEGMENT_LENGTH,
+                                     64,
+                                     plain,
+                                     &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "stream: truncated stream is detected");
+}
+
+static bool range_matches(uint64_t offset, size_t length)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = 0;
+
+    if (ecrypt_secure_cell_decrypt_seal_stream_range(master_key,
+                                                     sizeof(master_key),
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     stream_data,
+                                                     stream_length,
+                                                     offset,
+                                                     length,
+                                                     NULL,
+                                                     &plain_length)
+            != ECRYPT_BUFFER_TOO_SMALL
+        || plain_length != length) {
+        return false;
+    }
+
+    memset(plain, 0, sizeof(plain));
+    plain_length = sizeof(plain);
+    return ecrypt_secure_cell_decrypt_seal_stream_range(master_key,
+                                                        sizeof(master_key),
+                                                        user_context,
+                                                        sizeof(user_context),
+                                                        stream_data,
+                                                        stream_length,
+                                                        offset,
+                                                        length,
+                                                        plain,
+                                                        &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == length && !memcmp(plain, message + offset, length);
+}
+
+static void stream_range_decryption(void)
+{
+    uint8_t plain[MESSAGE_LENGTH];
+    size_t plain_length = sizeof(plain);
+
+    testsuite_fail_unless(range_matches(0, sizeof(message)), "stream range: whole stream");
+    testsuite_fail_unless(range_matches(10, 20), "stream range: within a segment");
+    testsuite_fail_unless(range_matches(SEGMENT_LENGTH, SEGMENT_LENGTH), "stream range: exactly one segment");
+    testsuite_fail_unless(range_matches(SEGMENT_LENGTH - 5, 2 * SEGMENT_LENGTH + 10),
+                          "stream range: across segments");
+    testsuite_fail_unless(range_matches(sizeof(message) - 1, 1), "stream range: last byte");
+
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_stream_range(master_key,
+                                                                       sizeof(master_key),
+                                                                       user_context,
+                                                                       sizeof(user_context),
+                                                                       stream_data,
+                                                                       stream_length,
+                                                                       sizeof(message) - 1,
+                                                                       2,
+                                                                       plain,
+                                                                       &plain_length)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "stream range: range past the end is rejected");
+
+    stream_data[stream_length / 2] ^= 0x01;
+    plain_length = sizeof(plain);
+    testsuite_fail_if(ecrypt_secure_cell_decrypt_seal_stream_range(master_key,
+                                                                   sizeof(master_key),
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   stream_data,
+                                                                   stream_length,
+                                                                   0,
+                                                                   sizeof(message),
+                                                                   plain,
+                                                                   &plain_length)
+                          == ECRYPT_SUCCESS,
+                      "stream range: corrupted segment is detected");
+    stream_data[stream_length / 2] ^= 0x01;
+}
+
+void run_secure_cell_stream_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x57e4);
+
+    stream_round_trip();
+    stream_rejects_tampering();
+    stream_range_decryption();
+}
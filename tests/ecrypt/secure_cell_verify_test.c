@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define DEFAULT_AUTH_TOKEN_LENGTH 44
+#define MESSAGE_LENGTH 333
+
+static const uint8_t master_key[32] = "verify test master key 012345678";
+static const uint8_t wrong_master_key[32] = "verify test wrong key 0123456789";
+static const uint8_t user_context[] = "verify test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+
+static void verify_seal(uint32_t flags, const char* name)
+{
+    ecrypt_secure_cell_seal_ctx_t* ctx = ecrypt_secure_cell_seal_ctx_create(master_key, sizeof(master_key));
+    uint8_t cell[DEFAULT_AUTH_TOKEN_LENGTH + MESSAGE_LENGTH];
+    size_t cell_length = sizeof(cell);
+    bool all_rejected = true;
+    bool verified = false;
+    size_t i;
+
+    ecrypt_secure_cell_encrypt_seal_ex(master_key,
+                                       sizeof(master_key),
+                                       user_context,
+                                       sizeof(user_context),
+                                       message,
+                                       sizeof(message),
+                                       cell,
+                                       &cell_length,
+                                       flags);
+
+    verified = ecrypt_secure_cell_verify_seal(master_key,
+                                              sizeof(master_key),
+                                              user_context,
+                                              sizeof(user_context),
+                                              cell,
+                                              cell_length)
+                   == ECRYPT_SUCCESS
+               && ecrypt_secure_cell_verify_seal_with_ctx(ctx, user_context, sizeof(user_context), cell, cell_length)
+                      == ECRYPT_SUCCESS;
+    testsuite_fail_unless(verified, name);
+
+    for (i = 0; i < cell_length; i++) {
+        cell[i] ^= 0x40;
+        if (ecrypt_secure_cell_verify_seal(master_key,
+                                           sizeof(master_key),
+                                           user_context,
+                                           sizeof(user_context),
+                                           cell,
+                                           cell_length)
+                == ECRYPT_SUCCESS
+            || ecrypt_secure_cell_verify_seal_with_ctx(ctx, user_context, sizeof(user_context), cell, cell_length)
+                   == ECRYPT_SUCCESS) {
+            all_rejected = false;
+        }
+        cell[i] ^= 0x40;
+    }
+    testsuite_fail_unless(all_rejected, "verify seal: every corrupted byte is detected");
+
+    testsuite_fail_if(ecrypt_secure_cell_verify_seal(wrong_master_key,
+                                                     sizeof(wrong_master_key),
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     cell,
+                                                     cell_length)
+                          == ECRYPT_SUCCESS,
+                      "verify seal: wrong key is rejected");
+    testsuite_fail_if(ecrypt_secure_cell_verify_seal_with_ctx(ctx, NULL, 0, cell, cell_length) == ECRYPT_SUCCESS,
+                      "verify seal: wrong context is rejected");
+    testsuite_fail_if(ecrypt_secure_cell_verify_seal(master_key,
+                                                     sizeof(master_key),
+                                                     user_context,
+                                                     sizeof(user_context),
+                                                     cell,
+                                                     cell_length - 1)
+                          == ECRYPT_SUCCESS,
+                      "verify seal: truncated cell is rejected");
+
+    ecrypt_secure_cell_seal_ctx_destroy(ctx);
+}
+
+static void verify_token_protect(void)
+{
+    uint8_t token[DEFAULT_AUTH_TOKEN_LENGTH];
+    uint8_t encrypted[MESSAGE_LENGTH];
+    size_t token_length = sizeof(token);
+    size_t encrypted_length = sizeof(encrypted);
+
+    ecrypt_secure_cell_encrypt_token_protect(master_key,
+                                             sizeof(master_key),
+                                             user_context,
+                                             sizeof(user_context),
+                                             message,
+                                             sizeof(message),
+                                             token,
+                                             &token_length,
+                                             encrypted,
+                                             &encrypted_length);
+    testsuite_fail_unless(ecrypt_secure_cell_verify_token_protect(master_key,
+                                                                  sizeof(master_key),
+                                                                  user_context,
+                                                                  sizeof(user_context),
+                                                                  encrypted,
+                                                                  encrypted_length,
+                                                                  token,
+                                                                  token_length)
+                              == ECRYPT_SUCCESS,
+                          "verify token protect: authentic data");
+
+    encrypted[encrypted_length - 1] ^= 0x01;
+    testsuite_fail_if(ecrypt_secure_cell_verify_token_protect(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              encrypted,
+                                                              encrypted_length,
+                                                              token,
+                                                              token_length)
+                          == ECRYPT_SUCCESS,
+                      "verify token protect: corrupted data is rejected");
+    encrypted[encrypted_length - 1] ^= 0x01;
+
+    token[DEFAULT_AUTH_TOKEN_LENGTH / 2] ^= 0x01;
+    testsuite_fail_if(ecrypt_secure_cell_verify_token_protect(master_key,
+                                                              sizeof(master_key),
+                                                              user_context,
+                                                              sizeof(user_context),
+                                                              encrypted,
+                                                              encrypted_length,
+                                                              token,
+                                                              token_length)
+                          == ECRYPT_SUCCESS,
+                      "verify token protect: corrupted token is rejected");
+}
+
+static void verify_parameter_checks(void)
+{
+    testsuite_fail_unless(ecrypt_secure_cell_verify_seal(master_key, sizeof(master_key), NULL, 0, NULL, 0)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "verify seal: cell is required");
+    testsuite_fail_unless(ecrypt_secure_cell_verify_seal_with_ctx(NULL, NULL, 0, message, sizeof(message))
+                              == ECRYPT_INVALID_PARAMETER,
+                          "verify seal: context is required");
+}
+
+void run_secure_cell_verify_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x7e41f);
+
+    verify_seal(0, "verify seal: AES-GCM cell");
+    verify_seal(ECRYPT_SCELL_FLAG_CHACHA20_POLY1305, "verify seal: ChaCha20-Poly1305 cell");
+    verify_token_protect();
+    verify_parameter_checks();
+}
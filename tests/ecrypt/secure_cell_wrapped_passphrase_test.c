@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ecrypt/test.h"
+
+#define MESSAGE_LENGTH 4000
+#define MAX_CELL_LENGTH (MESSAGE_LENGTH + 256)
+
+static const uint8_t old_passphrase[] = "wrapped passphrase test old secret";
+static const uint8_t new_passphrase[] = "wrapped passphrase test new secret";
+static const uint8_t user_context[] = "wrapped passphrase test context";
+
+static uint8_t message[MESSAGE_LENGTH];
+static uint8_t cell[MAX_CELL_LENGTH];
+static uint8_t saved[MAX_CELL_LENGTH];
+static uint8_t plain[MESSAGE_LENGTH];
+
+static bool decrypts(const uint8_t* passphrase, size_t passphrase_length, size_t cell_length)
+{
+    size_t plain_length = sizeof(plain);
+
+    return ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase(passphrase,
+                                                                   passphrase_length,
+                                                                   user_context,
+                                                                   sizeof(user_context),
+                                                                   cell,
+                                                                   cell_length,
+                                                                   plain,
+                                                                   &plain_length)
+               == ECRYPT_SUCCESS
+           && plain_length == sizeof(message) && !memcmp(plain, message, sizeof(message));
+}
+
+static ecrypt_status_t rewrap(const uint8_t* from, size_t from_length, const uint8_t* to, size_t to_length, size_t header_length)
+{
+    return ecrypt_secure_cell_rewrap_passphrase(from,
+                                                from_length,
+                                                to,
+                                                to_length,
+                                                user_context,
+                                                sizeof(user_context),
+                                                cell,
+                                                header_length);
+}
+
+static void wrapped_passphrase_round_trip(void)
+{
+    size_t cell_length = 0;
+    size_t header_length = 0;
+    size_t plain_length = 0;
+
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_wrapped_passphrase(old_passphrase,
+                                                                                  sizeof(old_passphrase),
+                                                                                  user_context,
+                                                                                  sizeof(user_context),
+                                                                                  message,
+                                                                                  sizeof(message),
+                                                                                  NULL,
+                                                                                  &cell_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && cell_length > sizeof(message) && cell_length <= sizeof(cell),
+                          "wrapped passphrase: size query");
+    testsuite_fail_unless(ecrypt_secure_cell_encrypt_seal_with_wrapped_passphrase(old_passphrase,
+                                                                                  sizeof(old_passphrase),
+                                                                                  user_context,
+                                                                                  sizeof(user_context),
+                                                                                  message,
+                                                                                  sizeof(message),
+                                                                                  cell,
+                                                                                  &cell_length)
+                              == ECRYPT_SUCCESS,
+                          "wrapped passphrase: encryption");
+    testsuite_fail_unless(ecrypt_secure_cell_decrypt_seal_with_wrapped_passphrase(old_passphrase,
+                                                                                  sizeof(old_passphrase),
+                                                                                  user_context,
+                                                                                  sizeof(user_context),
+                                                                                  cell,
+                                                                                  cell_length,
+                                                                                  NULL,
+                                                                                  &plain_length)
+                                  == ECRYPT_BUFFER_TOO_SMALL
+                              && plain_length == sizeof(message),
+                          "wrapped passphrase: decryption size query");
+    testsuite_fail_unless(decrypts(old_passphrase, sizeof(old_passphrase), cell_length),
+                          "wrapped passphrase: decryption");
+
+    testsuite_fail_unless(ecrypt_secure_cell_wrapped_passphrase_header_length(cell, 20, &header_length) == ECRYPT_SUCCESS
+                              && header_length + sizeof(message) < cell_length,
+                          "wrapped passphrase: header length from 20 bytes");
+    testsuite_fail_unless(ecrypt_secure_cell_wrapped_passphrase_header_length(cell, 19, &header_length) == ECRYPT_FAIL,
+                          "wrapped passphrase: header length needs 20 bytes");
+
+    memcpy(saved, cell, cell_length);
+    testsuite_fail_unless(rewrap(new_passphrase, sizeof(new_passphrase), old_passphrase, sizeof(old_passphrase), header_length)
+                                  == ECRYPT_FAIL
+                              && !memcmp(saved, cell, cell_length),
+                          "wrapped passphrase: wrong old passphrase leaves header intact");
+    testsuite_fail_unless(rewrap(old_passphrase, sizeof(old_passphrase), new_passphrase, sizeof(new_passphrase), header_length - 1)
+                              == ECRYPT_INVALID_PARAMETER,
+                          "wrapped passphrase: header length is checked");
+
+    testsuite_fail_unless(rewrap(old_passphrase, sizeof(old_passphrase), new_passphrase, sizeof(new_passphrase), header_length)
+                                  == ECRYPT_SUCCESS
+                              && !memcmp(saved + header_length, cell + header_length, cell_length - header_length),
+                          "wrapped passphrase: rewrap touches only the header");
+    testsuite_fail_unless(decrypts(new_passphrase, sizeof(new_passphrase), cell_length),
+                          "wrapped passphrase: new passphrase decrypts");
+    testsuite_fail_if(decrypts(old_passphrase, sizeof(old_passphrase), cell_length),
+                      "wrapped passphrase: old passphrase is rejected");
+
+    cell[cell_length - 1] ^= 0x01;
+    testsuite_fail_if(decrypts(new_passphrase, sizeof(new_passphrase), cell_length),
+                      "wrapped passphrase: corrupted message");
+}
+
+void run_secure_cell_wrapped_passphrase_test(void)
+{
+    testsuite_fill_random(message, sizeof(message), 0x3a9);
+
+    wrapped_passphrase_round_trip();
+}
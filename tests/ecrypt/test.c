@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ecrypt/test.h"
+
+int main(void)
+{
+    testsuite_enter_suite("ecrypt: Secure Cell seal context");
+    run_secure_cell_seal_context_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell streams");
+    run_secure_cell_stream_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell batches");
+    run_secure_cell_batch_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell flags");
+    run_secure_cell_flags_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell key rings");
+    run_secure_cell_key_ring_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell scatter/gather");
+    run_secure_cell_iov_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell ChaCha20-Poly1305");
+    run_secure_cell_chacha20_poly1305_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell key cache");
+    run_secure_cell_key_cache_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell verification");
+    run_secure_cell_verify_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell reseal");
+    run_secure_cell_reseal_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell in place");
+    run_secure_cell_in_place_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell compact token");
+    run_secure_cell_compact_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell associated data");
+    run_secure_cell_aad_test();
+
+    testsuite_enter_suite("ecrypt: output size and inspection");
+    run_inspect_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell passphrase context");
+    run_secure_cell_passphrase_ctx_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell passphrase batch");
+    run_secure_cell_passphrase_batch_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell passphrase iterations");
+    run_secure_cell_passphrase_iterations_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell wrapped passphrase");
+    run_secure_cell_wrapped_passphrase_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell columnar Token Protect");
+    run_secure_cell_column_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell blind index");
+    run_secure_cell_blind_index_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell imprint range");
+    run_secure_cell_imprint_range_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell sector mode");
+    run_secure_cell_sector_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell envelope");
+    run_secure_cell_envelope_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell compression");
+    run_secure_cell_compress_test();
+
+    testsuite_enter_suite("ecrypt: Secure Cell log segments");
+    run_secure_cell_log_test();
+
+    return testsuite_finish_testing();
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015 Cossack Labs Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ECRYPT_TEST_H
+#define ECRYPT_TEST_H
+
+#include <ecrypt/ecrypt.h>
+
+#include "common/test_utils.h"
+
+void run_secure_cell_seal_context_test(void);
+void run_secure_cell_stream_test(void);
+void run_secure_cell_batch_test(void);
+void run_secure_cell_flags_test(void);
+void run_secure_cell_key_ring_test(void);
+void run_secure_cell_iov_test(void);
+void run_secure_cell_chacha20_poly1305_test(void);
+void run_secure_cell_key_cache_test(void);
+void run_secure_cell_verify_test(void);
+void run_secure_cell_reseal_test(void);
+void run_secure_cell_in_place_test(void);
+void run_secure_cell_compact_test(void);
+void run_secure_cell_aad_test(void);
+void run_inspect_test(void);
+void run_secure_cell_passphrase_ctx_test(void);
+void run_secure_cell_passphrase_batch_test(void);
+void run_secure_cell_passphrase_iterations_test(void);
+void run_secure_cell_wrapped_passphrase_test(void);
+void run_secure_cell_column_test(void);
+void run_secure_cell_blind_index_test(void);
+void run_secure_cell_imprint_range_test(void);
+void run_secure_cell_sector_test(void);
+void run_secure_cell_envelope_test(void);
+void run_secure_cell_compress_test(void);
+void run_secure_cell_log_test(void);
+
+#endif /* ECRYPT_TEST_H */
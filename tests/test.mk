@@ -0,0 +1,54 @@
+#
+# Copyright (c) 2015 Cossack Labs Limited
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+TEST_SRC_PATH = tests
+TEST_BIN_PATH = $(BIN_PATH)/tests
+
+COMMON_TEST_SRC = $(wildcard $(TEST_SRC_PATH)/common/*.c)
+COMMON_TEST_OBJ = $(patsubst %,$(OBJ_PATH)/%.o, $(COMMON_TEST_SRC))
+
+ECCONNECT_TEST_SOURCES = $(wildcard $(TEST_SRC_PATH)/ecconnect/*.c)
+ECCONNECT_TEST_OBJ = $(patsubst %,$(OBJ_PATH)/%.o, $(ECCONNECT_TEST_SOURCES))
+
+ECRYPT_TEST_SOURCES = $(wildcard $(TEST_SRC_PATH)/ecrypt/*.c)
+ECRYPT_TEST_OBJ = $(patsubst %,$(OBJ_PATH)/%.o, $(ECRYPT_TEST_SOURCES))
+
+$(COMMON_TEST_OBJ) $(ECCONNECT_TEST_OBJ) $(ECRYPT_TEST_OBJ): CFLAGS += -I$(TEST_SRC_PATH)
+
+$(TEST_BIN_PATH)/ecconnect_test: CMD = $(CC) -o $@ $(filter %.o %.a, $^) $(LDFLAGS) $(CRYPTO_ENGINE_LDFLAGS) -lpthread
+
+$(TEST_BIN_PATH)/ecconnect_test: $(COMMON_TEST_OBJ) $(ECCONNECT_TEST_OBJ) $(ECCONNECT_STATIC)
+	@mkdir -p $(@D)
+	@echo -n "link "
+	@$(BUILD_CMD)
+
+$(TEST_BIN_PATH)/ecrypt_test: CMD = $(CC) -o $@ $(filter %.o %.a, $^) $(LDFLAGS) $(CRYPTO_ENGINE_LDFLAGS) -lpthread
+
+$(TEST_BIN_PATH)/ecrypt_test: $(COMMON_TEST_OBJ) $(ECRYPT_TEST_OBJ) $(ECRYPT_STATIC)
+	@mkdir -p $(@D)
+	@echo -n "link "
+	@$(BUILD_CMD)
+
+prepare_tests_basic: $(TEST_BIN_PATH)/ecconnect_test $(TEST_BIN_PATH)/ecrypt_test
+
+test: prepare_tests_basic
+	@echo "------------------------------------------------------------"
+	@echo "Running ecconnect tests"
+	@$(TEST_BIN_PATH)/ecconnect_test
+	@echo "------------------------------------------------------------"
+	@echo "Running ecrypt tests"
+	@$(TEST_BIN_PATH)/ecrypt_test
+	@echo "------------------------------------------------------------"